@@ -35,7 +35,9 @@ namespace d2dx
 			_isChromaKeyEnabled_gameAddress_paletteIndex(0),
 			_textureCategory_primitiveType_combiners(0),
 			_startVertexLow(0),
-			_textureAtlas_filterMode(0)
+			_textureAtlas_filterMode(0),
+			_textureOrigin(0),
+			_surfaceId(0)
 		{
 		}
 
@@ -204,6 +206,52 @@ namespace d2dx
 			_startVertexHigh_textureIndex |= (uint16_t)(textureIndex & 0x0FFF);
 		}
 
+		/* The atlas and slice combined into the atlas index of the game vertices. */
+		inline uint32_t GetVertexAtlasIndex() const noexcept
+		{
+			assert(GetTextureIndex() < D2DX_MAX_TEXTURES_PER_ATLAS);
+			return (GetTextureAtlas() << D2DX_TEXTURE_ATLAS_SLICE_BITS) | GetTextureIndex();
+		}
+
+		inline int32_t GetTextureOriginS() const noexcept
+		{
+			return (_textureOrigin & 0x1F) << 3;
+		}
+
+		inline int32_t GetTextureOriginT() const noexcept
+		{
+			return (_textureOrigin & 0x3E0) >> 2;
+		}
+
+		inline void SetTextureOrigin(int32_t s, int32_t t) noexcept
+		{
+			assert(s >= 0 && s < 256 && !(s & 7));
+			assert(t >= 0 && t < 256 && !(t & 7));
+			_textureOrigin = (uint16_t)((s >> 3) | ((t >> 3) << 5));
+		}
+
+		/* The surface ID is the same for the whole batch, so it is kept here rather than in every
+		   vertex, and looked up per quad by the game vertex shader. */
+		inline int32_t GetSurfaceId() const noexcept
+		{
+			return _surfaceId;
+		}
+
+		inline void SetSurfaceId(int32_t surfaceId) noexcept
+		{
+			assert(surfaceId >= 0 && surfaceId <= D2DX_SURFACE_ID_USER_INTERFACE);
+			_surfaceId = (uint16_t)surfaceId;
+		}
+
+		/* What the game vertex shader looks up per quad: the surface ID in bits 0-13, and log2 of the
+		   texture width and height in bits 16-19 and 20-23. */
+		inline uint32_t GetQuadAttributes() const noexcept
+		{
+			const uint32_t log2Width = ((_textureHeight_textureWidth_alphaBlend >> 2) & 7) + 1;
+			const uint32_t log2Height = ((_textureHeight_textureWidth_alphaBlend >> 5) & 7) + 1;
+			return _surfaceId | (log2Width << 16) | (log2Height << 20);
+		}
+
 		inline TextureCategory GetTextureCategory() const noexcept
 		{
 			return (TextureCategory)(_textureCategory_primitiveType_combiners >> 5U);
@@ -245,6 +293,13 @@ namespace d2dx
 			return _textureAtlas_filterMode >> 7;
 		}
 
+		/* Batches with equal state keys can be merged into one draw call. The vertices select the
+		   texture atlas, so only the blend and filter state remain. */
+		inline uint32_t GetStateKey() const noexcept
+		{
+			return ((uint32_t)GetAlphaBlend() << 1) | GetFilterMode();
+		}
+
 		inline bool IsValid() const noexcept
 		{
 			return _textureStartAddress != 0;
@@ -260,6 +315,8 @@ namespace d2dx
 		uint8_t _isChromaKeyEnabled_gameAddress_paletteIndex;	// CGGGPPPP
 		uint8_t _textureCategory_primitiveType_combiners;		// TTT.PPCC
 		uint8_t _textureAtlas_filterMode;						// M....AAA
+		uint16_t _textureOrigin;								// ......TT TTTSSSSS
+		uint16_t _surfaceId;
 	};
 
 	static_assert(sizeof(Batch) == 24, "sizeof(Batch)");
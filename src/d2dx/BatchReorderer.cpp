@@ -0,0 +1,147 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "BatchReorderer.h"
+#include "Batch.h"
+#include "Vertex.h"
+
+using namespace d2dx;
+
+/* How many groups back a batch may be moved. Keeps the cost linear in the batch count. */
+#define D2DX_BATCH_REORDER_WINDOW 64
+
+#define D2DX_NO_BATCH 0xFFFFFFFF
+
+_Use_decl_annotations_
+BatchReorderer::BatchReorderer(
+	uint32_t maxBatchCount,
+	uint32_t maxVertexCount) :
+	_groups{ maxBatchCount },
+	_nextBatchInGroup{ maxBatchCount },
+	_reorderedBatches{ maxBatchCount },
+	_reorderedVertices{ maxVertexCount }
+{
+}
+
+_Use_decl_annotations_
+void BatchReorderer::Reorder(
+	Buffer<Batch>& batches,
+	uint32_t& batchCount,
+	Buffer<Vertex>& vertices,
+	uint32_t& vertexCount,
+	const uint64_t* stateKeys)
+{
+	assert(batches.capacity == _reorderedBatches.capacity);
+	assert(vertices.capacity == _reorderedVertices.capacity);
+
+	uint32_t groupCount = 0;
+
+	for (uint32_t batchIndex = 0; batchIndex < batchCount; ++batchIndex)
+	{
+		const Batch& batch = batches.items[batchIndex];
+
+		if (!batch.IsValid() || batch.GetVertexCount() == 0)
+		{
+			continue;
+		}
+
+		const Vertex* batchVertices = &vertices.items[batch.GetStartVertex()];
+
+		Bounds bounds = { batchVertices[0].GetX(), batchVertices[0].GetY(), batchVertices[0].GetX(), batchVertices[0].GetY() };
+
+		for (uint32_t i = 1; i < batch.GetVertexCount(); ++i)
+		{
+			const float x = batchVertices[i].GetX();
+			const float y = batchVertices[i].GetY();
+			bounds.minX = min(bounds.minX, x);
+			bounds.minY = min(bounds.minY, y);
+			bounds.maxX = max(bounds.maxX, x);
+			bounds.maxY = max(bounds.maxY, y);
+		}
+
+		_nextBatchInGroup.items[batchIndex] = D2DX_NO_BATCH;
+
+		/* Walk back through the most recent groups, looking for one with the same state. We may not
+		   move past a group that we overlap, since that group must stay in front of this batch. */
+		Group* targetGroup = nullptr;
+		const uint32_t oldestGroup = groupCount > D2DX_BATCH_REORDER_WINDOW ? groupCount - D2DX_BATCH_REORDER_WINDOW : 0;
+
+		for (uint32_t groupIndex = groupCount; groupIndex > oldestGroup; --groupIndex)
+		{
+			Group& group = _groups.items[groupIndex - 1];
+
+			if (group.stateKey == stateKeys[batchIndex] &&
+				(group.vertexCount + batch.GetVertexCount()) <= D2DX_MAX_VERTICES_PER_BATCH)
+			{
+				targetGroup = &group;
+				break;
+			}
+
+			/* Touching bounds count as overlapping, to be safe with filtering and anti-aliasing. */
+			if (bounds.minX <= group.bounds.maxX && group.bounds.minX <= bounds.maxX &&
+				bounds.minY <= group.bounds.maxY && group.bounds.minY <= bounds.maxY)
+			{
+				break;
+			}
+		}
+
+		if (targetGroup)
+		{
+			_nextBatchInGroup.items[targetGroup->lastBatch] = batchIndex;
+			targetGroup->lastBatch = batchIndex;
+			targetGroup->vertexCount += batch.GetVertexCount();
+			targetGroup->bounds.minX = min(targetGroup->bounds.minX, bounds.minX);
+			targetGroup->bounds.minY = min(targetGroup->bounds.minY, bounds.minY);
+			targetGroup->bounds.maxX = max(targetGroup->bounds.maxX, bounds.maxX);
+			targetGroup->bounds.maxY = max(targetGroup->bounds.maxY, bounds.maxY);
+		}
+		else
+		{
+			Group& group = _groups.items[groupCount++];
+			group.stateKey = stateKeys[batchIndex];
+			group.bounds = bounds;
+			group.firstBatch = batchIndex;
+			group.lastBatch = batchIndex;
+			group.vertexCount = batch.GetVertexCount();
+		}
+	}
+
+	uint32_t reorderedBatchCount = 0;
+	uint32_t reorderedVertexCount = 0;
+
+	for (uint32_t groupIndex = 0; groupIndex < groupCount; ++groupIndex)
+	{
+		for (uint32_t batchIndex = _groups.items[groupIndex].firstBatch; batchIndex != D2DX_NO_BATCH; batchIndex = _nextBatchInGroup.items[batchIndex])
+		{
+			Batch batch = batches.items[batchIndex];
+
+			memcpy(&_reorderedVertices.items[reorderedVertexCount], &vertices.items[batch.GetStartVertex()], batch.GetVertexCount() * sizeof(Vertex));
+
+			batch.SetStartVertex(reorderedVertexCount);
+			reorderedVertexCount += batch.GetVertexCount();
+
+			_reorderedBatches.items[reorderedBatchCount++] = batch;
+		}
+	}
+
+	std::swap(batches, _reorderedBatches);
+	std::swap(vertices, _reorderedVertices);
+	batchCount = reorderedBatchCount;
+	vertexCount = reorderedVertexCount;
+}
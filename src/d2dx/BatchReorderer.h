@@ -0,0 +1,73 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "Types.h"
+
+namespace d2dx
+{
+	class Batch;
+	class Vertex;
+
+	/* Moves batches so that those sharing render state (blend and filter, see Batch::GetStateKey) end
+	   up next to each other and can be merged into one draw call. A batch is only ever moved in front
+	   of batches whose screen-space bounds it does not intersect, so the painter's order is kept
+	   wherever it could make a visible difference. */
+	class BatchReorderer final
+	{
+	public:
+		BatchReorderer(
+			_In_ uint32_t maxBatchCount,
+			_In_ uint32_t maxVertexCount);
+
+		/* Reorders the batches and rewrites the vertices in the new batch order, so that mergeable
+		   batches are also contiguous in the vertex buffer. Invalid batches are dropped. stateKeys
+		   holds one key per batch; batches may only be grouped if their keys are equal. */
+		void Reorder(
+			_Inout_ Buffer<Batch>& batches,
+			_Inout_ uint32_t& batchCount,
+			_Inout_ Buffer<Vertex>& vertices,
+			_Inout_ uint32_t& vertexCount,
+			_In_reads_(batchCount) const uint64_t* stateKeys);
+
+	private:
+		struct Bounds final
+		{
+			float minX;
+			float minY;
+			float maxX;
+			float maxY;
+		};
+
+		struct Group final
+		{
+			uint64_t stateKey;
+			Bounds bounds;
+			uint32_t firstBatch;
+			uint32_t lastBatch;
+			uint32_t vertexCount;
+		};
+
+		Buffer<Group> _groups;
+		Buffer<uint32_t> _nextBatchInGroup;
+		Buffer<Batch> _reorderedBatches;
+		Buffer<Vertex> _reorderedVertices;
+	};
+}
@@ -23,7 +23,7 @@ cbuffer Constants : register(b0)
 	float2 c_invScreenSize : packoffset(c0.z);
 	uint2 c_flagsx : packoffset(c1);
 	float c_sharpness : packoffset(c1.z);
-	uint c_padding : packoffset(c1.w);
+	float c_positionScale : packoffset(c1.w);
 };
 
 SamplerState PointSampler : register(s0);
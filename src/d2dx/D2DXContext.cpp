@@ -29,6 +29,7 @@
 #include "Vertex.h"
 #include "dx256_bmp.h"
 #include "Profiler.h"
+#include "Tracer.h"
 
 using namespace d2dx;
 using namespace DirectX::PackedVector;
@@ -53,13 +54,15 @@ _Use_decl_annotations_
 D2DXContext::D2DXContext(
 	const std::shared_ptr<IGameHelper>& gameHelper,
 	const std::shared_ptr<ISimd>& simd,
-	const std::shared_ptr<CompatibilityModeDisabler>& compatibilityModeDisabler) :
+	const std::shared_ptr<CompatibilityModeDisabler>& compatibilityModeDisabler,
+	const std::shared_ptr<IRenderContext>& renderContext) :
+	_renderContext{ renderContext },
 	_gameHelper{ gameHelper },
 	_simd{ simd },
 	_compatibilityModeDisabler{ compatibilityModeDisabler },
 	_frame(0),
 	_majorGameState(MajorGameState::Unknown),
-	_paletteKeys(D2DX_MAX_PALETTES, true),
+	_paletteCache(D2DX_MAX_GAME_PALETTES),
 	_batchCount(0),
 	_batches(D2DX_MAX_BATCHES_PER_FRAME),
 	_vertexCount(0),
@@ -74,10 +77,39 @@ D2DXContext::D2DXContext(
 {
 	_threadId = GetCurrentThreadId();
 
+	if (!_simd)
+	{
+		_simd = D2DXContextFactory::CreateSimd(_options.GetSimdBackend());
+	}
+
+#ifndef D2DX_UNITTEST
 	if (!_options.GetFlag(OptionsFlag::NoCompatModeFix))
 	{
 		_compatibilityModeDisabler->DisableCompatibilityMode();
 	}
+#endif
+
+	if (_options.GetTextureDiskCacheSize() > 0)
+	{
+		_textureDiskCache = std::make_unique<TextureDiskCache>("d2dx_texturecache.bin", (uint32_t)_options.GetTextureDiskCacheSize() * 1024 * 1024);
+	}
+
+	_textureCacheBalancer = std::make_unique<TextureCacheBalancer>((uint32_t)_options.GetTextureCacheBudget() * 1024 * 1024);
+
+	if (_options.GetFlag(OptionsFlag::DbgTrace))
+	{
+		StartTracing();
+	}
+
+	if (_options.GetFlag(OptionsFlag::DbgLiveMetrics))
+	{
+		_liveMetrics = std::make_unique<LiveMetrics>();
+
+		if (!_liveMetrics->IsValid())
+		{
+			_liveMetrics = nullptr;
+		}
+	}
 
 	auto apparentWindowsVersion = GetWindowsVersion();
 	auto actualWindowsVersion = GetActualWindowsVersion();
@@ -94,7 +126,24 @@ D2DXContext::D2DXContext(
 
 D2DXContext::~D2DXContext() noexcept
 {
+#ifndef D2DX_UNITTEST
 	DetachLateDetours(_gameHelper.get(), this);
+#endif
+
+	/* Executes any frame still in flight before the render context goes away. */
+	_renderThread = nullptr;
+
+	_textureDiskCache = nullptr;
+
+	WriteLatencyReport();
+
+	StopTracing();
+
+	D2DX_LOG("Palette cache: %u hits, %u misses, %u evictions (%u of palettes in use by the frame).",
+		_paletteCache.GetHitCount(), _paletteCache.GetMissCount(), _paletteCache.GetEvictionCount(),
+		_paletteCache.GetInUseEvictionCount());
+
+	detail::FlushLog();
 }
 
 _Use_decl_annotations_
@@ -186,6 +235,7 @@ void D2DXContext::OnSstWinOpen(
 
 	if (!_renderContext)
 	{
+#ifndef D2DX_UNITTEST
 		_renderContext = std::make_shared<RenderContext>(
 			(HWND)hWnd,
 			gameSize,
@@ -193,6 +243,9 @@ void D2DXContext::OnSstWinOpen(
 			_initialScreenMode,
 			this,
 			_simd);
+#else
+		D2DX_FATAL_ERROR("No render context was supplied.");
+#endif
 	}
 	else
 	{
@@ -201,9 +254,20 @@ void D2DXContext::OnSstWinOpen(
 			windowSize.width = width;
 			windowSize.height = height;
 		}
+
+		if (_renderThread)
+		{
+			_renderThread->Flush();
+		}
+
 		_renderContext->SetSizes(gameSize, windowSize * _options.GetWindowScale(), _renderContext->GetScreenMode());
 	}
 
+	if (!_renderThread)
+	{
+		_renderThread = std::make_unique<RenderThread>(_renderContext, !_options.GetFlag(OptionsFlag::NoRenderThread));
+	}
+
 	_batchCount = 0;
 	_vertexCount = 0;
 	_scratchBatch = Batch();
@@ -242,10 +306,19 @@ void D2DXContext::OnTexDownload(
 		return;
 	}
 
-	_textureHasher.Invalidate(startAddress);
-
 	uint32_t memRequired = (uint32_t)(width * height);
 
+	/* The game often re-downloads identical sprite frames to the same address. Hash the source
+	   up front, and skip the copy (and the rehash in OnTexSource) if the content is unchanged. */
+	const XXH64_hash_t contentHash = XXH3_64bits(sourceAddress, memRequired);
+	const bool isChanged = _textureHasher.UpdateContent(startAddress, memRequired, contentHash);
+	AddTexDownload(memRequired, !isChanged);
+
+	if (!isChanged)
+	{
+		return;
+	}
+
 	auto pStart = _glideState.tmuMemory.items + startAddress;
 	auto pEnd = _glideState.tmuMemory.items + startAddress + memRequired;
 	assert(pEnd <= (_glideState.tmuMemory.items + _glideState.tmuMemory.capacity));
@@ -327,7 +400,9 @@ void D2DXContext::CheckMajorGameState()
 	if (_gameHelper->IsInGame())
 	{
 		_majorGameState = MajorGameState::InGame;
+#ifndef D2DX_UNITTEST
 		AttachLateDetours(_gameHelper.get(), this);
+#endif
 	}
 	else
 	{
@@ -345,73 +420,60 @@ void D2DXContext::CheckMajorGameState()
 	}
 }
 
-_Use_decl_annotations_
-void D2DXContext::DrawBatches(
-	uint32_t startVertexLocation)
+void D2DXContext::OnBufferSwap()
 {
-	const int32_t batchCount = (int32_t)_batchCount;
-
-	Batch mergedBatch;
-	int32_t drawCalls = 0;
-
-	for (int32_t i = 0; i < batchCount; ++i)
+	if (_isFullscreenTogglePending.exchange(false, std::memory_order_relaxed) && _renderThread)
 	{
-		const Batch& batch = _batches.items[i];
+		_renderThread->Flush();
+		_renderContext->ToggleFullscreen();
+	}
 
-		if (!batch.IsValid())
-		{
-			D2DX_DEBUG_LOG("Skipping batch %i, it is invalid.", i);
-			continue;
-		}
+	CheckMajorGameState();
+	InsertLogoOnTitleScreen();
 
-		if (!mergedBatch.IsValid())
-		{
-			mergedBatch = batch;
-		}
-		else
-		{
-			if (_renderContext->GetTextureCache(batch) != _renderContext->GetTextureCache(mergedBatch) ||
-				batch.GetTextureAtlas() != mergedBatch.GetTextureAtlas() ||
-				batch.GetAlphaBlend() != mergedBatch.GetAlphaBlend() ||
-				batch.GetFilterMode() != mergedBatch.GetFilterMode() ||
-				((mergedBatch.GetVertexCount() + batch.GetVertexCount()) > 65535))
-			{
-				_renderContext->Draw(mergedBatch, startVertexLocation);
-				++drawCalls;
-				mergedBatch = batch;
-			}
-			else
-			{
-				mergedBatch.SetVertexCount(mergedBatch.GetVertexCount() + batch.GetVertexCount());
-			}
-		}
-	}
+	/* Static screens (menus, character select etc) draw the exact same frame over and over,
+	   and there is no need to render those again. */
+	const uint64_t frameFingerprint = GetFrameFingerprint();
+	bool isRepeatedFrame = false;
 
-	if (mergedBatch.IsValid())
+	if (frameFingerprint == _lastFrameFingerprint && _repeatedFrameCount < _options.GetMaxRepeatedFrames())
 	{
-		_renderContext->Draw(mergedBatch, startVertexLocation);
-		++drawCalls;
+		isRepeatedFrame = true;
+		++_repeatedFrameCount;
 	}
-
-	if (!(_frame & 255))
+	else
 	{
-		D2DX_DEBUG_LOG("Nr draw calls: %i", drawCalls);
+		_repeatedFrameCount = 0;
 	}
-}
 
+	_lastFrameFingerprint = frameFingerprint;
 
-void D2DXContext::OnBufferSwap()
-{
-	CheckMajorGameState();
-	InsertLogoOnTitleScreen();
+	_renderThread->SubmitFrame(_batches, _batchCount, _vertices, _vertexCount, isRepeatedFrame);
+
+	BalanceTextureCaches();
 
+	if (_liveMetrics)
+	{
+		PublishLiveMetrics();
+	}
+
+	if (!(_frame & 255))
 	{
-		Timer _timer(ProfCategory::DrawBatches);
-		auto startVertexLocation = _renderContext->BulkWriteVertices(_vertices.items, _vertexCount);
-		DrawBatches(startVertexLocation);
+		D2DX_DEBUG_LOG("Texture cache use: %u, %u, %u, %u, %u, %u, %u",
+			_renderContext->GetTextureCache(TextureCacheSizeClass::Size8)->GetUsedCount(),
+			_renderContext->GetTextureCache(TextureCacheSizeClass::Size16)->GetUsedCount(),
+			_renderContext->GetTextureCache(TextureCacheSizeClass::Size32)->GetUsedCount(),
+			_renderContext->GetTextureCache(TextureCacheSizeClass::Size64)->GetUsedCount(),
+			_renderContext->GetTextureCache(TextureCacheSizeClass::Size128)->GetUsedCount(),
+			_renderContext->GetTextureCache(TextureCacheSizeClass::Size256)->GetUsedCount(),
+			_renderContext->GetTextureCache(TextureCacheSizeClass::Size256x128)->GetUsedCount());
 	}
 
-	_renderContext->Present();
+	/* Only the texture cache bookkeeping is advanced here, which is game thread state: the render
+	   thread executing the submitted frame doesn't read it. */
+	_renderContext->OnNewFrame();
+
+	PreloadTextures();
 
 	++_frame;
 
@@ -422,6 +484,8 @@ void D2DXContext::OnBufferSwap()
 
 	_surfaceIdTracker.OnNewFrame();
 
+	_paletteCache.OnNewFrame();
+
 	_renderContext->GetCurrentMetrics(&_gameSize, nullptr, nullptr);
 
 	_avgDir = { 0.0f, 0.0f };
@@ -539,7 +603,6 @@ void D2DXContext::OnDrawPoint(
 	vertex0.SetPosition(d2Vertex->x, d2Vertex->y);
 	vertex0.SetTexcoord((int32_t)d2Vertex->s >> stShift, (int32_t)d2Vertex->t >> stShift);
 	vertex0.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
-	vertex0.SetSurfaceId(_surfaceIdTracker.GetCurrentSurfaceId());
 
 	Vertex vertex1 = vertex0;
 	Vertex vertex2 = vertex0;
@@ -547,12 +610,14 @@ void D2DXContext::OnDrawPoint(
 	vertex1.AddOffset(1, 0);
 	vertex2.AddOffset(1, 1);
 
-	assert((_vertexCount + 3) < _vertices.capacity);
+	/* A single triangle, written as a quad whose second triangle is degenerate. */
+	assert((_vertexCount + 4) < _vertices.capacity);
 	_vertices.items[_vertexCount++] = vertex0;
 	_vertices.items[_vertexCount++] = vertex1;
 	_vertices.items[_vertexCount++] = vertex2;
+	_vertices.items[_vertexCount++] = vertex2;
 
-	batch.SetVertexCount(3);
+	batch.SetVertexCount(4);
 
 	_surfaceIdTracker.UpdateBatchSurfaceId(batch, _majorGameState, _gameSize, &_vertices.items[batch.GetStartVertex()], batch.GetVertexCount());
 
@@ -572,11 +637,11 @@ void D2DXContext::OnDrawLine(
 	batch.SetStartVertex(_vertexCount);
 	batch.SetPaletteIndex(D2DX_WHITE_PALETTE_INDEX);
 	batch.SetTextureCategory(TextureCategory::UserInterface);
+	batch.SetSurfaceId(D2DX_SURFACE_ID_USER_INTERFACE);
 
 	EnsureReadVertexStateUpdated(batch);
 
 	auto vertex0 = _readVertexState.templateVertex;
-	vertex0.SetSurfaceId(D2DX_SURFACE_ID_USER_INTERFACE);
 
 	const uint32_t iteratedColorMask = _readVertexState.iteratedColorMask;
 	const uint32_t maskedConstantColor = _readVertexState.maskedConstantColor;
@@ -653,25 +718,19 @@ void D2DXContext::OnDrawLine(
 		vertex3.SetColor(c);
 		vertex4.SetColor(c);
 
-		assert((_vertexCount + 3 * 4) < _vertices.capacity);
+		assert((_vertexCount + 2 * 4) < _vertices.capacity);
 
 		_vertices.items[_vertexCount++] = vertex0;
 		_vertices.items[_vertexCount++] = vertex1;
 		_vertices.items[_vertexCount++] = vertex2;
-
-		_vertices.items[_vertexCount++] = vertex0;
-		_vertices.items[_vertexCount++] = vertex2;
 		_vertices.items[_vertexCount++] = vertex3;
 
 		_vertices.items[_vertexCount++] = vertex0;
 		_vertices.items[_vertexCount++] = vertex3;
 		_vertices.items[_vertexCount++] = vertex4;
-
-		_vertices.items[_vertexCount++] = vertex0;
-		_vertices.items[_vertexCount++] = vertex4;
 		_vertices.items[_vertexCount++] = vertex1;
 
-		batch.SetVertexCount(3 * 4);
+		batch.SetVertexCount(2 * 4);
 
 		_lastWeatherParticleIndex = currentWeatherParticleIndex;
 	}
@@ -689,15 +748,13 @@ void D2DXContext::OnDrawLine(
 		vertex2.SetPosition(d2Vertex1->x - widening.x, d2Vertex1->y + widening.y);
 		vertex3.SetPosition(d2Vertex0->x - widening.x, d2Vertex0->y + widening.y);
 
-		assert((_vertexCount + 6) < _vertices.capacity);
+		assert((_vertexCount + 4) < _vertices.capacity);
 		_vertices.items[_vertexCount++] = vertex0;
 		_vertices.items[_vertexCount++] = vertex1;
-		_vertices.items[_vertexCount++] = vertex2;
-		_vertices.items[_vertexCount++] = vertex1;
 		_vertices.items[_vertexCount++] = vertex3;
 		_vertices.items[_vertexCount++] = vertex2;
 
-		batch.SetVertexCount(6);
+		batch.SetVertexCount(4);
 	}
 
 	assert(_batchCount < _batches.capacity);
@@ -713,7 +770,7 @@ const Batch D2DXContext::PrepareBatchForSubmit(
 {
 	auto gameAddress = _gameHelper->IdentifyGameAddress(gameContext);
 
-	auto tcl = _renderContext->UpdateTexture(batch, _glideState.tmuMemory.items, _glideState.tmuMemory.capacity);
+	auto tcl = UpdateTexture(batch, _glideState.tmuMemory.items, _glideState.tmuMemory.capacity);
 
 	if (tcl._textureAtlas < 0)
 	{
@@ -722,6 +779,7 @@ const Batch D2DXContext::PrepareBatchForSubmit(
 
 	batch.SetTextureAtlas(tcl._textureAtlas);
 	batch.SetTextureIndex(tcl._textureIndex);
+	batch.SetTextureOrigin(tcl._originS, tcl._originT);
 
 	batch.SetGameAddress(gameAddress);
 	batch.SetStartVertex(_vertexCount);
@@ -730,6 +788,152 @@ const Batch D2DXContext::PrepareBatchForSubmit(
 	return batch;
 }
 
+_Use_decl_annotations_
+TextureCacheLocation D2DXContext::UpdateTexture(
+	const Batch& batch,
+	const uint8_t* tmuData,
+	uint32_t tmuDataSize) const
+{
+	TraceScope _trace("D2DXContext::UpdateTexture");
+
+	if (!batch.IsValid())
+	{
+		return { -1, -1 };
+	}
+
+	const uint64_t contentKey = batch.GetHash();
+
+	if (_textureDiskCache)
+	{
+		_textureDiskCache->OnTextureUsed(contentKey, batch.GetTextureWidth(), batch.GetTextureHeight(), tmuData + batch.GetTextureStartAddress());
+	}
+
+	ITextureCache* textureCache = _renderContext->GetTextureCache(batch);
+
+	auto tcl = textureCache->FindTexture(contentKey, batch, -1);
+
+	if (tcl._textureAtlas < 0)
+	{
+		tcl = textureCache->InsertTexture(contentKey, batch);
+
+		/* The cache slot is assigned now, but the data is uploaded by the render thread before it draws the frame. */
+		_renderThread->RecordTextureUpload(batch, tcl, tmuData, tmuDataSize);
+	}
+
+	return tcl;
+}
+
+void D2DXContext::PreloadTextures()
+{
+	if (!_textureDiskCache)
+	{
+		return;
+	}
+
+	/* Spread the preloading over several frames, to not cause a hitch at startup. Textures that are
+	   skipped count too, as their texels have been touched as well. */
+	const uint32_t maxPreloadSizePerFrame = 1024 * 1024;
+	uint32_t preloadSize = 0;
+
+	while (preloadSize < maxPreloadSizePerFrame)
+	{
+		uint64_t contentKey;
+		int32_t width, height;
+		const uint8_t* texels = _textureDiskCache->GetNextPreload(contentKey, width, height);
+
+		if (!texels)
+		{
+			break;
+		}
+
+		preloadSize += width * height;
+
+		Batch batch;
+		batch.SetTextureStartAddress(0);
+		batch.SetTextureSize(width, height);
+		batch.SetTextureHash(contentKey);
+
+		/* Contains and PreloadTexture rather than FindTexture and InsertTexture, so that preloading
+		   doesn't count as the game using the texture. The batch has no texture category, so the
+		   texture goes into the unpinned part of the cache. */
+		ITextureCache* textureCache = _renderContext->GetTextureCache(batch);
+
+		if (textureCache->Contains(contentKey))
+		{
+			continue;
+		}
+
+		/* Only free slots are filled, as evicting textures used by the game would defeat the
+		   purpose. When this size class is full, the texture is dropped, but the textures of the
+		   other size classes are still preloaded. */
+		auto tcl = textureCache->PreloadTexture(contentKey, batch);
+
+		if (tcl._textureAtlas < 0)
+		{
+			continue;
+		}
+
+		_renderThread->RecordTextureUpload(batch, tcl, texels, width * height);
+	}
+}
+
+void D2DXContext::BalanceTextureCaches()
+{
+	uint32_t workingSetSizes[TextureCacheBalancer::SizeClassCount];
+	uint32_t evictionCounts[TextureCacheBalancer::SizeClassCount];
+
+	for (int32_t i = 0; i < TextureCacheBalancer::SizeClassCount; ++i)
+	{
+		const ITextureCache* textureCache = _renderContext->GetTextureCache((TextureCacheSizeClass)i);
+		workingSetSizes[i] = textureCache->GetWorkingSetSize();
+		evictionCounts[i] = textureCache->GetEvictionCount();
+		_textureCacheEvictionTotals[i] += evictionCounts[i];
+	}
+
+	if (!_textureCacheBalancer->OnFrame(workingSetSizes, evictionCounts))
+	{
+		return;
+	}
+
+	const uint32_t* capacities = _textureCacheBalancer->GetCapacities();
+
+	D2DX_LOG("Resizing texture caches to %u, %u, %u, %u, %u, %u, %u.",
+		capacities[0], capacities[1], capacities[2], capacities[3], capacities[4], capacities[5], capacities[6]);
+
+	/* The frame just submitted may still use the atlases that are about to be replaced. */
+	_renderThread->Flush();
+	_renderContext->SetTextureCacheCapacities(capacities);
+}
+
+_Use_decl_annotations_
+void D2DXContext::ApplyTextureOrigin(
+	const Batch& batch)
+{
+	/* Textures sharing an atlas slice are drawn from their own sub-rect of it. */
+	const int32_t originS = batch.GetTextureOriginS();
+	const int32_t originT = batch.GetTextureOriginT();
+
+	if (!(originS | originT))
+	{
+		return;
+	}
+
+	Vertex* vertices = &_vertices.items[batch.GetStartVertex()];
+
+	for (uint32_t i = 0; i < batch.GetVertexCount(); ++i)
+	{
+		vertices[i].AddTexcoordOffset(originS, originT);
+	}
+}
+
+uint64_t D2DXContext::GetFrameFingerprint() const
+{
+	/* Batches and vertices only refer to textures and palettes by location, so any change to their
+	   contents is covered by the content generation instead. */
+	const uint64_t batchesHash = XXH3_64bits_withSeed(_batches.items, sizeof(Batch) * _batchCount, _renderThread->GetContentGeneration());
+	return XXH3_64bits_withSeed(_vertices.items, sizeof(Vertex) * _vertexCount, batchesHash);
+}
+
 _Use_decl_annotations_
 void D2DXContext::EnsureReadVertexStateUpdated(
 	const Batch& batch)
@@ -744,9 +948,8 @@ void D2DXContext::EnsureReadVertexStateUpdated(
 		0, 0,
 		0,
 		batch.IsChromaKeyEnabled(),
-		batch.GetTextureIndex(),
-		batch.GetRgbCombine() == RgbCombine::ColorMultipliedByTexture ? batch.GetPaletteIndex() : D2DX_WHITE_PALETTE_INDEX,
-		0);
+		batch.GetVertexAtlasIndex(),
+		batch.GetRgbCombine() == RgbCombine::ColorMultipliedByTexture ? batch.GetPaletteIndex() : D2DX_WHITE_PALETTE_INDEX);
 
 	const bool isIteratedColor = batch.GetRgbCombine() == RgbCombine::ColorMultipliedByTexture;
 	const uint32_t constantColorMask = isIteratedColor ? 0xFF000000 : 0xFFFFFFFF;
@@ -771,7 +974,11 @@ void D2DXContext::OnDrawVertexArray(
 		return;
 	}
 
-	Batch batch = PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Triangles, 3 * (count - 2), gameContext);
+	const uint32_t vertexCount = 4 * ((count - 1) / 2);
+	assert(vertexCount <= D2DX_MAX_VERTICES_PER_BATCH);
+	assert((_vertexCount + vertexCount) < _vertices.capacity);
+
+	Batch batch = PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Triangles, vertexCount, gameContext);
 
 	if (!batch.IsValid())
 	{
@@ -780,52 +987,17 @@ void D2DXContext::OnDrawVertexArray(
 
 	EnsureReadVertexStateUpdated(batch);
 
-	Vertex v = _readVertexState.templateVertex;
-
-	const uint32_t iteratedColorMask = _readVertexState.iteratedColorMask;
-	const uint32_t maskedConstantColor = _readVertexState.maskedConstantColor;
-
-	Vertex* pVertices = &_vertices.items[_vertexCount];
-
-	for (int32_t i = 0; i < 3; ++i)
-	{
-		const D2::Vertex* d2Vertex = (const D2::Vertex*)pointers[i];
-		v.SetPosition(d2Vertex->x, d2Vertex->y);
-		v.SetTexcoord((int32_t)d2Vertex->s >> _glideState.stShift, (int32_t)d2Vertex->t >> _glideState.stShift);
-		v.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
-		*pVertices++ = v;
-	}
-
-	if (mode == GR_TRIANGLE_FAN)
-	{
-		auto vertex0 = pVertices[-3];
-
-		for (uint32_t i = 0; i < (count - 3); ++i)
-		{
-			*pVertices++ = vertex0;
-			*pVertices++ = pVertices[-2];
-			const D2::Vertex* d2Vertex = (const D2::Vertex*)pointers[i + 3];
-			v.SetPosition(d2Vertex->x, d2Vertex->y);
-			v.SetTexcoord((int32_t)d2Vertex->s >> _glideState.stShift, (int32_t)d2Vertex->t >> _glideState.stShift);
-			v.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
-			*pVertices++ = v;
-		}
-	}
-	else
-	{
-		for (uint32_t i = 0; i < (count - 3); ++i)
-		{
-			*pVertices++ = pVertices[-2];
-			*pVertices++ = pVertices[-2];
-			const D2::Vertex* d2Vertex = (const D2::Vertex*)pointers[i + 3];
-			v.SetPosition(d2Vertex->x, d2Vertex->y);
-			v.SetTexcoord((int32_t)d2Vertex->s >> _glideState.stShift, (int32_t)d2Vertex->t >> _glideState.stShift);
-			v.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
-			*pVertices++ = v;
-		}
-	}
+	_vertexCount += _simd->ExpandVertexArray(
+		mode,
+		count,
+		(const D2::Vertex* const*)pointers,
+		_readVertexState.templateVertex,
+		_readVertexState.maskedConstantColor,
+		_readVertexState.iteratedColorMask,
+		_glideState.stShift,
+		&_vertices.items[_vertexCount]);
 
-	_vertexCount += 3 * (count - 2);
+	ApplyTextureOrigin(batch);
 
 	_surfaceIdTracker.UpdateBatchSurfaceId(batch, _majorGameState, _gameSize, &_vertices.items[batch.GetStartVertex()], batch.GetVertexCount());
 
@@ -851,7 +1023,7 @@ void D2DXContext::OnDrawVertexArrayContiguous(
 		return;
 	}
 
-	Batch batch = PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Triangles, 6, gameContext);
+	Batch batch = PrepareBatchForSubmit(_scratchBatch, PrimitiveType::Triangles, 4, gameContext);
 
 	if (!batch.IsValid())
 	{
@@ -860,27 +1032,21 @@ void D2DXContext::OnDrawVertexArrayContiguous(
 
 	EnsureReadVertexStateUpdated(batch);
 
-	const uint32_t iteratedColorMask = _readVertexState.iteratedColorMask;
-	const uint32_t maskedConstantColor = _readVertexState.maskedConstantColor;
-
 	const D2::Vertex* d2Vertices = (const D2::Vertex*)vertex;
+	const D2::Vertex* d2VertexPointers[4] = { &d2Vertices[0], &d2Vertices[1], &d2Vertices[2], &d2Vertices[3] };
 
-	Vertex v = _readVertexState.templateVertex;
-
-	Vertex* pVertices = &_vertices.items[_vertexCount];
-
-	for (int32_t i = 0; i < 4; ++i)
-	{
-		v.SetPosition(d2Vertices[i].x, d2Vertices[i].y);
-		v.SetTexcoord((int32_t)d2Vertices[i].s >> _glideState.stShift, (int32_t)d2Vertices[i].t >> _glideState.stShift);
-		v.SetColor(maskedConstantColor | (d2Vertices[i].color & iteratedColorMask));
-		pVertices[i] = v;
-	}
-
-	pVertices[4] = pVertices[0];
-	pVertices[5] = pVertices[2];
+	assert((_vertexCount + 4) < _vertices.capacity);
+	_vertexCount += _simd->ExpandVertexArray(
+		GR_TRIANGLE_FAN,
+		4,
+		d2VertexPointers,
+		_readVertexState.templateVertex,
+		_readVertexState.maskedConstantColor,
+		_readVertexState.iteratedColorMask,
+		_glideState.stShift,
+		&_vertices.items[_vertexCount]);
 
-	_vertexCount += 6;
+	ApplyTextureOrigin(batch);
 
 	_surfaceIdTracker.UpdateBatchSurfaceId(batch, _majorGameState, _gameSize, &_vertices.items[batch.GetStartVertex()], batch.GetVertexCount());
 
@@ -905,46 +1071,29 @@ void D2DXContext::OnTexDownloadTable(
 	uint64_t hash = XXH3_64bits(data, 1024);
 	assert(hash != 0);
 
-	for (uint32_t i = 0; i < D2DX_MAX_GAME_PALETTES; ++i)
-	{
-		if (_paletteKeys.items[i] == 0)
-		{
-			break;
-		}
+	bool isNewPalette = false;
+	const int32_t paletteIndex = _paletteCache.FindOrInsert(hash, isNewPalette);
 
-		if (_paletteKeys.items[i] == hash)
-		{
-			_scratchBatch.SetPaletteIndex(i);
-			return;
-		}
-	}
+	_scratchBatch.SetPaletteIndex(paletteIndex);
 
-	for (uint32_t i = 0; i < D2DX_MAX_GAME_PALETTES; ++i)
+	if (!isNewPalette)
 	{
-		if (_paletteKeys.items[i] == 0)
-		{
-			_paletteKeys.items[i] = hash;
-			_scratchBatch.SetPaletteIndex(i);
-
-			uint32_t* palette = (uint32_t*)data;
+		return;
+	}
 
-			for (int32_t j = 0; j < 256; ++j)
-			{
-				palette[j] |= 0xFF000000;
-			}
+	uint32_t* palette = (uint32_t*)data;
 
-			if (_options.GetFlag(OptionsFlag::DbgDumpTextures))
-			{
-				memcpy(_glideState.palettes.items + 256 * i, palette, 1024);
-			}
+	for (int32_t j = 0; j < 256; ++j)
+	{
+		palette[j] |= 0xFF000000;
+	}
 
-			_renderContext->SetPalette(i, palette);
-			return;
-		}
+	if (_options.GetFlag(OptionsFlag::DbgDumpTextures))
+	{
+		memcpy(_glideState.palettes.items + 256 * paletteIndex, palette, 1024);
 	}
 
-	assert(false && "Too many palettes.");
-	D2DX_LOG("Too many palettes.");
+	_renderThread->RecordPalette(paletteIndex, palette);
 }
 
 _Use_decl_annotations_
@@ -969,6 +1118,7 @@ void D2DXContext::OnLoadGammaTable(
 		_glideState.gammaTable.items[i] = ((blue[i] & 0xFF) << 16) | ((green[i] & 0xFF) << 8) | (red[i] & 0xFF);
 	}
 
+	_renderThread->Flush();
 	_renderContext->LoadGammaTable(_glideState.gammaTable.items, _glideState.gammaTable.capacity);
 }
 
@@ -978,6 +1128,7 @@ void D2DXContext::OnLfbUnlock(
 	uint32_t strideInBytes)
 {
 	bool forCinematic = !(_majorGameState == MajorGameState::Unknown || _majorGameState == MajorGameState::FmvIntro);
+	_renderThread->Flush();
 	_renderContext->WriteToScreen(lfbPtr, 640, 480, forCinematic);
 }
 
@@ -1002,6 +1153,7 @@ void D2DXContext::OnGammaCorrectionRGB(
 		gammaTable[i] = (ri << 16) | (gi << 8) | bi;
 	}
 
+	_renderThread->Flush();
 	_renderContext->LoadGammaTable(gammaTable, ARRAYSIZE(gammaTable));
 }
 
@@ -1022,7 +1174,7 @@ void D2DXContext::PrepareLogoTextureBatch()
 		palette.items[i] |= 0xFF000000;
 	}
 
-	_renderContext->SetPalette(D2DX_LOGO_PALETTE_INDEX, palette.items);
+	_renderThread->RecordPalette(D2DX_LOGO_PALETTE_INDEX, palette.items);
 
 	uint64_t hash = XXH3_64bits((void*)srcPixels, sizeof(uint8_t) * 81 * 40);
 
@@ -1037,7 +1189,7 @@ void D2DXContext::PrepareLogoTextureBatch()
 	_logoTextureBatch.SetRgbCombine(RgbCombine::ColorMultipliedByTexture);
 	_logoTextureBatch.SetAlphaCombine(AlphaCombine::One);
 	_logoTextureBatch.SetPaletteIndex(D2DX_LOGO_PALETTE_INDEX);
-	_logoTextureBatch.SetVertexCount(6);
+	_logoTextureBatch.SetVertexCount(4);
 
 	memset(data, 0, _logoTextureBatch.GetTextureWidth() * _logoTextureBatch.GetTextureHeight());
 
@@ -1058,11 +1210,12 @@ void D2DXContext::InsertLogoOnTitleScreen()
 
 	PrepareLogoTextureBatch();
 
-	auto tcl = _renderContext->UpdateTexture(_logoTextureBatch, _glideState.sideTmuMemory.items, _glideState.sideTmuMemory.capacity);
+	auto tcl = UpdateTexture(_logoTextureBatch, _glideState.sideTmuMemory.items, _glideState.sideTmuMemory.capacity);
 
 	_logoTextureBatch.SetTextureAtlas(tcl._textureAtlas);
 	_logoTextureBatch.SetTextureIndex(tcl._textureIndex);
 	_logoTextureBatch.SetStartVertex(_vertexCount);
+	_logoTextureBatch.SetSurfaceId(D2DX_SURFACE_ID_USER_INTERFACE);
 
 	Size gameSize;
 	_renderContext->GetCurrentMetrics(&gameSize, nullptr, nullptr);
@@ -1073,17 +1226,16 @@ void D2DXContext::InsertLogoOnTitleScreen()
 	const float y2 = static_cast<float>(gameSize.height - 9 - 16);
 	const uint32_t color = 0xFFFFa090;
 
-	Vertex vertex0(x1, y1, 0, 0, color, true, _logoTextureBatch.GetTextureIndex(), D2DX_LOGO_PALETTE_INDEX, D2DX_SURFACE_ID_USER_INTERFACE);
-	Vertex vertex1(x2, y1, 80, 0, color, true, _logoTextureBatch.GetTextureIndex(), D2DX_LOGO_PALETTE_INDEX, D2DX_SURFACE_ID_USER_INTERFACE);
-	Vertex vertex2(x2, y2, 80, 41, color, true, _logoTextureBatch.GetTextureIndex(), D2DX_LOGO_PALETTE_INDEX, D2DX_SURFACE_ID_USER_INTERFACE);
-	Vertex vertex3(x1, y2, 0, 41, color, true, _logoTextureBatch.GetTextureIndex(), D2DX_LOGO_PALETTE_INDEX, D2DX_SURFACE_ID_USER_INTERFACE);
+	const int32_t atlasIndex = (int32_t)_logoTextureBatch.GetVertexAtlasIndex();
+	Vertex vertex0(x1, y1, 0, 0, color, true, atlasIndex, D2DX_LOGO_PALETTE_INDEX);
+	Vertex vertex1(x2, y1, 80, 0, color, true, atlasIndex, D2DX_LOGO_PALETTE_INDEX);
+	Vertex vertex2(x2, y2, 80, 41, color, true, atlasIndex, D2DX_LOGO_PALETTE_INDEX);
+	Vertex vertex3(x1, y2, 0, 41, color, true, atlasIndex, D2DX_LOGO_PALETTE_INDEX);
 
-	assert((_vertexCount + 6) < _vertices.capacity);
+	assert((_vertexCount + 4) < _vertices.capacity);
 	_vertices.items[_vertexCount++] = vertex0;
 	_vertices.items[_vertexCount++] = vertex1;
 	_vertices.items[_vertexCount++] = vertex2;
-	_vertices.items[_vertexCount++] = vertex0;
-	_vertices.items[_vertexCount++] = vertex2;
 	_vertices.items[_vertexCount++] = vertex3;
 
 	_batches.items[_batchCount++] = _logoTextureBatch;
@@ -1182,6 +1334,95 @@ void D2DXContext::DisableBuiltinResMod()
 	_options.SetFlag(OptionsFlag::NoResMod, true);
 }
 
+void D2DXContext::DisableRenderThread()
+{
+	assert(!_renderThread && "The render thread is already running.");
+	_options.SetFlag(OptionsFlag::NoRenderThread, true);
+}
+
+void D2DXContext::ToggleFullscreen()
+{
+	/* Called from the window procedure. Waiting for the render thread there can deadlock, as it may
+	   be inside Present waiting for the window's messages to be pumped, so the toggle is done by
+	   the game thread at the next buffer swap instead. */
+	_isFullscreenTogglePending.store(true, std::memory_order_relaxed);
+}
+
+void D2DXContext::PublishLiveMetrics()
+{
+	static_assert(LiveMetricsTextureCacheCount == TextureCacheBalancer::SizeClassCount, "Texture cache counts must match.");
+
+	LiveMetricsGameFrame* metrics = _liveMetrics->BeginGameFrameUpdate();
+
+	metrics->frame = (uint32_t)_frame;
+	metrics->majorGameState = (uint32_t)_majorGameState;
+	metrics->batchCount = _batchCount;
+	metrics->vertexCount = _vertexCount;
+	metrics->paletteCount = _paletteCache.GetUsedCount();
+	metrics->textureHashMissCount = _textureHasher.GetMissCount();
+	metrics->textureHashMissBytes = _textureHasher.GetMissBytes();
+
+	for (int32_t i = 0; i < TextureCacheBalancer::SizeClassCount; ++i)
+	{
+		const ITextureCache* textureCache = _renderContext->GetTextureCache((TextureCacheSizeClass)i);
+		metrics->textureCacheCapacities[i] = textureCache->GetCapacity();
+		metrics->textureCacheUsedCounts[i] = textureCache->GetUsedCount();
+		metrics->textureCacheEvictionCounts[i] = _textureCacheEvictionTotals[i];
+	}
+
+	_liveMetrics->EndGameFrameUpdate();
+}
+
+void D2DXContext::DumpTextureCacheStatistics()
+{
+	const char* filename = "d2dx_texturecache_stats.csv";
+	FILE* file = nullptr;
+
+	if (fopen_s(&file, filename, "a") != 0 || !file)
+	{
+		D2DX_LOG("Failed to open %s for writing.", filename);
+		return;
+	}
+
+	fseek(file, 0, SEEK_END);
+
+	if (ftell(file) == 0)
+	{
+		fprintf(file, "frame,size,capacity,used,pinned_capacity,pinned_used,lookups,last_index_hits,scan_hits,misses,"
+			"inserts,evictions,pinned_evictions,uploaded_bytes,frames,working_set,peak_working_set\n");
+	}
+
+	for (int32_t i = 0; i < TextureCacheBalancer::SizeClassCount; ++i)
+	{
+		const Size textureSize = TextureCacheBalancer::GetTextureSize((TextureCacheSizeClass)i);
+		const TextureCacheStatistics statistics = _renderContext->GetTextureCache((TextureCacheSizeClass)i)->GetStatistics();
+
+		fprintf(file, "%i,%ix%i,%u,%u,%u,%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%u,%u,%u\n",
+			_frame,
+			textureSize.width,
+			textureSize.height,
+			statistics.capacity,
+			statistics.usedCount,
+			statistics.pinnedCapacity,
+			statistics.pinnedUsedCount,
+			statistics.lookupCount,
+			statistics.lastIndexHitCount,
+			statistics.scanHitCount,
+			statistics.missCount,
+			statistics.insertCount,
+			statistics.evictionCount,
+			statistics.pinnedEvictionCount,
+			statistics.uploadedBytes,
+			statistics.frameCount,
+			statistics.workingSetSize,
+			statistics.peakWorkingSetSize);
+	}
+
+	fclose(file);
+
+	D2DX_LOG("Wrote texture cache statistics to %s.", filename);
+}
+
 const Options& D2DXContext::GetOptions() const
 {
 	return _options;
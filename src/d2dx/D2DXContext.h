@@ -27,7 +27,11 @@
 #include "IRenderContext.h"
 #include "IWin32InterceptionHandler.h"
 #include "CompatibilityModeDisabler.h"
+#include "PaletteCache.h"
+#include "RenderThread.h"
 #include "SurfaceIdTracker.h"
+#include "TextureCacheBalancer.h"
+#include "TextureDiskCache.h"
 #include "TextureHasher.h"
 #include "WeatherMotionPredictor.h"
 #include "Vertex.h"
@@ -42,8 +46,9 @@ namespace d2dx
 	public:
 		D2DXContext(
 			_In_ const std::shared_ptr<IGameHelper>& gameHelper,
-			_In_ const std::shared_ptr<ISimd>& simd,
-			_In_ const std::shared_ptr<CompatibilityModeDisabler>& compatibilityModeDisabler);
+			_In_opt_ const std::shared_ptr<ISimd>& simd,
+			_In_ const std::shared_ptr<CompatibilityModeDisabler>& compatibilityModeDisabler,
+			_In_opt_ const std::shared_ptr<IRenderContext>& renderContext);
 		
 		virtual ~D2DXContext() noexcept;
 
@@ -169,6 +174,12 @@ namespace d2dx
 
 		virtual void DisableBuiltinResMod() override;
 
+		virtual void DisableRenderThread() override;
+
+		virtual void ToggleFullscreen() override;
+
+		virtual void DumpTextureCacheStatistics() override;
+
 		virtual const Options& GetOptions() const override;
 
 		virtual uint32_t GetActiveThreadId() const noexcept override
@@ -181,6 +192,11 @@ namespace d2dx
 			return _majorGameState == MajorGameState::InGame;
 		}
 
+		virtual LiveMetrics* GetLiveMetrics() noexcept override
+		{
+			return _liveMetrics.get();
+		}
+
 #pragma endregion ID2DXContext
 
 #pragma region IWin32InterceptionHandler
@@ -217,18 +233,31 @@ namespace d2dx
 
 		void InsertLogoOnTitleScreen();
 
-		void DrawBatches(
-			_In_ uint32_t startVertexLocation);
-
 		const Batch PrepareBatchForSubmit(
 			_In_ Batch batch,
 			_In_ PrimitiveType primitiveType,
 			_In_ uint32_t vertexCount,
 			_In_ uint32_t gameContext) const;
 		
+		TextureCacheLocation UpdateTexture(
+			_In_ const Batch& batch,
+			_In_reads_(tmuDataSize) const uint8_t* tmuData,
+			_In_ uint32_t tmuDataSize) const;
+
+		void PreloadTextures();
+
+		void BalanceTextureCaches();
+
+		void PublishLiveMetrics();
+
+		void ApplyTextureOrigin(
+			_In_ const Batch& batch);
+
 		void EnsureReadVertexStateUpdated(
 			_In_ const Batch& batch);
 
+		uint64_t GetFrameFingerprint() const;
+
 		struct GlideState
 		{
 			Buffer<uint8_t> tmuMemory{ D2DX_TMU_MEMORY_SIZE };
@@ -255,6 +284,13 @@ namespace d2dx
 
 		int32_t _frame;
 		std::shared_ptr<IRenderContext> _renderContext;
+		std::unique_ptr<RenderThread> _renderThread;
+		std::unique_ptr<TextureDiskCache> _textureDiskCache;
+		std::unique_ptr<TextureCacheBalancer> _textureCacheBalancer;
+		std::unique_ptr<LiveMetrics> _liveMetrics;
+
+		/* Kept here, since the caches' own counters start over when they are resized. */
+		uint32_t _textureCacheEvictionTotals[TextureCacheBalancer::SizeClassCount] = { 0 };
 		std::shared_ptr<IGameHelper> _gameHelper;
 		std::shared_ptr<ISimd> _simd;
 		std::shared_ptr<CompatibilityModeDisabler> _compatibilityModeDisabler;
@@ -266,7 +302,7 @@ namespace d2dx
 		MajorGameState _majorGameState;
 		ScreenMode _initialScreenMode;
 
-		Buffer<uint64_t> _paletteKeys;
+		PaletteCache _paletteCache;
 
 		uint32_t _batchCount;
 		Buffer<Batch> _batches;
@@ -282,6 +318,9 @@ namespace d2dx
 
 		uint32_t _lastScreenOpenMode;
 
+		uint64_t _lastFrameFingerprint = 0;
+		int32_t _repeatedFrameCount = 0;
+
 		Size _gameSize;
 
 		bool _isDrawingText = false;
@@ -291,6 +330,8 @@ namespace d2dx
 
 		OffsetF _avgDir = { 0.0f, 0.0f };
 
+		std::atomic<bool> _isFullscreenTogglePending = { false };
+
 		uint32_t _threadId = 0;
 	};
 }
@@ -20,6 +20,8 @@
 #include "D2DXContextFactory.h"
 #include "GameHelper.h"
 #include "SimdSse2.h"
+#include "SimdAvx2.h"
+#include "SimdAvx512.h"
 #include "D2DXContext.h"
 #include "CompatibilityModeDisabler.h"
 
@@ -36,9 +38,10 @@ ID2DXContext* D2DXContextFactory::GetInstance(
 	if (!instance && !destroyed && createIfNeeded)
 	{
 		auto gameHelper = std::make_shared<GameHelper>();
-		auto simd = std::make_shared<SimdSse2>();
 		auto compatibilityModeDisabler = std::make_shared<CompatibilityModeDisabler>();
-		instance = std::make_shared<D2DXContext>(gameHelper, simd, compatibilityModeDisabler);
+
+		/* The context picks the SIMD backend itself, since it depends on the options. */
+		instance = std::make_shared<D2DXContext>(gameHelper, nullptr, compatibilityModeDisabler, nullptr);
 	}
 
 	return instance.get();
@@ -49,3 +52,45 @@ void D2DXContextFactory::DestroyInstance()
 	instance = nullptr;
 	destroyed = true;
 }
+
+_Use_decl_annotations_
+SimdBackend D2DXContextFactory::ResolveSimdBackend(
+	SimdBackend requestedBackend)
+{
+	const bool isAvx512Supported = IsAvx512Supported();
+	const bool isAvx2Supported = IsAvx2Supported();
+
+	if ((requestedBackend == SimdBackend::Avx512 && !isAvx512Supported) ||
+		(requestedBackend == SimdBackend::Avx2 && !isAvx2Supported))
+	{
+		D2DX_LOG("The requested SIMD backend is not supported by the CPU.");
+		requestedBackend = SimdBackend::Auto;
+	}
+
+	if (requestedBackend == SimdBackend::Auto)
+	{
+		return isAvx512Supported ? SimdBackend::Avx512 :
+			isAvx2Supported ? SimdBackend::Avx2 :
+			SimdBackend::Sse2;
+	}
+
+	return requestedBackend;
+}
+
+_Use_decl_annotations_
+std::shared_ptr<ISimd> D2DXContextFactory::CreateSimd(
+	SimdBackend backend)
+{
+	switch (ResolveSimdBackend(backend))
+	{
+	case SimdBackend::Avx512:
+		D2DX_LOG("Using AVX-512.");
+		return std::make_shared<SimdAvx512>();
+	case SimdBackend::Avx2:
+		D2DX_LOG("Using AVX2.");
+		return std::make_shared<SimdAvx2>();
+	default:
+		D2DX_LOG("Using SSE2.");
+		return std::make_shared<SimdSse2>();
+	}
+}
@@ -19,6 +19,8 @@
 #pragma once
 
 #include "ID2DXContext.h"
+#include "ISimd.h"
+#include "Options.h"
 
 namespace d2dx
 {
@@ -27,5 +29,13 @@ namespace d2dx
 	public:
 		static ID2DXContext* GetInstance(bool createIfNeeded = true);
 		static void DestroyInstance();
+
+		/* Returns the backend to use for the requested one: the fastest one the CPU supports for
+		   SimdBackend::Auto, or if the CPU doesn't support the requested one. */
+		static SimdBackend ResolveSimdBackend(
+			_In_ SimdBackend requestedBackend);
+
+		static std::shared_ptr<ISimd> CreateSimd(
+			_In_ SimdBackend backend);
 	};
 }
@@ -25,14 +25,17 @@ void main(
 	out DisplayVSOutput vs_out,
 	out noperspective float4 vs_out_pos : SV_POSITION)	
 {
-	float2 fpos = float2(vs_in.pos) * c_invScreenSize - 0.5;
+	/* A triangle twice the size of the screen, generated from the vertex id so that it works with either vertex format. */
+	float2 fpos = float2(vs_in_vertexId == 1 ? 1.5 : -0.5, vs_in_vertexId == 2 ? 1.5 : -0.5);
 	vs_out_pos = fpos.xyxx * float4(2, -2, 0, 0) + float4(0,0,0,1);
 	
 	float2 stf = vs_in.st;
 	vs_out.textureSize_invTextureSize = float4(stf, 1/stf);
 
-	const float srcWidth = vs_in.misc.y & 16383;
-	const float srcHeight = vs_in.misc.x & 4095;
+	/* The position of every vertex is the size of the source (see RenderContext::UpdateVerticesWithFullScreenTriangle). */
+	const float2 srcSize = round(vs_in.pos * c_positionScale);
+	const float srcWidth = srcSize.x;
+	const float srcHeight = srcSize.y;
 
 	switch (vs_in_vertexId)
 	{
@@ -23,6 +23,8 @@ struct GameVSInput
 	int2 texCoord : TEXCOORD0;
 	float4 color : COLOR0;
 	uint2 misc : TEXCOORD1;
+	uint firstQuad : TEXCOORD2;
+	uint vertexId : SV_VertexID;
 };
 
 struct GameVSOutput
@@ -30,6 +32,7 @@ struct GameVSOutput
 	noperspective float4 pos : SV_POSITION;
 	noperspective float2 tc : TEXCOORD0;
 	noperspective float4 color : COLOR0;
+	/* flags: bit 0 is chroma keying, bits 4-7 and 8-11 are log2 of the texture width and height. */
 	nointerpolation uint4 atlasIndex_paletteIndex_surfaceId_flags : TEXCOORD1;
 };
 
@@ -18,9 +18,7 @@
 */
 #include "Constants.hlsli"
 #include "Game.hlsli"
-
-Texture2DArray<uint> tex : register(t0);
-Texture1DArray palette : register(t1);
+#include "GameTextures.hlsli"
 
 void main(
 	in GamePSInput ps_in,
@@ -30,17 +28,20 @@ void main(
 	const bool chromaKeyEnabled = ps_in.atlasIndex_paletteIndex_surfaceId_flags.w & 1;
 	const uint surfaceId = ps_in.atlasIndex_paletteIndex_surfaceId_flags.z;
 	const uint paletteIndex = ps_in.atlasIndex_paletteIndex_surfaceId_flags.y;
+	const uint flags = ps_in.atlasIndex_paletteIndex_surfaceId_flags.w;
+	const int2 textureSizeMask = int2(1 << ((flags >> 4) & 15), 1 << ((flags >> 8) & 15)) - 1;
 
-	if (chromaKeyEnabled && tex.Load(int4(ps_in.tc, atlasIndex, 0)) == 0)
+	if (chromaKeyEnabled && LoadIndexedColor(atlasIndex, ps_in.tc) == 0)
 		discard;
 
 	const float2 tc = ps_in.tc - 0.5;
 	const int2 ulTc = int2(tc);
 	const int2 lrTc = ulTc + 1;
-	const uint i1 = tex.Load(int4(ulTc, atlasIndex, 0));
-	const uint i2 = tex.Load(int4(lrTc.x, ulTc.y, atlasIndex, 0));
-	const uint i3 = tex.Load(int4(ulTc.x, lrTc.y, atlasIndex, 0));
-	const uint i4 = tex.Load(int4(lrTc, atlasIndex, 0));
+	const int2 centerTc = int2(ps_in.tc);
+	const uint i1 = LoadNeighborIndexedColor(atlasIndex, ulTc, centerTc, textureSizeMask);
+	const uint i2 = LoadNeighborIndexedColor(atlasIndex, int2(lrTc.x, ulTc.y), centerTc, textureSizeMask);
+	const uint i3 = LoadNeighborIndexedColor(atlasIndex, int2(ulTc.x, lrTc.y), centerTc, textureSizeMask);
+	const uint i4 = LoadNeighborIndexedColor(atlasIndex, lrTc, centerTc, textureSizeMask);
 	const float4 c1 = palette.Load(int3(i1, paletteIndex, 0));
 	const float4 c2 = palette.Load(int3(i2, paletteIndex, 0));
 	const float4 c3 = palette.Load(int3(i3, paletteIndex, 0));
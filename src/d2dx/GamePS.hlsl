@@ -18,9 +18,7 @@
 */
 #include "Constants.hlsli"
 #include "Game.hlsli"
-
-Texture2DArray<uint> tex : register(t0);
-Texture1DArray palette : register(t1);
+#include "GameTextures.hlsli"
 
 void main(
 	in GamePSInput ps_in,
@@ -31,7 +29,7 @@ void main(
 	const uint surfaceId = ps_in.atlasIndex_paletteIndex_surfaceId_flags.z;
 	const uint paletteIndex = ps_in.atlasIndex_paletteIndex_surfaceId_flags.y;
 
-	const uint indexedColor = tex.Load(int4(ps_in.tc, atlasIndex, 0));
+	const uint indexedColor = LoadIndexedColor(atlasIndex, ps_in.tc);
 
 	if (chromaKeyEnabled && indexedColor == 0)
 		discard;
@@ -0,0 +1,62 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Must match D2DX_MAX_TEXTURE_ATLASES and D2DX_TEXTURE_ATLAS_SLICE_BITS in Types.h. */
+#define MAX_TEXTURE_ATLASES 8
+#define TEXTURE_ATLAS_SLICE_BITS 9
+
+/* The atlases of all texture caches, bound once per frame, so that batches from different
+   caches can be drawn together. Shader model 4 can only index resource arrays with literals,
+   hence the switch. */
+Texture2DArray<uint> atlases[MAX_TEXTURE_ATLASES] : register(t2);
+Texture1DArray palette : register(t1);
+
+uint LoadIndexedColor(
+	uint atlasIndex,
+	int2 tc)
+{
+	const int4 location = int4(tc, atlasIndex & ((1 << TEXTURE_ATLAS_SLICE_BITS) - 1), 0);
+
+	[forcecase]
+	switch (atlasIndex >> TEXTURE_ATLAS_SLICE_BITS)
+	{
+	default:
+	case 0: return atlases[0].Load(location);
+	case 1: return atlases[1].Load(location);
+	case 2: return atlases[2].Load(location);
+	case 3: return atlases[3].Load(location);
+	case 4: return atlases[4].Load(location);
+	case 5: return atlases[5].Load(location);
+	case 6: return atlases[6].Load(location);
+	case 7: return atlases[7].Load(location);
+	}
+}
+
+/* Textures may share an atlas slice, each aligned to its (power-of-two) size, so the texture that
+   contains the sampled texel centerTc is found by masking it. A texel tc of a filter footprint that
+   is outside of that texture reads as 0, as it would outside of an atlas slice, instead of bleeding
+   in the texture next to it. */
+uint LoadNeighborIndexedColor(
+	uint atlasIndex,
+	int2 tc,
+	int2 centerTc,
+	int2 textureSizeMask)
+{
+	return any((tc & ~textureSizeMask) != (centerTc & ~textureSizeMask)) ? 0 : LoadIndexedColor(atlasIndex, tc);
+}
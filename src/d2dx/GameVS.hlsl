@@ -19,16 +19,22 @@
 #include "Constants.hlsli"
 #include "Game.hlsli"
 
+/* The surface ID and texture size of each quad of the frame (see Batch::GetQuadAttributes). The
+   first quad of the draw comes in as per-instance data, since SV_VertexID doesn't include the base
+   vertex. */
+Buffer<uint> quadAttributes : register(t0);
+
 void main(
 	in GameVSInput vs_in,
 	out GameVSOutput vs_out)
 {
-	float2 unitPos = float2(vs_in.pos) * c_invScreenSize - 0.5;
+	float2 unitPos = vs_in.pos * c_positionScale * c_invScreenSize - 0.5;
 	vs_out.pos = unitPos.xyxx * float4(2, -2, 0, 0) + float4(0, 0, 0, 1);
 	vs_out.tc = vs_in.texCoord;
 	vs_out.color = vs_in.color;
 	vs_out.atlasIndex_paletteIndex_surfaceId_flags.x = vs_in.misc.x & 4095;
 	vs_out.atlasIndex_paletteIndex_surfaceId_flags.y = (vs_in.misc.x >> 12) | ((vs_in.misc.y & 0x8000) ? 0x10 : 0);
-	vs_out.atlasIndex_paletteIndex_surfaceId_flags.z = vs_in.misc.y & 16383;
-	vs_out.atlasIndex_paletteIndex_surfaceId_flags.w = (vs_in.misc.y & 0x4000) ? 1 : 0;
+	const uint attributes = quadAttributes[vs_in.firstQuad + vs_in.vertexId / 4];
+	vs_out.atlasIndex_paletteIndex_surfaceId_flags.z = attributes & 16383;
+	vs_out.atlasIndex_paletteIndex_surfaceId_flags.w = ((vs_in.misc.y & 0x4000) ? 1 : 0) | ((attributes >> 12) & 0xFF0);
 }
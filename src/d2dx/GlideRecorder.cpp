@@ -0,0 +1,448 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "GlideRecorder.h"
+#include "D2Types.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+GlideRecorder::GlideRecorder(
+	const char* filename)
+{
+	if (fopen_s(&_file, filename, "wb") != 0 || !_file)
+	{
+		D2DX_LOG("Failed to open %s for writing, Glide recording is disabled.", filename);
+		_file = nullptr;
+		return;
+	}
+
+	const GlideTrace::FileHeader fileHeader{ GlideTrace::FileMagic, GlideTrace::FileVersion, sizeof(D2::Vertex), 0 };
+	fwrite(&fileHeader, sizeof(fileHeader), 1, _file);
+
+	for (uint32_t i = 0; i < ChunkCount; ++i)
+	{
+		_chunks[i].data = Buffer<uint8_t>(ChunkCapacity);
+	}
+
+	_chunkSubmittedEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+	_chunkWrittenEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+
+	if (_chunkSubmittedEvent.IsValid() && _chunkWrittenEvent.IsValid())
+	{
+		_writerThread = CreateThread(nullptr, 0, WriterThreadProc, this, 0, nullptr);
+	}
+
+	if (!_writerThread)
+	{
+		D2DX_LOG("Failed to start the Glide trace writer, Glide recording is disabled.");
+		fclose(_file);
+		_file = nullptr;
+		return;
+	}
+
+	D2DX_LOG("Recording Glide calls to %s.", filename);
+}
+
+GlideRecorder::~GlideRecorder() noexcept
+{
+	assert(!_writerThread);
+}
+
+void GlideRecorder::Stop() noexcept
+{
+	if (!_writerThread)
+	{
+		return;
+	}
+
+	SubmitChunk();
+
+	_isStopping.store(true, memory_order_release);
+	SetEvent(_chunkSubmittedEvent.Get());
+	WaitForSingleObject(_writerThread, INFINITE);
+	CloseHandle(_writerThread);
+	_writerThread = nullptr;
+
+	fclose(_file);
+	_file = nullptr;
+
+	D2DX_LOG("Recorded %u frames of Glide calls (writer stalled %u times).", _frame, _stallCount);
+}
+
+_Use_decl_annotations_
+uint8_t* GlideRecorder::BeginRecord(
+	GlideTrace::Command command,
+	const void* args,
+	uint32_t argsSize,
+	uint32_t payloadSize)
+{
+	if (!_writerThread)
+	{
+		return nullptr;
+	}
+
+	const uint32_t unpaddedSize = (uint32_t)sizeof(GlideTrace::RecordHeader) + argsSize + payloadSize;
+	const uint32_t recordSize = (unpaddedSize + 3) & ~3U;
+
+	if (recordSize > ChunkCapacity)
+	{
+		if (!_hasLoggedOversizedRecord)
+		{
+			D2DX_LOG("Glide trace record of %u bytes exceeds the chunk size, dropping it.", recordSize);
+			_hasLoggedOversizedRecord = true;
+		}
+		return nullptr;
+	}
+
+	Chunk* chunk = &_chunks[_submittedChunkCount.load(memory_order_relaxed) % ChunkCount];
+
+	if ((chunk->size + recordSize) > ChunkCapacity)
+	{
+		SubmitChunk();
+		chunk = &_chunks[_submittedChunkCount.load(memory_order_relaxed) % ChunkCount];
+	}
+
+	uint8_t* record = chunk->data.items + chunk->size;
+
+	const GlideTrace::RecordHeader recordHeader{ command, (uint16_t)argsSize, payloadSize };
+	memcpy(record, &recordHeader, sizeof(recordHeader));
+
+	if (argsSize > 0)
+	{
+		memcpy(record + sizeof(recordHeader), args, argsSize);
+	}
+
+	if (recordSize > unpaddedSize)
+	{
+		memset(record + unpaddedSize, 0, recordSize - unpaddedSize);
+	}
+
+	chunk->size += recordSize;
+	++chunk->recordCount;
+
+	return record + sizeof(recordHeader) + argsSize;
+}
+
+void GlideRecorder::SubmitChunk()
+{
+	Chunk& chunk = _chunks[_submittedChunkCount.load(memory_order_relaxed) % ChunkCount];
+
+	if (chunk.recordCount == 0)
+	{
+		return;
+	}
+
+	chunk.frame = _frame;
+
+	const uint32_t submittedChunkCount = _submittedChunkCount.fetch_add(1, memory_order_release) + 1;
+	SetEvent(_chunkSubmittedEvent.Get());
+
+	/* Only block when the writer has fallen a whole ring behind. */
+	if ((submittedChunkCount - _writtenChunkCount.load(memory_order_acquire)) >= ChunkCount)
+	{
+		++_stallCount;
+
+		while ((submittedChunkCount - _writtenChunkCount.load(memory_order_acquire)) >= ChunkCount)
+		{
+			WaitForSingleObject(_chunkWrittenEvent.Get(), INFINITE);
+		}
+	}
+
+	Chunk& nextChunk = _chunks[submittedChunkCount % ChunkCount];
+	nextChunk.size = 0;
+	nextChunk.recordCount = 0;
+}
+
+void GlideRecorder::WriteChunks()
+{
+	uint32_t writtenChunkCount = _writtenChunkCount.load(memory_order_relaxed);
+
+	for (;;)
+	{
+		const bool isStopping = _isStopping.load(memory_order_acquire);
+
+		while (writtenChunkCount != _submittedChunkCount.load(memory_order_acquire))
+		{
+			const Chunk& chunk = _chunks[writtenChunkCount % ChunkCount];
+			const GlideTrace::ChunkHeader chunkHeader{ GlideTrace::ChunkMagic, chunk.size, chunk.recordCount, chunk.frame };
+			fwrite(&chunkHeader, sizeof(chunkHeader), 1, _file);
+			fwrite(chunk.data.items, 1, chunk.size, _file);
+
+			_writtenChunkCount.store(++writtenChunkCount, memory_order_release);
+			SetEvent(_chunkWrittenEvent.Get());
+		}
+
+		if (isStopping)
+		{
+			break;
+		}
+
+		WaitForSingleObject(_chunkSubmittedEvent.Get(), INFINITE);
+	}
+
+	fflush(_file);
+}
+
+_Use_decl_annotations_
+DWORD WINAPI GlideRecorder::WriterThreadProc(
+	LPVOID lpParameter)
+{
+	((GlideRecorder*)lpParameter)->WriteChunks();
+	return 0;
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnSstWinOpen(
+	uint32_t hWnd,
+	int32_t width,
+	int32_t height)
+{
+	BeginRecord(GlideTrace::Command::SstWinOpen, GlideTrace::SstWinOpenArgs{ hWnd, width, height }, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnVertexLayout(
+	uint32_t param,
+	int32_t offset)
+{
+	BeginRecord(GlideTrace::Command::VertexLayout, GlideTrace::VertexLayoutArgs{ param, offset }, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnTexDownload(
+	uint32_t tmu,
+	const uint8_t* sourceAddress,
+	uint32_t startAddress,
+	int32_t width,
+	int32_t height)
+{
+	const uint32_t payloadSize = (uint32_t)(width * height);
+	auto payload = BeginRecord(GlideTrace::Command::TexDownload, GlideTrace::TexDownloadArgs{ tmu, startAddress, width, height }, payloadSize);
+
+	if (payload)
+	{
+		memcpy(payload, sourceAddress, payloadSize);
+	}
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnTexSource(
+	uint32_t tmu,
+	uint32_t startAddress,
+	int32_t width,
+	int32_t height,
+	uint32_t largeLog2,
+	uint32_t ratioLog2)
+{
+	BeginRecord(GlideTrace::Command::TexSource, GlideTrace::TexSourceArgs{ tmu, startAddress, width, height, largeLog2, ratioLog2 }, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnConstantColorValue(
+	uint32_t color)
+{
+	BeginRecord(GlideTrace::Command::ConstantColorValue, GlideTrace::ConstantColorValueArgs{ color }, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnAlphaBlendFunction(
+	GrAlphaBlendFnc_t rgb_sf,
+	GrAlphaBlendFnc_t rgb_df,
+	GrAlphaBlendFnc_t alpha_sf,
+	GrAlphaBlendFnc_t alpha_df)
+{
+	BeginRecord(GlideTrace::Command::AlphaBlendFunction, GlideTrace::AlphaBlendFunctionArgs{ rgb_sf, rgb_df, alpha_sf, alpha_df }, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnColorCombine(
+	GrCombineFunction_t function,
+	GrCombineFactor_t factor,
+	GrCombineLocal_t local,
+	GrCombineOther_t other,
+	bool invert)
+{
+	BeginRecord(GlideTrace::Command::ColorCombine, GlideTrace::CombineArgs{ function, factor, local, other, invert ? 1U : 0U }, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnAlphaCombine(
+	GrCombineFunction_t function,
+	GrCombineFactor_t factor,
+	GrCombineLocal_t local,
+	GrCombineOther_t other,
+	bool invert)
+{
+	BeginRecord(GlideTrace::Command::AlphaCombine, GlideTrace::CombineArgs{ function, factor, local, other, invert ? 1U : 0U }, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnDrawPoint(
+	const void* pt,
+	uint32_t gameContext)
+{
+	auto payload = BeginRecord(GlideTrace::Command::DrawPoint, GlideTrace::DrawPrimitiveArgs{ gameContext }, sizeof(D2::Vertex));
+
+	if (payload)
+	{
+		memcpy(payload, pt, sizeof(D2::Vertex));
+	}
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnDrawLine(
+	const void* v1,
+	const void* v2,
+	uint32_t gameContext)
+{
+	auto payload = BeginRecord(GlideTrace::Command::DrawLine, GlideTrace::DrawPrimitiveArgs{ gameContext }, 2 * sizeof(D2::Vertex));
+
+	if (payload)
+	{
+		memcpy(payload, v1, sizeof(D2::Vertex));
+		memcpy(payload + sizeof(D2::Vertex), v2, sizeof(D2::Vertex));
+	}
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnDrawVertexArray(
+	uint32_t mode,
+	uint32_t count,
+	const uint8_t* const* pointers,
+	uint32_t gameContext)
+{
+	auto payload = BeginRecord(GlideTrace::Command::DrawVertexArray, GlideTrace::DrawVertexArrayArgs{ mode, count, gameContext }, count * sizeof(D2::Vertex));
+
+	if (payload)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			memcpy(payload, pointers[i], sizeof(D2::Vertex));
+			payload += sizeof(D2::Vertex);
+		}
+	}
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnDrawVertexArrayContiguous(
+	uint32_t mode,
+	uint32_t count,
+	const uint8_t* vertex,
+	uint32_t stride,
+	uint32_t gameContext)
+{
+	const uint32_t payloadSize = count * stride;
+	auto payload = BeginRecord(GlideTrace::Command::DrawVertexArrayContiguous, GlideTrace::DrawVertexArrayContiguousArgs{ mode, count, stride, gameContext }, payloadSize);
+
+	if (payload)
+	{
+		memcpy(payload, vertex, payloadSize);
+	}
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnTexDownloadTable(
+	GrTexTable_t type,
+	const void* data)
+{
+	auto payload = BeginRecord(GlideTrace::Command::TexDownloadTable, GlideTrace::TexDownloadTableArgs{ (uint32_t)type }, 256 * 4);
+
+	if (payload)
+	{
+		memcpy(payload, data, 256 * 4);
+	}
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnLoadGammaTable(
+	uint32_t nentries,
+	const uint32_t* red,
+	const uint32_t* green,
+	const uint32_t* blue)
+{
+	const uint32_t tableSize = nentries * sizeof(uint32_t);
+	auto payload = BeginRecord(GlideTrace::Command::LoadGammaTable, GlideTrace::LoadGammaTableArgs{ nentries }, 3 * tableSize);
+
+	if (payload)
+	{
+		memcpy(payload, red, tableSize);
+		memcpy(payload + tableSize, green, tableSize);
+		memcpy(payload + 2 * tableSize, blue, tableSize);
+	}
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnChromakeyMode(
+	GrChromakeyMode_t mode)
+{
+	BeginRecord(GlideTrace::Command::ChromakeyMode, GlideTrace::ChromakeyModeArgs{ (uint32_t)mode }, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnLfbUnlock(
+	const uint32_t* lfbPtr,
+	uint32_t strideInBytes)
+{
+	const uint32_t payloadSize = strideInBytes * 480;
+	auto payload = BeginRecord(GlideTrace::Command::LfbUnlock, GlideTrace::LfbUnlockArgs{ strideInBytes }, payloadSize);
+
+	if (payload)
+	{
+		memcpy(payload, lfbPtr, payloadSize);
+	}
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnGammaCorrectionRGB(
+	float red,
+	float green,
+	float blue)
+{
+	BeginRecord(GlideTrace::Command::GammaCorrectionRGB, GlideTrace::GammaCorrectionRGBArgs{ red, green, blue }, 0);
+}
+
+void GlideRecorder::OnBufferSwap()
+{
+	if (!_writerThread)
+	{
+		return;
+	}
+
+	BeginRecord(GlideTrace::Command::BufferSwap, nullptr, 0, 0);
+
+	/* Hand over each frame as it completes, so that the writer keeps up and a crash loses little. */
+	SubmitChunk();
+	++_frame;
+}
+
+void GlideRecorder::OnBufferClear()
+{
+	BeginRecord(GlideTrace::Command::BufferClear, nullptr, 0, 0);
+}
+
+_Use_decl_annotations_
+void GlideRecorder::OnTexFilterMode(
+	GrChipID_t tmu,
+	GrTextureFilterMode_t filterMode)
+{
+	BeginRecord(GlideTrace::Command::TexFilterMode, GlideTrace::TexFilterModeArgs{ (uint32_t)tmu, (uint32_t)filterMode }, 0);
+}
@@ -0,0 +1,193 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "GlideTrace.h"
+
+namespace d2dx
+{
+	/*
+		Records the Glide call stream (calls, arguments and referenced vertex/texel/palette data)
+		into a chunked binary trace, see GlideTrace.h. Recording happens on the game thread and
+		only appends to a ring of chunks; full chunks are written to disk by a background thread.
+	*/
+	class GlideRecorder final
+	{
+	public:
+		GlideRecorder(
+			_In_z_ const char* filename);
+
+		~GlideRecorder() noexcept;
+
+		/* Writes out the last chunk and waits for the writer thread to finish. Must be called before
+		   destruction, and not from DllMain, where waiting for a thread can deadlock on the loader lock. */
+		void Stop() noexcept;
+
+		bool IsRecording() const noexcept
+		{
+			return _writerThread != nullptr;
+		}
+
+		void OnSstWinOpen(
+			_In_ uint32_t hWnd,
+			_In_ int32_t width,
+			_In_ int32_t height);
+
+		void OnVertexLayout(
+			_In_ uint32_t param,
+			_In_ int32_t offset);
+
+		void OnTexDownload(
+			_In_ uint32_t tmu,
+			_In_reads_(width * height) const uint8_t* sourceAddress,
+			_In_ uint32_t startAddress,
+			_In_ int32_t width,
+			_In_ int32_t height);
+
+		void OnTexSource(
+			_In_ uint32_t tmu,
+			_In_ uint32_t startAddress,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_ uint32_t largeLog2,
+			_In_ uint32_t ratioLog2);
+
+		void OnConstantColorValue(
+			_In_ uint32_t color);
+
+		void OnAlphaBlendFunction(
+			_In_ GrAlphaBlendFnc_t rgb_sf,
+			_In_ GrAlphaBlendFnc_t rgb_df,
+			_In_ GrAlphaBlendFnc_t alpha_sf,
+			_In_ GrAlphaBlendFnc_t alpha_df);
+
+		void OnColorCombine(
+			_In_ GrCombineFunction_t function,
+			_In_ GrCombineFactor_t factor,
+			_In_ GrCombineLocal_t local,
+			_In_ GrCombineOther_t other,
+			_In_ bool invert);
+
+		void OnAlphaCombine(
+			_In_ GrCombineFunction_t function,
+			_In_ GrCombineFactor_t factor,
+			_In_ GrCombineLocal_t local,
+			_In_ GrCombineOther_t other,
+			_In_ bool invert);
+
+		void OnDrawPoint(
+			_In_ const void* pt,
+			_In_ uint32_t gameContext);
+
+		void OnDrawLine(
+			_In_ const void* v1,
+			_In_ const void* v2,
+			_In_ uint32_t gameContext);
+
+		void OnDrawVertexArray(
+			_In_ uint32_t mode,
+			_In_ uint32_t count,
+			_In_reads_(count) const uint8_t* const* pointers,
+			_In_ uint32_t gameContext);
+
+		void OnDrawVertexArrayContiguous(
+			_In_ uint32_t mode,
+			_In_ uint32_t count,
+			_In_reads_(count * stride) const uint8_t* vertex,
+			_In_ uint32_t stride,
+			_In_ uint32_t gameContext);
+
+		void OnTexDownloadTable(
+			_In_ GrTexTable_t type,
+			_In_reads_bytes_(256 * 4) const void* data);
+
+		void OnLoadGammaTable(
+			_In_ uint32_t nentries,
+			_In_reads_(nentries) const uint32_t* red,
+			_In_reads_(nentries) const uint32_t* green,
+			_In_reads_(nentries) const uint32_t* blue);
+
+		void OnChromakeyMode(
+			_In_ GrChromakeyMode_t mode);
+
+		void OnLfbUnlock(
+			_In_reads_bytes_(strideInBytes * 480) const uint32_t* lfbPtr,
+			_In_ uint32_t strideInBytes);
+
+		void OnGammaCorrectionRGB(
+			_In_ float red,
+			_In_ float green,
+			_In_ float blue);
+
+		void OnBufferSwap();
+
+		void OnBufferClear();
+
+		void OnTexFilterMode(
+			_In_ GrChipID_t tmu,
+			_In_ GrTextureFilterMode_t filterMode);
+
+	private:
+		static constexpr uint32_t ChunkCount = 8;
+		static constexpr uint32_t ChunkCapacity = 4 * 1024 * 1024;
+
+		struct Chunk final
+		{
+			Buffer<uint8_t> data;
+			uint32_t size = 0;
+			uint32_t recordCount = 0;
+			uint32_t frame = 0;
+		};
+
+		template<typename TArgs>
+		_Ret_maybenull_ uint8_t* BeginRecord(
+			_In_ GlideTrace::Command command,
+			_In_ const TArgs& args,
+			_In_ uint32_t payloadSize)
+		{
+			return BeginRecord(command, &args, sizeof(TArgs), payloadSize);
+		}
+
+		_Ret_maybenull_ uint8_t* BeginRecord(
+			_In_ GlideTrace::Command command,
+			_In_reads_bytes_opt_(argsSize) const void* args,
+			_In_ uint32_t argsSize,
+			_In_ uint32_t payloadSize);
+
+		void SubmitChunk();
+
+		void WriteChunks();
+
+		static DWORD WINAPI WriterThreadProc(
+			_In_ LPVOID lpParameter);
+
+		FILE* _file = nullptr;
+		HANDLE _writerThread = nullptr;
+		EventHandle _chunkSubmittedEvent;
+		EventHandle _chunkWrittenEvent;
+		std::atomic<uint32_t> _submittedChunkCount = { 0 };
+		std::atomic<uint32_t> _writtenChunkCount = { 0 };
+		std::atomic<bool> _isStopping = { false };
+		uint32_t _frame = 0;
+		uint32_t _stallCount = 0;
+		bool _hasLoggedOversizedRecord = false;
+		Chunk _chunks[ChunkCount];
+	};
+}
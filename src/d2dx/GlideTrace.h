@@ -0,0 +1,203 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+namespace d2dx
+{
+	/*
+		Binary format of the Glide call-stream traces written by GlideRecorder.
+
+		A trace file starts with a FileHeader, followed by any number of chunks. Each chunk is a
+		ChunkHeader followed by chunk.size bytes of records. A record is a RecordHeader, the
+		command's fixed-size arguments and a variable-size payload (vertices, texels, palette...),
+		padded to a multiple of 4 bytes. Records never straddle chunk boundaries.
+	*/
+	namespace GlideTrace
+	{
+		static constexpr uint32_t FileMagic = 0x54584432; /* "2DXT" */
+		static constexpr uint32_t FileVersion = 1;
+		static constexpr uint32_t ChunkMagic = 0x4B484332; /* "2CHK" */
+
+		enum class Command : uint16_t
+		{
+			SstWinOpen = 0,
+			VertexLayout = 1,
+			TexDownload = 2,
+			TexSource = 3,
+			ConstantColorValue = 4,
+			AlphaBlendFunction = 5,
+			ColorCombine = 6,
+			AlphaCombine = 7,
+			DrawPoint = 8,
+			DrawLine = 9,
+			DrawVertexArray = 10,
+			DrawVertexArrayContiguous = 11,
+			TexDownloadTable = 12,
+			LoadGammaTable = 13,
+			ChromakeyMode = 14,
+			LfbUnlock = 15,
+			GammaCorrectionRGB = 16,
+			BufferSwap = 17,
+			BufferClear = 18,
+			TexFilterMode = 19,
+			Count = 20
+		};
+
+		struct FileHeader final
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vertexSize;
+			uint32_t reserved;
+		};
+
+		struct ChunkHeader final
+		{
+			uint32_t magic;
+			uint32_t size;
+			uint32_t recordCount;
+			uint32_t frame;
+		};
+
+		struct RecordHeader final
+		{
+			Command command;
+			uint16_t argsSize;
+			uint32_t payloadSize;
+		};
+
+		struct SstWinOpenArgs final
+		{
+			uint32_t hWnd;
+			int32_t width;
+			int32_t height;
+		};
+
+		struct VertexLayoutArgs final
+		{
+			uint32_t param;
+			int32_t offset;
+		};
+
+		/* Payload: width * height texels. */
+		struct TexDownloadArgs final
+		{
+			uint32_t tmu;
+			uint32_t startAddress;
+			int32_t width;
+			int32_t height;
+		};
+
+		struct TexSourceArgs final
+		{
+			uint32_t tmu;
+			uint32_t startAddress;
+			int32_t width;
+			int32_t height;
+			uint32_t largeLog2;
+			uint32_t ratioLog2;
+		};
+
+		struct ConstantColorValueArgs final
+		{
+			uint32_t color;
+		};
+
+		struct AlphaBlendFunctionArgs final
+		{
+			int32_t rgb_sf;
+			int32_t rgb_df;
+			int32_t alpha_sf;
+			int32_t alpha_df;
+		};
+
+		/* Used for both ColorCombine and AlphaCombine. */
+		struct CombineArgs final
+		{
+			int32_t function;
+			int32_t factor;
+			int32_t local;
+			int32_t other;
+			uint32_t invert;
+		};
+
+		/* Payload: one D2::Vertex (DrawPoint) or two (DrawLine). */
+		struct DrawPrimitiveArgs final
+		{
+			uint32_t gameContext;
+		};
+
+		/* Payload: count D2::Vertex, gathered from the game's pointer array. */
+		struct DrawVertexArrayArgs final
+		{
+			uint32_t mode;
+			uint32_t count;
+			uint32_t gameContext;
+		};
+
+		/* Payload: count * stride bytes of vertex data. */
+		struct DrawVertexArrayContiguousArgs final
+		{
+			uint32_t mode;
+			uint32_t count;
+			uint32_t stride;
+			uint32_t gameContext;
+		};
+
+		/* Payload: 256 palette entries. */
+		struct TexDownloadTableArgs final
+		{
+			uint32_t type;
+		};
+
+		/* Payload: nentries red, then green, then blue values. */
+		struct LoadGammaTableArgs final
+		{
+			uint32_t nentries;
+		};
+
+		struct ChromakeyModeArgs final
+		{
+			uint32_t mode;
+		};
+
+		/* Payload: strideInBytes * 480 bytes of frame buffer. */
+		struct LfbUnlockArgs final
+		{
+			uint32_t strideInBytes;
+		};
+
+		struct GammaCorrectionRGBArgs final
+		{
+			float red;
+			float green;
+			float blue;
+		};
+
+		struct TexFilterModeArgs final
+		{
+			uint32_t tmu;
+			uint32_t filterMode;
+		};
+
+		static_assert(sizeof(FileHeader) == 16, "sizeof(FileHeader)");
+		static_assert(sizeof(ChunkHeader) == 16, "sizeof(ChunkHeader)");
+		static_assert(sizeof(RecordHeader) == 8, "sizeof(RecordHeader)");
+	}
+}
@@ -21,6 +21,7 @@
 #include "IGlide3x.h"
 #include "IWin32InterceptionHandler.h"
 #include "ID2InterceptionHandler.h"
+#include "LiveMetrics.h"
 #include "Options.h"
 
 namespace d2dx
@@ -41,10 +42,21 @@ namespace d2dx
 
 		virtual void DisableBuiltinResMod() = 0;
 
+		virtual void DisableRenderThread() = 0;
+
+		/* Toggles fullscreen at the next buffer swap. May be called from the window procedure. */
+		virtual void ToggleFullscreen() = 0;
+
+		/* Appends the statistics of each texture cache to d2dx_texturecache_stats.csv. */
+		virtual void DumpTextureCacheStatistics() = 0;
+
 		virtual const Options& GetOptions() const = 0;
 
 		virtual uint32_t GetActiveThreadId() const noexcept = 0;
 
 		virtual bool InGame() const noexcept = 0;
+
+		/* Null unless live metrics are enabled. */
+		virtual LiveMetrics* GetLiveMetrics() noexcept = 0;
 	};
 }
@@ -41,10 +41,17 @@ namespace d2dx
 			_In_reads_(vertexCount) const Vertex* vertices,
 			_In_ uint32_t vertexCount) = 0;
 
-		virtual TextureCacheLocation UpdateTexture(
+		/* Writes the surface ID and texture size (Batch::GetQuadAttributes) of every quad of the
+		   batches, which must be the ones whose vertices were just written. The quads are indexed by
+		   vertex / 4 relative to the written vertices. */
+		virtual void BulkWriteSurfaceIds(
+			_In_reads_(batchCount) const Batch* batches,
+			_In_ uint32_t batchCount) = 0;
+
+		virtual void UploadTexture(
 			_In_ const Batch& batch,
-			_In_reads_(tmuDataSize) const uint8_t* tmuData,
-			_In_ uint32_t tmuDataSize) = 0;
+			_In_ TextureCacheLocation location,
+			_In_reads_(batch.GetTextureWidth() * batch.GetTextureHeight()) const uint8_t* data) = 0;
 
 		virtual void Draw(
 			_In_ const Batch& batch,
@@ -52,6 +59,15 @@ namespace d2dx
 
 		virtual void Present() = 0;
 
+		/* Presents the previously presented frame again, without drawing or post-processing it.
+		   Returns false if that frame can't be shown again, e.g. after a resize or gamma change. */
+		virtual bool RepeatPresent() = 0;
+
+		/* Starts a new frame in the texture caches. Called on the game thread, which owns the texture
+		   cache bookkeeping (lookups, insertions and evictions) while the render thread is executing
+		   the previous frame; the render thread only uploads texels to the locations it is given. */
+		virtual void OnNewFrame() = 0;
+
 		virtual void WriteToScreen(
 			_In_reads_(width * height) const uint32_t* pixels,
 			_In_ int32_t width,
@@ -67,6 +83,14 @@ namespace d2dx
 		virtual ITextureCache* GetTextureCache(
 			_In_ const Batch& batch) const = 0;
 
+		virtual ITextureCache* GetTextureCache(
+			_In_ TextureCacheSizeClass sizeClass) const = 0;
+
+		/* Recreates the texture caches whose capacity changed, which empties them. Must be preceded
+		   by a Flush of the render thread. */
+		virtual void SetTextureCacheCapacities(
+			_In_reads_((int32_t)TextureCacheSizeClass::Count) const uint32_t* capacities) = 0;
+
 		virtual void SetSizes(
 			_In_ Size gameSize,
 			_In_ Size windowSize,
@@ -22,6 +22,13 @@
 
 namespace d2dx
 {
+	class Vertex;
+
+	namespace D2
+	{
+		struct Vertex;
+	}
+
 	struct ISimd abstract
 	{
 		virtual ~ISimd() noexcept {}
@@ -35,5 +42,19 @@ namespace d2dx
 			_In_reads_(itemsCount) const uint64_t* __restrict items,
 			_In_ uint32_t itemsCount,
 			_In_ uint64_t item) = 0;
+
+		/* Converts the game's vertices for a GR_TRIANGLE_STRIP or GR_TRIANGLE_FAN into a quad list
+		   (see QuadListWriter) and returns the number of vertices written, 4 * ((count - 1) / 2).
+		   Each vertex is templateVertex with the position, the texcoords shifted right by stShift
+		   and the color (maskedConstantColor | (color & iteratedColorMask)). */
+		virtual uint32_t ExpandVertexArray(
+			_In_ uint32_t mode,
+			_In_ uint32_t count,
+			_In_reads_(count) const D2::Vertex* const* d2Vertices,
+			_In_ const Vertex& templateVertex,
+			_In_ uint32_t maskedConstantColor,
+			_In_ uint32_t iteratedColorMask,
+			_In_ int32_t stShift,
+			_Out_writes_(4 * ((count - 1) / 2)) Vertex* __restrict vertices) = 0;
 	};
 }
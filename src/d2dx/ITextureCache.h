@@ -27,11 +27,33 @@ namespace d2dx
 
 	struct TextureCacheLocation final
 	{
-		int16_t _textureAtlas;
+		int16_t _textureAtlas;	/* Index into the table of atlases bound to the game pixel shaders. */
 		int16_t _textureIndex;
+		int16_t _originS;	/* Of the texture within the atlas slice, when slices are shared. */
+		int16_t _originT;
 	};
 
-	static_assert(sizeof(TextureCacheLocation) == 4, "sizeof(TextureCacheLocation) == 4");
+	static_assert(sizeof(TextureCacheLocation) == 8, "sizeof(TextureCacheLocation) == 8");
+
+	/* Counters are totals since the cache was created, which happens again when it is resized. */
+	struct TextureCacheStatistics final
+	{
+		uint64_t lookupCount;
+		uint64_t lastIndexHitCount;	/* Lookups that found the texture in the slot given as lastIndex. */
+		uint64_t scanHitCount;		/* Lookups that found the texture elsewhere. */
+		uint64_t missCount;
+		uint64_t insertCount;
+		uint64_t evictionCount;
+		uint64_t pinnedEvictionCount;
+		uint64_t uploadedBytes;
+		uint32_t frameCount;
+		uint32_t workingSetSize;	/* Of the last complete frame. */
+		uint32_t peakWorkingSetSize;
+		uint32_t usedCount;
+		uint32_t capacity;
+		uint32_t pinnedUsedCount;
+		uint32_t pinnedCapacity;
+	};
 
 	struct ITextureCache abstract
 	{
@@ -39,15 +61,36 @@ namespace d2dx
 
 		virtual void OnNewFrame() = 0;
 
+		/* Textures of UI batches are looked up in, and inserted into, the pinned partition of the
+		   cache, where other textures can never evict them. */
 		virtual TextureCacheLocation FindTexture(
 			_In_ uint64_t contentKey,
+			_In_ const Batch& batch,
 			_In_ int32_t lastIndex) = 0;
 
+		/* Returns whether the texture is cached in either partition. Unlike FindTexture, this neither
+		   counts as a use of the texture nor as a lookup in the statistics. */
+		virtual bool Contains(
+			_In_ uint64_t contentKey) const = 0;
+
 		virtual TextureCacheLocation InsertTexture(
 			_In_ uint64_t contentKey,
-			_In_ const Batch& batch,
-			_In_reads_(tmuDataSize) const uint8_t* tmuData,
-			_In_ uint32_t tmuDataSize) = 0;
+			_In_ const Batch& batch) = 0;
+
+		/* Inserts a texture that the game hasn't asked for yet into a free slot of the unpinned
+		   partition, and returns a location with a negative atlas index if there is none, so that
+		   preloading never evicts a texture. Unlike InsertTexture, this doesn't count as a use of the
+		   texture: it adds neither to the working set nor to the inserts and uploaded bytes of the
+		   statistics. */
+		virtual TextureCacheLocation PreloadTexture(
+			_In_ uint64_t contentKey,
+			_In_ const Batch& batch) = 0;
+
+		virtual void UploadTexture(
+			_In_ TextureCacheLocation location,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_reads_(width * height) const uint8_t* data) = 0;
 
 		virtual ID3D11ShaderResourceView* GetSrv(
 			_In_ uint32_t atlasIndex) const = 0;
@@ -55,5 +98,22 @@ namespace d2dx
 		virtual uint32_t GetMemoryFootprint() const = 0;
 
 		virtual uint32_t GetUsedCount() const = 0;
+
+		virtual uint32_t GetCapacity() const = 0;
+
+		/* The number of different textures found or inserted since the last OnNewFrame. */
+		virtual uint32_t GetWorkingSetSize() const = 0;
+
+		/* The number of textures evicted since the last OnNewFrame. */
+		virtual uint32_t GetEvictionCount() const = 0;
+
+		/* The part of the capacity, used count and eviction count that is due to the pinned partition. */
+		virtual uint32_t GetPinnedCapacity() const = 0;
+
+		virtual uint32_t GetPinnedUsedCount() const = 0;
+
+		virtual uint32_t GetPinnedEvictionCount() const = 0;
+
+		virtual TextureCacheStatistics GetStatistics() const = 0;
 	};
 }
@@ -0,0 +1,54 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Types.h"
+
+namespace d2dx
+{
+	/*
+		Decides which texture atlas slot holds which content key, and which slot to replace when a
+		new texture is inserted into a full cache. Slots used in the current frame may still be
+		referenced by pending draw calls, so policies must not replace them unless every slot has
+		been used in the frame.
+	*/
+	struct ITextureCachePolicy abstract
+	{
+		virtual ~ITextureCachePolicy() noexcept {}
+
+		/* Returns the slot holding the content key, or -1 if not cached. lastIndex is the slot the
+		   key was found in before (or -1), and is checked first. */
+		virtual int32_t Find(
+			_In_ uint64_t contentKey,
+			_In_ int32_t lastIndex) = 0;
+
+		/* Returns whether the content key is cached, without counting as a use of it. */
+		virtual bool Contains(
+			_In_ uint64_t contentKey) const = 0;
+
+		/* Picks a slot for a content key that is not cached, replacing another key if needed. */
+		virtual int32_t Insert(
+			_In_ uint64_t contentKey,
+			_Out_ bool& evicted) = 0;
+
+		virtual void OnNewFrame() = 0;
+
+		virtual uint32_t GetUsedCount() const = 0;
+	};
+}
@@ -0,0 +1,118 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "LatencyHistogram.h"
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+void LatencyHistogram::Record(
+	uint32_t value) noexcept
+{
+	++_counts[GetBucketIndex(value)];
+	++_count;
+	_max = max(_max, value);
+}
+
+_Use_decl_annotations_
+void LatencyHistogram::Add(
+	const LatencyHistogram& other) noexcept
+{
+	for (uint32_t i = 0; i < BucketCount; ++i)
+	{
+		_counts[i] += other._counts[i];
+	}
+
+	_count += other._count;
+	_max = max(_max, other._max);
+}
+
+void LatencyHistogram::Reset() noexcept
+{
+	memset(_counts, 0, sizeof(_counts));
+	_count = 0;
+	_max = 0;
+}
+
+uint32_t LatencyHistogram::GetCount() const noexcept
+{
+	return _count;
+}
+
+uint32_t LatencyHistogram::GetMax() const noexcept
+{
+	return _max;
+}
+
+_Use_decl_annotations_
+uint32_t LatencyHistogram::GetPercentile(
+	double percentile) const noexcept
+{
+	if (_count == 0)
+	{
+		return 0;
+	}
+
+	const uint64_t rank = max((uint64_t)1, (uint64_t)ceil(percentile / 100.0 * _count));
+	uint64_t cumulativeCount = 0;
+
+	for (uint32_t i = 0; i < BucketCount; ++i)
+	{
+		cumulativeCount += _counts[i];
+
+		if (cumulativeCount >= rank)
+		{
+			return min(GetBucketHighestValue(i), _max);
+		}
+	}
+
+	return _max;
+}
+
+_Use_decl_annotations_
+uint32_t LatencyHistogram::GetBucketIndex(
+	uint32_t value) noexcept
+{
+	if (value < 2 * SubBucketCount)
+	{
+		return value;
+	}
+
+	DWORD msb;
+	BitScanReverse(&msb, value);
+
+	const uint32_t shift = msb - SubBucketBits;
+	return (shift + 1) * SubBucketCount + (value >> shift) - SubBucketCount;
+}
+
+_Use_decl_annotations_
+uint32_t LatencyHistogram::GetBucketHighestValue(
+	uint32_t bucketIndex) noexcept
+{
+	assert(bucketIndex < BucketCount);
+
+	if (bucketIndex < 2 * SubBucketCount)
+	{
+		return bucketIndex;
+	}
+
+	const uint32_t shift = bucketIndex / SubBucketCount - 1;
+	const uint32_t lowestValue = (bucketIndex % SubBucketCount + SubBucketCount) << shift;
+	return lowestValue + ((1U << shift) - 1);
+}
@@ -0,0 +1,63 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+namespace d2dx
+{
+	/*
+		Histogram of durations in microseconds with a fixed size, for reporting percentiles. Values
+		below 2 * SubBucketCount are counted exactly. Above that, each power of two is split into
+		SubBucketCount buckets of equal width, which bounds the relative error by 1 / SubBucketCount.
+	*/
+	class LatencyHistogram final
+	{
+	public:
+		static constexpr uint32_t SubBucketBits = 5;
+		static constexpr uint32_t SubBucketCount = 1 << SubBucketBits;
+		static constexpr uint32_t BucketCount = (32 - SubBucketBits + 1) * SubBucketCount;
+
+		void Record(
+			_In_ uint32_t value) noexcept;
+
+		void Add(
+			_In_ const LatencyHistogram& other) noexcept;
+
+		void Reset() noexcept;
+
+		uint32_t GetCount() const noexcept;
+
+		uint32_t GetMax() const noexcept;
+
+		/* Returns the smallest value that at least percentile % of the recorded values are less than
+		   or equal to, rounded up to the end of its bucket. Zero if nothing has been recorded. */
+		uint32_t GetPercentile(
+			_In_ double percentile) const noexcept;
+
+		static uint32_t GetBucketIndex(
+			_In_ uint32_t value) noexcept;
+
+		static uint32_t GetBucketHighestValue(
+			_In_ uint32_t bucketIndex) noexcept;
+
+	private:
+		uint32_t _counts[BucketCount] = { 0 };
+		uint32_t _count = 0;
+		uint32_t _max = 0;
+	};
+}
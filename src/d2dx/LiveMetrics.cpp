@@ -0,0 +1,97 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "LiveMetrics.h"
+#include "Utils.h"
+
+using namespace d2dx;
+
+LiveMetrics::LiveMetrics()
+{
+	char name[64];
+	GetPageName(GetCurrentProcessId(), name, sizeof(name));
+
+	_fileMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(LiveMetricsPage), name);
+
+	if (!_fileMapping)
+	{
+		D2DX_LOG("Failed to create the live metrics page %s (error %u).", name, GetLastError());
+		return;
+	}
+
+	_page = (LiveMetricsPage*)MapViewOfFile(_fileMapping, FILE_MAP_WRITE, 0, 0, sizeof(LiveMetricsPage));
+
+	if (!_page)
+	{
+		D2DX_LOG("Failed to map the live metrics page %s (error %u).", name, GetLastError());
+		CloseHandle(_fileMapping);
+		_fileMapping = nullptr;
+		return;
+	}
+
+	/* The page starts out zeroed, so only the header needs to be written. The magic goes last, so
+	   that readers never see a valid magic with the rest of the header missing. */
+	_page->version = LiveMetricsVersion;
+	_page->processId = GetCurrentProcessId();
+	_page->size = sizeof(LiveMetricsPage);
+	std::atomic_thread_fence(std::memory_order_release);
+	_page->magic = LiveMetricsMagic;
+
+	D2DX_LOG("Publishing live metrics in %s.", name);
+}
+
+LiveMetrics::~LiveMetrics() noexcept
+{
+	if (_page)
+	{
+		UnmapViewOfFile(_page);
+	}
+
+	if (_fileMapping)
+	{
+		CloseHandle(_fileMapping);
+	}
+}
+
+bool LiveMetrics::IsValid() const noexcept
+{
+	return _page != nullptr;
+}
+
+LiveMetricsGameFrame* LiveMetrics::BeginGameFrameUpdate() noexcept
+{
+	assert(_page);
+	return _page->game.BeginWrite();
+}
+
+void LiveMetrics::EndGameFrameUpdate() noexcept
+{
+	_page->game.EndWrite();
+}
+
+LiveMetricsRenderFrame* LiveMetrics::BeginRenderFrameUpdate() noexcept
+{
+	assert(_page);
+	return _page->render.BeginWrite();
+}
+
+void LiveMetrics::EndRenderFrameUpdate() noexcept
+{
+	_page->render.EndWrite();
+}
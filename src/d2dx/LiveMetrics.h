@@ -0,0 +1,128 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+namespace d2dx
+{
+	/*
+		Layout of the shared memory page that D2DX updates every frame when live metrics are
+		enabled, for monitoring tools such as d2dxmon. The page is named "Local\d2dx_metrics_<pid>".
+		It only holds fixed-size types, and Version must be bumped whenever the layout changes.
+
+		The game thread and the render thread each own one section. A section is guarded by a
+		sequence lock: the writer makes the sequence odd while it updates the section and even
+		again when done, and readers retry if the sequence was odd or changed while they copied.
+	*/
+	static constexpr uint32_t LiveMetricsMagic = 0x4D584432; /* "2DXM" */
+	static constexpr uint32_t LiveMetricsVersion = 1;
+	static constexpr uint32_t LiveMetricsTextureCacheCount = 7;
+
+	/* Written by the game thread at the end of each frame. Counts are per frame unless noted. */
+	struct LiveMetricsGameFrame final
+	{
+		uint32_t frame;
+		uint32_t majorGameState;
+		uint32_t batchCount;
+		uint32_t vertexCount;
+		uint32_t paletteCount;
+		uint32_t textureHashMissCount;					/* Since startup. */
+		uint64_t textureHashMissBytes;					/* Since startup. */
+		uint32_t textureCacheCapacities[LiveMetricsTextureCacheCount];
+		uint32_t textureCacheUsedCounts[LiveMetricsTextureCacheCount];
+		uint32_t textureCacheEvictionCounts[LiveMetricsTextureCacheCount];	/* Since startup. */
+	};
+
+	/* Written by the render thread after each present. */
+	struct LiveMetricsRenderFrame final
+	{
+		uint32_t presentCount;							/* Since startup. */
+		uint32_t drawCallCount;
+		uint32_t drawnVertexCount;
+		float frameTimeMs;
+		float presentTimeMs;
+	};
+
+	template<typename T>
+	struct alignas(64) LiveMetricsSection final
+	{
+		std::atomic<uint32_t> sequence;
+		T data;
+
+		_Ret_notnull_ T* BeginWrite() noexcept
+		{
+			sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			return &data;
+		}
+
+		void EndWrite() noexcept
+		{
+			sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/* Returns false if the writer was updating the section, in which case the caller should retry. */
+		_Success_(return)
+		bool TryRead(
+			_Out_ T& result) const noexcept
+		{
+			const uint32_t sequenceBefore = sequence.load(std::memory_order_acquire);
+			memcpy(&result, (const void*)&data, sizeof(T));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return !(sequenceBefore & 1) && sequence.load(std::memory_order_relaxed) == sequenceBefore;
+		}
+	};
+
+	struct LiveMetricsPage final
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t processId;
+		uint32_t size;
+		LiveMetricsSection<LiveMetricsGameFrame> game;
+		LiveMetricsSection<LiveMetricsRenderFrame> render;
+	};
+
+	/* Creates and owns the live metrics page of this process. */
+	class LiveMetrics final
+	{
+	public:
+		LiveMetrics();
+		~LiveMetrics() noexcept;
+
+		bool IsValid() const noexcept;
+
+		_Ret_notnull_ LiveMetricsGameFrame* BeginGameFrameUpdate() noexcept;
+		void EndGameFrameUpdate() noexcept;
+
+		_Ret_notnull_ LiveMetricsRenderFrame* BeginRenderFrameUpdate() noexcept;
+		void EndRenderFrameUpdate() noexcept;
+
+		static void GetPageName(
+			_In_ uint32_t processId,
+			_Out_writes_z_(nameSize) char* name,
+			_In_ uint32_t nameSize) noexcept
+		{
+			sprintf_s(name, nameSize, "Local\\d2dx_metrics_%u", processId);
+		}
+
+	private:
+		HANDLE _fileMapping = nullptr;
+		LiveMetricsPage* _page = nullptr;
+	};
+}
@@ -20,6 +20,7 @@
 #include "Options.h"
 #include "Buffer.h"
 #include "Utils.h"
+#include "TextureCachePolicyFactory.h"
 
 #include "../../thirdparty/toml/toml.h"
 
@@ -79,6 +80,7 @@ void Options::ApplyCfg(
 		READ_OPTOUTS_FLAG(OptionsFlag::NoCompatModeFix, "nocompatmodefix");
 		READ_OPTOUTS_FLAG(OptionsFlag::NoTitleChange, "notitlechange");
 		READ_OPTOUTS_FLAG(OptionsFlag::NoKeepAspectRatio, "nokeepaspectratio");
+		READ_OPTOUTS_FLAG(OptionsFlag::NoRenderThread, "norenderthread");
 
 #undef READ_OPTOUTS_FLAG
 	}
@@ -110,6 +112,30 @@ void Options::ApplyCfg(
 		{
 			SetBilinearSharpness(static_cast<float>(bilinearSharpness.u.d));
 		}
+
+		auto maxRepeatedFrames = toml_int_in(game, "max-repeated-frames");
+		if (maxRepeatedFrames.ok)
+		{
+			SetMaxRepeatedFrames((int32_t)maxRepeatedFrames.u.i);
+		}
+
+		auto textureDiskCacheSize = toml_int_in(game, "texture-disk-cache-size");
+		if (textureDiskCacheSize.ok)
+		{
+			SetTextureDiskCacheSize((int32_t)textureDiskCacheSize.u.i);
+		}
+
+		auto textureCacheBudget = toml_int_in(game, "texture-cache-budget");
+		if (textureCacheBudget.ok)
+		{
+			SetTextureCacheBudget((int32_t)textureCacheBudget.u.i);
+		}
+
+		auto uiTextureCacheShare = toml_int_in(game, "ui-texture-cache-share");
+		if (uiTextureCacheShare.ok)
+		{
+			SetUiTextureCacheShare((int32_t)uiTextureCacheShare.u.i);
+		}
 	}
 
 	auto window = toml_table_in(root, "window");
@@ -150,6 +176,62 @@ void Options::ApplyCfg(
 		{
 			SetFlag(OptionsFlag::DbgDumpTextures, dumpTextures.u.b);
 		}
+
+		auto recordGlide = toml_bool_in(debug, "recordglide");
+		if (recordGlide.ok)
+		{
+			SetFlag(OptionsFlag::DbgRecordGlide, recordGlide.u.b);
+		}
+
+		auto trace = toml_bool_in(debug, "trace");
+		if (trace.ok)
+		{
+			SetFlag(OptionsFlag::DbgTrace, trace.u.b);
+		}
+
+		auto liveMetrics = toml_bool_in(debug, "live-metrics");
+		if (liveMetrics.ok)
+		{
+			SetFlag(OptionsFlag::DbgLiveMetrics, liveMetrics.u.b);
+		}
+
+		auto simd = toml_string_in(debug, "simd");
+		if (simd.ok)
+		{
+			if (!strcmp(simd.u.s, "auto")) SetSimdBackend(SimdBackend::Auto);
+			else if (!strcmp(simd.u.s, "sse2")) SetSimdBackend(SimdBackend::Sse2);
+			else if (!strcmp(simd.u.s, "avx2")) SetSimdBackend(SimdBackend::Avx2);
+			else if (!strcmp(simd.u.s, "avx512")) SetSimdBackend(SimdBackend::Avx512);
+			free(simd.u.s);
+		}
+
+		/* Either one policy for all texture caches, or one per cache from 8x8 up to 256x128. */
+		auto textureCachePolicy = toml_string_in(debug, "texture-cache-policy");
+		if (textureCachePolicy.ok)
+		{
+			const auto policyType = TextureCachePolicyFactory::FromName(textureCachePolicy.u.s);
+
+			for (int32_t i = 0; i < (int32_t)TextureCacheSizeClass::Count; ++i)
+			{
+				SetTextureCachePolicy((TextureCacheSizeClass)i, policyType);
+			}
+
+			free(textureCachePolicy.u.s);
+		}
+
+		auto textureCachePolicies = toml_array_in(debug, "texture-cache-policy");
+		if (textureCachePolicies)
+		{
+			for (int32_t i = 0; i < (int32_t)TextureCacheSizeClass::Count; ++i)
+			{
+				auto policy = toml_string_at(textureCachePolicies, i);
+				if (policy.ok)
+				{
+					SetTextureCachePolicy((TextureCacheSizeClass)i, TextureCachePolicyFactory::FromName(policy.u.s));
+					free(policy.u.s);
+				}
+			}
+		}
 	}
 
 	toml_free(root);
@@ -169,6 +251,7 @@ void Options::ApplyCommandLine(
 	if (strstr(cmdLine, "-dxnocompatmodefix")) SetFlag(OptionsFlag::NoCompatModeFix, true);
 	if (strstr(cmdLine, "-dxnotitlechange")) SetFlag(OptionsFlag::NoTitleChange, true);
 	if (strstr(cmdLine, "-dxnokeepaspectratio")) SetFlag(OptionsFlag::NoKeepAspectRatio, true);
+	if (strstr(cmdLine, "-dxnorenderthread")) SetFlag(OptionsFlag::NoRenderThread, true);
 	if (strstr(cmdLine, "-dxvsync")) SetFlag(OptionsFlag::NoVSync, false);
 
 	char const* upscale = strstr(cmdLine, "-dxupscale=");
@@ -182,6 +265,9 @@ void Options::ApplyCommandLine(
 	else if (strstr(cmdLine, "-dxscale2")) SetWindowScale(2);
 
 	if (strstr(cmdLine, "-dxdbg_dump_textures")) SetFlag(OptionsFlag::DbgDumpTextures, true);
+	if (strstr(cmdLine, "-dxdbg_record_glide")) SetFlag(OptionsFlag::DbgRecordGlide, true);
+	if (strstr(cmdLine, "-dxdbg_trace")) SetFlag(OptionsFlag::DbgTrace, true);
+	if (strstr(cmdLine, "-dxdbg_live_metrics")) SetFlag(OptionsFlag::DbgLiveMetrics, true);
 }
 
 _Use_decl_annotations_
@@ -260,4 +346,78 @@ void Options::SetBilinearSharpness(
 	_In_ float sharpness) noexcept
 {
 	_bilinearSharpness = max(sharpness, 1.0f);
+}
+
+int32_t Options::GetMaxRepeatedFrames() const
+{
+	return _maxRepeatedFrames;
+}
+
+void Options::SetMaxRepeatedFrames(
+	_In_ int32_t maxRepeatedFrames) noexcept
+{
+	_maxRepeatedFrames = min(1000, max(0, maxRepeatedFrames));
+}
+
+int32_t Options::GetTextureDiskCacheSize() const
+{
+	return _textureDiskCacheSize;
+}
+
+void Options::SetTextureDiskCacheSize(
+	_In_ int32_t textureDiskCacheSize) noexcept
+{
+	_textureDiskCacheSize = min(128, max(0, textureDiskCacheSize));
+}
+
+int32_t Options::GetTextureCacheBudget() const
+{
+	return _textureCacheBudget;
+}
+
+void Options::SetTextureCacheBudget(
+	_In_ int32_t textureCacheBudget) noexcept
+{
+	_textureCacheBudget = min(1024, max(0, textureCacheBudget));
+}
+
+int32_t Options::GetUiTextureCacheShare() const
+{
+	return _uiTextureCacheShare;
+}
+
+void Options::SetUiTextureCacheShare(
+	_In_ int32_t uiTextureCacheShare) noexcept
+{
+	_uiTextureCacheShare = min(50, max(0, uiTextureCacheShare));
+}
+
+SimdBackend Options::GetSimdBackend() const
+{
+	return _simdBackend;
+}
+
+void Options::SetSimdBackend(
+	_In_ SimdBackend simdBackend) noexcept
+{
+	_simdBackend = simdBackend < SimdBackend::Count ? simdBackend : SimdBackend::Auto;
+}
+
+TextureCachePolicyType Options::GetTextureCachePolicy(
+	_In_ TextureCacheSizeClass sizeClass) const
+{
+	assert(sizeClass < TextureCacheSizeClass::Count);
+	return _textureCachePolicies[(int)sizeClass];
+}
+
+void Options::SetTextureCachePolicy(
+	_In_ TextureCacheSizeClass sizeClass,
+	_In_ TextureCachePolicyType policyType) noexcept
+{
+	if (sizeClass >= TextureCacheSizeClass::Count)
+	{
+		return;
+	}
+
+	_textureCachePolicies[(int)sizeClass] = policyType < TextureCachePolicyType::Count ? policyType : TextureCachePolicyType::BitPmru;
 }
\ No newline at end of file
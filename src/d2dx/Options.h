@@ -34,8 +34,12 @@ namespace d2dx
 		NoTitleChange,
 		NoVSync,
 		NoKeepAspectRatio,
+		NoRenderThread,
 
 		DbgDumpTextures,
+		DbgRecordGlide,
+		DbgTrace,
+		DbgLiveMetrics,
 
 		Frameless,
 
@@ -52,6 +56,38 @@ namespace d2dx
 		Count = 5
 	};
 
+	enum class SimdBackend
+	{
+		Auto = 0,
+		Sse2 = 1,
+		Avx2 = 2,
+		Avx512 = 3,
+		Count = 4
+	};
+
+	enum class TextureCachePolicyType
+	{
+		BitPmru = 0,
+		Clock = 1,
+		TwoQueue = 2,
+		Arc = 3,
+		Lfu = 4,
+		Count = 5
+	};
+
+	/* The texture caches, one per texture size class. */
+	enum class TextureCacheSizeClass
+	{
+		Size8 = 0,
+		Size16 = 1,
+		Size32 = 2,
+		Size64 = 3,
+		Size128 = 4,
+		Size256 = 5,
+		Size256x128 = 6,
+		Count = 7
+	};
+
 	class Options final
 	{
 	public:
@@ -96,6 +132,38 @@ namespace d2dx
 		void SetBilinearSharpness(
 			_In_ float sharpness) noexcept;
 
+		int32_t GetMaxRepeatedFrames() const;
+
+		void SetMaxRepeatedFrames(
+			_In_ int32_t maxRepeatedFrames) noexcept;
+
+		int32_t GetTextureDiskCacheSize() const;
+
+		void SetTextureDiskCacheSize(
+			_In_ int32_t textureDiskCacheSize) noexcept;
+
+		int32_t GetTextureCacheBudget() const;
+
+		void SetTextureCacheBudget(
+			_In_ int32_t textureCacheBudget) noexcept;
+
+		int32_t GetUiTextureCacheShare() const;
+
+		void SetUiTextureCacheShare(
+			_In_ int32_t uiTextureCacheShare) noexcept;
+
+		SimdBackend GetSimdBackend() const;
+
+		void SetSimdBackend(
+			_In_ SimdBackend simdBackend) noexcept;
+
+		TextureCachePolicyType GetTextureCachePolicy(
+			_In_ TextureCacheSizeClass sizeClass) const;
+
+		void SetTextureCachePolicy(
+			_In_ TextureCacheSizeClass sizeClass,
+			_In_ TextureCachePolicyType policyType) noexcept;
+
 	private:
 		uint32_t _flags = 1 << (int)OptionsFlag::NoVSync;
 		int32_t _windowScale = 1;
@@ -103,5 +171,11 @@ namespace d2dx
 		Size _userSpecifiedGameSize{ -1, -1 };
 		UpscaleMethod _upscaleMethod{ UpscaleMethod::HighQuality };
 		float _bilinearSharpness = 2.0;
+		int32_t _maxRepeatedFrames = 30;
+		int32_t _textureDiskCacheSize = 0;
+		int32_t _textureCacheBudget = 0;
+		int32_t _uiTextureCacheShare = 10;
+		SimdBackend _simdBackend{ SimdBackend::Auto };
+		TextureCachePolicyType _textureCachePolicies[(int)TextureCacheSizeClass::Count]{};
 	};
 }
\ No newline at end of file
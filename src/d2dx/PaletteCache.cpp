@@ -0,0 +1,211 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "PaletteCache.h"
+#include "Utils.h"
+
+using namespace d2dx;
+
+/* Index entries hold slot + 1, so that zero means empty. */
+#define D2DX_PALETTE_INDEX_EMPTY 0
+
+_Use_decl_annotations_
+PaletteCache::PaletteCache(
+	uint32_t capacity) :
+	_capacity{ capacity },
+	_hashes{ capacity, true },
+	_lastUseTimes{ capacity, true }
+{
+	assert(capacity > 0 && capacity < 255);
+
+	/* Keep the load factor at or below 1/4, so that probe sequences stay very short. */
+	uint32_t indexSize = 4;
+
+	while (indexSize < capacity * 4)
+	{
+		indexSize *= 2;
+	}
+
+	_indexMask = indexSize - 1;
+	_index = Buffer<uint8_t>(indexSize, true);
+}
+
+_Use_decl_annotations_
+int32_t PaletteCache::FindOrInsert(
+	uint64_t hash,
+	bool& isNew) noexcept
+{
+	assert(hash != 0);
+
+	++_useTime;
+
+	uint32_t i = GetHomeIndex(hash);
+
+	while (_index.items[i] != D2DX_PALETTE_INDEX_EMPTY)
+	{
+		const uint32_t slot = _index.items[i] - 1U;
+
+		if (_hashes.items[slot] == hash)
+		{
+			_lastUseTimes.items[slot] = _useTime;
+			_boundSlot = (int32_t)slot;
+			++_hitCount;
+			isNew = false;
+			return (int32_t)slot;
+		}
+
+		i = (i + 1) & _indexMask;
+	}
+
+	++_missCount;
+	isNew = true;
+
+	uint32_t slot = 0;
+
+	if (_usedCount < _capacity)
+	{
+		slot = _usedCount++;
+	}
+	else
+	{
+		/* Pick the least recently used palette other than the bound one, so that palettes used by
+		   the current frame are only picked when all the others are too. */
+		slot = (_boundSlot == 0 && _capacity > 1) ? 1 : 0;
+
+		for (uint32_t j = slot + 1; j < _capacity; ++j)
+		{
+			if ((int32_t)j != _boundSlot && _lastUseTimes.items[j] < _lastUseTimes.items[slot])
+			{
+				slot = j;
+			}
+		}
+
+		/* The render thread uploads the frame's palettes before drawing any of its batches, so the
+		   batches recorded earlier in the frame with this slot will be drawn with the new palette. */
+		if (_lastUseTimes.items[slot] > _frameStartUseTime)
+		{
+			D2DX_LOG("Evicting palette %u, which is in use by the current frame.", slot);
+			++_inUseEvictionCount;
+		}
+
+		RemoveFromIndex(_hashes.items[slot]);
+		++_evictionCount;
+
+		/* Removing an entry may have shifted the probe sequence for the new hash. */
+		i = GetHomeIndex(hash);
+
+		while (_index.items[i] != D2DX_PALETTE_INDEX_EMPTY)
+		{
+			i = (i + 1) & _indexMask;
+		}
+	}
+
+	_hashes.items[slot] = hash;
+	_lastUseTimes.items[slot] = _useTime;
+	_index.items[i] = (uint8_t)(slot + 1);
+	_boundSlot = (int32_t)slot;
+
+	return (int32_t)slot;
+}
+
+void PaletteCache::OnNewFrame() noexcept
+{
+	_frameStartUseTime = _useTime;
+
+	/* The new frame's batches use the bound palette without it being downloaded again. */
+	if (_boundSlot >= 0)
+	{
+		_lastUseTimes.items[_boundSlot] = ++_useTime;
+	}
+}
+
+uint32_t PaletteCache::GetHitCount() const noexcept
+{
+	return _hitCount;
+}
+
+uint32_t PaletteCache::GetMissCount() const noexcept
+{
+	return _missCount;
+}
+
+uint32_t PaletteCache::GetEvictionCount() const noexcept
+{
+	return _evictionCount;
+}
+
+uint32_t PaletteCache::GetInUseEvictionCount() const noexcept
+{
+	return _inUseEvictionCount;
+}
+
+uint32_t PaletteCache::GetUsedCount() const noexcept
+{
+	return _usedCount;
+}
+
+_Use_decl_annotations_
+uint32_t PaletteCache::GetHomeIndex(
+	uint64_t hash) const noexcept
+{
+	return (uint32_t)(hash ^ (hash >> 32)) & _indexMask;
+}
+
+_Use_decl_annotations_
+void PaletteCache::RemoveFromIndex(
+	uint64_t hash) noexcept
+{
+	uint32_t i = GetHomeIndex(hash);
+
+	for (;;)
+	{
+		assert(_index.items[i] != D2DX_PALETTE_INDEX_EMPTY);
+
+		if (_hashes.items[_index.items[i] - 1U] == hash)
+		{
+			break;
+		}
+
+		i = (i + 1) & _indexMask;
+	}
+
+	/* Backward shift deletion: move later entries of the probe sequence into the hole, as long as
+	   that doesn't put them before their home index. */
+	uint32_t j = i;
+
+	for (;;)
+	{
+		j = (j + 1) & _indexMask;
+
+		if (_index.items[j] == D2DX_PALETTE_INDEX_EMPTY)
+		{
+			break;
+		}
+
+		const uint32_t home = GetHomeIndex(_hashes.items[_index.items[j] - 1U]);
+
+		if (((j - home) & _indexMask) >= ((j - i) & _indexMask))
+		{
+			_index.items[i] = _index.items[j];
+			i = j;
+		}
+	}
+
+	_index.items[i] = D2DX_PALETTE_INDEX_EMPTY;
+}
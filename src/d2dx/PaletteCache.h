@@ -0,0 +1,83 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+
+namespace d2dx
+{
+	/*
+		Maps palette contents (by hash) to the palette slots used by the shaders. Lookups go through
+		a small open-addressing hash table, and when all slots are taken the least recently used
+		palette is evicted, so that only that slot needs to be uploaded again.
+
+		A palette that has been used during the current frame is only evicted if every slot has
+		been used during the frame, since batches recorded earlier in the frame may still refer to it.
+		This includes the palette that is still bound from the previous frame, which the frame's
+		batches use until the game downloads another one. The bound palette itself is never evicted
+		(unless it is the only slot).
+	*/
+	class PaletteCache final
+	{
+	public:
+		PaletteCache(
+			_In_ uint32_t capacity);
+
+		/* Returns the slot of the palette and marks it as used. If the palette was not cached, isNew is
+		   set and the caller must upload the palette to the returned slot. */
+		int32_t FindOrInsert(
+			_In_ uint64_t hash,
+			_Out_ bool& isNew) noexcept;
+
+		void OnNewFrame() noexcept;
+
+		uint32_t GetHitCount() const noexcept;
+
+		uint32_t GetMissCount() const noexcept;
+
+		uint32_t GetEvictionCount() const noexcept;
+
+		/* The evictions of palettes that had been used by the current frame, which the frame's
+		   earlier batches are then drawn with the wrong palette for. */
+		uint32_t GetInUseEvictionCount() const noexcept;
+
+		uint32_t GetUsedCount() const noexcept;
+
+	private:
+		uint32_t GetHomeIndex(
+			_In_ uint64_t hash) const noexcept;
+
+		void RemoveFromIndex(
+			_In_ uint64_t hash) noexcept;
+
+		uint32_t _capacity = 0;
+		uint32_t _usedCount = 0;
+		uint32_t _indexMask = 0;
+		Buffer<uint64_t> _hashes;
+		Buffer<uint64_t> _lastUseTimes;
+		Buffer<uint8_t> _index;
+		uint64_t _useTime = 0;
+		uint64_t _frameStartUseTime = 0;
+		int32_t _boundSlot = -1;
+		uint32_t _hitCount = 0;
+		uint32_t _missCount = 0;
+		uint32_t _evictionCount = 0;
+		uint32_t _inUseEvictionCount = 0;
+	};
+}
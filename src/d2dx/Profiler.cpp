@@ -1,12 +1,145 @@
 #include "pch.h"
 
 #include "Profiler.h"
+#include "LatencyHistogram.h"
+#include "Tracer.h"
 #include "Utils.h"
 #include "D2DXContextFactory.h"
 
 using namespace d2dx;
 using namespace std;
 
+static const char* const categoryNames[static_cast<size_t>(ProfCategory::Count)] = {
+	"TextureSource",
+	"MotionPrediction",
+	"Draw",
+	"DrawBatches",
+	"TextureDownload",
+	"Sleep",
+	"Present",
+	"Detours",
+};
+
+/* Keeps latency histograms of in-game frames: the frame time, the time spent presenting, and (in
+   profiling builds) the time spent in each category per frame. Percentiles are logged for every
+   window of WindowMs, and for the whole session on exit. */
+class LatencyRecorder final {
+public:
+	static constexpr double WindowMs = 60000.0;
+	static constexpr size_t FrameMetric = 0;
+	static constexpr size_t PresentMetric = 1;
+	static constexpr size_t FirstCategoryMetric = 2;
+	static constexpr size_t MetricCount = FirstCategoryMetric + static_cast<size_t>(ProfCategory::Count);
+
+	void Record(
+		_In_ size_t metric,
+		_In_ int64_t time) noexcept
+	{
+		const double us = TimeToMs(time) * 1000.0;
+		_window[metric].Record(us < (double)UINT32_MAX ? (uint32_t)us : UINT32_MAX);
+	}
+
+	void EndFrame(
+		_In_ int64_t frameTime) noexcept
+	{
+		_windowTimeMs += TimeToMs(frameTime);
+
+		if (_windowTimeMs >= WindowMs)
+		{
+			EndWindow();
+		}
+	}
+
+	void WriteReport() noexcept
+	{
+		EndWindow();
+
+		if (_session[FrameMetric].GetCount() == 0)
+		{
+			return;
+		}
+
+		const char* filename = "d2dx_latency.csv";
+		FILE* file = nullptr;
+
+		if (fopen_s(&file, filename, "w") != 0 || !file)
+		{
+			D2DX_LOG("Failed to open %s for writing.", filename);
+			return;
+		}
+
+		fprintf(file, "metric,count,p50_ms,p90_ms,p99_ms,p99.9_ms,max_ms\n");
+
+		for (size_t i = 0; i < MetricCount; ++i)
+		{
+			const LatencyHistogram& histogram = _session[i];
+
+			if (histogram.GetCount() > 0)
+			{
+				fprintf(file, "%s,%u,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+					GetMetricName(i),
+					histogram.GetCount(),
+					histogram.GetPercentile(50.0) / 1000.0,
+					histogram.GetPercentile(90.0) / 1000.0,
+					histogram.GetPercentile(99.0) / 1000.0,
+					histogram.GetPercentile(99.9) / 1000.0,
+					histogram.GetMax() / 1000.0);
+			}
+		}
+
+		fclose(file);
+
+		D2DX_LOG("Wrote latency percentiles to %s.", filename);
+	}
+
+private:
+	void EndWindow() noexcept
+	{
+		for (size_t i = 0; i < MetricCount; ++i)
+		{
+			LatencyHistogram& histogram = _window[i];
+
+			if (histogram.GetCount() > 0)
+			{
+				D2DX_LOG("%s latency over %.0f s (%u samples): p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f ms.",
+					GetMetricName(i),
+					_windowTimeMs / 1000.0,
+					histogram.GetCount(),
+					histogram.GetPercentile(50.0) / 1000.0,
+					histogram.GetPercentile(90.0) / 1000.0,
+					histogram.GetPercentile(99.0) / 1000.0,
+					histogram.GetPercentile(99.9) / 1000.0,
+					histogram.GetMax() / 1000.0);
+
+				_session[i].Add(histogram);
+				histogram.Reset();
+			}
+		}
+
+		_windowTimeMs = 0.0;
+	}
+
+	static const char* GetMetricName(
+		_In_ size_t metric) noexcept
+	{
+		switch (metric)
+		{
+		case FrameMetric:
+			return "Frame";
+		case PresentMetric:
+			return "Present";
+		default:
+			return categoryNames[metric - FirstCategoryMetric];
+		}
+	}
+
+	LatencyHistogram _window[MetricCount];
+	LatencyHistogram _session[MetricCount];
+	double _windowTimeMs = 0.0;
+};
+
+static LatencyRecorder latencyRecorder;
+
 #ifdef D2DX_PROFILE
 static thread_local unsigned int halt_sleep_profile = 0;
 static thread_local Timer* currentTimer = nullptr;
@@ -25,13 +158,7 @@ public:
 				auto ctxt = D2DXContextFactory::GetInstance(false);
 				if (ctxt && ctxt->GetActiveThreadId() == GetCurrentThreadId())
 				{
-					_times[static_cast<size_t>(category)] += time;
-					_times[static_cast<size_t>(ProfCategory::Count)] += time;
-					if (fullEvent)
-					{
-						++_events[static_cast<size_t>(category)];
-						++_events[static_cast<size_t>(ProfCategory::Count)];
-					}
+					AddCategoryTime(time, category, fullEvent);
 				}
 				else
 				{
@@ -45,13 +172,7 @@ public:
 		}
 		else
 		{
-			_times[static_cast<size_t>(category)] += time;
-			_times[static_cast<size_t>(ProfCategory::Count)] += time;
-			if (fullEvent)
-			{
-				++_events[static_cast<size_t>(category)];
-				++_events[static_cast<size_t>(ProfCategory::Count)];
-			}
+			AddCategoryTime(time, category, fullEvent);
 		}
 	}
 
@@ -61,7 +182,25 @@ public:
 		if (ctxt && ctxt->InGame()) {
 			double frameTime = TimeToMs(TimeStamp() - lastProfileTime);
 
-			double hashSize = static_cast<double>(tex_miss_size);
+			/* The game thread and the render thread both add to the counters, so take each one
+			   out with an exchange rather than reading it and clearing it afterwards. */
+			int64_t times[static_cast<size_t>(ProfCategory::Count) + 1];
+			uint32_t events[static_cast<size_t>(ProfCategory::Count) + 1];
+			for (size_t i = 0; i <= static_cast<size_t>(ProfCategory::Count); ++i)
+			{
+				times[i] = _times[i].exchange(0, memory_order_relaxed);
+				events[i] = _events[i].exchange(0, memory_order_relaxed);
+			}
+			const int64_t atomicTime = _atomicTime.exchange(0, memory_order_relaxed);
+			const uint32_t atomicEvents = _atomicEvents.exchange(0, memory_order_relaxed);
+			const size_t texLookups = tex_lookups.exchange(0, memory_order_relaxed);
+			const size_t texMisses = tex_misses.exchange(0, memory_order_relaxed);
+			const size_t texMissSize = tex_miss_size.exchange(0, memory_order_relaxed);
+			const size_t texDownloads = tex_downloads.exchange(0, memory_order_relaxed);
+			const size_t texElidedDownloads = tex_elided_downloads.exchange(0, memory_order_relaxed);
+			const size_t texElidedSize = tex_elided_size.exchange(0, memory_order_relaxed);
+
+			double hashSize = static_cast<double>(texMissSize);
 			auto hashUnit = "B";
 			if (hashSize >= 1024 * 1024) {
 				hashSize /= 1024 * 1024;
@@ -71,8 +210,17 @@ public:
 				hashSize /= 1024;
 				hashUnit = "kiB";
 			}
-			int64_t atomicTime = _atomicTime.load(memory_order_relaxed);
-			uint32_t atomicEvents = _atomicEvents.load(memory_order_relaxed);
+
+			double elidedSize = static_cast<double>(texElidedSize);
+			auto elidedUnit = "B";
+			if (elidedSize >= 1024 * 1024) {
+				elidedSize /= 1024 * 1024;
+				elidedUnit = "MiB";
+			}
+			else if (elidedSize >= 1024) {
+				elidedSize /= 1024;
+				elidedUnit = "kiB";
+			}
 
 			if (frameTime > 50) {
 				D2DX_LOG_PROFILE(
@@ -82,6 +230,7 @@ public:
 					"TextureDownload: %.4fms (%u events)\n"
 					"TextureSource: %.4fms (%u events)\n"
 					"TextureHash Miss Rate: %u/%u (%.2f%s)\n"
+					"TextureDownload Elided: %u/%u (%.2f%s)\n"
 					"MotionPrediction: %.4fms (%u events)\n"
 					"Detours: %.4fms (%u events)\n"
 					"Draw: %.4fms (%u events)\n"
@@ -90,47 +239,63 @@ public:
 					"Sleep (other): %.4fms (%u events)\n"
 					"Present: %.4fms\n",
 					frameTime,
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::Count)]),
-					_events[static_cast<std::size_t>(ProfCategory::Count)],
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::TextureDownload)]),
-					_events[static_cast<std::size_t>(ProfCategory::TextureDownload)],
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::TextureSource)]),
-					_events[static_cast<std::size_t>(ProfCategory::TextureSource)],
-					tex_misses, tex_lookups, hashSize, hashUnit,
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::MotionPrediction)]),
-					_events[static_cast<std::size_t>(ProfCategory::MotionPrediction)],
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::Detours)]),
-					_events[static_cast<std::size_t>(ProfCategory::Detours)],
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::Draw)]),
-					_events[static_cast<std::size_t>(ProfCategory::Draw)],
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::DrawBatches)]),
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::Sleep)]),
-					_events[static_cast<std::size_t>(ProfCategory::Sleep)],
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::Count)]),
+					events[static_cast<std::size_t>(ProfCategory::Count)],
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::TextureDownload)]),
+					events[static_cast<std::size_t>(ProfCategory::TextureDownload)],
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::TextureSource)]),
+					events[static_cast<std::size_t>(ProfCategory::TextureSource)],
+					texMisses, texLookups, hashSize, hashUnit,
+					texElidedDownloads, texDownloads, elidedSize, elidedUnit,
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::MotionPrediction)]),
+					events[static_cast<std::size_t>(ProfCategory::MotionPrediction)],
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::Detours)]),
+					events[static_cast<std::size_t>(ProfCategory::Detours)],
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::Draw)]),
+					events[static_cast<std::size_t>(ProfCategory::Draw)],
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::DrawBatches)]),
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::Sleep)]),
+					events[static_cast<std::size_t>(ProfCategory::Sleep)],
 					TimeToMs(atomicTime),
 					atomicEvents,
-					TimeToMs(_times[static_cast<std::size_t>(ProfCategory::Present)])
+					TimeToMs(times[static_cast<std::size_t>(ProfCategory::Present)])
 				);
 			}
-			memset(&_times, 0, sizeof(_times));
-			memset(&_events, 0, sizeof(_events));
-			_atomicTime.fetch_sub(atomicTime, memory_order_relaxed);
-			_atomicEvents.fetch_sub(atomicEvents, memory_order_relaxed);
-			tex_lookups = 0;
-			tex_misses = 0;
-			tex_miss_size = 0;
+			for (size_t i = 0; i < static_cast<size_t>(ProfCategory::Count); ++i)
+			{
+				latencyRecorder.Record(LatencyRecorder::FirstCategoryMetric + i, times[i]);
+			}
+
 			lastProfileTime = TimeStamp();
 		}
 	}
 
-	int64_t _times[static_cast<size_t>(ProfCategory::Count) + 1] = {};
-	uint32_t _events[static_cast<size_t>(ProfCategory::Count) + 1] = {};
+	void AddCategoryTime(
+		_In_ int64_t time,
+		_In_ ProfCategory category,
+		_In_ bool fullEvent) noexcept
+	{
+		_times[static_cast<size_t>(category)].fetch_add(time, memory_order_relaxed);
+		_times[static_cast<size_t>(ProfCategory::Count)].fetch_add(time, memory_order_relaxed);
+		if (fullEvent)
+		{
+			_events[static_cast<size_t>(category)].fetch_add(1, memory_order_relaxed);
+			_events[static_cast<size_t>(ProfCategory::Count)].fetch_add(1, memory_order_relaxed);
+		}
+	}
+
+	atomic<int64_t> _times[static_cast<size_t>(ProfCategory::Count) + 1] = {};
+	atomic<uint32_t> _events[static_cast<size_t>(ProfCategory::Count) + 1] = {};
 	atomic<int64_t> _atomicTime = { 0 };
 	atomic<uint32_t> _atomicEvents = { 0 };
 
 	int64_t lastProfileTime = 0;
-	size_t tex_lookups = 0;
-	size_t tex_misses = 0;
-	size_t tex_miss_size = 0;
+	atomic<size_t> tex_lookups = { 0 };
+	atomic<size_t> tex_misses = { 0 };
+	atomic<size_t> tex_miss_size = { 0 };
+	atomic<size_t> tex_downloads = { 0 };
+	atomic<size_t> tex_elided_downloads = { 0 };
+	atomic<size_t> tex_elided_size = { 0 };
 };
 
 static Profiler profiler;
@@ -145,6 +310,7 @@ d2dx::Timer::Timer(
 	, parent(currentTimer)
 #endif
 {
+	TraceBegin(categoryNames[static_cast<size_t>(category)]);
 #ifdef D2DX_PROFILE
 	currentTimer = this;
 	if (parent)
@@ -164,6 +330,7 @@ d2dx::Timer::~Timer() noexcept
 	}
 	currentTimer = parent;
 #endif
+	TraceEnd();
 }
 
 d2dx::HaltSleepProfile::HaltSleepProfile() noexcept
@@ -187,10 +354,29 @@ void d2dx::WriteProfile() noexcept
 #endif
 }
 
+_Use_decl_annotations_
+void d2dx::RecordFrameLatency(
+	int64_t frameTime,
+	int64_t presentTime) noexcept
+{
+	auto ctxt = D2DXContextFactory::GetInstance(false);
+	if (ctxt && ctxt->InGame())
+	{
+		latencyRecorder.Record(LatencyRecorder::FrameMetric, frameTime);
+		latencyRecorder.Record(LatencyRecorder::PresentMetric, presentTime);
+		latencyRecorder.EndFrame(frameTime);
+	}
+}
+
+void d2dx::WriteLatencyReport() noexcept
+{
+	latencyRecorder.WriteReport();
+}
+
 void d2dx::AddTexHashLookup() noexcept
 {
 #ifdef D2DX_PROFILE
-	profiler.tex_lookups += 1;
+	profiler.tex_lookups.fetch_add(1, memory_order_relaxed);
 #endif
 }
 
@@ -199,7 +385,22 @@ void d2dx::AddTexHashMiss(
 	size_t size) noexcept
 {
 #ifdef D2DX_PROFILE
-	profiler.tex_misses += 1;
-	profiler.tex_miss_size += size;
+	profiler.tex_misses.fetch_add(1, memory_order_relaxed);
+	profiler.tex_miss_size.fetch_add(size, memory_order_relaxed);
+#endif
+}
+
+_Use_decl_annotations_
+void d2dx::AddTexDownload(
+	size_t size,
+	bool isElided) noexcept
+{
+#ifdef D2DX_PROFILE
+	profiler.tex_downloads.fetch_add(1, memory_order_relaxed);
+	if (isElided)
+	{
+		profiler.tex_elided_downloads.fetch_add(1, memory_order_relaxed);
+		profiler.tex_elided_size.fetch_add(size, memory_order_relaxed);
+	}
 #endif
 }
\ No newline at end of file
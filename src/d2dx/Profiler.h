@@ -35,7 +35,16 @@ namespace d2dx {
 
 	void WriteProfile() noexcept;
 
+	void RecordFrameLatency(
+		_In_ int64_t frameTime,
+		_In_ int64_t presentTime) noexcept;
+
+	void WriteLatencyReport() noexcept;
+
 	void AddTexHashLookup() noexcept;
 	void AddTexHashMiss(
 		_In_ size_t size) noexcept;
+	void AddTexDownload(
+		_In_ size_t size,
+		_In_ bool isElided) noexcept;
 }
\ No newline at end of file
@@ -0,0 +1,105 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Types.h"
+#include "Vertex.h"
+
+namespace d2dx
+{
+	/* Turns the vertices of a triangle strip or fan, pushed one at a time, into a quad list
+	   suitable for drawing with the shared quad index buffer (triangles 0-1-2 and 0-2-3 of each
+	   quad). Two consecutive triangles of the strip or fan become one quad. If the triangle count
+	   is odd, the last quad repeats its third vertex, making its second triangle degenerate. */
+	class QuadListWriter final
+	{
+	public:
+		QuadListWriter(
+			_In_ uint32_t mode,
+			_Out_ Vertex* __restrict vertices) noexcept :
+			_vertices{ vertices },
+			_firstVertex{ vertices },
+			_isFan{ mode == GR_TRIANGLE_FAN }
+		{
+		}
+
+		__forceinline void Push(
+			_In_ const Vertex& vertex) noexcept
+		{
+			if (_pushedCount >= 2)
+			{
+				if (_pushedCount & 1)
+				{
+					/* The quad's diagonal is the edge shared by the two triangles. For a fan
+					   that is the edge from the first vertex, for a strip the middle edge. */
+					_vertices[0] = _isFan ? _a : _b;
+					_vertices[1] = _isFan ? _b : _a;
+					_vertices[2] = _c;
+					_vertices[3] = vertex;
+					_vertices += 4;
+
+					if (!_isFan)
+					{
+						_a = _c;
+					}
+
+					_b = vertex;
+				}
+				else
+				{
+					_c = vertex;
+				}
+			}
+			else if (_pushedCount == 0)
+			{
+				_a = vertex;
+			}
+			else
+			{
+				_b = vertex;
+			}
+
+			++_pushedCount;
+		}
+
+		/* Writes the pending odd triangle, if any, and returns the number of vertices written. */
+		__forceinline uint32_t Finish() noexcept
+		{
+			if (_pushedCount >= 3 && (_pushedCount & 1))
+			{
+				_vertices[0] = _a;
+				_vertices[1] = _b;
+				_vertices[2] = _c;
+				_vertices[3] = _c;
+				_vertices += 4;
+			}
+
+			return (uint32_t)(_vertices - _firstVertex);
+		}
+
+	private:
+		Vertex* __restrict _vertices;
+		Vertex* _firstVertex;
+		Vertex _a;
+		Vertex _b;
+		Vertex _c;
+		uint32_t _pushedCount = 0;
+		bool _isFan;
+	};
+}
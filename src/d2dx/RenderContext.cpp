@@ -25,6 +25,9 @@
 #include "Vertex.h"
 #include "Utils.h"
 #include "Profiler.h"
+#include "Tracer.h"
+
+#include <algorithm>
 
 #define MAX_FRAME_LATENCY 1
 #undef ALLOW_SET_SOURCE_SIZE
@@ -69,6 +72,7 @@ RenderContext::RenderContext(
 	memset(&_shadowState, 0, sizeof(_shadowState));
 
 	_constants.sharpness = _d2dxContext->GetOptions().GetBilinearSharpness();
+	_constants.positionScale = Vertex::IsCompact ? 32767.0f / (1 << Vertex::PositionFractionBits) : 1.0f;
 
 	_desktopSize = { GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN) };
 	_desktopClientMaxHeight = GetSystemMetrics(SM_CYFULLSCREEN);
@@ -279,7 +283,8 @@ RenderContext::RenderContext(
 			16 * sizeof(Constants),
 		framebufferSize,
 			_device.Get(),
-			simd);
+			simd,
+			_d2dxContext->GetOptions());
 
 	SetRasterizerState(_resources->GetRasterizerState(true));
 	_deviceContext->IASetInputLayout(_resources->GetInputLayout());
@@ -300,10 +305,14 @@ RenderContext::RenderContext(
 		_resources->GetFramebufferRtv(RenderContextFramebuffer::Game),
 		_resources->GetFramebufferRtv(RenderContextFramebuffer::SurfaceId));
 
-	uint32_t stride = sizeof(Vertex);
-	uint32_t offset = 0;
-	ID3D11Buffer* vbs[1] = { _resources->GetVertexBuffer() };
-	_deviceContext->IASetVertexBuffers(0, 1, vbs, &stride, &offset);
+	uint32_t strides[2] = { sizeof(Vertex), sizeof(uint32_t) };
+	uint32_t offsets[2] = { 0, 0 };
+	ID3D11Buffer* vbs[2] = { _resources->GetVertexBuffer(), _resources->GetFirstQuadBuffer() };
+	_deviceContext->IASetVertexBuffers(0, 2, vbs, strides, offsets);
+	_deviceContext->IASetIndexBuffer(_resources->GetQuadIndexBuffer(), DXGI_FORMAT_R16_UINT, 0);
+
+	ID3D11ShaderResourceView* surfaceIdSrv = _resources->GetSurfaceIdSrv();
+	_deviceContext->VSSetShaderResources(0, 1, &surfaceIdSrv);
 }
 
 HWND RenderContext::GetHWnd() const
@@ -316,9 +325,12 @@ void RenderContext::Draw(
 	const Batch& batch,
 	uint32_t startVertexLocation)
 {
-	SetBlendState(batch.GetAlphaBlend());
+	if (!_isGameFrameBegun)
+	{
+		BeginGameFrame();
+	}
 
-	ITextureCache* atlas = GetTextureCache(batch);
+	SetBlendState(batch.GetAlphaBlend());
 
 	RenderContextPixelShader shader = batch.GetFilterMode() == GR_TEXTUREFILTER_BILINEAR
 		? RenderContextPixelShader::GameBilinear
@@ -327,10 +339,19 @@ void RenderContext::Draw(
 	SetShaderState(
 		_resources->GetVertexShader(RenderContextVertexShader::Game),
 		_resources->GetPixelShader(shader),
-		atlas ? atlas->GetSrv(batch.GetTextureAtlas()) : nullptr,
+		nullptr,
 		_resources->GetTexture1DSrv(RenderContextTexture1D::Palette));
 
-	_deviceContext->Draw(batch.GetVertexCount(), startVertexLocation + batch.GetStartVertex());
+	assert(!(batch.GetVertexCount() & 3));
+	assert(!(batch.GetStartVertex() & 3));
+	const uint32_t quadCount = batch.GetVertexCount() / 4;
+	const uint32_t firstQuad = batch.GetStartVertex() / 4;
+
+	/* The single instance starts at the first quad, for looking up the surface IDs. */
+	_deviceContext->DrawIndexedInstanced(quadCount * 6, 1, 0, startVertexLocation + batch.GetStartVertex(), firstQuad);
+
+	++_drawCallCount;
+	_drawnVertexCount += batch.GetVertexCount();
 }
 
 bool RenderContext::IsIntegerScale() const
@@ -343,6 +364,14 @@ bool RenderContext::IsIntegerScale() const
 
 void RenderContext::Present()
 {
+	TraceScope _trace("RenderContext::Present");
+
+	/* A frame without any draws still shows a cleared game framebuffer. */
+	if (!_isGameFrameBegun)
+	{
+		BeginGameFrame();
+	}
+
 	_deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	float color[] = { .0f, .0f, .0f, .0f };
@@ -370,8 +399,7 @@ void RenderContext::Present()
 		auto startVertexLocation = _vbWriteIndex;
 		uint32_t vertexCount = UpdateVerticesWithFullScreenTriangle(
 			_gameSize,
-			_resources->GetFramebufferSize(),
-			{ 0,0,_gameSize.width, _gameSize.height });
+			_resources->GetFramebufferSize());
 		_deviceContext->Draw(vertexCount, startVertexLocation);
 		source = _resources->GetFramebufferSrv(RenderContextFramebuffer::GammaCorrected);
 	}
@@ -398,8 +426,7 @@ void RenderContext::Present()
 		auto startVertexLocation = _vbWriteIndex;
 		auto vertexCount = UpdateVerticesWithFullScreenTriangle(
 			_gameSize,
-			_resources->GetFramebufferSize(),
-			{ 0,0,_gameSize.width, _gameSize.height });
+			_resources->GetFramebufferSize());
 
 		_deviceContext->Draw(vertexCount, startVertexLocation);
 		source = _resources->GetFramebufferSrv(RenderContextFramebuffer::Game);
@@ -433,6 +460,32 @@ void RenderContext::Present()
 		additionalSource = _resources->GetFramebufferSrv(RenderContextFramebuffer::SurfaceId);
 	}
 
+	_displayPixelShader = pixelShader;
+	_displaySource = source;
+	_displayAdditionalSource = additionalSource;
+
+	DrawDisplayAndPresent();
+
+	_isGameFrameBegun = false;
+	_canRepeatPresent = true;
+}
+
+bool RenderContext::RepeatPresent()
+{
+	if (!_canRepeatPresent)
+	{
+		return false;
+	}
+
+	DrawDisplayAndPresent();
+	return true;
+}
+
+void RenderContext::DrawDisplayAndPresent()
+{
+	float color[] = { .0f, .0f, .0f, .0f };
+
+	SetBlendState(AlphaBlend::Opaque);
 	SetRasterizerState(_resources->GetRasterizerState(false));
 	SetRenderTargets(_backbufferRtv.Get(), nullptr);
 	_deviceContext->ClearRenderTargetView(_backbufferRtv.Get(), color);
@@ -440,15 +493,14 @@ void RenderContext::Present()
 
 	SetShaderState(
 		_resources->GetVertexShader(RenderContextVertexShader::Display),
-		_resources->GetPixelShader(pixelShader),
-		source,
-		additionalSource);
+		_resources->GetPixelShader(_displayPixelShader),
+		_displaySource,
+		_displayAdditionalSource);
 
 	auto startVertexLocation = _vbWriteIndex;
 	auto vertexCount = UpdateVerticesWithFullScreenTriangle(
 		_gameSize,
-		_resources->GetFramebufferSize(),
-		_renderRect);
+		_resources->GetFramebufferSize());
 
 	_deviceContext->Draw(vertexCount, startVertexLocation);
 
@@ -458,17 +510,7 @@ void RenderContext::Present()
 		nullptr,
 		nullptr);
 
-	if (!(_frameCount & 255))
-	{
-		D2DX_DEBUG_LOG("Texture cache use: %u, %u, %u, %u, %u, %u, %u",
-			this->_resources->GetTextureCache(8, 8)->GetUsedCount(),
-			this->_resources->GetTextureCache(16, 16)->GetUsedCount(),
-			this->_resources->GetTextureCache(32, 32)->GetUsedCount(),
-			this->_resources->GetTextureCache(64, 64)->GetUsedCount(),
-			this->_resources->GetTextureCache(128, 128)->GetUsedCount(),
-			this->_resources->GetTextureCache(256, 256)->GetUsedCount(),
-			this->_resources->GetTextureCache(256, 128)->GetUsedCount());
-	}
+	const int64_t presentStartTimeStamp = TimeStamp();
 
 	{
 		HaltSleepProfile _halt;
@@ -494,16 +536,41 @@ void RenderContext::Present()
 	WriteProfile();
 
 	auto curTimeStamp = TimeStamp();
-	_frameTimeMs = TimeToMs(curTimeStamp - _prevTimeStamp);
+	RecordFrameLatency(curTimeStamp - _prevTimeStamp, curTimeStamp - presentStartTimeStamp);
+	const double frameTimeMs = TimeToMs(curTimeStamp - _prevTimeStamp);
+	_frameTimeMs.store(frameTimeMs, std::memory_order_relaxed);
 	_prevTimeStamp = curTimeStamp;
 
+	++_presentCount;
+
+	if (LiveMetrics* liveMetrics = _d2dxContext->GetLiveMetrics())
+	{
+		LiveMetricsRenderFrame* metrics = liveMetrics->BeginRenderFrameUpdate();
+		metrics->presentCount = _presentCount;
+		metrics->drawCallCount = _drawCallCount;
+		metrics->drawnVertexCount = _drawnVertexCount;
+		metrics->frameTimeMs = (float)frameTimeMs;
+		metrics->presentTimeMs = (float)TimeToMs(curTimeStamp - presentStartTimeStamp);
+		liveMetrics->EndRenderFrameUpdate();
+	}
+
+	_drawCallCount = 0;
+	_drawnVertexCount = 0;
+
 	if (_deviceContext1)
 	{
-		_deviceContext1->DiscardView(_resources->GetFramebufferRtv(RenderContextFramebuffer::Game));
 		_deviceContext1->DiscardView(_backbufferRtv.Get());
 	}
+}
 
-	_resources->OnNewFrame();
+void RenderContext::BeginGameFrame()
+{
+	float color[] = { .0f, .0f, .0f, .0f };
+
+	if (_deviceContext1)
+	{
+		_deviceContext1->DiscardView(_resources->GetFramebufferRtv(RenderContextFramebuffer::Game));
+	}
 
 	SetRenderTargets(
 		_resources->GetFramebufferRtv(RenderContextFramebuffer::Game),
@@ -523,7 +590,15 @@ void RenderContext::Present()
 		nullptr,
 		nullptr);
 
-	++_frameCount;
+	/* The vertices select the texture atlas, so all of them stay bound for the whole frame. */
+	_deviceContext->PSSetShaderResources(2, _resources->GetTextureAtlasCount(), _resources->GetTextureAtlasSrvs());
+
+	_isGameFrameBegun = true;
+}
+
+void RenderContext::OnNewFrame()
+{
+	_resources->OnNewFrame();
 }
 
 _Use_decl_annotations_
@@ -533,6 +608,8 @@ void RenderContext::LoadGammaTable(
 {
 	_deviceContext->UpdateSubresource(
 		_resources->GetTexture1D(RenderContextTexture1D::GammaTable), 0, nullptr, values, valueCount * sizeof(uint32_t), 0);
+
+	_canRepeatPresent = false;
 }
 
 _Use_decl_annotations_
@@ -542,6 +619,11 @@ void RenderContext::WriteToScreen(
 	int32_t height,
 	bool forCinematic)
 {
+	if (!_isGameFrameBegun)
+	{
+		BeginGameFrame();
+	}
+
 	D3D11_MAPPED_SUBRESOURCE ms;
 	SetBlendState(AlphaBlend::Opaque);
 	uint32_t startVertexLocation = _vbWriteIndex;
@@ -557,7 +639,7 @@ void RenderContext::WriteToScreen(
 			_resources->GetPixelShader(RenderContextPixelShader::Video),
 			_resources->GetCinematicSrv(),
 			nullptr);
-		vertexCount = UpdateVerticesWithFullScreenTriangle(_gameSize, _resources->GetCinematicTextureSize(), { 0,0,_gameSize.width, _gameSize.height });
+		vertexCount = UpdateVerticesWithFullScreenTriangle(_gameSize, _resources->GetCinematicTextureSize());
 	}
 	else {
 		D2DX_CHECK_HR(_deviceContext->Map(_resources->GetVideoTexture(), 0, D3D11_MAP_WRITE_DISCARD, 0, &ms));
@@ -568,13 +650,16 @@ void RenderContext::WriteToScreen(
 			_resources->GetPixelShader(RenderContextPixelShader::Video),
 			_resources->GetVideoSrv(),
 			nullptr);
-		vertexCount = UpdateVerticesWithFullScreenTriangle(_gameSize, _resources->GetVideoTextureSize(), { 0,0,_gameSize.width, _gameSize.height });
+		vertexCount = UpdateVerticesWithFullScreenTriangle(_gameSize, _resources->GetVideoTextureSize());
 		UpdateViewport({ 0,0,_gameSize.width, _gameSize.height });
 	}
 
 	_deviceContext->Draw(vertexCount, startVertexLocation);
 
 	Present();
+
+	/* Game frames must not repeat a video frame. */
+	_canRepeatPresent = false;
 }
 
 _Use_decl_annotations_
@@ -589,6 +674,8 @@ uint32_t RenderContext::BulkWriteVertices(
 	const Vertex* vertices,
 	uint32_t vertexCount)
 {
+	TraceScope _trace("RenderContext::BulkWriteVertices");
+
 	auto mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
 	if ((_vbWriteIndex + vertexCount) > _vbCapacity)
 	{
@@ -614,16 +701,49 @@ uint32_t RenderContext::BulkWriteVertices(
 	return startVertexLocation;
 }
 
+_Use_decl_annotations_
+void RenderContext::BulkWriteSurfaceIds(
+	const Batch* batches,
+	uint32_t batchCount)
+{
+	TraceScope _trace("RenderContext::BulkWriteSurfaceIds");
+
+	if (batchCount == 0)
+	{
+		return;
+	}
+
+	/* Only the draws of this frame use the surface IDs, so unlike the vertices they are not appended. */
+	D3D11_MAPPED_SUBRESOURCE mappedSubResource = { 0 };
+	D2DX_CHECK_HR(_deviceContext->Map(_resources->GetSurfaceIdBuffer(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedSubResource));
+	uint32_t* pMappedQuadAttributes = (uint32_t*)mappedSubResource.pData;
+
+	for (uint32_t i = 0; i < batchCount; ++i)
+	{
+		const Batch& batch = batches[i];
+
+		if (batch.IsValid())
+		{
+			assert((batch.GetStartVertex() + batch.GetVertexCount()) <= D2DX_MAX_VERTICES_PER_FRAME);
+			std::fill_n(pMappedQuadAttributes + batch.GetStartVertex() / 4, batch.GetVertexCount() / 4, batch.GetQuadAttributes());
+		}
+	}
+
+	_deviceContext->Unmap(_resources->GetSurfaceIdBuffer(), 0);
+}
+
 _Use_decl_annotations_
 uint32_t RenderContext::UpdateVerticesWithFullScreenTriangle(
 	Size srcSize,
-	Size srcTextureSize,
-	Rect dstRect)
+	Size srcTextureSize)
 {
+	/* DisplayVS generates the triangle's corners from SV_VertexID, so the position carries the source size instead. */
+	const float srcWidth = (float)srcSize.width;
+	const float srcHeight = (float)srcSize.height;
 	Vertex vertices[3] = {
-		Vertex{ 0, 0, srcTextureSize.width, srcTextureSize.height, 0xFFFFFFFF, false, srcSize.height, 0, srcSize.width },
-		Vertex{ static_cast<float>(dstRect.size.width * 2), 0, srcTextureSize.width, srcTextureSize.height, 0xFFFFFFFF, false, srcSize.height, 0, srcSize.width },
-		Vertex{ 0, static_cast<float>(dstRect.size.height * 2), srcTextureSize.width, srcTextureSize.height, 0xFFFFFFFF, false, srcSize.height, 0, srcSize.width },
+		Vertex{ srcWidth, srcHeight, srcTextureSize.width, srcTextureSize.height, 0xFFFFFFFF, false, 0, 0 },
+		Vertex{ srcWidth, srcHeight, srcTextureSize.width, srcTextureSize.height, 0xFFFFFFFF, false, 0, 0 },
+		Vertex{ srcWidth, srcHeight, srcTextureSize.width, srcTextureSize.height, 0xFFFFFFFF, false, 0, 0 },
 	};
 
 	auto mapType = D3D11_MAP_WRITE_NO_OVERWRITE;
@@ -646,28 +766,12 @@ uint32_t RenderContext::UpdateVerticesWithFullScreenTriangle(
 }
 
 _Use_decl_annotations_
-TextureCacheLocation RenderContext::UpdateTexture(
+void RenderContext::UploadTexture(
 	const Batch& batch,
-	const uint8_t* tmuData,
-	uint32_t tmuDataSize)
+	TextureCacheLocation location,
+	const uint8_t* data)
 {
-	if (!batch.IsValid())
-	{
-		return { -1, -1 };
-	}
-
-	const uint64_t contentKey = batch.GetHash();
-
-	ITextureCache* atlas = GetTextureCache(batch);
-
-	auto tcl = atlas->FindTexture(contentKey, -1);
-
-	if (tcl._textureAtlas < 0)
-	{
-		tcl = atlas->InsertTexture(contentKey, batch, tmuData, tmuDataSize);
-	}
-
-	return tcl;
+	GetTextureCache(batch)->UploadTexture(location, batch.GetTextureWidth(), batch.GetTextureHeight(), data);
 }
 
 _Use_decl_annotations_
@@ -766,7 +870,18 @@ static LRESULT CALLBACK d2dxSubclassWndProc(
 	case WM_SYSKEYDOWN: case WM_KEYDOWN:
 		if (wParam == VK_RETURN && (HIWORD(lParam) & KF_ALTDOWN))
 		{
-			renderContext->ToggleFullscreen();
+			/* Goes through D2DXContext, which toggles at the next buffer swap once the render thread is idle. */
+			D2DXContextFactory::GetInstance()->ToggleFullscreen();
+			return 0;
+		}
+		else if (wParam == VK_F11 && (HIWORD(lParam) & KF_ALTDOWN))
+		{
+			D2DXContextFactory::GetInstance()->DumpTextureCacheStatistics();
+			return 0;
+		}
+		else if (wParam == VK_F12 && (HIWORD(lParam) & KF_ALTDOWN))
+		{
+			SnapshotTrace();
 			return 0;
 		}
 		break;
@@ -901,6 +1016,20 @@ ITextureCache* RenderContext::GetTextureCache(
 	return _resources->GetTextureCache(batch.GetTextureWidth(), batch.GetTextureHeight());
 }
 
+_Use_decl_annotations_
+ITextureCache* RenderContext::GetTextureCache(
+	TextureCacheSizeClass sizeClass) const
+{
+	return _resources->GetTextureCache(sizeClass);
+}
+
+_Use_decl_annotations_
+void RenderContext::SetTextureCacheCapacities(
+	const uint32_t* capacities)
+{
+	_resources->SetTextureCacheCapacities(capacities, _device.Get());
+}
+
 void RenderContext::ResizeBackbuffer()
 {
 	if (_backbufferSizingStrategy == RenderContextBackbufferSizingStrategy::SetSourceSize)
@@ -932,6 +1061,9 @@ void RenderContext::SetSizes(
 		return;
 	}
 
+	/* The framebuffers may be recreated below. */
+	_canRepeatPresent = false;
+
 	bool updateGameSize = gameSize != _gameSize;
 	_gameSize = gameSize;
 	_windowSize = windowSize;
@@ -1164,12 +1296,12 @@ void RenderContext::UnclipCursor()
 
 float RenderContext::GetFrameTime() const
 {
-	return (float)(_frameTimeMs / 1000.0);
+	return (float)(_frameTimeMs.load(std::memory_order_relaxed) / 1000.0);
 }
 
 int32_t RenderContext::GetFrameTimeFp() const
 {
-	auto frameTimeMs = (int64_t)(_frameTimeMs * (65536.0 / 1000.0));
+	auto frameTimeMs = (int64_t)(_frameTimeMs.load(std::memory_order_relaxed) * (65536.0 / 1000.0));
 	return (int32_t)max(INT_MIN, min(INT_MAX, frameTimeMs));
 }
 
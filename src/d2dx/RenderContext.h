@@ -72,10 +72,14 @@ namespace d2dx
 			_In_reads_(vertexCount) const Vertex* vertices,
 			_In_ uint32_t vertexCount) override;
 
-		virtual TextureCacheLocation UpdateTexture(
+		virtual void BulkWriteSurfaceIds(
+			_In_reads_(batchCount) const Batch* batches,
+			_In_ uint32_t batchCount) override;
+
+		virtual void UploadTexture(
 			_In_ const Batch& batch,
-			_In_reads_(tmuDataSize) const uint8_t* tmuData,
-			_In_ uint32_t tmuDataSize) override;
+			_In_ TextureCacheLocation location,
+			_In_reads_(batch.GetTextureWidth() * batch.GetTextureHeight()) const uint8_t* data) override;
 
 		virtual void Draw(
 			_In_ const Batch& batch,
@@ -83,6 +87,10 @@ namespace d2dx
 
 		virtual void Present() override;
 
+		virtual bool RepeatPresent() override;
+
+		virtual void OnNewFrame() override;
+
 		virtual void WriteToScreen(
 			_In_reads_(width* height) const uint32_t* pixels,
 			_In_ int32_t width,
@@ -98,6 +106,12 @@ namespace d2dx
 		virtual ITextureCache* GetTextureCache(
 			_In_ const Batch& batch) const override;
 
+		virtual ITextureCache* GetTextureCache(
+			_In_ TextureCacheSizeClass sizeClass) const override;
+
+		virtual void SetTextureCacheCapacities(
+			_In_reads_((int32_t)TextureCacheSizeClass::Count) const uint32_t* capacities) override;
+
 		virtual void SetSizes(
 			_In_ Size gameSize,
 			_In_ Size windowSize,
@@ -147,8 +161,7 @@ namespace d2dx
 
 		uint32_t UpdateVerticesWithFullScreenTriangle(
 			_In_ Size srcSize,
-			_In_ Size srcTextureSize,
-			_In_ Rect dstRect);
+			_In_ Size srcTextureSize);
 
 		bool IsFrameLatencyWaitableObjectSupported() const;
 
@@ -167,13 +180,17 @@ namespace d2dx
 		
 		bool NeedsPostRenderUpscale() const noexcept;
 
+		void BeginGameFrame();
+
+		void DrawDisplayAndPresent();
+
 		struct Constants final
 		{
 			float screenSize[2] = { 0.0f, 0.0f };
 			float invScreenSize[2] = { 0.0f, 0.0f };
 			uint32_t flags[2] = { 0, 0 };
 			float sharpness = 1.0f;
-			uint32_t padding = 0;
+			float positionScale = 1.0f;
 		};
 
 		static_assert(sizeof(Constants) == 8 * 4, "size of Constants");
@@ -202,7 +219,6 @@ namespace d2dx
 		std::unique_ptr<RenderContextResources> _resources;
 		std::shared_ptr<ISimd> _simd;
 
-		uint32_t _frameCount = 0;
 		Size _gameSize = { 0, 0 };
 		Rect _renderRect = { 0,0,0,0 };
 		Size _windowSize = { 0,0 };
@@ -227,7 +243,21 @@ namespace d2dx
 		bool _isActiveWindow = false;
 		bool _isCursorClipped = false;
 
+		/* The game framebuffer is only cleared when the next frame starts drawing, so that the
+		   final display pass of the last presented frame can be repeated by RepeatPresent. */
+		bool _isGameFrameBegun = false;
+		bool _canRepeatPresent = false;
+		RenderContextPixelShader _displayPixelShader = RenderContextPixelShader::Gamma;
+		ID3D11ShaderResourceView* _displaySource = nullptr;
+		ID3D11ShaderResourceView* _displayAdditionalSource = nullptr;
+
 		int64_t _prevTimeStamp;
-		double _frameTimeMs;
+
+		/* Written on the render thread when presenting, read by the game thread (motion prediction). */
+		std::atomic<double> _frameTimeMs = { 0.0 };
+
+		uint32_t _presentCount = 0;
+		uint32_t _drawCallCount = 0;
+		uint32_t _drawnVertexCount = 0;
 	};
 }
\ No newline at end of file
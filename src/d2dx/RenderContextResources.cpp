@@ -21,6 +21,8 @@
 #include "Utils.h"
 #include "Types.h"
 #include "TextureCache.h"
+#include "TextureCacheBalancer.h"
+#include "TextureCachePolicyFactory.h"
 #include "DisplayVS_cso.h"
 #include "DisplayNonintegerScalePS_cso.h"
 #include "DisplayIntegerScalePS_cso.h"
@@ -43,10 +45,11 @@ RenderContextResources::RenderContextResources(
 	uint32_t cbSizeBytes,
 	Size framebufferSize,
 	ID3D11Device* device,
-	const std::shared_ptr<ISimd>& simd)
+	const std::shared_ptr<ISimd>& simd,
+	const Options& options)
 {
 	CreateTexture1Ds(device);
-	CreateTextureCaches(device, simd);
+	CreateTextureCaches(device, simd, options);
 	CreateVideoTextures(device);
 	CreateShadersAndInputLayout(device);
 	CreateRasterizerState(device);
@@ -54,7 +57,9 @@ RenderContextResources::RenderContextResources(
 	CreateBlendStates(device);
 	CreateFramebuffers(framebufferSize, device);
 	CreateVertexBuffer(vbSizeBytes, device);
+	CreateQuadIndexBuffer(device);
 	CreateConstantBuffer(cbSizeBytes, device);
+	CreateSurfaceIdBuffers(device);
 }
 
 void RenderContextResources::OnNewFrame()
@@ -65,6 +70,13 @@ void RenderContextResources::OnNewFrame()
 	}
 }
 
+_Use_decl_annotations_
+ITextureCache* RenderContextResources::GetTextureCache(
+	TextureCacheSizeClass sizeClass) const
+{
+	return _textureCaches[(int32_t)sizeClass].get();
+}
+
 ITextureCache* RenderContextResources::GetTextureCache(
 	int32_t textureWidth,
 	int32_t textureHeight) const
@@ -139,13 +151,26 @@ void RenderContextResources::CreateShadersAndInputLayout(
 	D2DX_CHECK_HR(
 		device->CreatePixelShader(ResolveAA_cso, ARRAYSIZE(ResolveAA_cso), NULL, &_pixelShaders[(int32_t)RenderContextPixelShader::ResolveAA]));
 
-	D3D11_INPUT_ELEMENT_DESC inputElementDescs[4] =
+#ifdef D2DX_COMPACT_VERTEX
+	/* The 13.3 fixed-point position is read as SNORM and scaled back up by c_positionScale in the shader. */
+	D3D11_INPUT_ELEMENT_DESC inputElementDescs[5] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_SINT, 0, 4, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 0, DXGI_FORMAT_B8G8R8A8_UNORM, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 1, DXGI_FORMAT_R16G16_UINT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 2, DXGI_FORMAT_R32_UINT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+	};
+#else
+	D3D11_INPUT_ELEMENT_DESC inputElementDescs[5] =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_SINT, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "COLOR", 0, DXGI_FORMAT_B8G8R8A8_UNORM, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 1, DXGI_FORMAT_R16G16_UINT, 0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+		{ "TEXCOORD", 1, DXGI_FORMAT_R16G16_UINT, 0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 2, DXGI_FORMAT_R32_UINT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
 	};
+#endif
 
 	D2DX_CHECK_HR(
 		device->CreateInputLayout(inputElementDescs, ARRAYSIZE(inputElementDescs), GameVS_cso, ARRAYSIZE(GameVS_cso), &_inputLayout));
@@ -204,33 +229,100 @@ void RenderContextResources::CreateTexture1Ds(
 _Use_decl_annotations_
 void RenderContextResources::CreateTextureCaches(
 	ID3D11Device* device,
-	const std::shared_ptr<ISimd>& simd)
+	const std::shared_ptr<ISimd>& simd,
+	const Options& options)
+{
+	const uint32_t maxTextureArraySize = DetermineMaxTextureArraySize(device);
+	D2DX_LOG("The device supports %u textures per atlas.", maxTextureArraySize);
+
+	/* Atlas slices are addressed with D2DX_TEXTURE_ATLAS_SLICE_BITS bits in the vertex. */
+	_texturesPerAtlas = min(maxTextureArraySize, (uint32_t)D2DX_MAX_TEXTURES_PER_ATLAS);
+	_simd = simd;
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		_textureCachePolicies[i] = options.GetTextureCachePolicy((TextureCacheSizeClass)i);
+	}
+
+	_uiTextureCacheShare = options.GetUiTextureCacheShare();
+
+	SetTextureCacheCapacities(TextureCacheBalancer::DefaultCapacities, device);
+}
+
+_Use_decl_annotations_
+void RenderContextResources::SetTextureCacheCapacities(
+	const uint32_t* capacities,
+	ID3D11Device* device)
 {
-	static const uint32_t capacities[7] = { 512, 1024, 2048, 2048, 1024, 512, 1024 };
+	bool isSharedAtlasChanged = !_sharedAtlas;
 
-	const uint32_t texturesPerAtlas = DetermineMaxTextureArraySize(device);
-	D2DX_LOG("The device supports %u textures per atlas.", texturesPerAtlas);
+	for (int32_t i = 0; i < ShelfPackedAtlas::TextureSizeCount; ++i)
+	{
+		isSharedAtlasChanged |= capacities[i] != _textureCacheCapacities[i];
+	}
+
+	/* The caches for 8x8 up to 64x64 share one atlas, so that most UI, font and item draws can be merged. */
+	if (isSharedAtlasChanged)
+	{
+		_sharedAtlas = std::make_shared<ShelfPackedAtlas>(capacities, device);
+		assert(_sharedAtlas->GetSliceCount() <= _texturesPerAtlas);
+		D2DX_DEBUG_LOG("Creating shared texture atlas with %u slices.", _sharedAtlas->GetSliceCount());
+	}
+
+	const uint32_t sharedAtlasIndex = 0;
+	_textureAtlasSrvs[sharedAtlasIndex] = _sharedAtlas->GetSrv();
+	_textureAtlasCount = 1;
 
 	uint32_t totalSize = 0;
 	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
 	{
-		int32_t width = 1U << (i + 3);
-		int32_t height = 1U << (i + 3);
+		const Size textureSize = TextureCacheBalancer::GetTextureSize((TextureCacheSizeClass)i);
+		const bool isShared = textureSize.width <= ShelfPackedAtlas::MaxTextureSize;
+		const TextureCachePolicyType policyType = _textureCachePolicies[i];
+		const uint32_t pinnedCapacity = TextureCache::GetPinnedCapacity(capacities[i], _uiTextureCacheShare);
 
-		if (i == 6)
+		if (_textureCaches[i] && capacities[i] == _textureCacheCapacities[i] && !(isShared && isSharedAtlasChanged))
 		{
-			width = 256;
-			height = 128;
+			/* Unchanged caches keep their textures, but may have to move in the atlas table. */
+			if (!isShared)
+			{
+				_textureCaches[i]->SetFirstAtlasIndex(_textureAtlasCount);
+			}
+		}
+		else if (isShared)
+		{
+			_textureCaches[i] = std::make_unique<TextureCache>(textureSize.width, capacities[i], _sharedAtlas, _simd, policyType, sharedAtlasIndex, pinnedCapacity);
+		}
+		else
+		{
+			_textureCaches[i] = std::make_unique<TextureCache>(textureSize.width, textureSize.height, capacities[i], _texturesPerAtlas, device, _simd, policyType, _textureAtlasCount, pinnedCapacity);
 		}
 
-		_textureCaches[i] = std::make_unique<TextureCache>(width, height, capacities[i], texturesPerAtlas, device, simd);
+		if (_textureCacheCapacities[i] != capacities[i])
+		{
+			D2DX_DEBUG_LOG("Creating texture cache for %i x %i with capacity %u (%u pinned, %u kB) and %s policy.", textureSize.width, textureSize.height, capacities[i],
+				pinnedCapacity, _textureCaches[i]->GetMemoryFootprint() / 1024, TextureCachePolicyFactory::GetName(policyType));
+			_textureCacheCapacities[i] = capacities[i];
+		}
 
-		D2DX_DEBUG_LOG("Creating texture cache for %i x %i with capacity %u (%u kB).", width, height, capacities[i], _textureCaches[i]->GetMemoryFootprint() / 1024);
+		for (uint32_t atlasIndex = _textureAtlasCount; atlasIndex < _textureAtlasCount + _textureCaches[i]->GetAtlasCount(); ++atlasIndex)
+		{
+			_textureAtlasSrvs[atlasIndex] = _textureCaches[i]->GetSrv(atlasIndex);
+		}
+
+		_textureAtlasCount += _textureCaches[i]->GetAtlasCount();
 
 		totalSize += _textureCaches[i]->GetMemoryFootprint();
 	}
 
-	D2DX_LOG("Total size of texture caches is %u kB.", totalSize / 1024);
+	assert(_textureAtlasCount <= D2DX_MAX_TEXTURE_ATLASES);
+
+	for (uint32_t atlasIndex = _textureAtlasCount; atlasIndex < D2DX_MAX_TEXTURE_ATLASES; ++atlasIndex)
+	{
+		_textureAtlasSrvs[atlasIndex] = nullptr;
+	}
+
+	D2DX_LOG("Total size of texture caches is %u kB in %u atlases.", totalSize / 1024, _textureAtlasCount);
 }
 
 _Use_decl_annotations_
@@ -556,6 +648,39 @@ void RenderContextResources::CreateVertexBuffer(
 		device->CreateBuffer(&vbDesc, NULL, &_vb));
 }
 
+_Use_decl_annotations_
+void RenderContextResources::CreateQuadIndexBuffer(
+	ID3D11Device* device)
+{
+	/* Batches are drawn as lists of quads, each made up of the triangles 0-1-2 and 0-2-3.
+	   Since the pattern is the same for every batch, the index buffer never changes. */
+	const uint32_t quadCount = D2DX_MAX_VERTICES_PER_BATCH / 4;
+	auto indices = std::make_unique<uint16_t[]>(quadCount * 6);
+
+	const uint32_t quadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+
+	for (uint32_t i = 0; i < quadCount; ++i)
+	{
+		for (uint32_t j = 0; j < 6; ++j)
+		{
+			indices[i * 6 + j] = (uint16_t)(i * 4 + quadIndices[j]);
+		}
+	}
+
+	const CD3D11_BUFFER_DESC ibDesc
+	{
+		quadCount * 6 * sizeof(uint16_t),
+		D3D11_BIND_INDEX_BUFFER,
+		D3D11_USAGE_IMMUTABLE
+	};
+
+	D3D11_SUBRESOURCE_DATA initialData = { 0 };
+	initialData.pSysMem = indices.get();
+
+	D2DX_CHECK_HR(
+		device->CreateBuffer(&ibDesc, &initialData, &_quadIb));
+}
+
 _Use_decl_annotations_
 void RenderContextResources::CreateConstantBuffer(
 	uint32_t cbSizeBytes,
@@ -572,3 +697,54 @@ void RenderContextResources::CreateConstantBuffer(
 	D2DX_CHECK_HR(
 		device->CreateBuffer(&desc, NULL, _cb.GetAddressOf()));
 }
+
+_Use_decl_annotations_
+void RenderContextResources::CreateSurfaceIdBuffers(
+	ID3D11Device* device)
+{
+	const uint32_t quadCount = D2DX_MAX_VERTICES_PER_FRAME / 4;
+
+	const CD3D11_BUFFER_DESC surfaceIdDesc
+	{
+		quadCount * sizeof(uint32_t),
+		D3D11_BIND_SHADER_RESOURCE,
+		D3D11_USAGE_DYNAMIC,
+		D3D11_CPU_ACCESS_WRITE
+	};
+
+	D2DX_CHECK_HR(
+		device->CreateBuffer(&surfaceIdDesc, NULL, &_surfaceIdBuffer));
+
+	const CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc
+	{
+		_surfaceIdBuffer.Get(),
+		DXGI_FORMAT_R32_UINT,
+		0,
+		quadCount
+	};
+
+	D2DX_CHECK_HR(
+		device->CreateShaderResourceView(_surfaceIdBuffer.Get(), &srvDesc, &_surfaceIdSrv));
+
+	/* SV_VertexID doesn't include the base vertex of a draw, so the vertex shader can't tell which
+	   quads of the frame it is drawing. The start instance is applied to per-instance data though. */
+	auto firstQuads = std::make_unique<uint32_t[]>(quadCount);
+
+	for (uint32_t i = 0; i < quadCount; ++i)
+	{
+		firstQuads[i] = i;
+	}
+
+	const CD3D11_BUFFER_DESC firstQuadDesc
+	{
+		quadCount * sizeof(uint32_t),
+		D3D11_BIND_VERTEX_BUFFER,
+		D3D11_USAGE_IMMUTABLE
+	};
+
+	D3D11_SUBRESOURCE_DATA initialData = { 0 };
+	initialData.pSysMem = firstQuads.get();
+
+	D2DX_CHECK_HR(
+		device->CreateBuffer(&firstQuadDesc, &initialData, &_firstQuadBuffer));
+}
@@ -18,7 +18,9 @@
 */
 #pragma once
 
-#include "ITextureCache.h"
+#include "ShelfPackedAtlas.h"
+#include "TextureCache.h"
+#include "Options.h"
 #include "Types.h"
 
 namespace d2dx
@@ -75,7 +77,8 @@ namespace d2dx
 			_In_ uint32_t cbSizeBytes,
 			_In_ Size framebufferSize,
 			_In_ ID3D11Device* device,
-			_In_ const std::shared_ptr<ISimd>& simd);
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ const Options& options);
 		
 		virtual ~RenderContextResources() noexcept {}
 
@@ -99,6 +102,25 @@ namespace d2dx
 			int32_t textureWidth, 
 			int32_t textureHeight) const;
 
+		ITextureCache* GetTextureCache(
+			_In_ TextureCacheSizeClass sizeClass) const;
+
+		/* Recreates the texture caches whose capacity changed. The others keep their contents. */
+		void SetTextureCacheCapacities(
+			_In_reads_((int32_t)TextureCacheSizeClass::Count) const uint32_t* capacities,
+			_In_ ID3D11Device* device);
+
+		/* The atlases of all texture caches, indexed by TextureCacheLocation::_textureAtlas. */
+		ID3D11ShaderResourceView* const* GetTextureAtlasSrvs() const
+		{
+			return _textureAtlasSrvs;
+		}
+
+		uint32_t GetTextureAtlasCount() const
+		{
+			return _textureAtlasCount;
+		}
+
 		ID3D11Texture1D* GetTexture1D(RenderContextTexture1D texture1d) const
 		{ 
 			return _texture1Ds[(int32_t)texture1d].texture.Get();
@@ -179,11 +201,34 @@ namespace d2dx
 			return _vb.Get();
 		}
 
+		ID3D11Buffer* GetQuadIndexBuffer() const
+		{
+			return _quadIb.Get();
+		}
+
 		ID3D11Buffer* GetConstantBuffer() const
 		{
 			return _cb.Get();
 		}
 
+		/* One R32_UINT per quad of the frame's vertices, holding its surface ID and texture size. */
+		ID3D11Buffer* GetSurfaceIdBuffer() const
+		{
+			return _surfaceIdBuffer.Get();
+		}
+
+		ID3D11ShaderResourceView* GetSurfaceIdSrv() const
+		{
+			return _surfaceIdSrv.Get();
+		}
+
+		/* Per-instance vertex buffer holding 0, 1, 2, ..., which turns the start instance of a draw
+		   into the index of its first quad in the surface ID buffer. */
+		ID3D11Buffer* GetFirstQuadBuffer() const
+		{
+			return _firstQuadBuffer.Get();
+		}
+
 	private:
 		void CreateRasterizerState(
 			_In_ ID3D11Device* device);
@@ -199,7 +244,8 @@ namespace d2dx
 
 		void CreateTextureCaches(
 			_In_ ID3D11Device* device,
-			_In_ const std::shared_ptr<ISimd>& simd);
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ const Options& options);
 	
 		void CreateVideoTextures(
 			_In_ ID3D11Device* device);
@@ -218,10 +264,16 @@ namespace d2dx
 			_In_ uint32_t vbSizeBytes,
 			_In_ ID3D11Device* device);
 
+		void CreateQuadIndexBuffer(
+			_In_ ID3D11Device* device);
+
 		void CreateConstantBuffer(
 			_In_ uint32_t cbSizeBytes,
 			_In_ ID3D11Device* device);
 
+		void CreateSurfaceIdBuffers(
+			_In_ ID3D11Device* device);
+
 		ComPtr<ID3D11InputLayout> _inputLayout;
 		ComPtr<ID3D11VertexShader> _vertexShaders[(int32_t)RenderContextVertexShader::Count];
 		ComPtr<ID3D11PixelShader> _pixelShaders[(int32_t)RenderContextPixelShader::Count];
@@ -243,7 +295,15 @@ namespace d2dx
 		ComPtr<ID3D11Texture2D> _cinematicTexture;
 		ComPtr<ID3D11ShaderResourceView> _cinematicTextureSrv;
 
-		std::unique_ptr<ITextureCache> _textureCaches[7];
+		std::unique_ptr<TextureCache> _textureCaches[7];
+		uint32_t _textureCacheCapacities[7] = { 0 };
+		TextureCachePolicyType _textureCachePolicies[7] = {};
+		uint32_t _texturesPerAtlas = 0;
+		int32_t _uiTextureCacheShare = 0;
+		std::shared_ptr<ShelfPackedAtlas> _sharedAtlas;
+		std::shared_ptr<ISimd> _simd;
+		ID3D11ShaderResourceView* _textureAtlasSrvs[D2DX_MAX_TEXTURE_ATLASES] = { 0 };
+		uint32_t _textureAtlasCount = 0;
 
 		ComPtr<ID3D11RasterizerState> _rasterizerStateNoScissor;
 		ComPtr<ID3D11RasterizerState> _rasterizerState;
@@ -262,6 +322,10 @@ namespace d2dx
 		Size _framebufferSize;
 
 		ComPtr<ID3D11Buffer> _vb;
+		ComPtr<ID3D11Buffer> _quadIb;
 		ComPtr<ID3D11Buffer> _cb;
+		ComPtr<ID3D11Buffer> _surfaceIdBuffer;
+		ComPtr<ID3D11ShaderResourceView> _surfaceIdSrv;
+		ComPtr<ID3D11Buffer> _firstQuadBuffer;
 	};
 }
@@ -0,0 +1,349 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "RenderThread.h"
+#include "Profiler.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+RenderThread::RenderThread(
+	const std::shared_ptr<IRenderContext>& renderContext,
+	bool isThreaded) :
+	_renderContext{ renderContext },
+	_batchReorderer{ D2DX_MAX_BATCHES_PER_FRAME, D2DX_MAX_VERTICES_PER_FRAME },
+	_batchStateKeys(D2DX_MAX_BATCHES_PER_FRAME)
+{
+	_recordingPacket.textureUploads = Buffer<TextureUpload>(MaxTextureUploadsPerPacket);
+	_recordingPacket.textureData = Buffer<uint8_t>(TextureDataCapacity);
+	_recordingPacket.palettes = Buffer<uint32_t>(D2DX_MAX_PALETTES * 256);
+
+	_submittedPacket.batches = Buffer<Batch>(D2DX_MAX_BATCHES_PER_FRAME);
+	_submittedPacket.vertices = Buffer<Vertex>(D2DX_MAX_VERTICES_PER_FRAME);
+	_submittedPacket.textureUploads = Buffer<TextureUpload>(MaxTextureUploadsPerPacket);
+	_submittedPacket.textureData = Buffer<uint8_t>(TextureDataCapacity);
+	_submittedPacket.palettes = Buffer<uint32_t>(D2DX_MAX_PALETTES * 256);
+
+	if (!isThreaded)
+	{
+		D2DX_LOG("Rendering on the game thread.");
+		return;
+	}
+
+	_frameSubmittedEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+	_frameExecutedEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+
+	if (_frameSubmittedEvent.IsValid() && _frameExecutedEvent.IsValid())
+	{
+		_renderThread = CreateThread(nullptr, 0, RenderThreadProc, this, 0, nullptr);
+	}
+
+	if (!_renderThread)
+	{
+		D2DX_LOG("Failed to start the render thread, rendering on the game thread.");
+		return;
+	}
+
+	D2DX_LOG("Rendering on a dedicated render thread.");
+}
+
+RenderThread::~RenderThread() noexcept
+{
+	if (!_renderThread)
+	{
+		return;
+	}
+
+	/* Lets the last frame finish presenting before the thread is joined, see Flush. */
+	Flush();
+
+	_isStopping.store(true, memory_order_release);
+	SetEvent(_frameSubmittedEvent.Get());
+	WaitForSingleObject(_renderThread, INFINITE);
+	CloseHandle(_renderThread);
+	_renderThread = nullptr;
+
+	D2DX_LOG("Render thread executed %u frames, %u of them repeated (game thread stalled %u times).", _frameCount, _repeatedFrameCount, _stallCount);
+}
+
+_Use_decl_annotations_
+void RenderThread::RecordTextureUpload(
+	const Batch& batch,
+	TextureCacheLocation location,
+	const uint8_t* tmuData,
+	uint32_t tmuDataSize)
+{
+	const uint32_t dataSize = batch.GetTextureWidth() * batch.GetTextureHeight();
+
+	assert((batch.GetTextureStartAddress() + dataSize) <= tmuDataSize);
+
+	if (_recordingPacket.textureUploadCount >= _recordingPacket.textureUploads.capacity ||
+		(_recordingPacket.textureDataSize + dataSize) > _recordingPacket.textureData.capacity)
+	{
+		/* The packet is full. Once the render thread is idle, the recorded uploads (and this one)
+		   can be done right away without changing their order relative to the submitted frames. */
+		Flush();
+		ExecuteUploads(_recordingPacket);
+	}
+
+	TextureUpload& textureUpload = _recordingPacket.textureUploads.items[_recordingPacket.textureUploadCount++];
+	textureUpload.batch = batch;
+	textureUpload.location = location;
+	textureUpload.dataOffset = _recordingPacket.textureDataSize;
+
+	memcpy(_recordingPacket.textureData.items + _recordingPacket.textureDataSize, tmuData + batch.GetTextureStartAddress(), dataSize);
+	_recordingPacket.textureDataSize += dataSize;
+
+	++_contentGeneration;
+}
+
+_Use_decl_annotations_
+void RenderThread::RecordPalette(
+	int32_t paletteIndex,
+	const uint32_t* palette)
+{
+	assert(paletteIndex >= 0 && paletteIndex < D2DX_MAX_PALETTES);
+
+	memcpy(_recordingPacket.palettes.items + paletteIndex * 256, palette, 256 * sizeof(uint32_t));
+	_recordingPacket.dirtyPaletteMask |= 1U << paletteIndex;
+
+	++_contentGeneration;
+}
+
+_Use_decl_annotations_
+void RenderThread::SubmitFrame(
+	Buffer<Batch>& batches,
+	uint32_t batchCount,
+	Buffer<Vertex>& vertices,
+	uint32_t vertexCount,
+	bool isRepeatedFrame)
+{
+	/* Only block when the previous frame is still executing. */
+	const uint32_t submittedFrameCount = _submittedFrameCount.load(memory_order_relaxed);
+
+	if (submittedFrameCount != _executedFrameCount.load(memory_order_acquire))
+	{
+		++_stallCount;
+		Flush();
+	}
+
+	std::swap(_submittedPacket.batches, batches);
+	_submittedPacket.batchCount = batchCount;
+	std::swap(_submittedPacket.vertices, vertices);
+	_submittedPacket.vertexCount = vertexCount;
+	_submittedPacket.isRepeatedFrame = isRepeatedFrame;
+
+	std::swap(_submittedPacket.textureUploads, _recordingPacket.textureUploads);
+	_submittedPacket.textureUploadCount = _recordingPacket.textureUploadCount;
+	std::swap(_submittedPacket.textureData, _recordingPacket.textureData);
+	_submittedPacket.textureDataSize = _recordingPacket.textureDataSize;
+	std::swap(_submittedPacket.palettes, _recordingPacket.palettes);
+	_submittedPacket.dirtyPaletteMask = _recordingPacket.dirtyPaletteMask;
+
+	_recordingPacket.textureUploadCount = 0;
+	_recordingPacket.textureDataSize = 0;
+	_recordingPacket.dirtyPaletteMask = 0;
+
+	if (!_renderThread)
+	{
+		ExecutePacket(_submittedPacket);
+		_submittedFrameCount.store(submittedFrameCount + 1, memory_order_relaxed);
+		_executedFrameCount.store(submittedFrameCount + 1, memory_order_relaxed);
+		return;
+	}
+
+	_submittedFrameCount.store(submittedFrameCount + 1, memory_order_release);
+	SetEvent(_frameSubmittedEvent.Get());
+}
+
+void RenderThread::Flush()
+{
+	const uint32_t submittedFrameCount = _submittedFrameCount.load(memory_order_relaxed);
+
+	while (submittedFrameCount != _executedFrameCount.load(memory_order_acquire))
+	{
+		HANDLE frameExecutedEvent = _frameExecutedEvent.Get();
+
+		if (MsgWaitForMultipleObjects(1, &frameExecutedEvent, FALSE, INFINITE, QS_SENDMESSAGE) == WAIT_OBJECT_0 + 1)
+		{
+			/* Dispatches the sent messages, and nothing else. */
+			MSG msg;
+			PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+		}
+	}
+}
+
+uint32_t RenderThread::GetContentGeneration() const
+{
+	return _contentGeneration;
+}
+
+_Use_decl_annotations_
+void RenderThread::ExecuteUploads(
+	FramePacket& packet)
+{
+	for (uint32_t i = 0; i < packet.textureUploadCount; ++i)
+	{
+		const TextureUpload& textureUpload = packet.textureUploads.items[i];
+		_renderContext->UploadTexture(textureUpload.batch, textureUpload.location, packet.textureData.items + textureUpload.dataOffset);
+	}
+
+	packet.textureUploadCount = 0;
+	packet.textureDataSize = 0;
+}
+
+_Use_decl_annotations_
+void RenderThread::ExecutePacket(
+	FramePacket& packet)
+{
+	ExecuteUploads(packet);
+
+	uint32_t dirtyPaletteMask = packet.dirtyPaletteMask;
+	DWORD paletteIndex = 0;
+
+	while (BitScanForward(&paletteIndex, dirtyPaletteMask))
+	{
+		_renderContext->SetPalette((int32_t)paletteIndex, packet.palettes.items + paletteIndex * 256);
+		dirtyPaletteMask &= dirtyPaletteMask - 1;
+	}
+
+	packet.dirtyPaletteMask = 0;
+
+	if (packet.isRepeatedFrame && _renderContext->RepeatPresent())
+	{
+		++_repeatedFrameCount;
+	}
+	else
+	{
+		{
+			Timer _timer(ProfCategory::DrawBatches);
+			ReorderBatches(packet);
+			auto startVertexLocation = _renderContext->BulkWriteVertices(packet.vertices.items, packet.vertexCount);
+			_renderContext->BulkWriteSurfaceIds(packet.batches.items, packet.batchCount);
+			DrawBatches(packet, startVertexLocation);
+		}
+
+		_renderContext->Present();
+	}
+
+	++_frameCount;
+}
+
+_Use_decl_annotations_
+void RenderThread::ReorderBatches(
+	FramePacket& packet)
+{
+	for (uint32_t i = 0; i < packet.batchCount; ++i)
+	{
+		const Batch& batch = packet.batches.items[i];
+
+		/* The same state that DrawBatches requires for merging. */
+		_batchStateKeys.items[i] = batch.IsValid() ? batch.GetStateKey() : 0;
+	}
+
+	_batchReorderer.Reorder(packet.batches, packet.batchCount, packet.vertices, packet.vertexCount, _batchStateKeys.items);
+}
+
+_Use_decl_annotations_
+void RenderThread::DrawBatches(
+	const FramePacket& packet,
+	uint32_t startVertexLocation)
+{
+	const int32_t batchCount = (int32_t)packet.batchCount;
+
+	Batch mergedBatch;
+	int32_t drawCalls = 0;
+
+	for (int32_t i = 0; i < batchCount; ++i)
+	{
+		const Batch& batch = packet.batches.items[i];
+
+		if (!batch.IsValid())
+		{
+			D2DX_DEBUG_LOG("Skipping batch %i, it is invalid.", i);
+			continue;
+		}
+
+		if (!mergedBatch.IsValid())
+		{
+			mergedBatch = batch;
+		}
+		else
+		{
+			if (batch.GetStateKey() != mergedBatch.GetStateKey() ||
+				((mergedBatch.GetVertexCount() + batch.GetVertexCount()) > D2DX_MAX_VERTICES_PER_BATCH))
+			{
+				_renderContext->Draw(mergedBatch, startVertexLocation);
+				++drawCalls;
+				mergedBatch = batch;
+			}
+			else
+			{
+				mergedBatch.SetVertexCount(mergedBatch.GetVertexCount() + batch.GetVertexCount());
+			}
+		}
+	}
+
+	if (mergedBatch.IsValid())
+	{
+		_renderContext->Draw(mergedBatch, startVertexLocation);
+		++drawCalls;
+	}
+
+	if (!(_frameCount & 255))
+	{
+		D2DX_DEBUG_LOG("Nr draw calls: %i", drawCalls);
+	}
+}
+
+void RenderThread::ExecutePackets()
+{
+	uint32_t executedFrameCount = _executedFrameCount.load(memory_order_relaxed);
+
+	for (;;)
+	{
+		const bool isStopping = _isStopping.load(memory_order_acquire);
+
+		/* There is at most one packet in flight. */
+		if (executedFrameCount != _submittedFrameCount.load(memory_order_acquire))
+		{
+			ExecutePacket(_submittedPacket);
+
+			_executedFrameCount.store(++executedFrameCount, memory_order_release);
+			SetEvent(_frameExecutedEvent.Get());
+		}
+
+		if (isStopping)
+		{
+			break;
+		}
+
+		WaitForSingleObject(_frameSubmittedEvent.Get(), INFINITE);
+	}
+}
+
+_Use_decl_annotations_
+DWORD WINAPI RenderThread::RenderThreadProc(
+	LPVOID lpParameter)
+{
+	((RenderThread*)lpParameter)->ExecutePackets();
+	return 0;
+}
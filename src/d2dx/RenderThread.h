@@ -0,0 +1,139 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Batch.h"
+#include "BatchReorderer.h"
+#include "Buffer.h"
+#include "IRenderContext.h"
+#include "Vertex.h"
+
+namespace d2dx
+{
+	/*
+		Executes finished frames (texture uploads, palette updates, vertices and batches) on a
+		dedicated render thread, so that the game thread can start on the next frame while the
+		previous one is being submitted to D3D and presented.
+
+		A frame is recorded into a packet on the game thread and handed to the render thread at
+		SubmitFrame. Packets are double buffered: the game thread only blocks when it has finished
+		a frame while the previous one is still executing, i.e. when it is more than one frame ahead.
+
+		All other uses of the render context from the game thread must be preceded by Flush.
+		If the render thread is disabled, packets are executed directly in SubmitFrame.
+	*/
+	class RenderThread final
+	{
+	public:
+		RenderThread(
+			_In_ const std::shared_ptr<IRenderContext>& renderContext,
+			_In_ bool isThreaded);
+
+		~RenderThread() noexcept;
+
+		/* Copies the texture's data out of TMU memory so that it can be uploaded by the render thread. */
+		void RecordTextureUpload(
+			_In_ const Batch& batch,
+			_In_ TextureCacheLocation location,
+			_In_reads_(tmuDataSize) const uint8_t* tmuData,
+			_In_ uint32_t tmuDataSize);
+
+		void RecordPalette(
+			_In_ int32_t paletteIndex,
+			_In_reads_(256) const uint32_t* palette);
+
+		/* Hands the frame to the render thread. The batch and vertex buffers are swapped for ones
+		   that are no longer in use by the render thread. A repeated frame is identical to the
+		   previous one, and is only re-presented unless the render context can't do that. */
+		void SubmitFrame(
+			_Inout_ Buffer<Batch>& batches,
+			_In_ uint32_t batchCount,
+			_Inout_ Buffer<Vertex>& vertices,
+			_In_ uint32_t vertexCount,
+			_In_ bool isRepeatedFrame);
+
+		/* Waits until all submitted frames have been executed. The game thread owns the window, and
+		   Present may send it messages and wait for them to be handled, so the messages sent to this
+		   thread are dispatched while waiting. Posted messages are left for the game's own loop. */
+		void Flush();
+
+		/* Incremented whenever a texture upload or palette change is recorded. */
+		uint32_t GetContentGeneration() const;
+
+	private:
+		static constexpr uint32_t MaxTextureUploadsPerPacket = 4096;
+		static constexpr uint32_t TextureDataCapacity = 4 * 1024 * 1024;
+
+		struct TextureUpload final
+		{
+			Batch batch;
+			TextureCacheLocation location;
+			uint32_t dataOffset;
+		};
+
+		struct FramePacket final
+		{
+			Buffer<Batch> batches;
+			uint32_t batchCount = 0;
+			Buffer<Vertex> vertices;
+			uint32_t vertexCount = 0;
+			Buffer<TextureUpload> textureUploads;
+			uint32_t textureUploadCount = 0;
+			Buffer<uint8_t> textureData;
+			uint32_t textureDataSize = 0;
+			Buffer<uint32_t> palettes;
+			uint32_t dirtyPaletteMask = 0;
+			bool isRepeatedFrame = false;
+		};
+
+		void ExecuteUploads(
+			_Inout_ FramePacket& packet);
+
+		void ExecutePacket(
+			_Inout_ FramePacket& packet);
+
+		void ReorderBatches(
+			_Inout_ FramePacket& packet);
+
+		void DrawBatches(
+			_In_ const FramePacket& packet,
+			_In_ uint32_t startVertexLocation);
+
+		void ExecutePackets();
+
+		static DWORD WINAPI RenderThreadProc(
+			_In_ LPVOID lpParameter);
+
+		std::shared_ptr<IRenderContext> _renderContext;
+		BatchReorderer _batchReorderer;
+		Buffer<uint64_t> _batchStateKeys;
+		FramePacket _recordingPacket;
+		FramePacket _submittedPacket;
+		HANDLE _renderThread = nullptr;
+		EventHandle _frameSubmittedEvent;
+		EventHandle _frameExecutedEvent;
+		std::atomic<uint32_t> _submittedFrameCount = { 0 };
+		std::atomic<uint32_t> _executedFrameCount = { 0 };
+		std::atomic<bool> _isStopping = { false };
+		uint32_t _frameCount = 0;
+		uint32_t _repeatedFrameCount = 0;
+		uint32_t _stallCount = 0;
+		uint32_t _contentGeneration = 0;
+	};
+}
@@ -0,0 +1,135 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "ShelfPackedAtlas.h"
+#include "Utils.h"
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+ShelfPackedAtlas::ShelfPackedAtlas(
+	const uint32_t* capacities,
+	ID3D11Device* device)
+{
+	int32_t slice = 0;
+	int32_t y = 0;
+
+	for (int32_t sizeIndex = TextureSizeCount - 1; sizeIndex >= 0; --sizeIndex)
+	{
+		const int32_t textureSize = MinTextureSize << sizeIndex;
+		const uint32_t texturesPerShelf = SliceSize / textureSize;
+		const uint32_t shelfCount = (capacities[sizeIndex] + texturesPerShelf - 1) / texturesPerShelf;
+
+		_capacities[sizeIndex] = capacities[sizeIndex];
+		_shelves[sizeIndex] = Buffer<Shelf>(max(1U, shelfCount));
+
+		for (uint32_t i = 0; i < shelfCount; ++i)
+		{
+			if ((y + textureSize) > SliceSize)
+			{
+				++slice;
+				y = 0;
+			}
+
+			_shelves[sizeIndex].items[i] = { (int16_t)slice, (int16_t)y };
+			y += textureSize;
+		}
+	}
+
+	_sliceCount = (uint32_t)slice + (y > 0 ? 1 : 0);
+
+#ifndef D2DX_UNITTEST
+	CD3D11_TEXTURE2D_DESC desc
+	{
+		DXGI_FORMAT_R8_UINT,
+		(UINT)SliceSize,
+		(UINT)SliceSize,
+		max(1U, _sliceCount),
+		1U,
+		D3D11_BIND_SHADER_RESOURCE,
+		D3D11_USAGE_DEFAULT
+	};
+
+	D2DX_CHECK_HR(device->CreateTexture2D(&desc, nullptr, &_texture));
+	D2DX_CHECK_HR(device->CreateShaderResourceView(_texture.Get(), NULL, _srv.GetAddressOf()));
+
+	device->GetImmediateContext(&_deviceContext);
+	assert(_deviceContext);
+#endif
+}
+
+_Use_decl_annotations_
+TextureCacheLocation ShelfPackedAtlas::GetLocation(
+	int32_t textureSize,
+	uint32_t slot) const
+{
+	DWORD textureSizeLog2;
+	BitScanReverse(&textureSizeLog2, (DWORD)textureSize);
+	const int32_t sizeIndex = (int32_t)textureSizeLog2 - 3;
+
+	assert(sizeIndex >= 0 && sizeIndex < TextureSizeCount);
+	assert(slot < _capacities[sizeIndex]);
+
+	const uint32_t texturesPerShelf = SliceSize / textureSize;
+	const Shelf& shelf = _shelves[sizeIndex].items[slot / texturesPerShelf];
+
+	/* Shelves are packed from the largest size down, so every texture is aligned to its size, which
+	   the bilinear pixel shader relies on to find the bounds of the texture it samples. */
+	assert(!(shelf.y & (textureSize - 1)));
+
+	return { 0, shelf.slice, (int16_t)((slot & (texturesPerShelf - 1)) * textureSize), shelf.y };
+}
+
+_Use_decl_annotations_
+void ShelfPackedAtlas::UploadTexture(
+	TextureCacheLocation location,
+	int32_t width,
+	int32_t height,
+	const uint8_t* data)
+{
+	assert(location._textureIndex >= 0 && location._textureIndex < (int32_t)_sliceCount);
+	assert((location._originS + width) <= SliceSize && (location._originT + height) <= SliceSize);
+
+#ifndef D2DX_UNITTEST
+	CD3D11_BOX box;
+	box.left = location._originS;
+	box.top = location._originT;
+	box.right = location._originS + width;
+	box.bottom = location._originT + height;
+	box.front = 0;
+	box.back = 1;
+
+	_deviceContext->UpdateSubresource(_texture.Get(), location._textureIndex, &box, data, width, 0);
+#endif
+}
+
+ID3D11ShaderResourceView* ShelfPackedAtlas::GetSrv() const
+{
+	return _srv.Get();
+}
+
+uint32_t ShelfPackedAtlas::GetSliceCount() const
+{
+	return _sliceCount;
+}
+
+uint32_t ShelfPackedAtlas::GetMemoryFootprint() const
+{
+	return SliceSize * SliceSize * _sliceCount;
+}
@@ -0,0 +1,81 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "ITextureCache.h"
+
+namespace d2dx
+{
+	/*
+		A texture atlas of 256x256 slices shared by the texture caches for 8x8 up to 64x64, so that
+		batches using textures of different sizes can still be drawn together. Each texture size gets
+		whole shelves (rows of texture slots as high as the size), packed top to bottom from the
+		largest size down, so no space is lost between them. Textures are placed in the sub-rect of
+		their slot, and the caches replace textures one slot at a time as before.
+
+		There is no gutter between the textures: each one is aligned to its size, so the bilinear
+		pixel shader clamps its filter footprint to the texture using only the texture size.
+	*/
+	class ShelfPackedAtlas final
+	{
+	public:
+		static constexpr int32_t SliceSize = 256;
+		static constexpr int32_t MinTextureSize = 8;
+		static constexpr int32_t MaxTextureSize = 64;
+		static constexpr int32_t TextureSizeCount = 4;
+
+		/* capacities[i] is the number of slots for textures of size (8 << i) x (8 << i). */
+		ShelfPackedAtlas(
+			_In_reads_(TextureSizeCount) const uint32_t* capacities,
+			_In_opt_ ID3D11Device* device);
+
+		~ShelfPackedAtlas() noexcept {}
+
+		TextureCacheLocation GetLocation(
+			_In_ int32_t textureSize,
+			_In_ uint32_t slot) const;
+
+		void UploadTexture(
+			_In_ TextureCacheLocation location,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_reads_(width * height) const uint8_t* data);
+
+		ID3D11ShaderResourceView* GetSrv() const;
+
+		uint32_t GetSliceCount() const;
+
+		uint32_t GetMemoryFootprint() const;
+
+	private:
+		struct Shelf final
+		{
+			int16_t slice;
+			int16_t y;
+		};
+
+		Buffer<Shelf> _shelves[TextureSizeCount];
+		uint32_t _capacities[TextureSizeCount] = { 0 };
+		uint32_t _sliceCount = 0;
+		ComPtr<ID3D11DeviceContext> _deviceContext;
+		ComPtr<ID3D11Texture2D> _texture;
+		ComPtr<ID3D11ShaderResourceView> _srv;
+	};
+}
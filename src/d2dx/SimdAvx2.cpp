@@ -0,0 +1,294 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "SimdAvx2.h"
+#include "D2Types.h"
+#include "QuadListWriter.h"
+#include <immintrin.h>
+
+using namespace d2dx;
+using namespace std;
+
+/* Note: this file is built without /arch:AVX2 on purpose. The AVX2 code paths are only reached
+   after a CPU check, whereas inline functions compiled with /arch:AVX2 could be picked by the
+   linker for the rest of the DLL too. */
+
+_Use_decl_annotations_
+int32_t SimdAvx2::IndexOfUInt32(
+	const uint32_t* __restrict items,
+	uint32_t itemsCount,
+	uint32_t item)
+{
+	assert(items && ((uintptr_t)items & 63) == 0);
+	assert(!(itemsCount & 0x3F));
+
+	const __m256i key8 = _mm256_set1_epi32(item);
+
+	for (uint32_t i = 0; i < itemsCount; i += 64)
+	{
+		const __m256i cmp0 = _mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 0]));
+		const __m256i cmp1 = _mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 8]));
+		const __m256i cmp2 = _mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 16]));
+		const __m256i cmp3 = _mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 24]));
+		const __m256i cmp4 = _mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 32]));
+		const __m256i cmp5 = _mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 40]));
+		const __m256i cmp6 = _mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 48]));
+		const __m256i cmp7 = _mm256_cmpeq_epi32(key8, _mm256_load_si256((const __m256i*)&items[i + 56]));
+
+		const __m256i any = _mm256_or_si256(
+			_mm256_or_si256(_mm256_or_si256(cmp0, cmp1), _mm256_or_si256(cmp2, cmp3)),
+			_mm256_or_si256(_mm256_or_si256(cmp4, cmp5), _mm256_or_si256(cmp6, cmp7)));
+
+		if (_mm256_testz_si256(any, any))
+		{
+			continue;
+		}
+
+		/* One bit per item. */
+		const uint32_t res0123 =
+			(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp0)) |
+			((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp1)) << 8) |
+			((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp2)) << 16) |
+			((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp3)) << 24);
+		const uint32_t res4567 =
+			(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp4)) |
+			((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp5)) << 8) |
+			((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp6)) << 16) |
+			((uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp7)) << 24);
+
+		DWORD bitIndex = 0;
+		int32_t findIndex = (int32_t)i;
+
+		if (!BitScanForward(&bitIndex, res0123))
+		{
+			BitScanForward(&bitIndex, res4567);
+			findIndex += 32;
+		}
+
+		findIndex += (int32_t)bitIndex;
+		assert(findIndex >= 0 && findIndex < (int32_t)itemsCount);
+		assert(items[findIndex] == item);
+		return findIndex;
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+int32_t SimdAvx2::IndexOfUInt64(
+	const uint64_t* __restrict items,
+	uint32_t itemsCount,
+	uint64_t item)
+{
+	assert(items && ((uintptr_t)items & 0x1F) == 0);
+	assert(!(itemsCount & 0x1F));
+
+	const __m256i key4 = _mm256_set1_epi64x(item);
+
+	for (uint32_t i = 0; i < itemsCount; i += 32)
+	{
+		const __m256i cmp0 = _mm256_cmpeq_epi64(key4, _mm256_load_si256((const __m256i*)&items[i + 0]));
+		const __m256i cmp1 = _mm256_cmpeq_epi64(key4, _mm256_load_si256((const __m256i*)&items[i + 4]));
+		const __m256i cmp2 = _mm256_cmpeq_epi64(key4, _mm256_load_si256((const __m256i*)&items[i + 8]));
+		const __m256i cmp3 = _mm256_cmpeq_epi64(key4, _mm256_load_si256((const __m256i*)&items[i + 12]));
+		const __m256i cmp4 = _mm256_cmpeq_epi64(key4, _mm256_load_si256((const __m256i*)&items[i + 16]));
+		const __m256i cmp5 = _mm256_cmpeq_epi64(key4, _mm256_load_si256((const __m256i*)&items[i + 20]));
+		const __m256i cmp6 = _mm256_cmpeq_epi64(key4, _mm256_load_si256((const __m256i*)&items[i + 24]));
+		const __m256i cmp7 = _mm256_cmpeq_epi64(key4, _mm256_load_si256((const __m256i*)&items[i + 28]));
+
+		const __m256i any = _mm256_or_si256(
+			_mm256_or_si256(_mm256_or_si256(cmp0, cmp1), _mm256_or_si256(cmp2, cmp3)),
+			_mm256_or_si256(_mm256_or_si256(cmp4, cmp5), _mm256_or_si256(cmp6, cmp7)));
+
+		if (_mm256_testz_si256(any, any))
+		{
+			continue;
+		}
+
+		/* One bit per item. */
+		const uint32_t res =
+			(uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp0)) |
+			((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp1)) << 4) |
+			((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp2)) << 8) |
+			((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp3)) << 12) |
+			((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp4)) << 16) |
+			((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp5)) << 20) |
+			((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp6)) << 24) |
+			((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp7)) << 28);
+
+		DWORD bitIndex = 0;
+		BitScanForward(&bitIndex, res);
+		const int32_t findIndex = (int32_t)(i + bitIndex);
+		assert(findIndex >= 0 && findIndex < (int32_t)itemsCount);
+		assert(items[findIndex] == item);
+		return findIndex;
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+uint32_t SimdAvx2::ExpandVertexArray(
+	uint32_t mode,
+	uint32_t count,
+	const D2::Vertex* const* d2Vertices,
+	const Vertex& templateVertex,
+	uint32_t maskedConstantColor,
+	uint32_t iteratedColorMask,
+	int32_t stShift,
+	Vertex* __restrict vertices)
+{
+	static_assert(sizeof(Vertex) == (Vertex::IsCompact ? 16 : 20), "sizeof(Vertex)");
+	assert(count >= 3);
+
+	/* Most draws are quads (count == 4), which the SSE2 kernel handles in a single iteration. */
+	if (count <= 4)
+	{
+		return _sse2.ExpandVertexArray(mode, count, d2Vertices, templateVertex, maskedConstantColor, iteratedColorMask, stShift, vertices);
+	}
+
+	/* The last dword of a Vertex (palette/atlas index, chroma key) comes from the template. */
+	uint32_t attributes = 0;
+	memcpy(&attributes, (const uint8_t*)&templateVertex + sizeof(Vertex) - sizeof(uint32_t), sizeof(uint32_t));
+
+	const __m256i constantColor8 = _mm256_set1_epi32(maskedConstantColor);
+	const __m256i colorMask8 = _mm256_set1_epi32(iteratedColorMask);
+	const __m256i lowWordMask8 = _mm256_set1_epi32(0xFFFF);
+	const __m128i shift = _mm_cvtsi32_si128(stShift);
+#ifdef D2DX_COMPACT_VERTEX
+	const __m256 positionScale8 = _mm256_set1_ps((float)(1 << Vertex::PositionFractionBits));
+	const __m256 positionMin8 = _mm256_set1_ps(-32767.0f);
+	const __m256 positionMax8 = _mm256_set1_ps(32767.0f);
+	const __m256 attributes8 = _mm256_castsi256_ps(_mm256_set1_epi32(attributes));
+#else
+	const __m256i attributes0 = _mm256_setr_epi32(attributes, 0, 0, 0, attributes, 0, 0, 0);
+	const __m256i attributes1 = _mm256_setr_epi32(0, attributes, 0, 0, 0, attributes, 0, 0);
+	const __m256i attributes2 = _mm256_setr_epi32(0, 0, attributes, 0, 0, 0, attributes, 0);
+	const __m256i attributes3 = _mm256_setr_epi32(0, 0, 0, attributes, 0, 0, 0, attributes);
+#endif
+
+	alignas(32) Vertex converted[8];
+	__m128i* convertedPtr = (__m128i*)converted;
+
+	QuadListWriter writer{ mode, vertices };
+
+	for (uint32_t i = 0; i < count; i += 8)
+	{
+		/* Pad the last group by repeating the last vertex; the extra results are never pushed. */
+		const D2::Vertex* p[8];
+
+		for (uint32_t j = 0; j < 8; ++j)
+		{
+			p[j] = d2Vertices[min(i + j, count - 1)];
+		}
+
+		/* Vertices 0-3 go in the low lane and 4-7 in the high lane, so that each lane
+		   works exactly like the SSE2 kernel. */
+		__m256 r0 = _mm256_setr_m128(_mm_loadu_ps(&p[0]->x), _mm_loadu_ps(&p[4]->x));
+		__m256 r1 = _mm256_setr_m128(_mm_loadu_ps(&p[1]->x), _mm_loadu_ps(&p[5]->x));
+		__m256 r2 = _mm256_setr_m128(_mm_loadu_ps(&p[2]->x), _mm_loadu_ps(&p[6]->x));
+		__m256 r3 = _mm256_setr_m128(_mm_loadu_ps(&p[3]->x), _mm_loadu_ps(&p[7]->x));
+
+		/* Rows of (x, y, color, padding) transposed into columns within each lane. */
+		__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+		__m256 t1 = _mm256_unpacklo_ps(r2, r3);
+		__m256 t2 = _mm256_unpackhi_ps(r0, r1);
+		__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+		const __m256 x8 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m256 y8 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+		const __m256 color8 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+
+		const __m256 st01 = _mm256_setr_m128(
+			_mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&p[0]->s), (const __m64*)&p[1]->s),
+			_mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&p[4]->s), (const __m64*)&p[5]->s));
+		const __m256 st23 = _mm256_setr_m128(
+			_mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&p[2]->s), (const __m64*)&p[3]->s),
+			_mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&p[6]->s), (const __m64*)&p[7]->s));
+		const __m256 s8 = _mm256_shuffle_ps(st01, st23, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m256 t8 = _mm256_shuffle_ps(st01, st23, _MM_SHUFFLE(3, 1, 3, 1));
+
+		const __m256i si8 = _mm256_sra_epi32(_mm256_cvttps_epi32(s8), shift);
+		const __m256i ti8 = _mm256_sra_epi32(_mm256_cvttps_epi32(t8), shift);
+		const __m256i packedSt8 = _mm256_or_si256(_mm256_and_si256(si8, lowWordMask8), _mm256_slli_epi32(ti8, 16));
+		const __m256i blendedColor8 = _mm256_or_si256(constantColor8, _mm256_and_si256(_mm256_castps_si256(color8), colorMask8));
+
+#ifdef D2DX_COMPACT_VERTEX
+		/* Pack x and y to 13.3 fixed point, interleaved into one dword per vertex. */
+		const __m256i xi8 = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(x8, positionScale8), positionMin8), positionMax8));
+		const __m256i yi8 = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(y8, positionScale8), positionMin8), positionMax8));
+		const __m256i packedXy8 = _mm256_packs_epi32(xi8, yi8);
+		const __m256 xy8 = _mm256_castsi256_ps(_mm256_unpacklo_epi16(packedXy8, _mm256_srli_si256(packedXy8, 8)));
+
+		/* Back to rows of (xy, st, color, attributes), which are exactly 16-byte vertices. */
+		t0 = _mm256_unpacklo_ps(xy8, _mm256_castsi256_ps(packedSt8));
+		t1 = _mm256_unpacklo_ps(_mm256_castsi256_ps(blendedColor8), attributes8);
+		t2 = _mm256_unpackhi_ps(xy8, _mm256_castsi256_ps(packedSt8));
+		t3 = _mm256_unpackhi_ps(_mm256_castsi256_ps(blendedColor8), attributes8);
+		const __m256 out0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m256 out1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+		const __m256 out2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+		const __m256 out3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+		_mm_store_ps((float*)(convertedPtr + 0), _mm256_castps256_ps128(out0));
+		_mm_store_ps((float*)(convertedPtr + 1), _mm256_castps256_ps128(out1));
+		_mm_store_ps((float*)(convertedPtr + 2), _mm256_castps256_ps128(out2));
+		_mm_store_ps((float*)(convertedPtr + 3), _mm256_castps256_ps128(out3));
+		_mm_store_ps((float*)(convertedPtr + 4), _mm256_extractf128_ps(out0, 1));
+		_mm_store_ps((float*)(convertedPtr + 5), _mm256_extractf128_ps(out1, 1));
+		_mm_store_ps((float*)(convertedPtr + 6), _mm256_extractf128_ps(out2, 1));
+		_mm_store_ps((float*)(convertedPtr + 7), _mm256_extractf128_ps(out3, 1));
+#else
+		/* Back to rows of (x, y, st, color), then interleave the attributes dword to get 20-byte vertices. */
+		t0 = _mm256_unpacklo_ps(x8, y8);
+		t1 = _mm256_unpacklo_ps(_mm256_castsi256_ps(packedSt8), _mm256_castsi256_ps(blendedColor8));
+		t2 = _mm256_unpackhi_ps(x8, y8);
+		t3 = _mm256_unpackhi_ps(_mm256_castsi256_ps(packedSt8), _mm256_castsi256_ps(blendedColor8));
+		const __m256i v0 = _mm256_castps_si256(_mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0)));
+		const __m256i v1 = _mm256_castps_si256(_mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2)));
+		const __m256i v2 = _mm256_castps_si256(_mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0)));
+		const __m256i v3 = _mm256_castps_si256(_mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2)));
+
+		const __m256i out0 = v0;
+		const __m256i out1 = _mm256_or_si256(attributes0, _mm256_slli_si256(v1, 4));
+		const __m256i out2 = _mm256_or_si256(_mm256_or_si256(_mm256_srli_si256(v1, 12), attributes1), _mm256_slli_si256(v2, 8));
+		const __m256i out3 = _mm256_or_si256(_mm256_or_si256(_mm256_srli_si256(v2, 8), attributes2), _mm256_slli_si256(v3, 12));
+		const __m256i out4 = _mm256_or_si256(_mm256_srli_si256(v3, 4), attributes3);
+
+		_mm_store_si128(convertedPtr + 0, _mm256_castsi256_si128(out0));
+		_mm_store_si128(convertedPtr + 1, _mm256_castsi256_si128(out1));
+		_mm_store_si128(convertedPtr + 2, _mm256_castsi256_si128(out2));
+		_mm_store_si128(convertedPtr + 3, _mm256_castsi256_si128(out3));
+		_mm_store_si128(convertedPtr + 4, _mm256_castsi256_si128(out4));
+		_mm_store_si128(convertedPtr + 5, _mm256_extracti128_si256(out0, 1));
+		_mm_store_si128(convertedPtr + 6, _mm256_extracti128_si256(out1, 1));
+		_mm_store_si128(convertedPtr + 7, _mm256_extracti128_si256(out2, 1));
+		_mm_store_si128(convertedPtr + 8, _mm256_extracti128_si256(out3, 1));
+		_mm_store_si128(convertedPtr + 9, _mm256_extracti128_si256(out4, 1));
+#endif
+
+		const uint32_t convertedCount = min(8U, count - i);
+
+		for (uint32_t j = 0; j < convertedCount; ++j)
+		{
+			writer.Push(converted[j]);
+		}
+	}
+
+	return writer.Finish();
+}
@@ -0,0 +1,124 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "SimdAvx512.h"
+#include <immintrin.h>
+
+using namespace d2dx;
+
+/* Note: like SimdAvx2.cpp, this file is built without /arch on purpose, so that no AVX-512
+   instructions end up outside of the code paths that are only reached after a CPU check. */
+
+_Use_decl_annotations_
+int32_t SimdAvx512::IndexOfUInt32(
+	const uint32_t* __restrict items,
+	uint32_t itemsCount,
+	uint32_t item)
+{
+	assert(items && ((uintptr_t)items & 63) == 0);
+	assert(!(itemsCount & 0x3F));
+
+	const __m512i key16 = _mm512_set1_epi32((int)item);
+
+	for (uint32_t i = 0; i < itemsCount; i += 64)
+	{
+		const __mmask16 res0 = _mm512_cmpeq_epi32_mask(key16, _mm512_load_si512(&items[i + 0]));
+		const __mmask16 res1 = _mm512_cmpeq_epi32_mask(key16, _mm512_load_si512(&items[i + 16]));
+		const __mmask16 res2 = _mm512_cmpeq_epi32_mask(key16, _mm512_load_si512(&items[i + 32]));
+		const __mmask16 res3 = _mm512_cmpeq_epi32_mask(key16, _mm512_load_si512(&items[i + 48]));
+
+		/* One bit per item. */
+		const uint32_t res01 = (uint32_t)res0 | ((uint32_t)res1 << 16);
+		const uint32_t res23 = (uint32_t)res2 | ((uint32_t)res3 << 16);
+
+		if (!(res01 | res23))
+		{
+			continue;
+		}
+
+		DWORD bitIndex = 0;
+		int32_t findIndex = (int32_t)i;
+
+		if (!BitScanForward(&bitIndex, res01))
+		{
+			BitScanForward(&bitIndex, res23);
+			findIndex += 32;
+		}
+
+		findIndex += (int32_t)bitIndex;
+		assert(findIndex >= 0 && findIndex < (int32_t)itemsCount);
+		assert(items[findIndex] == item);
+		return findIndex;
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+int32_t SimdAvx512::IndexOfUInt64(
+	const uint64_t* __restrict items,
+	uint32_t itemsCount,
+	uint64_t item)
+{
+	assert(items && ((uintptr_t)items & 0x1F) == 0);
+	assert(!(itemsCount & 0x1F));
+
+	const __m512i key8 = _mm512_set1_epi64((long long)item);
+
+	/* The items are only guaranteed to be 32-byte aligned, hence the unaligned loads. */
+	for (uint32_t i = 0; i < itemsCount; i += 32)
+	{
+		const __mmask8 res0 = _mm512_cmpeq_epi64_mask(key8, _mm512_loadu_si512(&items[i + 0]));
+		const __mmask8 res1 = _mm512_cmpeq_epi64_mask(key8, _mm512_loadu_si512(&items[i + 8]));
+		const __mmask8 res2 = _mm512_cmpeq_epi64_mask(key8, _mm512_loadu_si512(&items[i + 16]));
+		const __mmask8 res3 = _mm512_cmpeq_epi64_mask(key8, _mm512_loadu_si512(&items[i + 24]));
+
+		/* One bit per item. */
+		const uint32_t res = (uint32_t)res0 | ((uint32_t)res1 << 8) | ((uint32_t)res2 << 16) | ((uint32_t)res3 << 24);
+
+		if (!res)
+		{
+			continue;
+		}
+
+		DWORD bitIndex = 0;
+		BitScanForward(&bitIndex, res);
+		const int32_t findIndex = (int32_t)(i + bitIndex);
+		assert(findIndex >= 0 && findIndex < (int32_t)itemsCount);
+		assert(items[findIndex] == item);
+		return findIndex;
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+uint32_t SimdAvx512::ExpandVertexArray(
+	uint32_t mode,
+	uint32_t count,
+	const D2::Vertex* const* d2Vertices,
+	const Vertex& templateVertex,
+	uint32_t maskedConstantColor,
+	uint32_t iteratedColorMask,
+	int32_t stShift,
+	Vertex* __restrict vertices)
+{
+	/* The per-vertex gather doesn't get any faster with wider vectors. */
+	return _avx2.ExpandVertexArray(mode, count, d2Vertices, templateVertex, maskedConstantColor, iteratedColorMask, stShift, vertices);
+}
@@ -0,0 +1,55 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "ISimd.h"
+#include "SimdAvx2.h"
+
+namespace d2dx
+{
+	/* Uses AVX-512 for the searches, and AVX2 for the rest. Only create this if IsAvx512Supported(). */
+	class SimdAvx512 final : public ISimd
+	{
+	public:
+		virtual ~SimdAvx512() noexcept {}
+
+		virtual int32_t IndexOfUInt32(
+			_In_reads_(itemsCount) const uint32_t* __restrict items,
+			_In_ uint32_t itemsCount,
+			_In_ uint32_t item) override;
+
+		virtual int32_t IndexOfUInt64(
+			_In_reads_(itemsCount) const uint64_t* __restrict items,
+			_In_ uint32_t itemsCount,
+			_In_ uint64_t item) override;
+
+		virtual uint32_t ExpandVertexArray(
+			_In_ uint32_t mode,
+			_In_ uint32_t count,
+			_In_reads_(count) const D2::Vertex* const* d2Vertices,
+			_In_ const Vertex& templateVertex,
+			_In_ uint32_t maskedConstantColor,
+			_In_ uint32_t iteratedColorMask,
+			_In_ int32_t stShift,
+			_Out_writes_(4 * ((count - 1) / 2)) Vertex* __restrict vertices) override;
+
+	private:
+		SimdAvx2 _avx2;
+	};
+}
@@ -18,6 +18,8 @@
 */
 #include "pch.h"
 #include "SimdSse2.h"
+#include "D2Types.h"
+#include "QuadListWriter.h"
 
 using namespace d2dx;
 using namespace std;
@@ -214,3 +216,116 @@ int32_t SimdSse2::IndexOfUInt64(
 
 	return -1;
 }
+
+_Use_decl_annotations_
+uint32_t SimdSse2::ExpandVertexArray(
+	uint32_t mode,
+	uint32_t count,
+	const D2::Vertex* const* d2Vertices,
+	const Vertex& templateVertex,
+	uint32_t maskedConstantColor,
+	uint32_t iteratedColorMask,
+	int32_t stShift,
+	Vertex* __restrict vertices)
+{
+	static_assert(sizeof(Vertex) == (Vertex::IsCompact ? 16 : 20), "sizeof(Vertex)");
+	assert(count >= 3);
+
+	/* The last dword of a Vertex (palette/atlas index, chroma key) comes from the template. */
+	uint32_t attributes = 0;
+	memcpy(&attributes, (const uint8_t*)&templateVertex + sizeof(Vertex) - sizeof(uint32_t), sizeof(uint32_t));
+
+	const __m128i constantColor4 = _mm_set1_epi32(maskedConstantColor);
+	const __m128i colorMask4 = _mm_set1_epi32(iteratedColorMask);
+	const __m128i lowWordMask4 = _mm_set1_epi32(0xFFFF);
+	const __m128i shift = _mm_cvtsi32_si128(stShift);
+#ifdef D2DX_COMPACT_VERTEX
+	const __m128 positionScale4 = _mm_set1_ps((float)(1 << Vertex::PositionFractionBits));
+	const __m128 positionMin4 = _mm_set1_ps(-32767.0f);
+	const __m128 positionMax4 = _mm_set1_ps(32767.0f);
+	const __m128 attributes4 = _mm_castsi128_ps(_mm_set1_epi32(attributes));
+#else
+	const __m128i attributes0 = _mm_setr_epi32(attributes, 0, 0, 0);
+	const __m128i attributes1 = _mm_setr_epi32(0, attributes, 0, 0);
+	const __m128i attributes2 = _mm_setr_epi32(0, 0, attributes, 0);
+	const __m128i attributes3 = _mm_setr_epi32(0, 0, 0, attributes);
+#endif
+
+	alignas(16) Vertex converted[4];
+	__m128i* convertedPtr = (__m128i*)converted;
+
+	QuadListWriter writer{ mode, vertices };
+
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		/* Pad the last group by repeating the last vertex; the extra results are never pushed. */
+		const D2::Vertex* p0 = d2Vertices[i];
+		const D2::Vertex* p1 = d2Vertices[min(i + 1, count - 1)];
+		const D2::Vertex* p2 = d2Vertices[min(i + 2, count - 1)];
+		const D2::Vertex* p3 = d2Vertices[min(i + 3, count - 1)];
+
+		/* Rows of (x, y, color, padding) transposed into columns. */
+		__m128 x4 = _mm_loadu_ps(&p0->x);
+		__m128 y4 = _mm_loadu_ps(&p1->x);
+		__m128 color4 = _mm_loadu_ps(&p2->x);
+		__m128 padding4 = _mm_loadu_ps(&p3->x);
+		_MM_TRANSPOSE4_PS(x4, y4, color4, padding4);
+
+		const __m128 st01 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&p0->s), (const __m64*)&p1->s);
+		const __m128 st23 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)&p2->s), (const __m64*)&p3->s);
+		const __m128 s4 = _mm_shuffle_ps(st01, st23, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 t4 = _mm_shuffle_ps(st01, st23, _MM_SHUFFLE(3, 1, 3, 1));
+
+		const __m128i si4 = _mm_sra_epi32(_mm_cvttps_epi32(s4), shift);
+		const __m128i ti4 = _mm_sra_epi32(_mm_cvttps_epi32(t4), shift);
+		const __m128i packedSt4 = _mm_or_si128(_mm_and_si128(si4, lowWordMask4), _mm_slli_epi32(ti4, 16));
+		const __m128i blendedColor4 = _mm_or_si128(constantColor4, _mm_and_si128(_mm_castps_si128(color4), colorMask4));
+
+#ifdef D2DX_COMPACT_VERTEX
+		/* Pack x and y to 13.3 fixed point, interleaved into one dword per vertex. */
+		const __m128i xi4 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(x4, positionScale4), positionMin4), positionMax4));
+		const __m128i yi4 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(y4, positionScale4), positionMin4), positionMax4));
+		const __m128i packedXy = _mm_packs_epi32(xi4, yi4);
+		const __m128i xy4 = _mm_unpacklo_epi16(packedXy, _mm_srli_si128(packedXy, 8));
+
+		/* Back to rows of (xy, st, color, attributes), which are exactly four 16-byte vertices. */
+		__m128 r0 = _mm_castsi128_ps(xy4);
+		__m128 r1 = _mm_castsi128_ps(packedSt4);
+		__m128 r2 = _mm_castsi128_ps(blendedColor4);
+		__m128 r3 = attributes4;
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		_mm_store_ps((float*)(convertedPtr + 0), r0);
+		_mm_store_ps((float*)(convertedPtr + 1), r1);
+		_mm_store_ps((float*)(convertedPtr + 2), r2);
+		_mm_store_ps((float*)(convertedPtr + 3), r3);
+#else
+		/* Back to rows of (x, y, st, color), then interleave the attributes dword to get four 20-byte vertices. */
+		__m128 r0 = x4;
+		__m128 r1 = y4;
+		__m128 r2 = _mm_castsi128_ps(packedSt4);
+		__m128 r3 = _mm_castsi128_ps(blendedColor4);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+		const __m128i v0 = _mm_castps_si128(r0);
+		const __m128i v1 = _mm_castps_si128(r1);
+		const __m128i v2 = _mm_castps_si128(r2);
+		const __m128i v3 = _mm_castps_si128(r3);
+
+		_mm_store_si128(convertedPtr + 0, v0);
+		_mm_store_si128(convertedPtr + 1, _mm_or_si128(attributes0, _mm_slli_si128(v1, 4)));
+		_mm_store_si128(convertedPtr + 2, _mm_or_si128(_mm_or_si128(_mm_srli_si128(v1, 12), attributes1), _mm_slli_si128(v2, 8)));
+		_mm_store_si128(convertedPtr + 3, _mm_or_si128(_mm_or_si128(_mm_srli_si128(v2, 8), attributes2), _mm_slli_si128(v3, 12)));
+		_mm_store_si128(convertedPtr + 4, _mm_or_si128(_mm_srli_si128(v3, 4), attributes3));
+#endif
+
+		const uint32_t convertedCount = min(4U, count - i);
+
+		for (uint32_t j = 0; j < convertedCount; ++j)
+		{
+			writer.Push(converted[j]);
+		}
+	}
+
+	return writer.Finish();
+}
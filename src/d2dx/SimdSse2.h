@@ -36,5 +36,15 @@ namespace d2dx
 			_In_reads_(itemsCount) const uint64_t* __restrict items,
 			_In_ uint32_t itemsCount,
 			_In_ uint64_t item) override;
+
+		virtual uint32_t ExpandVertexArray(
+			_In_ uint32_t mode,
+			_In_ uint32_t count,
+			_In_reads_(count) const D2::Vertex* const* d2Vertices,
+			_In_ const Vertex& templateVertex,
+			_In_ uint32_t maskedConstantColor,
+			_In_ uint32_t iteratedColorMask,
+			_In_ int32_t stShift,
+			_Out_writes_(4 * ((count - 1) / 2)) Vertex* __restrict vertices) override;
 	};
 }
@@ -43,27 +43,16 @@ void SurfaceIdTracker::UpdateBatchSurfaceId(
 	Batch& batch,
 	MajorGameState majorGameState,
 	Size gameSize,
-	Vertex* batchVertices,
+	const Vertex* batchVertices,
 	int32_t batchVerticesCount)
 {
 	uint32_t surfaceId = 0;
 
-	uint64_t drawCallTexture = (uint64_t)batch.GetTextureIndex() | ((uint64_t)batch.GetTextureAtlas() << 32ULL);
+	/* Textures can share an atlas slice, so tell them apart by content. */
+	uint64_t drawCallTexture = batch.GetHash();
 
-	int32_t minx = INT_MAX;
-	int32_t miny = INT_MAX;
-	int32_t maxx = INT_MIN;
-	int32_t maxy = INT_MIN;
-
-	for (uint32_t i = 0; i < batch.GetVertexCount(); ++i)
-	{
-		int32_t x = (int32_t)batchVertices[i].GetX();
-		int32_t y = (int32_t)batchVertices[i].GetY();
-		minx = min(minx, x);
-		miny = min(miny, y);
-		maxx = max(maxx, x);
-		maxy = max(maxy, y);
-	}
+	int32_t minx, miny, maxx, maxy;
+	GetVertexBounds(batchVertices, (uint32_t)batchVerticesCount, minx, miny, maxx, maxy);
 
 	if (majorGameState != MajorGameState::InGame)
 	{
@@ -141,11 +130,8 @@ void SurfaceIdTracker::UpdateBatchSurfaceId(
 	}
 
 	_previousSurfaceId = surfaceId;
+	batch.SetSurfaceId(surfaceId);
 
-	for (uint32_t i = 0; i < batch.GetVertexCount(); ++i)
-	{
-		batchVertices[i].SetSurfaceId(surfaceId);
-	}
 	_previousDrawCallTexture = drawCallTexture;
 	_previousDrawCallRect.offset.x = minx;
 	_previousDrawCallRect.offset.y = miny;
@@ -153,7 +139,67 @@ void SurfaceIdTracker::UpdateBatchSurfaceId(
 	_previousDrawCallRect.size.height = maxy - miny;
 }
 
-int32_t SurfaceIdTracker::GetCurrentSurfaceId() const
+_Use_decl_annotations_
+void SurfaceIdTracker::GetVertexBounds(
+	const Vertex* vertices,
+	uint32_t vertexCount,
+	int32_t& minx,
+	int32_t& miny,
+	int32_t& maxx,
+	int32_t& maxy)
 {
-	return _nextSurfaceId;
+	/* The bounds are found in the format the positions are stored in. Truncating them afterwards
+	   gives the same result as truncating every position, since truncation is monotonic. */
+	assert(vertexCount > 0);
+
+#ifdef D2DX_COMPACT_VERTEX
+	__m128i vmin = _mm_set1_epi16(INT16_MAX);
+	__m128i vmax = _mm_set1_epi16(INT16_MIN);
+
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		int32_t packedPosition;
+		memcpy(&packedPosition, vertices[i].GetPositionData(), sizeof(packedPosition));
+		const __m128i position = _mm_cvtsi32_si128(packedPosition);
+		vmin = _mm_min_epi16(vmin, position);
+		vmax = _mm_max_epi16(vmax, position);
+	}
+
+	minx = (int32_t)Vertex::UnpackPosition((int16_t)_mm_extract_epi16(vmin, 0));
+	miny = (int32_t)Vertex::UnpackPosition((int16_t)_mm_extract_epi16(vmin, 1));
+	maxx = (int32_t)Vertex::UnpackPosition((int16_t)_mm_extract_epi16(vmax, 0));
+	maxy = (int32_t)Vertex::UnpackPosition((int16_t)_mm_extract_epi16(vmax, 1));
+#else
+	/* Two positions per register, as x0 y0 x1 y1. */
+	__m128 vmin = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)vertices[0].GetPositionData()));
+	vmin = _mm_movelh_ps(vmin, vmin);
+	__m128 vmax = vmin;
+	uint32_t i = 1;
+
+	for (; (i + 1) < vertexCount; i += 2)
+	{
+		__m128 positions = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)vertices[i].GetPositionData()));
+		positions = _mm_loadh_pi(positions, (const __m64*)vertices[i + 1].GetPositionData());
+		vmin = _mm_min_ps(vmin, positions);
+		vmax = _mm_max_ps(vmax, positions);
+	}
+
+	if (i < vertexCount)
+	{
+		__m128 position = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)vertices[i].GetPositionData()));
+		position = _mm_movelh_ps(position, position);
+		vmin = _mm_min_ps(vmin, position);
+		vmax = _mm_max_ps(vmax, position);
+	}
+
+	vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+	vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+
+	const __m128i imin = _mm_cvttps_epi32(vmin);
+	const __m128i imax = _mm_cvttps_epi32(vmax);
+	minx = _mm_cvtsi128_si32(imin);
+	miny = _mm_cvtsi128_si32(_mm_shuffle_epi32(imin, 1));
+	maxx = _mm_cvtsi128_si32(imax);
+	maxy = _mm_cvtsi128_si32(_mm_shuffle_epi32(imax, 1));
+#endif
 }
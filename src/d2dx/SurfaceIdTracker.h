@@ -38,10 +38,17 @@ namespace d2dx
 			_Inout_ Batch& batch,
 			_In_ MajorGameState majorGameState,
 			_In_ Size gameSize,
-			_Inout_updates_all_(batchVerticesCount) Vertex* batchVertices,
+			_In_reads_(batchVerticesCount) const Vertex* batchVertices,
 			_In_ int32_t batchVerticesCount);
 
-		int32_t GetCurrentSurfaceId() const;
+		/* The bounds of the vertex positions, each truncated to an integer. */
+		static void GetVertexBounds(
+			_In_reads_(vertexCount) const Vertex* vertices,
+			_In_ uint32_t vertexCount,
+			_Out_ int32_t& minx,
+			_Out_ int32_t& miny,
+			_Out_ int32_t& maxx,
+			_Out_ int32_t& maxy);
 
 	private:
 		std::shared_ptr<IGameHelper> _gameHelper;
@@ -20,7 +20,7 @@
 #include "D2DXContext.h"
 #include "Utils.h"
 #include "TextureCache.h"
-#include "TextureCachePolicyBitPmru.h"
+#include "TextureCachePolicyFactory.h"
 
 using namespace d2dx;
 using namespace std;
@@ -32,16 +32,25 @@ TextureCache::TextureCache(
 	uint32_t capacity,
 	uint32_t texturesPerAtlas,
 	ID3D11Device* device,
-	const std::shared_ptr<ISimd>& simd)
+	const std::shared_ptr<ISimd>& simd,
+	TextureCachePolicyType policyType,
+	uint32_t firstAtlasIndex,
+	uint32_t pinnedCapacity)
 {
-	assert(_atlasCount <= 4);
+	assert(texturesPerAtlas <= D2DX_MAX_TEXTURES_PER_ATLAS);
 
 	_width = width;
 	_height = height;
 	_capacity = capacity;
 	_texturesPerAtlas = texturesPerAtlas;
-	_atlasCount = (int32_t)max(1, capacity / texturesPerAtlas);
-	_policy = TextureCachePolicyBitPmru(capacity, simd);
+	_atlasCount = (int32_t)max(1, (capacity + texturesPerAtlas - 1) / texturesPerAtlas);
+	_firstAtlasIndex = (int32_t)firstAtlasIndex;
+
+	assert(_atlasCount <= ARRAYSIZE(_textures));
+	assert((firstAtlasIndex + _atlasCount) <= D2DX_MAX_TEXTURE_ATLASES);
+
+	CreatePolicies(policyType, pinnedCapacity, simd);
+	_slotFrames = Buffer<uint32_t>(capacity, true);
 
 #ifndef D2DX_UNITTEST
 
@@ -56,10 +65,11 @@ TextureCache::TextureCache(
 		D3D11_USAGE_DEFAULT
 	};
 
-	uint32_t capacityPerPartition = _capacity;
-
-	for (int32_t partition = 0; partition < 4; ++partition)
+	for (int32_t partition = 0; partition < _atlasCount; ++partition)
 	{
+		/* The last partition only holds what is left of the capacity. */
+		desc.ArraySize = min(_texturesPerAtlas, _capacity - partition * _texturesPerAtlas);
+
 		D2DX_CHECK_HR(device->CreateTexture2D(&desc, nullptr, &_textures[partition]));
 		D2DX_CHECK_HR(device->CreateShaderResourceView(_textures[partition].Get(), NULL, _srvs[partition].GetAddressOf()));
 	}
@@ -69,71 +79,246 @@ TextureCache::TextureCache(
 #endif
 }
 
+_Use_decl_annotations_
+TextureCache::TextureCache(
+	int32_t size,
+	uint32_t capacity,
+	const std::shared_ptr<ShelfPackedAtlas>& sharedAtlas,
+	const std::shared_ptr<ISimd>& simd,
+	TextureCachePolicyType policyType,
+	uint32_t sharedAtlasIndex,
+	uint32_t pinnedCapacity) :
+	_sharedAtlas{ sharedAtlas }
+{
+	assert(size >= ShelfPackedAtlas::MinTextureSize && size <= ShelfPackedAtlas::MaxTextureSize);
+	assert(sharedAtlasIndex < D2DX_MAX_TEXTURE_ATLASES);
+
+	_width = size;
+	_height = size;
+	_capacity = capacity;
+	_atlasCount = 1;
+	_firstAtlasIndex = (int32_t)sharedAtlasIndex;
+
+	CreatePolicies(policyType, pinnedCapacity, simd);
+	_slotFrames = Buffer<uint32_t>(capacity, true);
+}
+
+_Use_decl_annotations_
+void TextureCache::CreatePolicies(
+	TextureCachePolicyType policyType,
+	uint32_t pinnedCapacity,
+	const std::shared_ptr<ISimd>& simd)
+{
+	assert(pinnedCapacity < _capacity);
+
+	_pinnedCapacity = pinnedCapacity;
+	_policy = TextureCachePolicyFactory::Create(policyType, _capacity - pinnedCapacity, simd);
+
+	if (pinnedCapacity > 0)
+	{
+		_pinnedPolicy = TextureCachePolicyFactory::Create(policyType, pinnedCapacity, simd);
+	}
+}
+
 uint32_t TextureCache::GetMemoryFootprint() const
 {
-	return _width * _height * _texturesPerAtlas * _atlasCount;
+	return _width * _height * _capacity;
 }
 
 _Use_decl_annotations_
 TextureCacheLocation TextureCache::FindTexture(
 	uint64_t contentKey,
+	const Batch& batch,
 	int32_t lastIndex)
 {
-	const int32_t index = _policy.Find(contentKey, lastIndex);
+	int32_t index;
+
+	if (_pinnedPolicy && IsPinned(batch.GetTextureCategory()))
+	{
+		const int32_t firstPinnedIndex = (int32_t)(_capacity - _pinnedCapacity);
+		index = _pinnedPolicy->Find(contentKey, lastIndex >= firstPinnedIndex ? lastIndex - firstPinnedIndex : -1);
+		index = index >= 0 ? firstPinnedIndex + index : -1;
+	}
+	else
+	{
+		index = _policy->Find(contentKey, lastIndex);
+	}
+
+	++_statistics.lookupCount;
 
 	if (index < 0)
 	{
+		++_statistics.missCount;
 		return { -1, -1 };
 	}
 
-	return { (int16_t)(index / _texturesPerAtlas), (int16_t)(index & (_texturesPerAtlas - 1)) };
+	if (index == lastIndex)
+	{
+		++_statistics.lastIndexHitCount;
+	}
+	else
+	{
+		++_statistics.scanHitCount;
+	}
+
+	OnSlotUsed(index);
+
+	return GetLocation(index);
 }
 
 _Use_decl_annotations_
 TextureCacheLocation TextureCache::InsertTexture(
 	uint64_t contentKey,
-	const Batch& batch,
-	const uint8_t* tmuData,
-	uint32_t tmuDataSize)
+	const Batch& batch)
 {
 	assert(batch.IsValid() && batch.GetTextureWidth() > 0 && batch.GetTextureHeight() > 0);
 
 	bool evicted = false;
-	int32_t replacementIndex = _policy.Insert(contentKey, evicted);
+	int32_t replacementIndex;
+
+	if (_pinnedPolicy && IsPinned(batch.GetTextureCategory()))
+	{
+		replacementIndex = (int32_t)(_capacity - _pinnedCapacity) + _pinnedPolicy->Insert(contentKey, evicted);
+
+		if (evicted)
+		{
+			D2DX_DEBUG_LOG("Evicted pinned %ix%i texture %i from cache.", batch.GetTextureWidth(), batch.GetTextureHeight(), replacementIndex);
+			++_pinnedEvictionCount;
+		}
+	}
+	else
+	{
+		replacementIndex = _policy->Insert(contentKey, evicted);
+
+		if (evicted)
+		{
+			D2DX_DEBUG_LOG("Evicted %ix%i texture %i from cache.", batch.GetTextureWidth(), batch.GetTextureHeight(), replacementIndex);
+		}
+	}
 
 	if (evicted)
 	{
-		D2DX_DEBUG_LOG("Evicted %ix%i texture %i from cache.", batch.GetTextureWidth(), batch.GetTextureHeight(), replacementIndex);
+		++_evictionCount;
+		++_statistics.evictionCount;
+		_statistics.pinnedEvictionCount += replacementIndex >= (int32_t)(_capacity - _pinnedCapacity) ? 1 : 0;
+	}
+
+	/* The texture is uploaded by the render thread later, but counting it here keeps the statistics
+	   on the game thread. */
+	++_statistics.insertCount;
+	_statistics.uploadedBytes += (uint64_t)batch.GetTextureWidth() * batch.GetTextureHeight();
+
+	OnSlotUsed(replacementIndex);
+
+	return GetLocation(replacementIndex);
+}
+
+_Use_decl_annotations_
+TextureCacheLocation TextureCache::PreloadTexture(
+	uint64_t contentKey,
+	const Batch& batch)
+{
+	assert(batch.IsValid() && batch.GetTextureWidth() > 0 && batch.GetTextureHeight() > 0);
+	assert(!IsPinned(batch.GetTextureCategory()));
+
+	if (_policy->GetUsedCount() >= (_capacity - _pinnedCapacity))
+	{
+		return { -1, -1 };
+	}
+
+	/* The policy still treats the texture as just inserted, but it is not part of the working set
+	   until the game looks it up. */
+	bool evicted = false;
+	const int32_t index = _policy->Insert(contentKey, evicted);
+	assert(!evicted);
+
+	return GetLocation(index);
+}
+
+_Use_decl_annotations_
+void TextureCache::UploadTexture(
+	TextureCacheLocation location,
+	int32_t width,
+	int32_t height,
+	const uint8_t* data)
+{
+	const int32_t partition = location._textureAtlas - _firstAtlasIndex;
+
+	assert(partition >= 0 && partition < _atlasCount);
+	assert(width > 0 && width <= _width && height > 0 && height <= _height);
+
+	if (_sharedAtlas)
+	{
+		_sharedAtlas->UploadTexture(location, width, height, data);
+		return;
 	}
 
 #ifndef D2DX_UNITTEST
 	CD3D11_BOX box;
 	box.left = 0;
 	box.top = 0;
-	box.right = batch.GetTextureWidth();
-	box.bottom = batch.GetTextureHeight();
+	box.right = width;
+	box.bottom = height;
 	box.front = 0;
 	box.back = 1;
 
-	const uint8_t* pData = tmuData + batch.GetTextureStartAddress();
-
-	_deviceContext->UpdateSubresource(_textures[replacementIndex / _texturesPerAtlas].Get(), replacementIndex & (_texturesPerAtlas - 1), &box, pData, batch.GetTextureWidth(), 0);
+	_deviceContext->UpdateSubresource(_textures[partition].Get(), location._textureIndex, &box, data, width, 0);
 #endif
-
-	return { (int16_t)(replacementIndex / _texturesPerAtlas), (int16_t)(replacementIndex & (_texturesPerAtlas - 1)) };
 }
 
 _Use_decl_annotations_
 ID3D11ShaderResourceView* TextureCache::GetSrv(
 	uint32_t textureAtlas) const
 {
-	assert(textureAtlas >= 0 && textureAtlas < (uint32_t)_atlasCount);
-	return _srvs[textureAtlas].Get();
+	const int32_t partition = (int32_t)textureAtlas - _firstAtlasIndex;
+
+	assert(partition >= 0 && partition < _atlasCount);
+	return _sharedAtlas ? _sharedAtlas->GetSrv() : _srvs[partition].Get();
+}
+
+uint32_t TextureCache::GetAtlasCount() const
+{
+	return _sharedAtlas ? 0 : (uint32_t)_atlasCount;
+}
+
+_Use_decl_annotations_
+void TextureCache::SetFirstAtlasIndex(
+	uint32_t firstAtlasIndex)
+{
+	assert((firstAtlasIndex + _atlasCount) <= D2DX_MAX_TEXTURE_ATLASES);
+	_firstAtlasIndex = (int32_t)firstAtlasIndex;
+}
+
+_Use_decl_annotations_
+TextureCacheLocation TextureCache::GetLocation(
+	int32_t slot) const
+{
+	if (_sharedAtlas)
+	{
+		TextureCacheLocation location = _sharedAtlas->GetLocation(_width, (uint32_t)slot);
+		location._textureAtlas = (int16_t)_firstAtlasIndex;
+		return location;
+	}
+
+	return { (int16_t)(_firstAtlasIndex + slot / _texturesPerAtlas), (int16_t)(slot & (_texturesPerAtlas - 1)) };
 }
 
 void TextureCache::OnNewFrame()
 {
-	_policy.OnNewFrame();
+	_policy->OnNewFrame();
+
+	if (_pinnedPolicy)
+	{
+		_pinnedPolicy->OnNewFrame();
+	}
+
+	++_frame;
+	++_statistics.frameCount;
+	_statistics.workingSetSize = _workingSetSize;
+	_statistics.peakWorkingSetSize = max(_statistics.peakWorkingSetSize, _workingSetSize);
+	_workingSetSize = 0;
+	_evictionCount = 0;
+	_pinnedEvictionCount = 0;
 }
 
 _Use_decl_annotations_
@@ -162,7 +347,87 @@ void TextureCache::CopyPixels(
 	}
 }
 
+_Use_decl_annotations_
+bool TextureCache::Contains(
+	uint64_t contentKey) const
+{
+	return _policy->Contains(contentKey) || (_pinnedPolicy && _pinnedPolicy->Contains(contentKey));
+}
+
 uint32_t TextureCache::GetUsedCount() const
 {
-	return _policy.GetUsedCount();
+	return _policy->GetUsedCount() + GetPinnedUsedCount();
+}
+
+uint32_t TextureCache::GetWorkingSetSize() const
+{
+	return _workingSetSize;
+}
+
+uint32_t TextureCache::GetEvictionCount() const
+{
+	return _evictionCount;
+}
+
+uint32_t TextureCache::GetPinnedCapacity() const
+{
+	return _pinnedCapacity;
+}
+
+uint32_t TextureCache::GetPinnedUsedCount() const
+{
+	return _pinnedPolicy ? _pinnedPolicy->GetUsedCount() : 0;
+}
+
+uint32_t TextureCache::GetPinnedEvictionCount() const
+{
+	return _pinnedEvictionCount;
+}
+
+TextureCacheStatistics TextureCache::GetStatistics() const
+{
+	TextureCacheStatistics statistics = _statistics;
+	statistics.usedCount = GetUsedCount();
+	statistics.capacity = _capacity;
+	statistics.pinnedUsedCount = GetPinnedUsedCount();
+	statistics.pinnedCapacity = _pinnedCapacity;
+	return statistics;
+}
+
+_Use_decl_annotations_
+uint32_t TextureCache::GetPinnedCapacity(
+	uint32_t capacity,
+	int32_t uiShare)
+{
+	if (uiShare <= 0)
+	{
+		return 0;
+	}
+
+	/* The bit-based policies need a multiple of 64 slots in each partition. */
+	const uint32_t pinnedCapacity = (capacity * (uint32_t)uiShare / 100 + 63) & ~63U;
+	return min(pinnedCapacity, (capacity / 2) & ~63U);
+}
+
+_Use_decl_annotations_
+bool TextureCache::IsPinned(
+	TextureCategory category)
+{
+	return category == TextureCategory::UserInterface || category == TextureCategory::MousePointer;
+}
+
+_Use_decl_annotations_
+void TextureCache::OnSlotUsed(
+	int32_t slot)
+{
+	if (_slotFrames.items[slot] != _frame)
+	{
+		_slotFrames.items[slot] = _frame;
+		++_workingSetSize;
+	}
+}
+
+uint32_t TextureCache::GetCapacity() const
+{
+	return _capacity;
 }
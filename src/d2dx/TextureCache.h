@@ -19,7 +19,9 @@
 #pragma once
 
 #include "ITextureCache.h"
-#include "TextureCachePolicyBitPmru.h"
+#include "ITextureCachePolicy.h"
+#include "Options.h"
+#include "ShelfPackedAtlas.h"
 
 namespace d2dx
 {
@@ -32,7 +34,20 @@ namespace d2dx
 			_In_ uint32_t capacity,
 			_In_ uint32_t texturesPerAtlas,
 			_In_ ID3D11Device* device,
-			_In_ const std::shared_ptr<ISimd>& simd);
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ TextureCachePolicyType policyType = TextureCachePolicyType::BitPmru,
+			_In_ uint32_t firstAtlasIndex = 0,
+			_In_ uint32_t pinnedCapacity = 0);
+
+		/* Creates a cache of square textures that are stored in slots of a shared atlas. */
+		TextureCache(
+			_In_ int32_t size,
+			_In_ uint32_t capacity,
+			_In_ const std::shared_ptr<ShelfPackedAtlas>& sharedAtlas,
+			_In_ const std::shared_ptr<ISimd>& simd,
+			_In_ TextureCachePolicyType policyType = TextureCachePolicyType::BitPmru,
+			_In_ uint32_t sharedAtlasIndex = 0,
+			_In_ uint32_t pinnedCapacity = 0);
 
 		virtual ~TextureCache() noexcept {}
 
@@ -40,13 +55,25 @@ namespace d2dx
 
 		virtual TextureCacheLocation FindTexture(
 			_In_ uint64_t contentKey,
+			_In_ const Batch& batch,
 			_In_ int32_t lastIndex) override;
 
+		virtual bool Contains(
+			_In_ uint64_t contentKey) const override;
+
 		virtual TextureCacheLocation InsertTexture(
 			_In_ uint64_t contentKey,
-			_In_ const Batch& batch,
-			_In_reads_(tmuDataSize) const uint8_t* tmuData,
-			_In_ uint32_t tmuDataSize) override;
+			_In_ const Batch& batch) override;
+
+		virtual TextureCacheLocation PreloadTexture(
+			_In_ uint64_t contentKey,
+			_In_ const Batch& batch) override;
+
+		virtual void UploadTexture(
+			_In_ TextureCacheLocation location,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_reads_(width * height) const uint8_t* data) override;
 
 		virtual ID3D11ShaderResourceView* GetSrv(
 			_In_ uint32_t atlasIndex) const override;
@@ -55,7 +82,50 @@ namespace d2dx
 
 		virtual uint32_t GetUsedCount() const override;
 
+		virtual uint32_t GetCapacity() const override;
+
+		virtual uint32_t GetWorkingSetSize() const override;
+
+		virtual uint32_t GetEvictionCount() const override;
+
+		virtual uint32_t GetPinnedCapacity() const override;
+
+		virtual uint32_t GetPinnedUsedCount() const override;
+
+		virtual uint32_t GetPinnedEvictionCount() const override;
+
+		virtual TextureCacheStatistics GetStatistics() const override;
+
+		/* The number of atlases owned by this cache, which take up consecutive entries of the atlas
+		   table from firstAtlasIndex. Zero when the cache uses a shared atlas. */
+		uint32_t GetAtlasCount() const;
+
+		/* Moves the cache's atlases to another place in the atlas table. The locations of the
+		   cached textures change accordingly. */
+		void SetFirstAtlasIndex(
+			_In_ uint32_t firstAtlasIndex);
+
+		/* The size of the pinned partition of a cache with the given capacity, when uiShare percent
+		   of it is reserved for UI textures. */
+		static uint32_t GetPinnedCapacity(
+			_In_ uint32_t capacity,
+			_In_ int32_t uiShare);
+
+		static bool IsPinned(
+			_In_ TextureCategory category);
+
 	private:
+		void CreatePolicies(
+			_In_ TextureCachePolicyType policyType,
+			_In_ uint32_t pinnedCapacity,
+			_In_ const std::shared_ptr<ISimd>& simd);
+
+		TextureCacheLocation GetLocation(
+			_In_ int32_t slot) const;
+
+		void OnSlotUsed(
+			_In_ int32_t slot);
+
 		void CopyPixels(
 			_In_ int32_t srcWidth,
 			_In_ int32_t srcHeight,
@@ -69,9 +139,19 @@ namespace d2dx
 		uint32_t _capacity = 0;
 		uint32_t _texturesPerAtlas = 0;
 		int32_t _atlasCount = 0;
+		int32_t _firstAtlasIndex = 0;
 		ComPtr<ID3D11DeviceContext> _deviceContext;
 		ComPtr<ID3D11Texture2D> _textures[4];
 		ComPtr<ID3D11ShaderResourceView> _srvs[4];
-		TextureCachePolicyBitPmru _policy;
+		std::unique_ptr<ITextureCachePolicy> _policy;	/* For slots [0, _capacity - _pinnedCapacity). */
+		std::unique_ptr<ITextureCachePolicy> _pinnedPolicy;	/* For the remaining slots, if any. */
+		uint32_t _pinnedCapacity = 0;
+		std::shared_ptr<ShelfPackedAtlas> _sharedAtlas;
+		Buffer<uint32_t> _slotFrames;	/* The frame each slot was last used in. */
+		uint32_t _frame = 1;
+		uint32_t _workingSetSize = 0;
+		uint32_t _evictionCount = 0;
+		uint32_t _pinnedEvictionCount = 0;
+		TextureCacheStatistics _statistics = { 0 };
 	};
 }
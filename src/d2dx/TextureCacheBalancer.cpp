@@ -0,0 +1,263 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureCacheBalancer.h"
+#include "ShelfPackedAtlas.h"
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+TextureCacheBalancer::TextureCacheBalancer(
+	uint32_t budget)
+{
+	for (int32_t i = 0; i < SizeClassCount; ++i)
+	{
+		_capacities[i] = DefaultCapacities[i];
+	}
+
+	_budget = max(budget, GetMemoryFootprint(DefaultCapacities));
+}
+
+_Use_decl_annotations_
+bool TextureCacheBalancer::OnFrame(
+	const uint32_t* workingSetSizes,
+	const uint32_t* evictionCounts)
+{
+	for (int32_t i = 0; i < SizeClassCount; ++i)
+	{
+		_peakWorkingSetSizes[i] = max(_peakWorkingSetSizes[i], workingSetSizes[i]);
+		_evictionCounts[i] += evictionCounts[i];
+	}
+
+	if (++_frameCount < FramesPerRebalance)
+	{
+		return false;
+	}
+
+	const bool hasChanged = Rebalance();
+
+	for (int32_t i = 0; i < SizeClassCount; ++i)
+	{
+		_peakWorkingSetSizes[i] = 0;
+		_evictionCounts[i] = 0;
+	}
+
+	_frameCount = 0;
+
+	return hasChanged;
+}
+
+bool TextureCacheBalancer::Rebalance()
+{
+	bool isHot[SizeClassCount];
+	uint32_t minCapacities[SizeClassCount];
+	bool hasHotSizeClass = false;
+
+	for (int32_t i = 0; i < SizeClassCount; ++i)
+	{
+		/* A cache that replaced a quarter of its capacity in the period is thrashing. */
+		isHot[i] = (_evictionCounts[i] * 4) >= _capacities[i] && CanGrow(i);
+		hasHotSizeClass |= isHot[i];
+
+		/* Donors keep half again their peak working set, so that they don't start thrashing instead. */
+		const uint32_t keptCapacity = _peakWorkingSetSizes[i] + _peakWorkingSetSizes[i] / 2;
+		minCapacities[i] = isHot[i] ? _capacities[i] :
+			min(_capacities[i], max(MinCapacity, (keptCapacity + CapacityGranularity - 1) & ~(CapacityGranularity - 1)));
+	}
+
+	if (!hasHotSizeClass)
+	{
+		return false;
+	}
+
+	uint32_t textureSizes[SizeClassCount];
+
+	for (int32_t i = 0; i < SizeClassCount; ++i)
+	{
+		const Size textureSize = GetTextureSize((TextureCacheSizeClass)i);
+		textureSizes[i] = (uint32_t)(textureSize.width * textureSize.height);
+	}
+
+	uint32_t footprint = GetMemoryFootprint(_capacities);
+	bool hasChanged = false;
+
+	for (;;)
+	{
+		/* Grow the hottest cache first, relative to its capacity. */
+		int32_t hotSizeClass = -1;
+
+		for (int32_t i = 0; i < SizeClassCount; ++i)
+		{
+			if (isHot[i] && (hotSizeClass < 0 ||
+				(uint64_t)_evictionCounts[i] * _capacities[hotSizeClass] > (uint64_t)_evictionCounts[hotSizeClass] * _capacities[i]))
+			{
+				hotSizeClass = i;
+			}
+		}
+
+		if (hotSizeClass < 0)
+		{
+			break;
+		}
+
+		isHot[hotSizeClass] = false;
+
+		const uint32_t maxCapacity = min(MaxCapacity,
+			_capacities[hotSizeClass] + ((_capacities[hotSizeClass] / 2 + CapacityGranularity - 1) & ~(CapacityGranularity - 1)));
+
+		while (_capacities[hotSizeClass] < maxCapacity && CanGrow(hotSizeClass))
+		{
+			const uint32_t stepSize = CapacityGranularity * textureSizes[hotSizeClass];
+
+			uint32_t spareSize = _budget - footprint;
+
+			for (int32_t i = 0; i < SizeClassCount; ++i)
+			{
+				spareSize += (_capacities[i] - minCapacities[i]) * textureSizes[i];
+			}
+
+			if (spareSize < stepSize)
+			{
+				break;
+			}
+
+			while ((footprint + stepSize) > _budget)
+			{
+				/* Take the smallest step that covers what is missing, or else the largest one. */
+				const uint32_t missingSize = footprint + stepSize - _budget;
+				int32_t donorSizeClass = -1;
+
+				for (int32_t i = 0; i < SizeClassCount; ++i)
+				{
+					if (i == hotSizeClass || (_capacities[i] - minCapacities[i]) < CapacityGranularity)
+					{
+						continue;
+					}
+
+					if (donorSizeClass < 0)
+					{
+						donorSizeClass = i;
+						continue;
+					}
+
+					const bool covers = textureSizes[i] * CapacityGranularity >= missingSize;
+					const bool donorCovers = textureSizes[donorSizeClass] * CapacityGranularity >= missingSize;
+
+					if (covers ? (!donorCovers || textureSizes[i] < textureSizes[donorSizeClass]) :
+						(!donorCovers && textureSizes[i] > textureSizes[donorSizeClass]))
+					{
+						donorSizeClass = i;
+					}
+				}
+
+				assert(donorSizeClass >= 0);
+				_capacities[donorSizeClass] -= CapacityGranularity;
+				footprint -= CapacityGranularity * textureSizes[donorSizeClass];
+			}
+
+			_capacities[hotSizeClass] += CapacityGranularity;
+			minCapacities[hotSizeClass] = _capacities[hotSizeClass];
+			footprint += stepSize;
+			hasChanged = true;
+		}
+	}
+
+	return hasChanged;
+}
+
+_Use_decl_annotations_
+bool TextureCacheBalancer::CanGrow(
+	int32_t sizeClass) const
+{
+	if ((_capacities[sizeClass] + CapacityGranularity) > MaxCapacity)
+	{
+		return false;
+	}
+
+	const Size textureSize = GetTextureSize((TextureCacheSizeClass)sizeClass);
+
+	if (textureSize.width <= ShelfPackedAtlas::MaxTextureSize)
+	{
+		/* The shared atlas must stay addressable by the slice bits of the vertex. */
+		uint32_t sharedSize = CapacityGranularity * textureSize.width * textureSize.height;
+
+		for (int32_t i = 0; i < SizeClassCount; ++i)
+		{
+			const Size size = GetTextureSize((TextureCacheSizeClass)i);
+
+			if (size.width <= ShelfPackedAtlas::MaxTextureSize)
+			{
+				sharedSize += _capacities[i] * size.width * size.height;
+			}
+		}
+
+		return sharedSize <= (uint32_t)(D2DX_MAX_TEXTURES_PER_ATLAS * ShelfPackedAtlas::SliceSize * ShelfPackedAtlas::SliceSize);
+	}
+
+	/* The other caches have atlases of their own, which must fit in the atlas table with the shared one. */
+	uint32_t atlasCount = 1;
+
+	for (int32_t i = 0; i < SizeClassCount; ++i)
+	{
+		if (GetTextureSize((TextureCacheSizeClass)i).width > ShelfPackedAtlas::MaxTextureSize)
+		{
+			const uint32_t capacity = _capacities[i] + (i == sizeClass ? CapacityGranularity : 0);
+			atlasCount += (capacity + D2DX_MAX_TEXTURES_PER_ATLAS - 1) / D2DX_MAX_TEXTURES_PER_ATLAS;
+		}
+	}
+
+	return atlasCount <= D2DX_MAX_TEXTURE_ATLASES;
+}
+
+const uint32_t* TextureCacheBalancer::GetCapacities() const
+{
+	return _capacities;
+}
+
+uint32_t TextureCacheBalancer::GetBudget() const
+{
+	return _budget;
+}
+
+_Use_decl_annotations_
+Size TextureCacheBalancer::GetTextureSize(
+	TextureCacheSizeClass sizeClass)
+{
+	if (sizeClass == TextureCacheSizeClass::Size256x128)
+	{
+		return { 256, 128 };
+	}
+
+	return { 8 << (int32_t)sizeClass, 8 << (int32_t)sizeClass };
+}
+
+_Use_decl_annotations_
+uint32_t TextureCacheBalancer::GetMemoryFootprint(
+	const uint32_t* capacities)
+{
+	uint32_t footprint = 0;
+
+	for (int32_t i = 0; i < SizeClassCount; ++i)
+	{
+		const Size textureSize = GetTextureSize((TextureCacheSizeClass)i);
+		footprint += capacities[i] * textureSize.width * textureSize.height;
+	}
+
+	return footprint;
+}
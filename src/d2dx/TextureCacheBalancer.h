@@ -0,0 +1,83 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Options.h"
+#include "Types.h"
+
+namespace d2dx
+{
+	/*
+		Moves texture cache capacity from size classes that have more than they use to ones that
+		are thrashing, within a fixed video memory budget. Mods with larger sprite sets tend to
+		overrun the 128x128 and 256x128 caches while the small ones sit mostly empty.
+
+		Each cache reports how many different textures it used (its working set) and how many it
+		evicted in each frame. Every FramesPerRebalance frames, caches that replaced a large part of
+		their capacity grow by up to half, paid for by the free budget first and then by caches
+		whose capacity exceeds their peak working set with some headroom.
+
+		Capacities change in steps of CapacityGranularity, which keeps the shelves of the shared
+		atlas full, and stay within what the atlas table and the shared atlas can address.
+	*/
+	class TextureCacheBalancer final
+	{
+	public:
+		static constexpr int32_t SizeClassCount = (int32_t)TextureCacheSizeClass::Count;
+		static constexpr uint32_t DefaultCapacities[SizeClassCount] = { 512, 1024, 2048, 2048, 1024, 512, 1024 };
+		static constexpr uint32_t CapacityGranularity = 256;
+		static constexpr uint32_t MinCapacity = 256;
+		static constexpr uint32_t MaxCapacity = 4 * D2DX_MAX_TEXTURES_PER_ATLAS;
+		static constexpr uint32_t FramesPerRebalance = 256;
+
+		/* budget is in bytes, and is raised to the size of the default capacities if smaller. */
+		TextureCacheBalancer(
+			_In_ uint32_t budget);
+
+		~TextureCacheBalancer() noexcept {}
+
+		/* Records the working set size and eviction count of each cache for the last frame.
+		   Returns true if the capacities have changed, and the caches must be resized. */
+		bool OnFrame(
+			_In_reads_(SizeClassCount) const uint32_t* workingSetSizes,
+			_In_reads_(SizeClassCount) const uint32_t* evictionCounts);
+
+		const uint32_t* GetCapacities() const;
+
+		uint32_t GetBudget() const;
+
+		static Size GetTextureSize(
+			_In_ TextureCacheSizeClass sizeClass);
+
+		static uint32_t GetMemoryFootprint(
+			_In_reads_(SizeClassCount) const uint32_t* capacities);
+
+	private:
+		bool Rebalance();
+
+		bool CanGrow(
+			_In_ int32_t sizeClass) const;
+
+		uint32_t _capacities[SizeClassCount] = { 0 };
+		uint32_t _peakWorkingSetSizes[SizeClassCount] = { 0 };
+		uint32_t _evictionCounts[SizeClassCount] = { 0 };
+		uint32_t _budget = 0;
+		uint32_t _frameCount = 0;
+	};
+}
@@ -0,0 +1,143 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureCacheIndex.h"
+
+using namespace d2dx;
+
+/* Index entries hold slot + 1, so that zero means empty. */
+#define D2DX_TEXTURE_INDEX_EMPTY 0
+
+_Use_decl_annotations_
+TextureCacheIndex::TextureCacheIndex(
+	uint32_t slotCount) :
+	_contentKeys{ slotCount, true }
+{
+	assert(slotCount < 65535);
+
+	uint32_t indexSize = 64;
+
+	while (indexSize < slotCount * 2)
+	{
+		indexSize *= 2;
+	}
+
+	_indexMask = indexSize - 1;
+	_index = Buffer<uint16_t>(indexSize, true);
+}
+
+_Use_decl_annotations_
+int32_t TextureCacheIndex::Find(
+	uint64_t contentKey) const
+{
+	assert(contentKey != 0);
+
+	if (!_index.items)
+	{
+		return -1;
+	}
+
+	for (uint32_t i = GetHomeIndex(contentKey); _index.items[i] != D2DX_TEXTURE_INDEX_EMPTY; i = (i + 1) & _indexMask)
+	{
+		const uint32_t slot = _index.items[i] - 1U;
+
+		if (_contentKeys.items[slot] == contentKey)
+		{
+			return (int32_t)slot;
+		}
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+void TextureCacheIndex::Insert(
+	uint64_t contentKey,
+	uint32_t slot)
+{
+	assert(contentKey != 0);
+	assert(slot < _contentKeys.capacity);
+	assert(_contentKeys.items[slot] == 0);
+
+	_contentKeys.items[slot] = contentKey;
+
+	uint32_t i = GetHomeIndex(contentKey);
+
+	while (_index.items[i] != D2DX_TEXTURE_INDEX_EMPTY)
+	{
+		i = (i + 1) & _indexMask;
+	}
+
+	_index.items[i] = (uint16_t)(slot + 1);
+}
+
+_Use_decl_annotations_
+void TextureCacheIndex::Remove(
+	uint32_t slot)
+{
+	assert(slot < _contentKeys.capacity);
+	assert(_contentKeys.items[slot] != 0);
+
+	/* Match on the slot rather than the key, in case the same key has been inserted twice. */
+	uint32_t i = GetHomeIndex(_contentKeys.items[slot]);
+
+	for (;;)
+	{
+		assert(_index.items[i] != D2DX_TEXTURE_INDEX_EMPTY);
+
+		if (_index.items[i] == slot + 1)
+		{
+			break;
+		}
+
+		i = (i + 1) & _indexMask;
+	}
+
+	/* Backward shift deletion: move later entries of the probe sequence into the hole, as long as
+	   that doesn't put them before their home index. */
+	uint32_t j = i;
+
+	for (;;)
+	{
+		j = (j + 1) & _indexMask;
+
+		if (_index.items[j] == D2DX_TEXTURE_INDEX_EMPTY)
+		{
+			break;
+		}
+
+		const uint32_t home = GetHomeIndex(_contentKeys.items[_index.items[j] - 1U]);
+
+		if (((j - home) & _indexMask) >= ((j - i) & _indexMask))
+		{
+			_index.items[i] = _index.items[j];
+			i = j;
+		}
+	}
+
+	_index.items[i] = D2DX_TEXTURE_INDEX_EMPTY;
+	_contentKeys.items[slot] = 0;
+}
+
+_Use_decl_annotations_
+uint32_t TextureCacheIndex::GetHomeIndex(
+	uint64_t contentKey) const
+{
+	return (uint32_t)(contentKey ^ (contentKey >> 32)) & _indexMask;
+}
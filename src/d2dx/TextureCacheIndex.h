@@ -0,0 +1,70 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+
+namespace d2dx
+{
+	/*
+		Maps content keys to a fixed number of slots. The keys are looked up through an open-addressing
+		hash index with linear probing, which is kept at a load factor of at most 1/2. A key of zero
+		marks an empty slot.
+	*/
+	class TextureCacheIndex final
+	{
+	public:
+		TextureCacheIndex() = default;
+		TextureCacheIndex& operator=(TextureCacheIndex&& rhs) = default;
+
+		TextureCacheIndex(
+			_In_ uint32_t slotCount);
+		~TextureCacheIndex() noexcept {}
+
+		int32_t Find(
+			_In_ uint64_t contentKey) const;
+
+		void Insert(
+			_In_ uint64_t contentKey,
+			_In_ uint32_t slot);
+
+		void Remove(
+			_In_ uint32_t slot);
+
+		uint64_t GetContentKey(
+			_In_ uint32_t slot) const
+		{
+			assert(slot < _contentKeys.capacity);
+			return _contentKeys.items[slot];
+		}
+
+		const uint64_t* GetContentKeys() const
+		{
+			return _contentKeys.items;
+		}
+
+	private:
+		uint32_t GetHomeIndex(
+			_In_ uint64_t contentKey) const;
+
+		Buffer<uint64_t> _contentKeys;
+		Buffer<uint16_t> _index;
+		uint32_t _indexMask = 0;
+	};
+}
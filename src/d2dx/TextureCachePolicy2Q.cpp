@@ -0,0 +1,201 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Utils.h"
+#include "TextureCachePolicy2Q.h"
+
+using namespace d2dx;
+
+/* The sizes of A1in and A1out recommended by the paper: 1/4 and 1/2 of the cache capacity. */
+#define D2DX_2Q_IN_CAPACITY(capacity) max(1U, (capacity) / 4)
+#define D2DX_2Q_OUT_CAPACITY(capacity) max(1U, (capacity) / 2)
+
+_Use_decl_annotations_
+TextureCachePolicy2Q::TextureCachePolicy2Q(
+	uint32_t capacity) :
+	_capacity{ capacity },
+	_inCapacity{ D2DX_2Q_IN_CAPACITY(capacity) },
+	_index{ capacity },
+	_lists{ capacity, 2 },
+	_ghostIndex{ D2DX_2Q_OUT_CAPACITY(capacity) },
+	_ghostLists{ D2DX_2Q_OUT_CAPACITY(capacity), 2 },
+	_lastUseFrames{ capacity, true }
+{
+	for (uint32_t i = 0; i < D2DX_2Q_OUT_CAPACITY(capacity); ++i)
+	{
+		_ghostLists.PushFront(GhostFree, i);
+	}
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicy2Q::Find(
+	uint64_t contentKey,
+	int32_t lastIndex)
+{
+	assert(contentKey != 0);
+
+	if (_capacity == 0)
+	{
+		return -1;
+	}
+
+	int32_t findIndex = lastIndex;
+
+	if (lastIndex < 0 || lastIndex >= (int32_t)_capacity ||
+		contentKey != _index.GetContentKey((uint32_t)lastIndex))
+	{
+		findIndex = _index.Find(contentKey);
+	}
+
+	if (findIndex >= 0)
+	{
+		/* Hits in A1in don't change its order, as those are likely correlated references. */
+		if (_lists.GetList((uint32_t)findIndex) == Am)
+		{
+			_lists.MoveToFront(Am, (uint32_t)findIndex);
+		}
+
+		_lastUseFrames.items[findIndex] = _frame;
+	}
+
+	return findIndex;
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicy2Q::Insert(
+	uint64_t contentKey,
+	bool& evicted)
+{
+	evicted = false;
+
+	if (_capacity == 0)
+	{
+		return -1;
+	}
+
+	/* Check the ghost queue before reclaiming a slot, which may push the key out of it. */
+	const int32_t ghostSlot = _ghostIndex.Find(contentKey);
+
+	if (ghostSlot >= 0)
+	{
+		_ghostIndex.Remove((uint32_t)ghostSlot);
+		_ghostLists.MoveToFront(GhostFree, (uint32_t)ghostSlot);
+	}
+
+	uint32_t replacementIndex;
+
+	if (_usedCount < _capacity)
+	{
+		replacementIndex = _usedCount++;
+	}
+	else
+	{
+		replacementIndex = Reclaim();
+		evicted = true;
+	}
+
+	_index.Insert(contentKey, replacementIndex);
+	_lists.PushFront(ghostSlot >= 0 ? Am : A1in, replacementIndex);
+	_lastUseFrames.items[replacementIndex] = _frame;
+
+	return (int32_t)replacementIndex;
+}
+
+void TextureCachePolicy2Q::OnNewFrame()
+{
+	++_frame;
+}
+
+_Use_decl_annotations_
+bool TextureCachePolicy2Q::Contains(
+	uint64_t contentKey) const
+{
+	return _capacity > 0 && _index.Find(contentKey) >= 0;
+}
+
+uint32_t TextureCachePolicy2Q::GetUsedCount() const
+{
+	return _usedCount;
+}
+
+uint32_t TextureCachePolicy2Q::Reclaim()
+{
+	const uint32_t preferredList = _lists.GetCount(A1in) > _inCapacity ? A1in : Am;
+	
+	int32_t slot = FindReplaceableSlot(preferredList);
+
+	if (slot < 0)
+	{
+		slot = FindReplaceableSlot(preferredList == A1in ? Am : A1in);
+	}
+
+	if (slot < 0)
+	{
+		D2DX_LOG("All texture atlas entries used in a single frame, starting over!");
+		slot = _lists.GetBack(preferredList);
+
+		if (slot < 0)
+		{
+			slot = _lists.GetBack(preferredList == A1in ? Am : A1in);
+		}
+	}
+
+	assert(slot >= 0);
+
+	if (_lists.GetList((uint32_t)slot) == A1in)
+	{
+		AddGhost(_index.GetContentKey((uint32_t)slot));
+	}
+
+	_lists.Remove((uint32_t)slot);
+	_index.Remove((uint32_t)slot);
+
+	return (uint32_t)slot;
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicy2Q::FindReplaceableSlot(
+	uint32_t list) const
+{
+	for (int32_t slot = _lists.GetBack(list); slot >= 0; slot = _lists.GetNewer((uint32_t)slot))
+	{
+		if (_lastUseFrames.items[slot] != _frame)
+		{
+			return slot;
+		}
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+void TextureCachePolicy2Q::AddGhost(
+	uint64_t contentKey)
+{
+	int32_t ghostSlot = _ghostLists.GetBack(GhostFree);
+
+	if (ghostSlot < 0)
+	{
+		ghostSlot = _ghostLists.GetBack(A1out);
+		_ghostIndex.Remove((uint32_t)ghostSlot);
+	}
+
+	_ghostIndex.Insert(contentKey, (uint32_t)ghostSlot);
+	_ghostLists.MoveToFront(A1out, (uint32_t)ghostSlot);
+}
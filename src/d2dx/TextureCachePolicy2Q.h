@@ -0,0 +1,88 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "ITextureCachePolicy.h"
+#include "TextureCacheIndex.h"
+#include "TextureCacheSlotLists.h"
+
+namespace d2dx
+{
+	/*
+		Picks slots to replace using the full 2Q algorithm (Johnson & Shasha). New textures go into a
+		FIFO queue (A1in), and are only promoted to the LRU queue (Am) if they are requested again
+		after having been evicted from A1in, while their key is still remembered in a ghost queue
+		(A1out). Textures that are only seen once, e.g. while running through an area, thus don't
+		push out the frequently used ones.
+	*/
+	class TextureCachePolicy2Q final : public ITextureCachePolicy
+	{
+	public:
+		TextureCachePolicy2Q(
+			_In_ uint32_t capacity);
+		virtual ~TextureCachePolicy2Q() noexcept {}
+
+		virtual int32_t Find(
+			_In_ uint64_t contentKey,
+			_In_ int32_t lastIndex) override;
+
+		virtual bool Contains(
+			_In_ uint64_t contentKey) const override;
+
+		virtual int32_t Insert(
+			_In_ uint64_t contentKey,
+			_Out_ bool& evicted) override;
+
+		virtual void OnNewFrame() override;
+
+		virtual uint32_t GetUsedCount() const override;
+
+	private:
+		enum
+		{
+			A1in = 0,
+			Am = 1,
+		};
+
+		enum
+		{
+			A1out = 0,
+			GhostFree = 1,
+		};
+
+		uint32_t Reclaim();
+
+		int32_t FindReplaceableSlot(
+			_In_ uint32_t list) const;
+
+		void AddGhost(
+			_In_ uint64_t contentKey);
+
+		uint32_t _capacity = 0;
+		uint32_t _inCapacity = 0;
+		TextureCacheIndex _index;
+		TextureCacheSlotLists _lists;
+		TextureCacheIndex _ghostIndex;
+		TextureCacheSlotLists _ghostLists;
+		Buffer<uint32_t> _lastUseFrames;
+		uint32_t _frame = 1;
+		uint32_t _usedCount = 0;
+	};
+}
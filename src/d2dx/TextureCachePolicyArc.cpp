@@ -0,0 +1,228 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Utils.h"
+#include "TextureCachePolicyArc.h"
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+TextureCachePolicyArc::TextureCachePolicyArc(
+	uint32_t capacity) :
+	_capacity{ capacity },
+	_index{ capacity },
+	_lists{ capacity, 2 },
+	_ghostIndex{ capacity },
+	_ghostLists{ capacity, 3 },
+	_lastUseFrames{ capacity, true }
+{
+	for (uint32_t i = 0; i < capacity; ++i)
+	{
+		_ghostLists.PushFront(GhostFree, i);
+	}
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicyArc::Find(
+	uint64_t contentKey,
+	int32_t lastIndex)
+{
+	assert(contentKey != 0);
+
+	if (_capacity == 0)
+	{
+		return -1;
+	}
+
+	int32_t findIndex = lastIndex;
+
+	if (lastIndex < 0 || lastIndex >= (int32_t)_capacity ||
+		contentKey != _index.GetContentKey((uint32_t)lastIndex))
+	{
+		findIndex = _index.Find(contentKey);
+	}
+
+	if (findIndex >= 0)
+	{
+		/* Count at most one hit per frame, so that a texture drawn several times in a frame
+		   doesn't look frequently used. */
+		if (_lastUseFrames.items[findIndex] != _frame)
+		{
+			_lists.MoveToFront(T2, (uint32_t)findIndex);
+		}
+
+		_lastUseFrames.items[findIndex] = _frame;
+	}
+
+	return findIndex;
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicyArc::Insert(
+	uint64_t contentKey,
+	bool& evicted)
+{
+	evicted = false;
+
+	if (_capacity == 0)
+	{
+		return -1;
+	}
+
+	const int32_t ghostSlot = _ghostIndex.Find(contentKey);
+	const int32_t ghostList = ghostSlot >= 0 ? _ghostLists.GetList((uint32_t)ghostSlot) : -1;
+	const uint32_t b1Count = _ghostLists.GetCount(B1);
+	const uint32_t b2Count = _ghostLists.GetCount(B2);
+
+	/* A hit in B1 means T1 was too small, a hit in B2 that T2 was. */
+	if (ghostList == B1)
+	{
+		_t1Target = min(_capacity, _t1Target + max(b2Count / b1Count, 1U));
+		RemoveGhost((uint32_t)ghostSlot);
+	}
+	else if (ghostList == B2)
+	{
+		const uint32_t delta = max(b1Count / b2Count, 1U);
+		_t1Target = _t1Target > delta ? _t1Target - delta : 0;
+		RemoveGhost((uint32_t)ghostSlot);
+	}
+
+	uint32_t replacementIndex;
+
+	if (_usedCount < _capacity)
+	{
+		replacementIndex = _usedCount++;
+	}
+	else
+	{
+		if (ghostList < 0)
+		{
+			/* Keep T1 + B1 within the capacity, and all four lists within twice that. */
+			if (_lists.GetCount(T1) + b1Count >= _capacity && b1Count > 0)
+			{
+				RemoveGhost((uint32_t)_ghostLists.GetBack(B1));
+			}
+			else if (b1Count + b2Count >= _capacity && b2Count > 0)
+			{
+				RemoveGhost((uint32_t)_ghostLists.GetBack(B2));
+			}
+		}
+
+		replacementIndex = Replace(ghostList == B2);
+		evicted = true;
+	}
+
+	_index.Insert(contentKey, replacementIndex);
+	_lists.PushFront(ghostList >= 0 ? T2 : T1, replacementIndex);
+	_lastUseFrames.items[replacementIndex] = _frame;
+
+	return (int32_t)replacementIndex;
+}
+
+void TextureCachePolicyArc::OnNewFrame()
+{
+	++_frame;
+}
+
+_Use_decl_annotations_
+bool TextureCachePolicyArc::Contains(
+	uint64_t contentKey) const
+{
+	return _capacity > 0 && _index.Find(contentKey) >= 0;
+}
+
+uint32_t TextureCachePolicyArc::GetUsedCount() const
+{
+	return _usedCount;
+}
+
+_Use_decl_annotations_
+uint32_t TextureCachePolicyArc::Replace(
+	bool isInB2)
+{
+	const uint32_t t1Count = _lists.GetCount(T1);
+	const uint32_t preferredList = t1Count > 0 && (t1Count > _t1Target || (isInB2 && t1Count == _t1Target)) ? T1 : T2;
+	const uint32_t otherList = preferredList == T1 ? T2 : T1;
+
+	int32_t slot = FindReplaceableSlot(preferredList);
+
+	if (slot < 0)
+	{
+		slot = FindReplaceableSlot(otherList);
+	}
+
+	if (slot < 0)
+	{
+		D2DX_LOG("All texture atlas entries used in a single frame, starting over!");
+		slot = _lists.GetBack(preferredList);
+
+		if (slot < 0)
+		{
+			slot = _lists.GetBack(otherList);
+		}
+	}
+
+	assert(slot >= 0);
+
+	AddGhost(_lists.GetList((uint32_t)slot) == T1 ? B1 : B2, _index.GetContentKey((uint32_t)slot));
+
+	_lists.Remove((uint32_t)slot);
+	_index.Remove((uint32_t)slot);
+
+	return (uint32_t)slot;
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicyArc::FindReplaceableSlot(
+	uint32_t list) const
+{
+	for (int32_t slot = _lists.GetBack(list); slot >= 0; slot = _lists.GetNewer((uint32_t)slot))
+	{
+		if (_lastUseFrames.items[slot] != _frame)
+		{
+			return slot;
+		}
+	}
+
+	return -1;
+}
+
+_Use_decl_annotations_
+void TextureCachePolicyArc::AddGhost(
+	uint32_t ghostList,
+	uint64_t contentKey)
+{
+	if (_ghostLists.GetCount(GhostFree) == 0)
+	{
+		RemoveGhost((uint32_t)_ghostLists.GetBack(_ghostLists.GetCount(ghostList) > 0 ? ghostList : (B1 + B2 - ghostList)));
+	}
+
+	const uint32_t ghostSlot = (uint32_t)_ghostLists.GetBack(GhostFree);
+
+	_ghostIndex.Insert(contentKey, ghostSlot);
+	_ghostLists.MoveToFront(ghostList, ghostSlot);
+}
+
+_Use_decl_annotations_
+void TextureCachePolicyArc::RemoveGhost(
+	uint32_t ghostSlot)
+{
+	_ghostIndex.Remove(ghostSlot);
+	_ghostLists.MoveToFront(GhostFree, ghostSlot);
+}
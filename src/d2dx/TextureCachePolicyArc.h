@@ -0,0 +1,93 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "ITextureCachePolicy.h"
+#include "TextureCacheIndex.h"
+#include "TextureCacheSlotLists.h"
+
+namespace d2dx
+{
+	/*
+		Picks slots to replace using ARC (Megiddo & Modha). Textures seen once are kept in an LRU
+		list (T1), textures seen more than once in another (T2). The keys of recently evicted
+		textures are remembered in a ghost list for each (B1 and B2), and hits in those adapt the
+		target size of T1, balancing recency against frequency for the current workload.
+	*/
+	class TextureCachePolicyArc final : public ITextureCachePolicy
+	{
+	public:
+		TextureCachePolicyArc(
+			_In_ uint32_t capacity);
+		virtual ~TextureCachePolicyArc() noexcept {}
+
+		virtual int32_t Find(
+			_In_ uint64_t contentKey,
+			_In_ int32_t lastIndex) override;
+
+		virtual bool Contains(
+			_In_ uint64_t contentKey) const override;
+
+		virtual int32_t Insert(
+			_In_ uint64_t contentKey,
+			_Out_ bool& evicted) override;
+
+		virtual void OnNewFrame() override;
+
+		virtual uint32_t GetUsedCount() const override;
+
+	private:
+		enum
+		{
+			T1 = 0,
+			T2 = 1,
+		};
+
+		enum
+		{
+			B1 = 0,
+			B2 = 1,
+			GhostFree = 2,
+		};
+
+		uint32_t Replace(
+			_In_ bool isInB2);
+
+		int32_t FindReplaceableSlot(
+			_In_ uint32_t list) const;
+
+		void AddGhost(
+			_In_ uint32_t ghostList,
+			_In_ uint64_t contentKey);
+
+		void RemoveGhost(
+			_In_ uint32_t ghostSlot);
+
+		uint32_t _capacity = 0;
+		uint32_t _t1Target = 0;
+		TextureCacheIndex _index;
+		TextureCacheSlotLists _lists;
+		TextureCacheIndex _ghostIndex;
+		TextureCacheSlotLists _ghostLists;
+		Buffer<uint32_t> _lastUseFrames;
+		uint32_t _frame = 1;
+		uint32_t _usedCount = 0;
+	};
+}
@@ -28,7 +28,7 @@ TextureCachePolicyBitPmru::TextureCachePolicyBitPmru(
 	uint32_t capacity,
 	const std::shared_ptr<ISimd>& simd) :
 	_capacity{ capacity },
-	_contentKeys{ capacity, true },
+	_index{ capacity },
 	_usedInFrameBits{ capacity >> 5, true },
 	_mruBits{ capacity >> 5, true },
 	_simd{ simd }
@@ -50,14 +50,16 @@ int32_t TextureCachePolicyBitPmru::Find(
 	}
 
 	if (lastIndex >= 0 && lastIndex < (int32_t)_capacity &&
-		contentKey == _contentKeys.items[lastIndex])
+		contentKey == _index.GetContentKey((uint32_t)lastIndex))
 	{
 		_usedInFrameBits.items[lastIndex >> 5] |= 1 << (lastIndex & 31);
 		_mruBits.items[lastIndex >> 5] |= 1 << (lastIndex & 31);
 		return lastIndex;
 	}
 
-	int32_t findIndex = _simd->IndexOfUInt64(_contentKeys.items, _capacity, contentKey);
+	const int32_t findIndex = _index.Find(contentKey);
+
+	assert(findIndex == _simd->IndexOfUInt64(_index.GetContentKeys(), _capacity, contentKey));
 
 	if (findIndex >= 0)
 	{
@@ -127,14 +129,18 @@ int32_t TextureCachePolicyBitPmru::Insert(
 	_mruBits.items[replacementIndex >> 5] |= 1 << (replacementIndex & 31);
 	_usedInFrameBits.items[replacementIndex >> 5] |= 1 << (replacementIndex & 31);
 
-	evicted = _contentKeys.items[replacementIndex] != 0;
+	evicted = _index.GetContentKey((uint32_t)replacementIndex) != 0;
 
-	if (!evicted)
+	if (evicted)
+	{
+		_index.Remove((uint32_t)replacementIndex);
+	}
+	else
 	{
 		++_usedCount;
 	}
 
-	_contentKeys.items[replacementIndex] = contentKey;
+	_index.Insert(contentKey, (uint32_t)replacementIndex);
 
 	return replacementIndex;
 }
@@ -144,6 +150,13 @@ void TextureCachePolicyBitPmru::OnNewFrame()
 	memset(_usedInFrameBits.items, 0, sizeof(uint32_t) * _usedInFrameBits.capacity);
 }
 
+_Use_decl_annotations_
+bool TextureCachePolicyBitPmru::Contains(
+	uint64_t contentKey) const
+{
+	return _capacity > 0 && _index.Find(contentKey) >= 0;
+}
+
 uint32_t TextureCachePolicyBitPmru::GetUsedCount() const
 {
 	return _usedCount;
@@ -20,36 +20,43 @@
 
 #include "Buffer.h"
 #include "ISimd.h"
+#include "ITextureCachePolicy.h"
+#include "TextureCacheIndex.h"
 
 namespace d2dx
 {
-	class TextureCachePolicyBitPmru final
+	/*
+		Keeps track of which texture atlas slots hold which content keys, and picks slots to replace
+		using a bit-PLRU scheme. Content keys are looked up through a hash index, which is kept in
+		sync with the slots on insertion and eviction.
+	*/
+	class TextureCachePolicyBitPmru final : public ITextureCachePolicy
 	{
 	public:
-		TextureCachePolicyBitPmru() = default;
-		TextureCachePolicyBitPmru& operator=(TextureCachePolicyBitPmru&& rhs) = default;
-
 		TextureCachePolicyBitPmru(
 			_In_ uint32_t capacity,
 			_In_ const std::shared_ptr<ISimd>& simd);
-		~TextureCachePolicyBitPmru() noexcept {}
+		virtual ~TextureCachePolicyBitPmru() noexcept {}
 
-		int32_t Find(
+		virtual int32_t Find(
 			_In_ uint64_t contentKey,
-			_In_ int32_t lastIndex);
+			_In_ int32_t lastIndex) override;
+
+		virtual bool Contains(
+			_In_ uint64_t contentKey) const override;
 		
-		int32_t Insert(
+		virtual int32_t Insert(
 			_In_ uint64_t contentKey,
-			_Out_ bool& evicted);
+			_Out_ bool& evicted) override;
 		
-		void OnNewFrame();
+		virtual void OnNewFrame() override;
 
-		uint32_t GetUsedCount() const;
+		virtual uint32_t GetUsedCount() const override;
 
 	private:
 		uint32_t _capacity = 0;
 		std::shared_ptr<ISimd> _simd;
-		Buffer<uint64_t> _contentKeys;
+		TextureCacheIndex _index;
 		Buffer<uint32_t> _usedInFrameBits;
 		Buffer<uint32_t> _mruBits;
 		uint32_t _usedCount = 0;
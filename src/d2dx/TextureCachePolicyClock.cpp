@@ -0,0 +1,145 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Utils.h"
+#include "TextureCachePolicyClock.h"
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+TextureCachePolicyClock::TextureCachePolicyClock(
+	uint32_t capacity) :
+	_capacity{ capacity },
+	_index{ capacity },
+	_referenceBits{ capacity, true },
+	_lastUseFrames{ capacity, true }
+{
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicyClock::Find(
+	uint64_t contentKey,
+	int32_t lastIndex)
+{
+	assert(contentKey != 0);
+
+	if (_capacity == 0)
+	{
+		return -1;
+	}
+
+	int32_t findIndex = lastIndex;
+
+	if (lastIndex < 0 || lastIndex >= (int32_t)_capacity ||
+		contentKey != _index.GetContentKey((uint32_t)lastIndex))
+	{
+		findIndex = _index.Find(contentKey);
+	}
+
+	if (findIndex >= 0)
+	{
+		Touch((uint32_t)findIndex);
+	}
+
+	return findIndex;
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicyClock::Insert(
+	uint64_t contentKey,
+	bool& evicted)
+{
+	evicted = false;
+
+	if (_capacity == 0)
+	{
+		return -1;
+	}
+
+	int32_t replacementIndex = -1;
+
+	if (_usedCount < _capacity)
+	{
+		replacementIndex = (int32_t)_usedCount++;
+	}
+	else
+	{
+		/* Two sweeps clear every reference bit, so a slot not used in this frame will be found
+		   within them if there is one. */
+		for (uint32_t i = 0; i < _capacity * 2; ++i)
+		{
+			const uint32_t slot = _hand;
+			_hand = (_hand + 1) % _capacity;
+
+			if (_lastUseFrames.items[slot] == _frame)
+			{
+				continue;
+			}
+
+			if (_referenceBits.items[slot])
+			{
+				_referenceBits.items[slot] = 0;
+				continue;
+			}
+
+			replacementIndex = (int32_t)slot;
+			break;
+		}
+
+		if (replacementIndex < 0)
+		{
+			D2DX_LOG("All texture atlas entries used in a single frame, starting over!");
+			replacementIndex = (int32_t)_hand;
+			_hand = (_hand + 1) % _capacity;
+		}
+
+		_index.Remove((uint32_t)replacementIndex);
+		evicted = true;
+	}
+
+	_index.Insert(contentKey, (uint32_t)replacementIndex);
+	Touch((uint32_t)replacementIndex);
+
+	return replacementIndex;
+}
+
+void TextureCachePolicyClock::OnNewFrame()
+{
+	++_frame;
+}
+
+_Use_decl_annotations_
+bool TextureCachePolicyClock::Contains(
+	uint64_t contentKey) const
+{
+	return _capacity > 0 && _index.Find(contentKey) >= 0;
+}
+
+uint32_t TextureCachePolicyClock::GetUsedCount() const
+{
+	return _usedCount;
+}
+
+_Use_decl_annotations_
+void TextureCachePolicyClock::Touch(
+	uint32_t slot)
+{
+	_referenceBits.items[slot] = 1;
+	_lastUseFrames.items[slot] = _frame;
+}
@@ -0,0 +1,73 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureCachePolicyFactory.h"
+#include "TextureCachePolicyBitPmru.h"
+#include "TextureCachePolicyClock.h"
+#include "TextureCachePolicy2Q.h"
+#include "TextureCachePolicyArc.h"
+#include "TextureCachePolicyLfu.h"
+
+using namespace d2dx;
+
+static const char* policyNames[(int)TextureCachePolicyType::Count] = { "bitpmru", "clock", "2q", "arc", "lfu" };
+
+_Use_decl_annotations_
+std::unique_ptr<ITextureCachePolicy> TextureCachePolicyFactory::Create(
+	TextureCachePolicyType policyType,
+	uint32_t capacity,
+	const std::shared_ptr<ISimd>& simd)
+{
+	switch (policyType)
+	{
+	default:
+	case TextureCachePolicyType::BitPmru:
+		return std::make_unique<TextureCachePolicyBitPmru>(capacity, simd);
+	case TextureCachePolicyType::Clock:
+		return std::make_unique<TextureCachePolicyClock>(capacity);
+	case TextureCachePolicyType::TwoQueue:
+		return std::make_unique<TextureCachePolicy2Q>(capacity);
+	case TextureCachePolicyType::Arc:
+		return std::make_unique<TextureCachePolicyArc>(capacity);
+	case TextureCachePolicyType::Lfu:
+		return std::make_unique<TextureCachePolicyLfu>(capacity);
+	}
+}
+
+_Use_decl_annotations_
+const char* TextureCachePolicyFactory::GetName(
+	TextureCachePolicyType policyType)
+{
+	return policyType < TextureCachePolicyType::Count ? policyNames[(int)policyType] : "unknown";
+}
+
+_Use_decl_annotations_
+TextureCachePolicyType TextureCachePolicyFactory::FromName(
+	const char* name)
+{
+	for (int32_t i = 0; i < (int32_t)TextureCachePolicyType::Count; ++i)
+	{
+		if (!strcmp(name, policyNames[i]))
+		{
+			return (TextureCachePolicyType)i;
+		}
+	}
+
+	return TextureCachePolicyType::Count;
+}
@@ -0,0 +1,163 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Utils.h"
+#include "TextureCachePolicyLfu.h"
+
+using namespace d2dx;
+
+/* Halve the use counts every this many frames (about half a second at 25 fps). */
+#define D2DX_LFU_AGING_INTERVAL 16
+
+_Use_decl_annotations_
+TextureCachePolicyLfu::TextureCachePolicyLfu(
+	uint32_t capacity) :
+	_capacity{ capacity },
+	_index{ capacity },
+	_useCounts{ capacity, true },
+	_lastUseFrames{ capacity, true }
+{
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicyLfu::Find(
+	uint64_t contentKey,
+	int32_t lastIndex)
+{
+	assert(contentKey != 0);
+
+	if (_capacity == 0)
+	{
+		return -1;
+	}
+
+	int32_t findIndex = lastIndex;
+
+	if (lastIndex < 0 || lastIndex >= (int32_t)_capacity ||
+		contentKey != _index.GetContentKey((uint32_t)lastIndex))
+	{
+		findIndex = _index.Find(contentKey);
+	}
+
+	if (findIndex >= 0)
+	{
+		Touch((uint32_t)findIndex);
+	}
+
+	return findIndex;
+}
+
+_Use_decl_annotations_
+int32_t TextureCachePolicyLfu::Insert(
+	uint64_t contentKey,
+	bool& evicted)
+{
+	evicted = false;
+
+	if (_capacity == 0)
+	{
+		return -1;
+	}
+
+	int32_t replacementIndex = -1;
+
+	if (_usedCount < _capacity)
+	{
+		replacementIndex = (int32_t)_usedCount++;
+	}
+	else
+	{
+		/* Among the least used slots, replace the one that was used longest ago. */
+		uint32_t lowestUseCount = UINT32_MAX;
+		uint32_t oldestLastUseFrame = UINT32_MAX;
+
+		for (uint32_t slot = 0; slot < _capacity; ++slot)
+		{
+			const uint32_t useCount = _useCounts.items[slot];
+			const uint32_t lastUseFrame = _lastUseFrames.items[slot];
+
+			if (lastUseFrame == _frame)
+			{
+				continue;
+			}
+
+			if (useCount < lowestUseCount ||
+				(useCount == lowestUseCount && lastUseFrame < oldestLastUseFrame))
+			{
+				lowestUseCount = useCount;
+				oldestLastUseFrame = lastUseFrame;
+				replacementIndex = (int32_t)slot;
+			}
+		}
+
+		if (replacementIndex < 0)
+		{
+			D2DX_LOG("All texture atlas entries used in a single frame, starting over!");
+			replacementIndex = 0;
+		}
+
+		_index.Remove((uint32_t)replacementIndex);
+		evicted = true;
+	}
+
+	_index.Insert(contentKey, (uint32_t)replacementIndex);
+	_useCounts.items[replacementIndex] = 0;
+	Touch((uint32_t)replacementIndex);
+
+	return replacementIndex;
+}
+
+void TextureCachePolicyLfu::OnNewFrame()
+{
+	++_frame;
+
+	if (!(_frame % D2DX_LFU_AGING_INTERVAL))
+	{
+		for (uint32_t slot = 0; slot < _usedCount; ++slot)
+		{
+			_useCounts.items[slot] >>= 1;
+		}
+	}
+}
+
+_Use_decl_annotations_
+bool TextureCachePolicyLfu::Contains(
+	uint64_t contentKey) const
+{
+	return _capacity > 0 && _index.Find(contentKey) >= 0;
+}
+
+uint32_t TextureCachePolicyLfu::GetUsedCount() const
+{
+	return _usedCount;
+}
+
+_Use_decl_annotations_
+void TextureCachePolicyLfu::Touch(
+	uint32_t slot)
+{
+	/* Count each slot at most once per frame, so that textures drawn many times per frame (e.g.
+	   floor tiles) don't get an outsized count. */
+	if (_lastUseFrames.items[slot] != _frame && _useCounts.items[slot] < UINT16_MAX)
+	{
+		++_useCounts.items[slot];
+	}
+
+	_lastUseFrames.items[slot] = _frame;
+}
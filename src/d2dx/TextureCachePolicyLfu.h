@@ -0,0 +1,64 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "ITextureCachePolicy.h"
+#include "TextureCacheIndex.h"
+
+namespace d2dx
+{
+	/*
+		Replaces the least frequently used slot. The use counts are halved at regular intervals, so
+		that textures that were popular a while ago (e.g. in another area) eventually age out.
+	*/
+	class TextureCachePolicyLfu final : public ITextureCachePolicy
+	{
+	public:
+		TextureCachePolicyLfu(
+			_In_ uint32_t capacity);
+		virtual ~TextureCachePolicyLfu() noexcept {}
+
+		virtual int32_t Find(
+			_In_ uint64_t contentKey,
+			_In_ int32_t lastIndex) override;
+
+		virtual bool Contains(
+			_In_ uint64_t contentKey) const override;
+
+		virtual int32_t Insert(
+			_In_ uint64_t contentKey,
+			_Out_ bool& evicted) override;
+
+		virtual void OnNewFrame() override;
+
+		virtual uint32_t GetUsedCount() const override;
+
+	private:
+		void Touch(
+			_In_ uint32_t slot);
+
+		uint32_t _capacity = 0;
+		TextureCacheIndex _index;
+		Buffer<uint16_t> _useCounts;
+		Buffer<uint32_t> _lastUseFrames;
+		uint32_t _frame = 1;
+		uint32_t _usedCount = 0;
+	};
+}
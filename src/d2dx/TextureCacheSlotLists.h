@@ -0,0 +1,138 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+
+namespace d2dx
+{
+	/*
+		A fixed set of intrusive doubly-linked lists over a fixed number of slots, used by the texture
+		cache policies to keep slots in recency order. Each slot is in at most one list at a time.
+		The front of a list is the most recently pushed slot, the back the least recently pushed.
+	*/
+	class TextureCacheSlotLists final
+	{
+	public:
+		TextureCacheSlotLists() = default;
+		TextureCacheSlotLists& operator=(TextureCacheSlotLists&& rhs) = default;
+
+		TextureCacheSlotLists(
+			_In_ uint32_t slotCount,
+			_In_ uint32_t listCount) :
+			_prev{ slotCount + listCount },
+			_next{ slotCount + listCount },
+			_lists{ slotCount, true, NoList },
+			_counts{ listCount, true }
+		{
+			assert(slotCount + listCount < 65536);
+
+			/* Each list has a sentinel node after the slots, linked to itself when the list is empty. */
+			for (uint32_t i = slotCount; i < slotCount + listCount; ++i)
+			{
+				_prev.items[i] = (uint16_t)i;
+				_next.items[i] = (uint16_t)i;
+			}
+		}
+
+		void PushFront(
+			_In_ uint32_t list,
+			_In_ uint32_t slot)
+		{
+			assert(list < _counts.capacity);
+			assert(_lists.items[slot] == NoList);
+
+			const uint32_t head = _lists.capacity + list;
+			const uint32_t first = _next.items[head];
+
+			_prev.items[slot] = (uint16_t)head;
+			_next.items[slot] = (uint16_t)first;
+			_prev.items[first] = (uint16_t)slot;
+			_next.items[head] = (uint16_t)slot;
+			_lists.items[slot] = (uint8_t)list;
+			++_counts.items[list];
+		}
+
+		void Remove(
+			_In_ uint32_t slot)
+		{
+			assert(_lists.items[slot] != NoList);
+
+			const uint32_t prev = _prev.items[slot];
+			const uint32_t next = _next.items[slot];
+
+			_next.items[prev] = (uint16_t)next;
+			_prev.items[next] = (uint16_t)prev;
+			--_counts.items[_lists.items[slot]];
+			_lists.items[slot] = NoList;
+		}
+
+		void MoveToFront(
+			_In_ uint32_t list,
+			_In_ uint32_t slot)
+		{
+			Remove(slot);
+			PushFront(list, slot);
+		}
+
+		/* Returns the least recently pushed slot in the list, or -1 if it is empty. */
+		int32_t GetBack(
+			_In_ uint32_t list) const
+		{
+			assert(list < _counts.capacity);
+			return ToSlot(_prev.items[_lists.capacity + list]);
+		}
+
+		/* Returns the slot pushed after the given one, or -1 if it is at the front of its list. */
+		int32_t GetNewer(
+			_In_ uint32_t slot) const
+		{
+			assert(_lists.items[slot] != NoList);
+			return ToSlot(_prev.items[slot]);
+		}
+
+		/* Returns the list the slot is in, or -1 if it isn't in one. */
+		int32_t GetList(
+			_In_ uint32_t slot) const
+		{
+			return _lists.items[slot] == NoList ? -1 : (int32_t)_lists.items[slot];
+		}
+
+		uint32_t GetCount(
+			_In_ uint32_t list) const
+		{
+			assert(list < _counts.capacity);
+			return _counts.items[list];
+		}
+
+	private:
+		static constexpr uint8_t NoList = 0xFF;
+
+		int32_t ToSlot(
+			_In_ uint32_t node) const
+		{
+			return node < _lists.capacity ? (int32_t)node : -1;
+		}
+
+		Buffer<uint16_t> _prev;
+		Buffer<uint16_t> _next;
+		Buffer<uint8_t> _lists;
+		Buffer<uint32_t> _counts;
+	};
+}
@@ -0,0 +1,423 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureDiskCache.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+using namespace d2dx;
+using namespace std;
+
+_Use_decl_annotations_
+TextureDiskCache::TextureDiskCache(
+	const char* filename,
+	uint32_t sizeBudget) :
+	_sizeBudget{ min(sizeBudget, MaxSizeBudget) },
+	_index{ MaxEntries },
+	_entries{ MaxEntries, true },
+	_preloadOrder{ MaxEntries }
+{
+	strcpy_s(_filename, filename);
+
+	_loaderThread = CreateThread(nullptr, 0, LoaderThreadProc, this, 0, nullptr);
+
+	if (!_loaderThread)
+	{
+		D2DX_LOG("Failed to start the texture disk cache loader, loading on the game thread.");
+		Load();
+	}
+}
+
+TextureDiskCache::~TextureDiskCache() noexcept
+{
+	if (_loaderThread)
+	{
+		WaitForSingleObject(_loaderThread, INFINITE);
+		CloseHandle(_loaderThread);
+		_loaderThread = nullptr;
+	}
+
+	Save();
+	Unmap();
+}
+
+_Use_decl_annotations_
+void TextureDiskCache::OnTextureUsed(
+	uint64_t contentKey,
+	int32_t width,
+	int32_t height,
+	const uint8_t* texels)
+{
+	/* Until the file has been loaded, the entries belong to the loader thread. */
+	if (!_isLoaded.load(memory_order_acquire))
+	{
+		return;
+	}
+
+	const int32_t entryIndex = _index.Find(contentKey);
+
+	if (entryIndex >= 0)
+	{
+		Entry& entry = _entries.items[entryIndex];
+
+		if (entry.lastSession != _session)
+		{
+			entry.lastSession = _session;
+			entry.useCount += entry.useCount < UINT16_MAX ? 1 : 0;
+		}
+
+		return;
+	}
+
+	const uint32_t size = (uint32_t)(width * height);
+
+	if (_entryCount >= MaxEntries || size > (_sizeBudget - _newTexelsSize))
+	{
+		return;
+	}
+
+	uint8_t* texelsCopy = AllocateNewTexels(size);
+
+	if (!texelsCopy)
+	{
+		return;
+	}
+
+	memcpy(texelsCopy, texels, size);
+	_newTexelsSize += size;
+
+	DWORD widthLog2, heightLog2;
+	BitScanReverse(&widthLog2, (DWORD)width);
+	BitScanReverse(&heightLog2, (DWORD)height);
+
+	Entry& entry = _entries.items[_entryCount];
+	entry.texels = texelsCopy;
+	entry.texelsHash = XXH3_64bits(texelsCopy, size);
+	entry.lastSession = _session;
+	entry.useCount = 1;
+	entry.widthLog2 = (uint8_t)widthLog2;
+	entry.heightLog2 = (uint8_t)heightLog2;
+	entry.isChecked = true;
+
+	_index.Insert(contentKey, _entryCount++);
+}
+
+_Use_decl_annotations_
+const uint8_t* TextureDiskCache::GetNextPreload(
+	uint64_t& contentKey,
+	int32_t& width,
+	int32_t& height)
+{
+	if (!_hasLoggedLoad && _isLoaded.load(memory_order_acquire))
+	{
+		if (_loadError)
+		{
+			D2DX_LOG("Texture disk cache %s not loaded: %s.", _filename, _loadError);
+		}
+		else
+		{
+			D2DX_LOG("Texture disk cache %s has %u textures from %u sessions.", _filename, _preloadCount, _session - 1);
+		}
+
+		_hasLoggedLoad = true;
+	}
+
+	const uint32_t checkedCount = _checkedCount.load(memory_order_acquire);
+
+	while (_nextPreload < checkedCount)
+	{
+		const uint32_t entryIndex = _preloadOrder.items[_nextPreload++];
+		const Entry& entry = _entries.items[entryIndex];
+
+		if (!entry.isChecked)
+		{
+			continue;
+		}
+
+		contentKey = _index.GetContentKey(entryIndex);
+		width = 1 << entry.widthLog2;
+		height = 1 << entry.heightLog2;
+		return entry.texels;
+	}
+
+	contentKey = 0;
+	width = 0;
+	height = 0;
+	return nullptr;
+}
+
+void TextureDiskCache::Load()
+{
+	_file = CreateFileA(_filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (_file == INVALID_HANDLE_VALUE)
+	{
+		_loadError = "could not open the file";
+		_isLoaded.store(true, memory_order_release);
+		return;
+	}
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(_file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(FileHeader) || fileSize.QuadPart > UINT32_MAX)
+	{
+		_loadError = "the file size is invalid";
+		Unmap();
+		_isLoaded.store(true, memory_order_release);
+		return;
+	}
+
+	_fileMapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	_view = _fileMapping ? (const uint8_t*)MapViewOfFile(_fileMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+	const uint32_t viewSize = (uint32_t)fileSize.QuadPart;
+	FileHeader header;
+
+	if (_view)
+	{
+		memcpy(&header, _view, sizeof(header));
+	}
+
+	if (!_view)
+	{
+		_loadError = "could not map the file";
+	}
+	else if (header.magic != FileMagic || header.version != FileVersion)
+	{
+		_loadError = "the file is from another version of D2DX";
+	}
+	else if (header.entryCount > MaxEntries || (sizeof(FileHeader) + header.entryCount * sizeof(FileEntry)) > viewSize)
+	{
+		_loadError = "the file is truncated";
+	}
+
+	if (_loadError)
+	{
+		Unmap();
+		_isLoaded.store(true, memory_order_release);
+		return;
+	}
+
+	_session = header.sessionCount + 1;
+
+	const FileEntry* fileEntries = (const FileEntry*)(_view + sizeof(FileHeader));
+
+	for (uint32_t i = 0; i < header.entryCount; ++i)
+	{
+		const FileEntry& fileEntry = fileEntries[i];
+
+		if (fileEntry.contentKey == 0 ||
+			fileEntry.widthLog2 < 3 || fileEntry.widthLog2 > 8 ||
+			fileEntry.heightLog2 < 3 || fileEntry.heightLog2 > 8 ||
+			fileEntry.dataOffset > viewSize ||
+			(1U << (fileEntry.widthLog2 + fileEntry.heightLog2)) > (viewSize - fileEntry.dataOffset) ||
+			_index.Find(fileEntry.contentKey) >= 0)
+		{
+			continue;
+		}
+
+		Entry& entry = _entries.items[_entryCount];
+		entry.texels = _view + fileEntry.dataOffset;
+		entry.texelsHash = fileEntry.texelsHash;
+		entry.lastSession = fileEntry.lastSession;
+		entry.useCount = fileEntry.useCount;
+		entry.widthLog2 = fileEntry.widthLog2;
+		entry.heightLog2 = fileEntry.heightLog2;
+		entry.isChecked = false;
+
+		_index.Insert(fileEntry.contentKey, _entryCount);
+		_preloadOrder.items[_entryCount] = (uint16_t)_entryCount;
+		++_entryCount;
+	}
+
+	_preloadCount = _entryCount;
+	SortByUse(_preloadOrder.items, _preloadCount);
+
+	_isLoaded.store(true, memory_order_release);
+
+	/* Checking the texels also pages them in, ahead of the game thread preloading them. */
+	for (uint32_t i = 0; i < _preloadCount; ++i)
+	{
+		Entry& entry = _entries.items[_preloadOrder.items[i]];
+		entry.isChecked = XXH3_64bits(entry.texels, (size_t)1 << (entry.widthLog2 + entry.heightLog2)) == entry.texelsHash;
+		_checkedCount.store(i + 1, memory_order_release);
+	}
+}
+
+void TextureDiskCache::Save()
+{
+	/* Drop the textures that weren't drawn in a while, and those that failed the check. */
+	Buffer<uint16_t> entryIndices{ max(1U, _entryCount) };
+	uint32_t count = 0;
+
+	for (uint32_t i = 0; i < _entryCount; ++i)
+	{
+		const Entry& entry = _entries.items[i];
+
+		if (entry.isChecked && (entry.lastSession + MaxUnusedSessions) >= _session)
+		{
+			entryIndices.items[count++] = (uint16_t)i;
+		}
+	}
+
+	SortByUse(entryIndices.items, count);
+
+	uint32_t dataSize = 0;
+	uint32_t savedCount = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const Entry& entry = _entries.items[entryIndices.items[i]];
+		const uint32_t size = 1U << (entry.widthLog2 + entry.heightLog2);
+
+		if ((dataSize + size) <= _sizeBudget)
+		{
+			entryIndices.items[savedCount++] = entryIndices.items[i];
+			dataSize += size;
+		}
+	}
+
+	if (savedCount == 0)
+	{
+		return;
+	}
+
+	/* Write to a temporary file, as the old one is still mapped, and so that a failed write
+	   doesn't lose it. */
+	char tempFilename[MAX_PATH + 4];
+	sprintf_s(tempFilename, "%s.tmp", _filename);
+
+	FILE* file = nullptr;
+
+	if (fopen_s(&file, tempFilename, "wb") != 0 || !file)
+	{
+		D2DX_LOG("Failed to open %s for writing, the texture disk cache is not saved.", tempFilename);
+		return;
+	}
+
+	const FileHeader header{ FileMagic, FileVersion, _session, savedCount };
+	fwrite(&header, sizeof(header), 1, file);
+
+	uint32_t dataOffset = sizeof(FileHeader) + savedCount * sizeof(FileEntry);
+
+	for (uint32_t i = 0; i < savedCount; ++i)
+	{
+		const uint32_t entryIndex = entryIndices.items[i];
+		const Entry& entry = _entries.items[entryIndex];
+
+		FileEntry fileEntry = { 0 };
+		fileEntry.contentKey = _index.GetContentKey(entryIndex);
+		fileEntry.texelsHash = entry.texelsHash;
+		fileEntry.dataOffset = dataOffset;
+		fileEntry.lastSession = entry.lastSession;
+		fileEntry.useCount = entry.useCount;
+		fileEntry.widthLog2 = entry.widthLog2;
+		fileEntry.heightLog2 = entry.heightLog2;
+		fwrite(&fileEntry, sizeof(fileEntry), 1, file);
+
+		dataOffset += 1U << (entry.widthLog2 + entry.heightLog2);
+	}
+
+	for (uint32_t i = 0; i < savedCount; ++i)
+	{
+		const Entry& entry = _entries.items[entryIndices.items[i]];
+		fwrite(entry.texels, 1, (size_t)1 << (entry.widthLog2 + entry.heightLog2), file);
+	}
+
+	const bool isWriteOk = !ferror(file);
+	fclose(file);
+
+	Unmap();
+
+	if (!isWriteOk || !MoveFileExA(tempFilename, _filename, MOVEFILE_REPLACE_EXISTING))
+	{
+		D2DX_LOG("Failed to write %s, the texture disk cache is not saved.", _filename);
+		DeleteFileA(tempFilename);
+		return;
+	}
+
+	D2DX_LOG("Saved %u textures (%u kB) to the texture disk cache %s.", savedCount, dataSize / 1024, _filename);
+}
+
+void TextureDiskCache::Unmap()
+{
+	if (_view)
+	{
+		UnmapViewOfFile(_view);
+		_view = nullptr;
+	}
+
+	if (_fileMapping)
+	{
+		CloseHandle(_fileMapping);
+		_fileMapping = nullptr;
+	}
+
+	if (_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(_file);
+		_file = INVALID_HANDLE_VALUE;
+	}
+}
+
+_Use_decl_annotations_
+void TextureDiskCache::SortByUse(
+	uint16_t* entryIndices,
+	uint32_t count) const
+{
+	/* Most used first, and of those, most recently used first. */
+	std::sort(entryIndices, entryIndices + count, [this](uint16_t a, uint16_t b)
+		{
+			const Entry& entryA = _entries.items[a];
+			const Entry& entryB = _entries.items[b];
+			return entryA.useCount != entryB.useCount ? entryA.useCount > entryB.useCount : entryA.lastSession > entryB.lastSession;
+		});
+}
+
+_Use_decl_annotations_
+uint8_t* TextureDiskCache::AllocateNewTexels(
+	uint32_t size)
+{
+	assert(size <= NewTexelsChunkSize);
+
+	if (_newTexelsChunkCount == 0 || size > (NewTexelsChunkSize - _newTexelsChunkUsedSize))
+	{
+		if (_newTexelsChunkCount >= ARRAYSIZE(_newTexelsChunks))
+		{
+			return nullptr;
+		}
+
+		_newTexelsChunks[_newTexelsChunkCount++] = Buffer<uint8_t>(NewTexelsChunkSize);
+		_newTexelsChunkUsedSize = 0;
+	}
+
+	uint8_t* texels = _newTexelsChunks[_newTexelsChunkCount - 1].items + _newTexelsChunkUsedSize;
+	_newTexelsChunkUsedSize += size;
+	return texels;
+}
+
+_Use_decl_annotations_
+DWORD WINAPI TextureDiskCache::LoaderThreadProc(
+	LPVOID lpParameter)
+{
+	TextureDiskCache* self = (TextureDiskCache*)lpParameter;
+	self->Load();
+	return 0;
+}
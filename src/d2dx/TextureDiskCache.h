@@ -0,0 +1,146 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "TextureCacheIndex.h"
+
+namespace d2dx
+{
+	/*
+		Remembers the textures drawn in previous sessions in a file, so that the most frequently
+		used ones can be preloaded into the texture caches at startup instead of being uploaded in a
+		burst the first time the game draws them (e.g. when entering a town).
+
+		The file is memory-mapped by a background thread, which also checks the texels of each
+		texture in preload order, so that the game thread doesn't stall on page faults. Textures not
+		in the file are copied as they are first drawn, and the file is rewritten on exit with the
+		textures drawn in the most sessions, up to the size budget.
+
+		Content keys are the texture hashes from TextureHasher, so FileVersion must be changed
+		whenever those change.
+	*/
+	class TextureDiskCache final
+	{
+	public:
+		TextureDiskCache(
+			_In_z_ const char* filename,
+			_In_ uint32_t sizeBudget);
+
+		~TextureDiskCache() noexcept;
+
+		/* Called from the game thread for each texture drawn. */
+		void OnTextureUsed(
+			_In_ uint64_t contentKey,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_reads_(width * height) const uint8_t* texels);
+
+		/* Called from the game thread. Returns the texels of the next texture to preload, or nullptr
+		   if there is none ready (yet). */
+		const uint8_t* GetNextPreload(
+			_Out_ uint64_t& contentKey,
+			_Out_ int32_t& width,
+			_Out_ int32_t& height);
+
+	private:
+		static constexpr uint32_t FileMagic = 0x43544432; /* "2DTC" */
+		static constexpr uint32_t FileVersion = 1;
+		static constexpr uint32_t MaxEntries = 16384;
+
+		/* The largest size budget. Textures first drawn in this session are copied into chunks that
+		   are allocated as needed, so that a large budget doesn't reserve its memory up front. */
+		static constexpr uint32_t MaxSizeBudget = 128 * 1024 * 1024;
+		static constexpr uint32_t NewTexelsChunkSize = 4 * 1024 * 1024;
+
+		/* Textures not drawn in this many sessions are dropped from the file. */
+		static constexpr uint32_t MaxUnusedSessions = 16;
+
+		struct FileHeader final
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t sessionCount;
+			uint32_t entryCount;
+		};
+
+		struct FileEntry final
+		{
+			uint64_t contentKey;
+			uint64_t texelsHash;
+			uint32_t dataOffset;
+			uint32_t lastSession;
+			uint16_t useCount;
+			uint8_t widthLog2;
+			uint8_t heightLog2;
+			uint32_t reserved;
+		};
+
+		static_assert(sizeof(FileEntry) == 32, "sizeof(FileEntry)");
+
+		struct Entry final
+		{
+			const uint8_t* texels;
+			uint64_t texelsHash;
+			uint32_t lastSession;
+			uint16_t useCount;
+			uint8_t widthLog2;
+			uint8_t heightLog2;
+			bool isChecked;
+		};
+
+		void Load();
+
+		void Save();
+
+		void Unmap();
+
+		void SortByUse(
+			_Inout_updates_(count) uint16_t* entryIndices,
+			_In_ uint32_t count) const;
+
+		uint8_t* AllocateNewTexels(
+			_In_ uint32_t size);
+
+		static DWORD WINAPI LoaderThreadProc(
+			_In_ LPVOID lpParameter);
+
+		char _filename[MAX_PATH] = { 0 };
+		uint32_t _sizeBudget = 0;
+		HANDLE _file = INVALID_HANDLE_VALUE;
+		HANDLE _fileMapping = nullptr;
+		const uint8_t* _view = nullptr;
+		const char* _loadError = nullptr;
+		uint32_t _session = 1;
+		TextureCacheIndex _index;
+		Buffer<Entry> _entries;
+		uint32_t _entryCount = 0;
+		Buffer<uint16_t> _preloadOrder;
+		uint32_t _preloadCount = 0;
+		uint32_t _nextPreload = 0;
+		Buffer<uint8_t> _newTexelsChunks[MaxSizeBudget / NewTexelsChunkSize];
+		uint32_t _newTexelsChunkCount = 0;
+		uint32_t _newTexelsChunkUsedSize = 0;
+		uint32_t _newTexelsSize = 0;
+		HANDLE _loaderThread = nullptr;
+		std::atomic<bool> _isLoaded = { false };
+		std::atomic<uint32_t> _checkedCount = { 0 };
+		bool _hasLoggedLoad = false;
+	};
+}
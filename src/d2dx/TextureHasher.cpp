@@ -24,16 +24,79 @@
 
 using namespace d2dx;
 
+/* The largest texture is 256x256, i.e. 256 pages. */
+#define D2DX_TEXTURE_HASHER_MAX_PAGES 256
+
 TextureHasher::TextureHasher() :
-	_cache{ D2DX_TMU_MEMORY_SIZE / 256, true }
+	_cache{ D2DX_TMU_MEMORY_SIZE / 256, true },
+	_dirtyPages{ D2DX_TMU_MEMORY_SIZE / 256 / 64, true }
 {
 }
 
 _Use_decl_annotations_
 void TextureHasher::Invalidate(
-	uint32_t startAddress)
+	uint32_t startAddress,
+	uint32_t size)
 {
-	_cache.items[startAddress >> 8] = 0;
+	if (size == 0)
+	{
+		return;
+	}
+
+	const uint32_t firstPage = startAddress >> 8;
+	const uint32_t lastPage = min((startAddress + size - 1) >> 8, _cache.capacity - 1);
+
+	for (uint32_t page = firstPage; page <= lastPage; )
+	{
+		const uint32_t bit = page & 63;
+		const uint32_t bitCount = min(64 - bit, lastPage - page + 1);
+		const uint64_t mask = bitCount == 64 ? ~0ULL : (((1ULL << bitCount) - 1) << bit);
+		_dirtyPages.items[page >> 6] |= mask;
+		page += bitCount;
+	}
+}
+
+_Use_decl_annotations_
+bool TextureHasher::UpdateContent(
+	uint32_t startAddress,
+	uint32_t size,
+	XXH64_hash_t contentHash)
+{
+	assert((startAddress & 255) == 0);
+
+	if (size == 0)
+	{
+		return false;
+	}
+
+	if (size > D2DX_TEXTURE_HASHER_MAX_PAGES * 256)
+	{
+		Invalidate(startAddress, size);
+		return true;
+	}
+
+	const uint32_t firstPage = startAddress >> 8;
+	const uint32_t lastPage = min((startAddress + size - 1) >> 8, _cache.capacity - 1);
+
+	if (IsAnyPageDirty(firstPage, lastPage))
+	{
+		ResolveDirtyPages(firstPage, lastPage);
+	}
+
+	CacheEntry& entry = _cache.items[firstPage];
+
+	if (entry.hash && entry.hash == contentHash && entry.pixelsSize == size)
+	{
+		return false;
+	}
+
+	/* Resolve the written range right away, so that the hash recorded below survives it. */
+	Invalidate(startAddress, size);
+	ResolveDirtyPages(firstPage, lastPage);
+
+	entry.hash = contentHash;
+	entry.pixelsSize = size;
+	return true;
 }
 
 _Use_decl_annotations_
@@ -45,18 +108,101 @@ XXH64_hash_t TextureHasher::GetHash(
 	uint32_t ratioLog2)
 {
 	assert((startAddress & 255) == 0);
+	assert(pixelsSize > 0 && pixelsSize <= D2DX_TEXTURE_HASHER_MAX_PAGES * 256);
+
+	const uint32_t firstPage = startAddress >> 8;
+	const uint32_t lastPage = min((startAddress + pixelsSize - 1) >> 8, _cache.capacity - 1);
 
-	XXH64_hash_t hash = _cache.items[startAddress >> 8];
+	if (IsAnyPageDirty(firstPage, lastPage))
+	{
+		ResolveDirtyPages(firstPage, lastPage);
+	}
+
+	CacheEntry& entry = _cache.items[firstPage];
 	AddTexHashLookup();
 
-	if (!hash)
+	if (!entry.hash || entry.pixelsSize != pixelsSize)
 	{
 		AddTexHashMiss(pixelsSize);
-		hash = XXH3_64bits((void *)pixels, pixelsSize);
-		hash ^= static_cast<XXH64_hash_t>(largeLog2 * 0x01000193u);
-		hash ^= static_cast<XXH64_hash_t>(ratioLog2 * 0x01000193u) << 32;
-		_cache.items[startAddress >> 8] = hash;
+		++_missCount;
+		_missBytes += pixelsSize;
+		entry.hash = XXH3_64bits((void *)pixels, pixelsSize);
+		entry.pixelsSize = pixelsSize;
 	}
 
+	XXH64_hash_t hash = entry.hash;
+	hash ^= static_cast<XXH64_hash_t>(largeLog2 * 0x01000193u);
+	hash ^= static_cast<XXH64_hash_t>(ratioLog2 * 0x01000193u) << 32;
 	return hash;
 }
+
+uint32_t TextureHasher::GetMissCount() const noexcept
+{
+	return _missCount;
+}
+
+uint64_t TextureHasher::GetMissBytes() const noexcept
+{
+	return _missBytes;
+}
+
+_Use_decl_annotations_
+bool TextureHasher::IsAnyPageDirty(
+	uint32_t firstPage,
+	uint32_t lastPage) const
+{
+	const uint32_t firstWord = firstPage >> 6;
+	const uint32_t lastWord = lastPage >> 6;
+	const uint64_t firstMask = ~0ULL << (firstPage & 63);
+	const uint64_t lastMask = ~0ULL >> (63 - (lastPage & 63));
+
+	if (firstWord == lastWord)
+	{
+		return (_dirtyPages.items[firstWord] & firstMask & lastMask) != 0;
+	}
+
+	uint64_t dirty = (_dirtyPages.items[firstWord] & firstMask) | (_dirtyPages.items[lastWord] & lastMask);
+
+	for (uint32_t word = firstWord + 1; word < lastWord; ++word)
+	{
+		dirty |= _dirtyPages.items[word];
+	}
+
+	return dirty != 0;
+}
+
+_Use_decl_annotations_
+void TextureHasher::ResolveDirtyPages(
+	uint32_t firstPage,
+	uint32_t lastPage)
+{
+	/* Find the span of dirty pages within the range. */
+	uint32_t firstDirtyPage = lastPage;
+	uint32_t lastDirtyPage = firstPage;
+
+	for (uint32_t page = firstPage; page <= lastPage; ++page)
+	{
+		if (_dirtyPages.items[page >> 6] & (1ULL << (page & 63)))
+		{
+			firstDirtyPage = min(firstDirtyPage, page);
+			lastDirtyPage = page;
+			_dirtyPages.items[page >> 6] &= ~(1ULL << (page & 63));
+		}
+	}
+
+	assert(firstDirtyPage <= lastDirtyPage);
+
+	/* Drop every cached hash whose texture overlaps the span. Hashes of textures that only touch
+	   clean pages inside the span are dropped too, which is harmless. */
+	const uint32_t firstStartPage = firstDirtyPage >= (D2DX_TEXTURE_HASHER_MAX_PAGES - 1) ? firstDirtyPage - (D2DX_TEXTURE_HASHER_MAX_PAGES - 1) : 0;
+
+	for (uint32_t startPage = firstStartPage; startPage <= lastDirtyPage; ++startPage)
+	{
+		CacheEntry& entry = _cache.items[startPage];
+
+		if (entry.hash && (startPage + ((entry.pixelsSize + 255) >> 8)) > firstDirtyPage)
+		{
+			entry.hash = 0;
+		}
+	}
+}
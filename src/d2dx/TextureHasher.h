@@ -22,6 +22,15 @@
 
 namespace d2dx
 {
+	/*
+		Caches content hashes by start address in TMU memory. Writes mark the 256-byte pages
+		they touch as dirty, and a cached hash is only used if none of the pages covered by its
+		texture are dirty. Dirty pages are resolved lazily: when a lookup finds dirty pages in its
+		range, every cached hash overlapping those pages is dropped and the pages are cleared.
+
+		Downloads that are hashed up front go through UpdateContent instead, which detects
+		re-downloads of identical content and primes the cache for the following GetHash.
+	*/
 	class TextureHasher final
 	{
 	public:
@@ -29,7 +38,14 @@ namespace d2dx
 		~TextureHasher() noexcept {}
 
 		void Invalidate(
-			_In_ uint32_t startAddress);
+			_In_ uint32_t startAddress,
+			_In_ uint32_t size);
+
+		/* Returns false if the memory already holds content with the given hash. */
+		bool UpdateContent(
+			_In_ uint32_t startAddress,
+			_In_ uint32_t size,
+			_In_ XXH64_hash_t contentHash);
 
 		XXH64_hash_t GetHash(
 			_In_ uint32_t startAddress,
@@ -38,7 +54,29 @@ namespace d2dx
 			_In_ uint32_t largeLog2,
 			_In_ uint32_t ratioLog2);
 
+		/* The number of hashes computed by GetHash because none was cached, and the bytes hashed. */
+		uint32_t GetMissCount() const noexcept;
+
+		uint64_t GetMissBytes() const noexcept;
+
 	private:
-		Buffer<XXH64_hash_t> _cache;
+		struct CacheEntry final
+		{
+			XXH64_hash_t hash;
+			uint32_t pixelsSize;
+		};
+
+		bool IsAnyPageDirty(
+			_In_ uint32_t firstPage,
+			_In_ uint32_t lastPage) const;
+
+		void ResolveDirtyPages(
+			_In_ uint32_t firstPage,
+			_In_ uint32_t lastPage);
+
+		Buffer<CacheEntry> _cache;
+		Buffer<uint64_t> _dirtyPages;
+		uint32_t _missCount = 0;
+		uint64_t _missBytes = 0;
 	};
 }
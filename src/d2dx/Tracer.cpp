@@ -0,0 +1,329 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Tracer.h"
+#include "Buffer.h"
+#include "Utils.h"
+
+#include <vector>
+
+using namespace d2dx;
+using namespace std;
+
+namespace
+{
+	struct TraceEvent final
+	{
+		int64_t timestamp;
+		const char* name;	/* Null for end events. */
+	};
+
+	/* Written only by the thread that owns it. writeCount is published after each event, and the
+	   writer thread drops whatever may have been overwritten while it was copying. */
+	struct ThreadRing final
+	{
+		Buffer<TraceEvent> events;
+		atomic<uint32_t> writeCount = { 0 };
+		DWORD threadId = 0;
+	};
+
+	struct ThreadEvents final
+	{
+		DWORD threadId;
+		vector<TraceEvent> events;
+	};
+
+	class Tracer final
+	{
+	public:
+		static constexpr uint32_t MaxThreadCount = 8;
+		static constexpr uint32_t EventsPerThread = 64 * 1024;
+		static constexpr uint32_t SnapshotSeconds = 10;
+
+		void Start()
+		{
+			if (_writerThread)
+			{
+				return;
+			}
+
+			for (uint32_t i = 0; i < MaxThreadCount; ++i)
+			{
+				if (!_rings[i].events.items)
+				{
+					_rings[i].events = Buffer<TraceEvent>(EventsPerThread);
+				}
+			}
+
+			_snapshotRequestedEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+
+			if (_snapshotRequestedEvent.IsValid())
+			{
+				_isStopping.store(false, memory_order_relaxed);
+				_writerThread = CreateThread(nullptr, 0, WriterThreadProc, this, 0, nullptr);
+			}
+
+			if (!_writerThread)
+			{
+				D2DX_LOG("Failed to start the trace writer, tracing is disabled.");
+				return;
+			}
+
+			_isEnabled.store(true, memory_order_release);
+
+			D2DX_LOG("Tracing enabled (%u kB per thread), press ALT-F12 to write the last %u seconds to a file.",
+				(uint32_t)(EventsPerThread * sizeof(TraceEvent) / 1024), SnapshotSeconds);
+		}
+
+		void Stop()
+		{
+			if (!_writerThread)
+			{
+				return;
+			}
+
+			_isEnabled.store(false, memory_order_relaxed);
+
+			_isStopping.store(true, memory_order_release);
+			SetEvent(_snapshotRequestedEvent.Get());
+			WaitForSingleObject(_writerThread, INFINITE);
+			CloseHandle(_writerThread);
+			_writerThread = nullptr;
+		}
+
+		void RequestSnapshot()
+		{
+			if (_writerThread)
+			{
+				SetEvent(_snapshotRequestedEvent.Get());
+			}
+		}
+
+		void AddEvent(
+			_In_opt_z_ const char* name) noexcept
+		{
+			if (!_isEnabled.load(memory_order_acquire))
+			{
+				return;
+			}
+
+			ThreadRing* ring = GetThreadRing();
+
+			if (!ring)
+			{
+				return;
+			}
+
+			const uint32_t writeCount = ring->writeCount.load(memory_order_relaxed);
+			TraceEvent& event = ring->events.items[writeCount & (EventsPerThread - 1)];
+			event.timestamp = TimeStamp();
+			event.name = name;
+			ring->writeCount.store(writeCount + 1, memory_order_release);
+		}
+
+	private:
+		ThreadRing* GetThreadRing() noexcept
+		{
+			static thread_local ThreadRing* threadRing = nullptr;
+			static thread_local bool hasThreadRing = false;
+
+			if (!hasThreadRing)
+			{
+				/* Threads beyond MaxThreadCount are not traced. */
+				const uint32_t ringIndex = _ringCount.fetch_add(1, memory_order_relaxed);
+
+				if (ringIndex < MaxThreadCount)
+				{
+					threadRing = &_rings[ringIndex];
+					threadRing->threadId = GetCurrentThreadId();
+				}
+
+				hasThreadRing = true;
+			}
+
+			return threadRing;
+		}
+
+		void CopyEvents(
+			_In_ ThreadRing& ring,
+			_In_ int64_t endTime,
+			_Inout_ ThreadEvents& threadEvents)
+		{
+			const uint32_t writeCount = ring.writeCount.load(memory_order_acquire);
+			const uint32_t firstIndex = writeCount > EventsPerThread ? writeCount - EventsPerThread : 0;
+
+			threadEvents.threadId = ring.threadId;
+			threadEvents.events.clear();
+
+			for (uint32_t i = firstIndex; i < writeCount; ++i)
+			{
+				threadEvents.events.push_back(ring.events.items[i & (EventsPerThread - 1)]);
+			}
+
+			/* The owning thread kept writing while the events were copied. Drop those that it may
+			   have overwritten, including the one it may be writing right now. */
+			const uint32_t laterWriteCount = ring.writeCount.load(memory_order_acquire);
+			const uint32_t firstValidIndex = (laterWriteCount + 1) > EventsPerThread ? laterWriteCount + 1 - EventsPerThread : 0;
+
+			if (firstValidIndex > firstIndex)
+			{
+				const uint32_t invalidCount = min(firstValidIndex - firstIndex, (uint32_t)threadEvents.events.size());
+				threadEvents.events.erase(threadEvents.events.begin(), threadEvents.events.begin() + invalidCount);
+			}
+
+			auto first = threadEvents.events.begin();
+
+			while (first != threadEvents.events.end() && TimeToMs(endTime - first->timestamp) > SnapshotSeconds * 1000.0)
+			{
+				++first;
+			}
+
+			threadEvents.events.erase(threadEvents.events.begin(), first);
+		}
+
+		void WriteSnapshot()
+		{
+			const int64_t endTime = TimeStamp();
+
+			ThreadEvents threadEvents[MaxThreadCount];
+			const uint32_t ringCount = min(_ringCount.load(memory_order_relaxed), MaxThreadCount);
+
+			for (uint32_t i = 0; i < ringCount; ++i)
+			{
+				CopyEvents(_rings[i], endTime, threadEvents[i]);
+			}
+
+			char filename[64];
+			sprintf_s(filename, "d2dx_trace_%u.json", _snapshotCount++);
+
+			FILE* file = nullptr;
+
+			if (fopen_s(&file, filename, "w") != 0 || !file)
+			{
+				D2DX_LOG("Failed to open %s for writing.", filename);
+				return;
+			}
+
+			fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+			const DWORD processId = GetCurrentProcessId();
+			uint32_t eventCount = 0;
+
+			for (uint32_t i = 0; i < ringCount; ++i)
+			{
+				/* End events whose begin event is no longer in the ring are left out. */
+				uint32_t depth = 0;
+
+				for (const auto& event : threadEvents[i].events)
+				{
+					if (!event.name && depth == 0)
+					{
+						continue;
+					}
+
+					if (event.name)
+					{
+						++depth;
+					}
+					else
+					{
+						--depth;
+					}
+
+					const double ts = TimeToMs(event.timestamp) * 1000.0;
+
+					if (event.name)
+					{
+						fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu}",
+							eventCount ? ",\n" : "", event.name, ts, processId, threadEvents[i].threadId);
+					}
+					else
+					{
+						fprintf(file, "%s{\"ph\":\"E\",\"ts\":%.3f,\"pid\":%lu,\"tid\":%lu}",
+							eventCount ? ",\n" : "", ts, processId, threadEvents[i].threadId);
+					}
+
+					++eventCount;
+				}
+			}
+
+			fprintf(file, "\n]}\n");
+			fclose(file);
+
+			D2DX_LOG("Wrote %u trace events to %s.", eventCount, filename);
+		}
+
+		static DWORD WINAPI WriterThreadProc(
+			_In_ LPVOID lpParameter)
+		{
+			Tracer* tracer = (Tracer*)lpParameter;
+
+			for (;;)
+			{
+				WaitForSingleObject(tracer->_snapshotRequestedEvent.Get(), INFINITE);
+
+				if (tracer->_isStopping.load(memory_order_acquire))
+				{
+					break;
+				}
+
+				tracer->WriteSnapshot();
+			}
+
+			return 0;
+		}
+
+		ThreadRing _rings[MaxThreadCount];
+		atomic<uint32_t> _ringCount = { 0 };
+		atomic<bool> _isEnabled = { false };
+		atomic<bool> _isStopping = { false };
+		HANDLE _writerThread = nullptr;
+		EventHandle _snapshotRequestedEvent;
+		uint32_t _snapshotCount = 0;
+	};
+
+	Tracer tracer;
+}
+
+void d2dx::StartTracing()
+{
+	tracer.Start();
+}
+
+void d2dx::StopTracing()
+{
+	tracer.Stop();
+}
+
+void d2dx::SnapshotTrace()
+{
+	tracer.RequestSnapshot();
+}
+
+_Use_decl_annotations_
+void d2dx::TraceBegin(
+	const char* name) noexcept
+{
+	tracer.AddEvent(name);
+}
+
+void d2dx::TraceEnd() noexcept
+{
+	tracer.AddEvent(nullptr);
+}
@@ -0,0 +1,57 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+namespace d2dx
+{
+	/*
+		Opt-in event tracer for attributing hitches. Every Timer scope and TraceScope records a
+		begin and an end event into a ring buffer owned by the calling thread, so recording never
+		takes a lock. The rings have a fixed size, and old events are overwritten by new ones.
+
+		SnapshotTrace asks a background thread to write the events of the last SnapshotSeconds
+		to d2dx_trace_<n>.json, in the trace event format read by chrome://tracing and Perfetto.
+	*/
+	void StartTracing();
+
+	void StopTracing();
+
+	void SnapshotTrace();
+
+	/* name must be a string literal, or otherwise outlive the tracer. */
+	void TraceBegin(
+		_In_z_ const char* name) noexcept;
+
+	void TraceEnd() noexcept;
+
+	class TraceScope final
+	{
+	public:
+		TraceScope(
+			_In_z_ const char* name) noexcept
+		{
+			TraceBegin(name);
+		}
+
+		~TraceScope() noexcept
+		{
+			TraceEnd();
+		}
+	};
+}
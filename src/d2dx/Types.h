@@ -23,6 +23,7 @@
 #define D2DX_SIDE_TMU_MEMORY_SIZE (1 * 1024 * 1024)
 #define D2DX_MAX_BATCHES_PER_FRAME 16384
 #define D2DX_MAX_VERTICES_PER_FRAME (1024 * 1024)
+#define D2DX_MAX_VERTICES_PER_BATCH (65536 - 4)
 
 #define D2DX_MAX_GAME_PALETTES 14
 #define D2DX_WHITE_PALETTE_INDEX 14
@@ -31,9 +32,17 @@
 
 #define D2DX_SURFACE_ID_USER_INTERFACE 16383
 
+/* All texture atlases are bound to the game pixel shaders at once (see GameTextures.hlsli).
+   A vertex selects the atlas with the upper bits of its atlas index and the slice with the
+   lower D2DX_TEXTURE_ATLAS_SLICE_BITS bits. */
+#define D2DX_MAX_TEXTURE_ATLASES 8
+#define D2DX_TEXTURE_ATLAS_SLICE_BITS 9
+#define D2DX_MAX_TEXTURES_PER_ATLAS (1 << D2DX_TEXTURE_ATLAS_SLICE_BITS)
+
 namespace d2dx
 {
 	static_assert(((D2DX_TMU_MEMORY_SIZE - 1) >> 8) == 0xFFFF, "TMU memory start addresses aren't 16 bit.");
+	static_assert((D2DX_MAX_TEXTURE_ATLASES << D2DX_TEXTURE_ATLAS_SLICE_BITS) <= 4096, "Texture atlas indices don't fit in 12 bits.");
 
 	enum class ScreenMode
 	{
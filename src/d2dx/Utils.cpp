@@ -26,6 +26,8 @@
 #define POCKETLZMA_LZMA_C_DEFINE
 #include "../../thirdparty/pocketlzma/pocketlzma.hpp"
 
+#include <intrin.h>
+
 #pragma comment(lib, "Netapi32.lib")
 
 using namespace d2dx;
@@ -109,52 +111,323 @@ WindowsVersion d2dx::GetActualWindowsVersion()
     return windowsVersion;
 }
 
-static bool logFileOpened = false;
-static FILE* logFile = nullptr;
-static CRITICAL_SECTION logFileCS;
+bool d2dx::IsAvx2Supported() noexcept
+{
+    int cpuInfo[4] = { 0 };
+
+    __cpuid(cpuInfo, 0);
+
+    if (cpuInfo[0] < 7)
+    {
+        return false;
+    }
+
+    /* The CPU must support AVX and the OS must save the YMM registers on context switches. */
+    __cpuid(cpuInfo, 1);
+
+    const bool hasOsxsave = (cpuInfo[2] & (1 << 27)) != 0;
+    const bool hasAvx = (cpuInfo[2] & (1 << 28)) != 0;
+
+    if (!hasOsxsave || !hasAvx || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+
+    __cpuidex(cpuInfo, 7, 0);
+
+    return (cpuInfo[1] & (1 << 5)) != 0;
+}
+
+bool d2dx::IsAvx512Supported() noexcept
+{
+    if (!IsAvx2Supported())
+    {
+        return false;
+    }
 
-static void EnsureLogFileOpened()
+    /* The OS must also save the opmask and ZMM registers on context switches. */
+    if ((_xgetbv(0) & 0xE6) != 0xE6)
+    {
+        return false;
+    }
+
+    int cpuInfo[4] = { 0 };
+
+    __cpuidex(cpuInfo, 7, 0);
+
+    return (cpuInfo[1] & (1 << 16)) != 0;
+}
+
+namespace
 {
-    if (!logFileOpened)
+    /* Log messages are formatted on the calling thread and put in a fixed size queue that many
+       threads can write to, but only one thread reads from (at a time). The writer thread drains it
+       into the log file in batches, and flushes the file when the queue goes idle or every
+       FlushIntervalMs while it is busy. Messages that don't fit in the queue are counted and
+       dropped, never blocking the game. */
+    class LogWriter final
     {
-        logFileOpened = true;
-        if (fopen_s(&logFile, "d2dx_log.txt", "w") != 0)
+    public:
+        static constexpr uint32_t RecordCount = 256;
+        static constexpr uint32_t RecordSize = 1024;
+        static constexpr uint32_t BatchSize = 64 * 1024;
+        static constexpr DWORD FlushIntervalMs = 500;
+
+        LogWriter() noexcept
+        {
+            static_assert((RecordCount & (RecordCount - 1)) == 0, "RecordCount must be a power of two.");
+
+            for (uint32_t i = 0; i < RecordCount; ++i)
+            {
+                _records[i].sequence.store(i, std::memory_order_relaxed);
+            }
+
+            if (fopen_s(&_file, "d2dx_log.txt", "w") != 0)
+            {
+                _file = nullptr;
+            }
+
+            InitializeCriticalSection(&_drainCS);
+
+            _recordEnqueuedEvent.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+
+            if (_recordEnqueuedEvent.IsValid())
+            {
+                HANDLE thread = CreateThread(nullptr, 0, WriterThreadProc, this, 0, nullptr);
+
+                if (thread)
+                {
+                    CloseHandle(thread);
+                }
+            }
+        }
+
+        _Success_(return)
+        bool Enqueue(
+            _In_reads_(length) const char* text,
+            _In_ uint32_t length) noexcept
+        {
+            uint32_t index = _enqueueIndex.load(std::memory_order_relaxed);
+            Record* record;
+
+            for (;;)
+            {
+                record = &_records[index % RecordCount];
+                const uint32_t sequence = record->sequence.load(std::memory_order_acquire);
+                const int32_t difference = (int32_t)(sequence - index);
+
+                if (difference == 0)
+                {
+                    if (_enqueueIndex.compare_exchange_weak(index, index + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    /* The writer hasn't caught up with the oldest record yet. */
+                    _droppedCount.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    index = _enqueueIndex.load(std::memory_order_relaxed);
+                }
+            }
+
+            record->length = min(length, RecordSize);
+            memcpy(record->text, text, record->length);
+            record->sequence.store(index + 1, std::memory_order_release);
+
+            SetEvent(_recordEnqueuedEvent.Get());
+            return true;
+        }
+
+        void Flush() noexcept
+        {
+            EnterCriticalSection(&_drainCS);
+            Drain();
+
+            if (_file)
+            {
+                fflush(_file);
+            }
+
+            _isDirty = false;
+            _lastFlushTime = TimeStamp();
+            LeaveCriticalSection(&_drainCS);
+        }
+
+    private:
+        struct Record final
+        {
+            std::atomic<uint32_t> sequence;
+            uint32_t length;
+            char text[RecordSize];
+        };
+
+        static DWORD WINAPI WriterThreadProc(
+            _In_ LPVOID parameter)
+        {
+            LogWriter* logWriter = (LogWriter*)parameter;
+
+            for (;;)
+            {
+                const bool isIdle = WaitForSingleObject(logWriter->_recordEnqueuedEvent.Get(), FlushIntervalMs) == WAIT_TIMEOUT;
+
+                EnterCriticalSection(&logWriter->_drainCS);
+                logWriter->Drain();
+
+                if (logWriter->_isDirty && (isIdle || TimeToMs(TimeStamp() - logWriter->_lastFlushTime) >= FlushIntervalMs))
+                {
+                    if (logWriter->_file)
+                    {
+                        fflush(logWriter->_file);
+                    }
+
+                    logWriter->_isDirty = false;
+                    logWriter->_lastFlushTime = TimeStamp();
+                }
+
+                LeaveCriticalSection(&logWriter->_drainCS);
+            }
+
+            return 0;
+        }
+
+        /* Must be called with _drainCS held, as it is the single reader of the queue. */
+        void Drain() noexcept
+        {
+            HaltSleepProfile _halt;
+            uint32_t batchLength = 0;
+
+            for (;;)
+            {
+                Record& record = _records[_dequeueIndex % RecordCount];
+
+                if (record.sequence.load(std::memory_order_acquire) != _dequeueIndex + 1)
+                {
+                    break;
+                }
+
+                if (batchLength + record.length > BatchSize)
+                {
+                    WriteBatch(batchLength);
+                    batchLength = 0;
+                }
+
+                memcpy(_batch + batchLength, record.text, record.length);
+                batchLength += record.length;
+
+                record.sequence.store(_dequeueIndex + RecordCount, std::memory_order_release);
+                ++_dequeueIndex;
+            }
+
+            const uint32_t droppedCount = _droppedCount.exchange(0, std::memory_order_relaxed);
+
+            if (droppedCount > 0)
+            {
+                if (batchLength + 128 > BatchSize)
+                {
+                    WriteBatch(batchLength);
+                    batchLength = 0;
+                }
+
+                batchLength += sprintf_s(_batch + batchLength, BatchSize + 1 - batchLength,
+                    "Dropped %u log messages because the log queue was full.\n", droppedCount);
+            }
+
+            WriteBatch(batchLength);
+        }
+
+        void WriteBatch(
+            _In_ uint32_t length) noexcept
         {
-            logFile = nullptr;
+            if (length == 0)
+            {
+                return;
+            }
+
+            _batch[length] = 0;
+            OutputDebugStringA(_batch);
+
+            if (_file)
+            {
+                fwrite(_batch, length, 1, _file);
+                _isDirty = true;
+            }
         }
-        InitializeCriticalSection(&logFileCS);
+
+        Record _records[RecordCount];
+        std::atomic<uint32_t> _enqueueIndex = { 0 };
+        std::atomic<uint32_t> _droppedCount = { 0 };
+        uint32_t _dequeueIndex = 0;
+        char _batch[BatchSize + 1];
+        FILE* _file = nullptr;
+        bool _isDirty = false;
+        int64_t _lastFlushTime = 0;
+        CRITICAL_SECTION _drainCS;
+        EventHandle _recordEnqueuedEvent;
+    };
+
+    static constexpr uint32_t LogRateLimitCount = 32;
+    static constexpr double LogRateLimitWindowMs = 1000.0;
+
+    LogWriter& GetLogWriter() noexcept
+    {
+        /* Never destroyed, so that messages can be logged until the process exits. */
+        static LogWriter* logWriter = new LogWriter();
+        return *logWriter;
     }
 }
 
-static DWORD WINAPI WriteToLogFileWorkItemFunc(PVOID pvContext)
+_Use_decl_annotations_
+void d2dx::detail::Log(
+    LogSite& site,
+    const char* fmt,
+    ...) noexcept
 {
     HaltSleepProfile _halt;
-    char* s = (char*)pvContext;
+    const int64_t timeStamp = TimeStamp();
+    int64_t windowStartTime = site.windowStartTime.load(std::memory_order_relaxed);
+    uint32_t suppressedCount = 0;
 
-    OutputDebugStringA(s);
+    if (TimeToMs(timeStamp - windowStartTime) >= LogRateLimitWindowMs &&
+        site.windowStartTime.compare_exchange_strong(windowStartTime, timeStamp, std::memory_order_relaxed))
+    {
+        site.count.store(0, std::memory_order_relaxed);
+        suppressedCount = site.suppressedCount.exchange(0, std::memory_order_relaxed);
+    }
 
-    EnterCriticalSection(&logFileCS);
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= LogRateLimitCount)
+    {
+        site.suppressedCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    char text[LogWriter::RecordSize];
+    int32_t length = 0;
 
-    if (logFile)
+    if (suppressedCount > 0)
     {
-        fwrite(s, strlen(s), 1, logFile);
-        fflush(logFile);
+        length = _snprintf_s(text, _TRUNCATE, "Suppressed %u messages from the following call site.\n", suppressedCount);
     }
 
-    LeaveCriticalSection(&logFileCS);
+    va_list args;
+    va_start(args, fmt);
+    const int32_t formattedLength = _vsnprintf_s(text + length, sizeof(text) - length, _TRUNCATE, fmt, args);
+    va_end(args);
 
-    free(s);
+    /* Truncated messages still end with a newline. */
+    length = formattedLength < 0 ? (int32_t)sizeof(text) - 2 : length + formattedLength;
+    text[length++] = '\n';
 
-    return 0;
+    GetLogWriter().Enqueue(text, (uint32_t)length);
 }
 
-_Use_decl_annotations_
-void d2dx::detail::Log(
-    const char* s)
+void d2dx::detail::FlushLog() noexcept
 {
-    HaltSleepProfile _halt;
-    EnsureLogFileOpened();
-    QueueUserWorkItem(WriteToLogFileWorkItemFunc, _strdup(s), WT_EXECUTEDEFAULT);
+    GetLogWriter().Flush();
 }
 
 _Use_decl_annotations_
@@ -231,6 +504,7 @@ void d2dx::detail::FatalException() noexcept
     catch (const std::exception& e)
     {
         D2DX_LOG("%s", e.what());
+        detail::FlushLog();
         MessageBoxA(nullptr, e.what(), "D2DX Fatal Error", MB_OK | MB_ICONSTOP);
         TerminateProcess(GetCurrentProcess(), -1);
     }
@@ -241,6 +515,7 @@ void d2dx::detail::FatalError(
     const char* msg) noexcept
 {
     D2DX_LOG("%s", msg);
+    detail::FlushLog();
     MessageBoxA(nullptr, msg, "D2DX Fatal Error", MB_OK | MB_ICONSTOP);
     TerminateProcess(GetCurrentProcess(), -1);
 }
@@ -23,9 +23,8 @@
 
 #define D2DX_LOG(fmt, ...) \
 	{ \
-		static char ssss[1024]; \
-		sprintf_s(ssss, fmt "\n", __VA_ARGS__); \
-		d2dx::detail::Log(ssss); \
+		static d2dx::detail::LogSite d2dxLogSite; \
+		d2dx::detail::Log(d2dxLogSite, fmt, __VA_ARGS__); \
 	}
 
 #ifdef NDEBUG
@@ -44,7 +43,21 @@ namespace d2dx
 {
 	namespace detail
 	{
-		__declspec(noinline) void Log(_In_z_ const char* s);
+		/* Per call site state for rate limiting log messages. */
+		struct LogSite final
+		{
+			std::atomic<int64_t> windowStartTime;
+			std::atomic<uint32_t> count;
+			std::atomic<uint32_t> suppressedCount;
+		};
+
+		__declspec(noinline) void Log(
+			_Inout_ LogSite& site,
+			_In_z_ _Printf_format_string_ const char* fmt,
+			...) noexcept;
+
+		/* Writes all queued log messages to the log file before returning. */
+		void FlushLog() noexcept;
 	}
 
 	int64_t TimeStamp() noexcept;
@@ -61,6 +74,10 @@ namespace d2dx
 
 	WindowsVersion GetActualWindowsVersion();
 
+	bool IsAvx2Supported() noexcept;
+
+	bool IsAvx512Supported() noexcept;
+
 	Buffer<char> ReadTextFile(
 		_In_z_ const char* filename);
 
@@ -18,19 +18,53 @@
 */
 #pragma once
 
+/*
+	Define D2DX_COMPACT_VERTEX to use a 16-byte vertex instead of the default 20-byte one. Every
+	project has a "Release (CompactVertex)" configuration that does, so that the compact format is
+	built and tested too. The compact vertex stores the position as 13.3 fixed point (int16), which
+	covers -4095.875..4095.875 in steps of 1/8 pixel. Positions outside of that range are clamped to
+	it, so the game must not draw that far off screen. -32768 is not used, since the SNORM input
+	format reads it as -32767. RenderContextResources picks the matching input layout and the vertex
+	shaders decode either format, so nothing else has to change.
+*/
+
 namespace d2dx
 {
 	class Vertex final
 	{
 	public:
+#ifdef D2DX_COMPACT_VERTEX
+		static constexpr bool IsCompact = true;
+#else
+		static constexpr bool IsCompact = false;
+#endif
+
+		/* Fractional bits of the compact vertex's fixed-point position. */
+		static constexpr int32_t PositionFractionBits = 3;
+
+		static inline int16_t PackPosition(
+			_In_ float value) noexcept
+		{
+			/* Clamp and round to nearest even, exactly like the SIMD vertex expansion does. */
+			__m128 scaled = _mm_set_ss(value * (float)(1 << PositionFractionBits));
+			scaled = _mm_min_ss(_mm_max_ss(scaled, _mm_set_ss(-32767.0f)), _mm_set_ss(32767.0f));
+			return (int16_t)_mm_cvtss_si32(scaled);
+		}
+
+		static inline float UnpackPosition(
+			_In_ int16_t value) noexcept
+		{
+			return value * (1.0f / (1 << PositionFractionBits));
+		}
+
 		Vertex() noexcept :
 			_x{ 0 },
 			_y{ 0 },
 			_s{ 0 },
 			_t{ 0 },
 			_color{ 0 },
-			_isChromaKeyEnabled_surfaceId{ 0 },
-			_paletteIndex_atlasIndex{ 0 }
+			_paletteIndex_atlasIndex{ 0 },
+			_isChromaKeyEnabled{ 0 }
 		{
 		}
 
@@ -42,57 +76,49 @@ namespace d2dx
 			uint32_t color,
 			bool isChromaKeyEnabled,
 			int32_t atlasIndex,
-			int32_t paletteIndex,
-			int32_t surfaceId) noexcept :
-			_x(x),
-			_y(y),
+			int32_t paletteIndex) noexcept :
+			_x(StorePosition(x)),
+			_y(StorePosition(y)),
 			_s(s),
 			_t(t),
 			_color(color),
-			_isChromaKeyEnabled_surfaceId((isChromaKeyEnabled ? 0x4000 : 0) | (surfaceId & 16383)),
-			_paletteIndex_atlasIndex((paletteIndex << 12) | (atlasIndex & 4095))
+			_paletteIndex_atlasIndex((paletteIndex << 12) | (atlasIndex & 4095)),
+			_isChromaKeyEnabled(isChromaKeyEnabled ? 0x4000 : 0)
 		{
 			assert(s >= INT16_MIN && s <= INT16_MAX);
 			assert(t >= INT16_MIN && t <= INT16_MAX);
 			assert(paletteIndex >= 0 && paletteIndex < D2DX_MAX_PALETTES);
 			assert(atlasIndex >= 0 && atlasIndex <= 4095);
-			assert(surfaceId >= 0 && surfaceId <= 16383);
 		}
 
 		inline void AddOffset(
 			_In_ int32_t x,
 			_In_ int32_t y) noexcept
 		{
-			_x += x;
-			_y += y;
+			SetPosition(GetX() + x, GetY() + y);
 		}
 
 		inline float GetX() const noexcept
 		{
-			return _x;
+			return LoadPosition(_x);
 		}
 
 		inline float GetY() const noexcept
 		{
-			return _y;
+			return LoadPosition(_y);
 		}
 
 		inline void SetPosition(float x, float y) noexcept
 		{
-			_x = x;
-			_y = y;
+			_x = StorePosition(x);
+			_y = StorePosition(y);
 		}
 
-		inline void SetSurfaceId(int32_t surfaceId) noexcept
+		/* The position as it is stored, for passes over many vertices at once: two floats, or two
+		   13.3 fixed-point int16s in the compact vertex. */
+		inline const void* GetPositionData() const noexcept
 		{
-			assert(surfaceId >= 0 && surfaceId <= 16383);
-			_isChromaKeyEnabled_surfaceId &= ~16383;
-			_isChromaKeyEnabled_surfaceId |= surfaceId & 16383;
-		}
-
-		inline int32_t GetSurfaceId() const noexcept
-		{
-			return _isChromaKeyEnabled_surfaceId & 16383;
+			return &_x;
 		}
 
 		inline int32_t GetS() const noexcept
@@ -105,6 +131,14 @@ namespace d2dx
 			return _t;
 		}
 
+		inline void AddTexcoordOffset(
+			_In_ int32_t s,
+			_In_ int32_t t) noexcept
+		{
+			_s += (int16_t)s;
+			_t += (int16_t)t;
+		}
+
 		inline void SetTexcoord(int32_t s, int32_t t) noexcept
 		{
 			assert(s >= 0 && s <= 511);
@@ -125,18 +159,48 @@ namespace d2dx
 
 		inline bool IsChromaKeyEnabled() const noexcept
 		{
-			return (_isChromaKeyEnabled_surfaceId & 0x4000) != 0;
+			return (_isChromaKeyEnabled & 0x4000) != 0;
 		}
 
 	private:
+#ifdef D2DX_COMPACT_VERTEX
+		static inline int16_t StorePosition(
+			_In_ float value) noexcept
+		{
+			assert(value >= -4095.875f && value <= 4095.875f);
+			return PackPosition(value);
+		}
+
+		static inline float LoadPosition(
+			_In_ int16_t value) noexcept
+		{
+			return UnpackPosition(value);
+		}
+
+		int16_t _x;
+		int16_t _y;
+#else
+		static inline float StorePosition(
+			_In_ float value) noexcept
+		{
+			return value;
+		}
+
+		static inline float LoadPosition(
+			_In_ float value) noexcept
+		{
+			return value;
+		}
+
 		float _x;
 		float _y;
+#endif
 		int16_t _s;
 		int16_t _t;
 		uint32_t _color;
 		uint16_t _paletteIndex_atlasIndex;
-		uint16_t _isChromaKeyEnabled_surfaceId;
+		uint16_t _isChromaKeyEnabled;	/* Bit 14, where GameVS reads it. */
 	};
 
-	static_assert(sizeof(Vertex) == 20, "sizeof(Vertex)");
+	static_assert(sizeof(Vertex) == (Vertex::IsCompact ? 16 : 20), "sizeof(Vertex)");
 }
@@ -18,6 +18,7 @@
 */
 #include "pch.h"
 #include "D2DXContextFactory.h"
+#include "GlideRecorder.h"
 #include "Utils.h"
 
 using namespace d2dx;
@@ -29,6 +30,10 @@ static GrLfbInfo_t lfbInfo = { 0 };
 static char tempString[2048];
 static bool initialized = false;
 
+/* Never destroyed by a static destructor, which would run under the loader lock when the DLL is
+   unloaded. grGlideShutdown stops and deletes it instead. */
+static GlideRecorder* glideRecorder = nullptr;
+
 extern "C" {
 
 FX_ENTRY void FX_CALL
@@ -37,6 +42,7 @@ FX_ENTRY void FX_CALL
 	try
 	{
 		const auto returnAddress = (uintptr_t)_ReturnAddress();
+		if (glideRecorder) glideRecorder->OnDrawPoint(pt, returnAddress);
 		D2DXContextFactory::GetInstance()->OnDrawPoint(pt, returnAddress);
 	}
 	catch (...)
@@ -51,6 +57,7 @@ FX_ENTRY void FX_CALL
 	try
 	{
 		const auto returnAddress = (uintptr_t)_ReturnAddress();
+		if (glideRecorder) glideRecorder->OnDrawLine(v1, v2, returnAddress);
 		D2DXContextFactory::GetInstance()->OnDrawLine(v1, v2, returnAddress);
 	}
 	catch (...)
@@ -64,6 +71,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{ 
+		if (glideRecorder) glideRecorder->OnVertexLayout(param, mode ? offset : 0xFF);
 		D2DXContextFactory::GetInstance()->OnVertexLayout(param, mode ? offset : 0xFF);
 	}
 	catch (...)
@@ -78,6 +86,7 @@ FX_ENTRY void FX_CALL
 	const auto returnAddress = (uintptr_t)_ReturnAddress();
 	try
 	{
+		if (glideRecorder) glideRecorder->OnDrawVertexArray(mode, Count, (const uint8_t* const*)pointers, returnAddress);
 		D2DXContextFactory::GetInstance()->OnDrawVertexArray(mode, Count, (uint8_t**)pointers, returnAddress);	
 	}
 	catch (...)
@@ -93,6 +102,7 @@ FX_ENTRY void FX_CALL
 
 	try
 	{
+		if (glideRecorder) glideRecorder->OnDrawVertexArrayContiguous(mode, Count, (const uint8_t*)vertex, stride, returnAddress);
 		D2DXContextFactory::GetInstance()->OnDrawVertexArrayContiguous(mode, Count, (uint8_t*)vertex, stride, returnAddress);
 	}
 	catch (...)
@@ -106,6 +116,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{
+		if (glideRecorder) glideRecorder->OnBufferClear();
 		D2DXContextFactory::GetInstance()->OnBufferClear();
 	}
 	catch (...)
@@ -119,6 +130,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{
+		if (glideRecorder) glideRecorder->OnBufferSwap();
 		D2DXContextFactory::GetInstance()->OnBufferSwap();
 	}
 	catch (...)
@@ -187,6 +199,7 @@ FX_ENTRY GrContext_t FX_CALL
 
 	try
 	{
+		if (glideRecorder) glideRecorder->OnSstWinOpen(hWnd, width, height);
 		D2DXContextFactory::GetInstance()->OnSstWinOpen(hWnd, width, height);
 	}
 	catch (...)
@@ -222,6 +235,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{
+		if (glideRecorder) glideRecorder->OnAlphaBlendFunction(rgb_sf, rgb_df, alpha_sf, alpha_df);
 		D2DXContextFactory::GetInstance()->OnAlphaBlendFunction(rgb_sf, rgb_df, alpha_sf, alpha_df);
 	}
 	catch (...)
@@ -252,6 +266,7 @@ FX_ENTRY void FX_CALL
 
 	try
 	{
+		if (glideRecorder) glideRecorder->OnAlphaCombine(function, factor, local, other, invert);
 		D2DXContextFactory::GetInstance()->OnAlphaCombine(function, factor, local, other, invert);
 	}
 	catch (...)
@@ -265,6 +280,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{
+		if (glideRecorder) glideRecorder->OnChromakeyMode(mode);
 		D2DXContextFactory::GetInstance()->OnChromakeyMode(mode);
 	}
 	catch (...)
@@ -302,6 +318,7 @@ FX_ENTRY void FX_CALL
 				
 	try
 	{
+		if (glideRecorder) glideRecorder->OnColorCombine(function, factor, local, other, invert);
 		D2DXContextFactory::GetInstance()->OnColorCombine(function, factor, local, other, invert);
 	}
 	catch (...)
@@ -320,6 +337,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{
+		if (glideRecorder) glideRecorder->OnConstantColorValue((uint32_t)value);
 		D2DXContextFactory::GetInstance()->OnConstantColorValue((uint32_t)value);
 	}
 	catch (...)
@@ -343,6 +361,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{
+		if (glideRecorder) glideRecorder->OnLoadGammaTable(nentries, (const uint32_t*)red, (const uint32_t*)green, (const uint32_t*)blue);
 		D2DXContextFactory::GetInstance()->OnLoadGammaTable(nentries, (uint32_t *)red, (uint32_t*)green, (uint32_t*)blue);
 	}
 	catch (...)
@@ -398,6 +417,7 @@ FX_ENTRY void FX_CALL
 
 	try
 	{
+		if (glideRecorder) glideRecorder->OnTexSource(tmu, startAddress, w, h, info->largeLodLog2, info->aspectRatioLog2);
 		D2DXContextFactory::GetInstance()->OnTexSource(tmu, startAddress, w, h, info->largeLodLog2, info->aspectRatioLog2);
 	}
 	catch (...)
@@ -434,6 +454,7 @@ FX_ENTRY void FX_CALL
 {
 	if (minfilter_mode == magfilter_mode)
 	{
+		if (glideRecorder) glideRecorder->OnTexFilterMode(tmu, minfilter_mode);
 		D2DXContextFactory::GetInstance()->OnTexFilterMode(tmu, minfilter_mode);
 	}
 }
@@ -446,6 +467,7 @@ FX_ENTRY void FX_CALL
 
 	try
 	{
+		if (glideRecorder) glideRecorder->OnTexDownload(tmu, (const uint8_t*)info->data, startAddress, (int32_t)width, (int32_t)height);
 		D2DXContextFactory::GetInstance()->OnTexDownload(tmu, (const uint8_t*)info->data, startAddress, (int32_t)width, (int32_t)height);
 	}
 	catch (...)
@@ -460,6 +482,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{
+		if (glideRecorder) glideRecorder->OnTexDownloadTable(type, data);
 		D2DXContextFactory::GetInstance()->OnTexDownloadTable(type, data);
 	}
 	catch (...)
@@ -515,6 +538,7 @@ FX_ENTRY FxBool FX_CALL
 	{
 		if (type == GR_LFB_WRITE_ONLY && buffer == GR_BUFFER_FRONTBUFFER)
 		{
+			if (glideRecorder) glideRecorder->OnLfbUnlock((const uint32_t*)lfbInfo.lfbPtr, lfbInfo.strideInBytes);
 			D2DXContextFactory::GetInstance()->OnLfbUnlock((const uint32_t*)lfbInfo.lfbPtr, lfbInfo.strideInBytes);
 			return FXTRUE;
 		}
@@ -532,11 +556,28 @@ FX_ENTRY FxBool FX_CALL
 FX_ENTRY void FX_CALL
 	grGlideInit(void)
 {
+	try
+	{
+		if (!glideRecorder && D2DXContextFactory::GetInstance()->GetOptions().GetFlag(OptionsFlag::DbgRecordGlide))
+		{
+			glideRecorder = new GlideRecorder("d2dx_glide_trace.bin");
+		}
+	}
+	catch (...)
+	{
+		D2DX_FATAL_EXCEPTION;
+	}
 }
 
 FX_ENTRY void FX_CALL
 	grGlideShutdown(void)
 {
+	if (glideRecorder)
+	{
+		glideRecorder->Stop();
+		delete glideRecorder;
+		glideRecorder = nullptr;
+	}
 }
 
 FX_ENTRY void FX_CALL
@@ -544,6 +585,7 @@ FX_ENTRY void FX_CALL
 {
 	try
 	{
+		if (glideRecorder) glideRecorder->OnGammaCorrectionRGB(red, green, blue);
 		D2DXContextFactory::GetInstance()->OnGammaCorrectionRGB(red, green, blue);
 	}
 	catch (...)
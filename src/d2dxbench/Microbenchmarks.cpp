@@ -0,0 +1,272 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "Microbenchmarks.h"
+#include "Buffer.h"
+#include "NullGameHelper.h"
+#include "SimdSse2.h"
+#include "SurfaceIdTracker.h"
+#include "TextureCachePolicyBitPmru.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+using namespace d2dx;
+
+static uint64_t NextRandom(
+	_Inout_ uint64_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/* Prevents the compiler from discarding the lookups. */
+static volatile int32_t benchmarkSink;
+
+_Use_decl_annotations_
+void d2dx::RunTextureCacheLookupBenchmark(
+	const std::shared_ptr<ISimd>& simd)
+{
+	/* The distinct capacities used by RenderContextResources::CreateTextureCaches. */
+	static const uint32_t capacities[] = { 512, 1024, 2048 };
+	static const uint32_t lookupCount = 1 << 20;
+
+	auto sse2 = std::make_shared<SimdSse2>();
+	Buffer<uint64_t> lookupKeys{ lookupCount };
+
+	printf("Texture cache lookup (ns per lookup, 1 in 8 lookups misses):\n");
+	printf("%-10s %12s %12s %12s\n", "capacity", "sse2 scan", "simd scan", "hash index");
+
+	for (uint32_t capacity : capacities)
+	{
+		TextureCachePolicyBitPmru policy{ capacity, simd };
+		Buffer<uint64_t> contentKeys{ capacity, true };
+		uint64_t state = 0x9E3779B97F4A7C15ull;
+
+		for (uint32_t i = 0; i < capacity; ++i)
+		{
+			bool evicted = false;
+			const uint64_t contentKey = NextRandom(state) | 1;
+			contentKeys.items[policy.Insert(contentKey, evicted)] = contentKey;
+		}
+
+		for (uint32_t i = 0; i < lookupCount; ++i)
+		{
+			const uint64_t r = NextRandom(state);
+			lookupKeys.items[i] = (r & 7) ? contentKeys.items[(r >> 32) % capacity] : (r | 1);
+		}
+
+		int64_t startTime = TimeStamp();
+
+		for (uint32_t i = 0; i < lookupCount; ++i)
+		{
+			benchmarkSink = sse2->IndexOfUInt64(contentKeys.items, capacity, lookupKeys.items[i]);
+		}
+
+		const double sse2Time = TimeToMs(TimeStamp() - startTime);
+		startTime = TimeStamp();
+
+		for (uint32_t i = 0; i < lookupCount; ++i)
+		{
+			benchmarkSink = simd->IndexOfUInt64(contentKeys.items, capacity, lookupKeys.items[i]);
+		}
+
+		const double simdTime = TimeToMs(TimeStamp() - startTime);
+		startTime = TimeStamp();
+
+		for (uint32_t i = 0; i < lookupCount; ++i)
+		{
+			benchmarkSink = policy.Find(lookupKeys.items[i], -1);
+		}
+
+		const double indexTime = TimeToMs(TimeStamp() - startTime);
+		const double msToNsPerLookup = 1000000.0 / lookupCount;
+
+		printf("%-10u %12.2f %12.2f %12.2f\n",
+			capacity,
+			sse2Time * msToNsPerLookup,
+			simdTime * msToNsPerLookup,
+			indexTime * msToNsPerLookup);
+	}
+}
+
+_Use_decl_annotations_
+void BatchTrace::AddFrame(
+	Size gameSize,
+	const Batch* batches,
+	uint32_t batchCount,
+	const Vertex* vertices,
+	uint32_t vertexCount)
+{
+	if (batchCount == 0 || _frames.size() >= MaxFrameCount)
+	{
+		return;
+	}
+
+	Frame& frame = _frames.emplace_back();
+	frame.gameSize = gameSize;
+	frame.vertices.assign(vertices, vertices + vertexCount);
+
+	/* Like the render thread, skip the batches that won't be drawn. */
+	for (uint32_t i = 0; i < batchCount; ++i)
+	{
+		if (batches[i].IsValid() && batches[i].GetVertexCount() > 0)
+		{
+			frame.batches.push_back(batches[i]);
+		}
+	}
+
+	if (frame.batches.empty())
+	{
+		_frames.pop_back();
+	}
+}
+
+const std::vector<BatchTrace::Frame>& BatchTrace::GetFrames() const
+{
+	return _frames;
+}
+
+/* A plain loop over the vertices, for comparison with SurfaceIdTracker::GetVertexBounds. */
+static void GetVertexBoundsScalar(
+	_In_reads_(vertexCount) const Vertex* vertices,
+	_In_ uint32_t vertexCount,
+	_Out_ int32_t& minx,
+	_Out_ int32_t& miny,
+	_Out_ int32_t& maxx,
+	_Out_ int32_t& maxy)
+{
+	minx = INT_MAX;
+	miny = INT_MAX;
+	maxx = INT_MIN;
+	maxy = INT_MIN;
+
+	for (uint32_t i = 0; i < vertexCount; ++i)
+	{
+		const int32_t x = (int32_t)vertices[i].GetX();
+		const int32_t y = (int32_t)vertices[i].GetY();
+		minx = min(minx, x);
+		miny = min(miny, y);
+		maxx = max(maxx, x);
+		maxy = max(maxy, y);
+	}
+}
+
+_Use_decl_annotations_
+void d2dx::RunSurfaceIdBenchmark(
+	const BatchTrace& trace)
+{
+	static const uint32_t passCount = 16;
+
+	const auto& frames = trace.GetFrames();
+
+	if (frames.empty())
+	{
+		printf("Surface ID assignment: the trace has no batches.\n");
+		return;
+	}
+
+	/* Replays never reach the in-game state, so force it to time the full set of rules. */
+	SurfaceIdTracker surfaceIdTracker{ std::make_shared<NullGameHelper>() };
+	Buffer<uint32_t> quadAttributes{ D2DX_MAX_VERTICES_PER_FRAME / 4 };
+	uint64_t batchCount = 0;
+	uint64_t vertexCount = 0;
+	int64_t scalarBoundsTime = 0;
+	int64_t simdBoundsTime = 0;
+	int64_t trackerTime = 0;
+	int64_t quadAttributesTime = 0;
+
+	for (uint32_t pass = 0; pass < passCount; ++pass)
+	{
+		for (const BatchTrace::Frame& frame : frames)
+		{
+			const Batch* batches = frame.batches.data();
+			const Vertex* vertices = frame.vertices.data();
+			const uint32_t frameBatchCount = (uint32_t)frame.batches.size();
+			int32_t minx, miny, maxx, maxy;
+
+			for (uint32_t i = 0; i < frameBatchCount; ++i)
+			{
+				vertexCount += batches[i].GetVertexCount();
+			}
+
+			batchCount += frameBatchCount;
+
+			int64_t startTime = TimeStamp();
+
+			for (uint32_t i = 0; i < frameBatchCount; ++i)
+			{
+				GetVertexBoundsScalar(&vertices[batches[i].GetStartVertex()], batches[i].GetVertexCount(), minx, miny, maxx, maxy);
+				benchmarkSink = minx + miny + maxx + maxy;
+			}
+
+			scalarBoundsTime += TimeStamp() - startTime;
+			startTime = TimeStamp();
+
+			for (uint32_t i = 0; i < frameBatchCount; ++i)
+			{
+				SurfaceIdTracker::GetVertexBounds(&vertices[batches[i].GetStartVertex()], batches[i].GetVertexCount(), minx, miny, maxx, maxy);
+				benchmarkSink = minx + miny + maxx + maxy;
+			}
+
+			simdBoundsTime += TimeStamp() - startTime;
+			startTime = TimeStamp();
+
+			surfaceIdTracker.OnNewFrame();
+
+			for (uint32_t i = 0; i < frameBatchCount; ++i)
+			{
+				Batch batch = batches[i];
+				surfaceIdTracker.UpdateBatchSurfaceId(batch, MajorGameState::InGame, frame.gameSize, &vertices[batch.GetStartVertex()], batch.GetVertexCount());
+				benchmarkSink = batch.GetSurfaceId();
+			}
+
+			trackerTime += TimeStamp() - startTime;
+			startTime = TimeStamp();
+
+			/* The same write as RenderContext::BulkWriteSurfaceIds, minus the mapping. */
+			for (uint32_t i = 0; i < frameBatchCount; ++i)
+			{
+				const Batch& batch = batches[i];
+
+				if (batch.IsValid())
+				{
+					std::fill_n(quadAttributes.items + batch.GetStartVertex() / 4, batch.GetVertexCount() / 4, batch.GetQuadAttributes());
+				}
+			}
+
+			benchmarkSink = quadAttributes.items[0];
+			quadAttributesTime += TimeStamp() - startTime;
+		}
+	}
+
+	const double msToNsPerBatch = 1000000.0 / batchCount;
+
+	printf("Surface ID assignment (ns per batch, %u frames, %.1f vertices per batch):\n",
+		(uint32_t)frames.size(),
+		(double)vertexCount / batchCount);
+	printf("%14s %14s %14s %14s\n", "scalar bounds", "simd bounds", "tracker", "quad attribs");
+	printf("%14.2f %14.2f %14.2f %14.2f\n",
+		TimeToMs(scalarBoundsTime) * msToNsPerBatch,
+		TimeToMs(simdBoundsTime) * msToNsPerBatch,
+		TimeToMs(trackerTime) * msToNsPerBatch,
+		TimeToMs(quadAttributesTime) * msToNsPerBatch);
+}
@@ -0,0 +1,68 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Batch.h"
+#include "ISimd.h"
+#include "Vertex.h"
+
+#include <vector>
+
+namespace d2dx
+{
+	/*
+		Synthetic benchmarks of individual hot paths, run with d2dxbench -microbench. Unlike trace
+		replay, these isolate a single data structure, so that alternative implementations can be
+		compared on equal terms.
+	*/
+	void RunTextureCacheLookupBenchmark(
+		_In_ const std::shared_ptr<ISimd>& simd);
+
+	/* The batches and vertices of the frames of a replay, as handed to the render context (that is,
+	   after reordering). Only the first MaxFrameCount frames with any batches are kept. */
+	class BatchTrace final
+	{
+	public:
+		static constexpr uint32_t MaxFrameCount = 1000;
+
+		struct Frame final
+		{
+			Size gameSize;
+			std::vector<Batch> batches;
+			std::vector<Vertex> vertices;
+		};
+
+		void AddFrame(
+			_In_ Size gameSize,
+			_In_reads_(batchCount) const Batch* batches,
+			_In_ uint32_t batchCount,
+			_In_reads_(vertexCount) const Vertex* vertices,
+			_In_ uint32_t vertexCount);
+
+		const std::vector<Frame>& GetFrames() const;
+
+	private:
+		std::vector<Frame> _frames;
+	};
+
+	/* Times the bounds pass and surface ID assignment of SurfaceIdTracker on recorded batches, and
+	   writing the resulting surface IDs per quad like RenderContext::BulkWriteSurfaceIds. */
+	void RunSurfaceIdBenchmark(
+		_In_ const BatchTrace& trace);
+}
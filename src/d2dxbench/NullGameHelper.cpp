@@ -0,0 +1,148 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "NullGameHelper.h"
+
+using namespace d2dx;
+
+GameVersion NullGameHelper::GetVersion() const
+{
+	return GameVersion::Unsupported;
+}
+
+_Use_decl_annotations_
+const char* NullGameHelper::GetVersionString() const
+{
+	return "Unsupported";
+}
+
+uint32_t NullGameHelper::ScreenOpenMode() const
+{
+	return 0;
+}
+
+Size NullGameHelper::GetConfiguredGameSize() const
+{
+	return { 640, 480 };
+}
+
+_Use_decl_annotations_
+GameAddress NullGameHelper::IdentifyGameAddress(
+	uint32_t returnAddress) const
+{
+	return GameAddress::Unknown;
+}
+
+_Use_decl_annotations_
+TextureCategory NullGameHelper::GetTextureCategoryFromHash(
+	uint64_t textureHash) const
+{
+	return TextureCategory::Unknown;
+}
+
+_Use_decl_annotations_
+TextureCategory NullGameHelper::RefineTextureCategoryFromGameAddress(
+	TextureCategory previousCategory,
+	GameAddress gameAddress) const
+{
+	return previousCategory;
+}
+
+bool NullGameHelper::TryApplyInGameFpsFix()
+{
+	return false;
+}
+
+bool NullGameHelper::TryApplyMenuFpsFix()
+{
+	return false;
+}
+
+bool NullGameHelper::TryApplyInGameSleepFixes()
+{
+	return false;
+}
+
+_Use_decl_annotations_
+void* NullGameHelper::GetFunction(
+	D2Function function) const
+{
+	return nullptr;
+}
+
+_Use_decl_annotations_
+DrawParameters NullGameHelper::GetDrawParameters(
+	const D2::CellContextAny* cellContext) const
+{
+	return { 0 };
+}
+
+D2::UnitAny* NullGameHelper::GetPlayerUnit() const
+{
+	return nullptr;
+}
+
+_Use_decl_annotations_
+Offset NullGameHelper::GetUnitPos(
+	const D2::UnitAny* unit) const
+{
+	return { 0, 0 };
+}
+
+_Use_decl_annotations_
+D2::UnitType NullGameHelper::GetUnitType(
+	const D2::UnitAny* unit) const
+{
+	return D2::UnitType::Player;
+}
+
+_Use_decl_annotations_
+uint32_t NullGameHelper::GetUnitId(
+	const D2::UnitAny* unit) const
+{
+	return 0;
+}
+
+_Use_decl_annotations_
+D2::UnitAny* NullGameHelper::FindUnit(
+	uint32_t unitId,
+	D2::UnitType unitType) const
+{
+	return nullptr;
+}
+
+int32_t NullGameHelper::GetCurrentAct() const
+{
+	return 0;
+}
+
+bool NullGameHelper::IsGameMenuOpen() const
+{
+	return false;
+}
+
+bool NullGameHelper::IsInGame() const
+{
+	return false;
+}
+
+bool NullGameHelper::IsProjectDiablo2() const
+{
+	return false;
+}
@@ -0,0 +1,354 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "NullRenderContext.h"
+#include "Batch.h"
+#include "Metrics.h"
+#include "TextureCache.h"
+#include "TextureCacheBalancer.h"
+#include "Utils.h"
+#include "Vertex.h"
+
+#include <algorithm>
+
+using namespace d2dx;
+using namespace std;
+
+/* Same as RenderContext. */
+static constexpr uint32_t VertexBufferCapacity = 1024 * 1024;
+
+/* Replays run as fast as possible, so report the frame time of the game's 25 Hz tick for determinism. */
+static constexpr double FrameTimeMs = 40.0;
+
+_Use_decl_annotations_
+NullRenderContext::NullRenderContext(
+	const std::shared_ptr<ISimd>& simd) :
+	_vertexBuffer(VertexBufferCapacity),
+	_quadAttributes(D2DX_MAX_VERTICES_PER_FRAME / 4),
+	_palettes(D2DX_MAX_PALETTES * 256, true),
+	_gammaTable(256, true),
+	_simd{ simd }
+{
+	CreateTextureCaches(TextureCacheBalancer::DefaultCapacities);
+}
+
+_Use_decl_annotations_
+void NullRenderContext::CreateTextureCaches(
+	const uint32_t* capacities)
+{
+	/* Same layout as RenderContextResources, but with no device behind the caches. */
+	auto sharedAtlas = std::make_shared<ShelfPackedAtlas>(capacities, (ID3D11Device*)nullptr);
+	uint32_t atlasCount = 1;
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		const uint32_t pinnedCapacity = TextureCache::GetPinnedCapacity(capacities[i], _options.GetUiTextureCacheShare());
+		int32_t width = 1U << (i + 3);
+		int32_t height = 1U << (i + 3);
+
+		if (i == 6)
+		{
+			width = 256;
+			height = 128;
+		}
+
+		if (width <= ShelfPackedAtlas::MaxTextureSize)
+		{
+			_textureCaches[i] = std::make_unique<TextureCache>(width, capacities[i], sharedAtlas, _simd,
+				_options.GetTextureCachePolicy((TextureCacheSizeClass)i), 0, pinnedCapacity);
+		}
+		else
+		{
+			auto textureCache = std::make_unique<TextureCache>(width, height, capacities[i], D2DX_MAX_TEXTURES_PER_ATLAS, (ID3D11Device*)nullptr, _simd,
+				_options.GetTextureCachePolicy((TextureCacheSizeClass)i), atlasCount, pinnedCapacity);
+			atlasCount += textureCache->GetAtlasCount();
+			_textureCaches[i] = std::move(textureCache);
+		}
+
+		if (_textureCacheTrace)
+		{
+			_textureCaches[i] = std::make_unique<RecordingTextureCache>(std::move(_textureCaches[i]), (TextureCacheSizeClass)i, _textureCacheTrace);
+		}
+	}
+}
+
+HWND NullRenderContext::GetHWnd() const
+{
+	return nullptr;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::LoadGammaTable(
+	const uint32_t* values,
+	uint32_t valueCount)
+{
+	memcpy(_gammaTable.items, values, min(valueCount, _gammaTable.capacity) * sizeof(uint32_t));
+	++_statistics.gammaTableUploadCount;
+	_canRepeatPresent = false;
+}
+
+_Use_decl_annotations_
+uint32_t NullRenderContext::BulkWriteVertices(
+	const Vertex* vertices,
+	uint32_t vertexCount)
+{
+	_drawBatchesStartTime = TimeStamp();
+
+	if ((_vbWriteIndex + vertexCount) > VertexBufferCapacity)
+	{
+		_vbWriteIndex = 0;
+		assert(vertexCount <= VertexBufferCapacity);
+		vertexCount = min(vertexCount, VertexBufferCapacity);
+	}
+
+	const uint32_t startVertexLocation = _vbWriteIndex;
+
+	if (vertexCount > 0)
+	{
+		memcpy(_vertexBuffer.items + _vbWriteIndex, vertices, sizeof(Vertex) * vertexCount);
+	}
+
+	_vbWriteIndex += vertexCount;
+	_frameStartVertexLocation = startVertexLocation;
+	_frameVertexCount = vertexCount;
+
+	return startVertexLocation;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::BulkWriteSurfaceIds(
+	const Batch* batches,
+	uint32_t batchCount)
+{
+	for (uint32_t i = 0; i < batchCount; ++i)
+	{
+		const Batch& batch = batches[i];
+
+		if (batch.IsValid())
+		{
+			std::fill_n(_quadAttributes.items + batch.GetStartVertex() / 4, batch.GetVertexCount() / 4, batch.GetQuadAttributes());
+		}
+	}
+
+	if (_batchTrace)
+	{
+		_batchTrace->AddFrame(_gameSize, batches, batchCount, _vertexBuffer.items + _frameStartVertexLocation, _frameVertexCount);
+	}
+}
+
+_Use_decl_annotations_
+void NullRenderContext::UploadTexture(
+	const Batch& batch,
+	TextureCacheLocation location,
+	const uint8_t* data)
+{
+	GetTextureCache(batch)->UploadTexture(location, batch.GetTextureWidth(), batch.GetTextureHeight(), data);
+
+	++_statistics.textureUploadCount;
+	_statistics.textureUploadBytes += (uint64_t)batch.GetTextureWidth() * batch.GetTextureHeight();
+}
+
+_Use_decl_annotations_
+void NullRenderContext::Draw(
+	const Batch& batch,
+	uint32_t startVertexLocation)
+{
+	++_statistics.drawCount;
+	_statistics.vertexCount += batch.GetVertexCount();
+}
+
+void NullRenderContext::Present()
+{
+	/* DrawBatches covers writing the vertices and issuing the draws, like the profiler's scope in D2DXContext. */
+	if (_drawBatchesStartTime)
+	{
+		_statistics.drawBatchesTime += TimeStamp() - _drawBatchesStartTime;
+		_drawBatchesStartTime = 0;
+	}
+
+	++_statistics.frameCount;
+	_canRepeatPresent = true;
+}
+
+bool NullRenderContext::RepeatPresent()
+{
+	if (!_canRepeatPresent)
+	{
+		return false;
+	}
+
+	++_statistics.frameCount;
+	++_statistics.repeatedFrameCount;
+	return true;
+}
+
+void NullRenderContext::OnNewFrame()
+{
+	if (_textureCacheTrace)
+	{
+		_textureCacheTrace->AddNewFrame();
+	}
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		_textureCaches[i]->OnNewFrame();
+	}
+}
+
+_Use_decl_annotations_
+void NullRenderContext::WriteToScreen(
+	const uint32_t* pixels,
+	int32_t width,
+	int32_t height,
+	bool forCinematic)
+{
+	++_statistics.screenWriteCount;
+	_statistics.screenWriteBytes += (uint64_t)width * height * 4;
+
+	Present();
+	_canRepeatPresent = false;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::SetPalette(
+	int32_t paletteIndex,
+	const uint32_t* palette)
+{
+	assert(paletteIndex >= 0 && paletteIndex < D2DX_MAX_PALETTES);
+	memcpy(_palettes.items + paletteIndex * 256, palette, 1024);
+	++_statistics.paletteUploadCount;
+}
+
+const Options& NullRenderContext::GetOptions() const
+{
+	return _options;
+}
+
+_Use_decl_annotations_
+ITextureCache* NullRenderContext::GetTextureCache(
+	const Batch& batch) const
+{
+	const int32_t textureWidth = batch.GetTextureWidth();
+	const int32_t textureHeight = batch.GetTextureHeight();
+
+	if (textureWidth == 256 && textureHeight == 128)
+	{
+		return _textureCaches[6].get();
+	}
+
+	const int32_t longest = max(textureWidth, textureHeight);
+	assert(longest >= 8);
+	uint32_t log2Longest = 0;
+	BitScanForward((DWORD*)&log2Longest, (DWORD)longest);
+	log2Longest -= 3;
+	assert(log2Longest <= 5);
+	return _textureCaches[log2Longest].get();
+}
+
+_Use_decl_annotations_
+ITextureCache* NullRenderContext::GetTextureCache(
+	TextureCacheSizeClass sizeClass) const
+{
+	return _textureCaches[(int32_t)sizeClass].get();
+}
+
+_Use_decl_annotations_
+void NullRenderContext::SetTextureCacheCapacities(
+	const uint32_t* capacities)
+{
+	CreateTextureCaches(capacities);
+}
+
+_Use_decl_annotations_
+void NullRenderContext::SetSizes(
+	Size gameSize,
+	Size windowSize,
+	ScreenMode screenMode)
+{
+	_gameSize = gameSize;
+	_windowSize = windowSize;
+	_screenMode = screenMode;
+	_canRepeatPresent = false;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::GetCurrentMetrics(
+	Size* gameSize,
+	Rect* renderRect,
+	Size* desktopSize) const
+{
+	if (gameSize)
+	{
+		*gameSize = _gameSize;
+	}
+
+	if (renderRect)
+	{
+		*renderRect = Metrics::GetRenderRect(_gameSize, _windowSize, true);
+	}
+
+	if (desktopSize)
+	{
+		*desktopSize = _windowSize;
+	}
+}
+
+void NullRenderContext::ToggleFullscreen()
+{
+}
+
+float NullRenderContext::GetFrameTime() const
+{
+	return (float)(FrameTimeMs / 1000.0);
+}
+
+int32_t NullRenderContext::GetFrameTimeFp() const
+{
+	return (int32_t)(FrameTimeMs * (65536.0 / 1000.0));
+}
+
+ScreenMode NullRenderContext::GetScreenMode() const
+{
+	return _screenMode;
+}
+
+const NullRenderStatistics& NullRenderContext::GetStatistics() const
+{
+	return _statistics;
+}
+
+_Use_decl_annotations_
+void NullRenderContext::RecordTextureCacheAccesses(
+	const std::shared_ptr<TextureCacheTrace>& trace)
+{
+	assert(!_textureCacheTrace);
+	_textureCacheTrace = trace;
+
+	for (int32_t i = 0; i < ARRAYSIZE(_textureCaches); ++i)
+	{
+		_textureCaches[i] = std::make_unique<RecordingTextureCache>(std::move(_textureCaches[i]), (TextureCacheSizeClass)i, trace);
+	}
+}
+
+_Use_decl_annotations_
+void NullRenderContext::RecordBatches(
+	const std::shared_ptr<BatchTrace>& trace)
+{
+	_batchTrace = trace;
+}
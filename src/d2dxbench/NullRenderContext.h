@@ -0,0 +1,162 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "Buffer.h"
+#include "IRenderContext.h"
+#include "Microbenchmarks.h"
+#include "Options.h"
+#include "TextureCacheSimulator.h"
+
+namespace d2dx
+{
+	struct NullRenderStatistics final
+	{
+		uint32_t frameCount;
+		uint32_t repeatedFrameCount;
+		uint32_t drawCount;
+		uint32_t vertexCount;
+		uint32_t textureUploadCount;
+		uint64_t textureUploadBytes;
+		uint32_t paletteUploadCount;
+		uint32_t gammaTableUploadCount;
+		uint32_t screenWriteCount;
+		uint64_t screenWriteBytes;
+		int64_t drawBatchesTime;
+	};
+
+	/*
+		IRenderContext that does no rendering. Vertices, textures and palettes go through the
+		same CPU-side paths as in RenderContext (vertex buffer copy, texture cache lookups and
+		insertions), but nothing reaches D3D; instead, the work is counted.
+	*/
+	class NullRenderContext final : public IRenderContext
+	{
+	public:
+		NullRenderContext(
+			_In_ const std::shared_ptr<ISimd>& simd);
+
+		virtual ~NullRenderContext() noexcept {}
+
+#pragma region IRenderContext
+
+		virtual HWND GetHWnd() const override;
+
+		virtual void LoadGammaTable(
+			_In_reads_(valueCount) const uint32_t* values,
+			_In_ uint32_t valueCount) override;
+
+		virtual uint32_t BulkWriteVertices(
+			_In_reads_(vertexCount) const Vertex* vertices,
+			_In_ uint32_t vertexCount) override;
+
+		virtual void BulkWriteSurfaceIds(
+			_In_reads_(batchCount) const Batch* batches,
+			_In_ uint32_t batchCount) override;
+
+		virtual void UploadTexture(
+			_In_ const Batch& batch,
+			_In_ TextureCacheLocation location,
+			_In_reads_(batch.GetTextureWidth() * batch.GetTextureHeight()) const uint8_t* data) override;
+
+		virtual void Draw(
+			_In_ const Batch& batch,
+			_In_ uint32_t startVertexLocation) override;
+
+		virtual void Present() override;
+
+		virtual bool RepeatPresent() override;
+
+		virtual void OnNewFrame() override;
+
+		virtual void WriteToScreen(
+			_In_reads_(width* height) const uint32_t* pixels,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_ bool forCinematic) override;
+
+		virtual void SetPalette(
+			_In_ int32_t paletteIndex,
+			_In_reads_(256) const uint32_t* palette) override;
+
+		virtual const Options& GetOptions() const override;
+
+		virtual ITextureCache* GetTextureCache(
+			_In_ const Batch& batch) const override;
+
+		virtual ITextureCache* GetTextureCache(
+			_In_ TextureCacheSizeClass sizeClass) const override;
+
+		virtual void SetTextureCacheCapacities(
+			_In_reads_((int32_t)TextureCacheSizeClass::Count) const uint32_t* capacities) override;
+
+		virtual void SetSizes(
+			_In_ Size gameSize,
+			_In_ Size windowSize,
+			_In_ ScreenMode screenMode) override;
+
+		virtual void GetCurrentMetrics(
+			_Out_opt_ Size* gameSize,
+			_Out_opt_ Rect* renderRect,
+			_Out_opt_ Size* desktopSize) const override;
+
+		virtual void ToggleFullscreen() override;
+
+		virtual float GetFrameTime() const override;
+
+		virtual int32_t GetFrameTimeFp() const override;
+
+		virtual ScreenMode GetScreenMode() const override;
+
+#pragma endregion IRenderContext
+
+		const NullRenderStatistics& GetStatistics() const;
+
+		/* Records the texture cache lookups made from now on, for RunTextureCacheSimulation. */
+		void RecordTextureCacheAccesses(
+			_In_ const std::shared_ptr<TextureCacheTrace>& trace);
+
+		/* Records the batches and vertices of the frames drawn from now on, for RunSurfaceIdBenchmark. */
+		void RecordBatches(
+			_In_ const std::shared_ptr<BatchTrace>& trace);
+
+	private:
+		void CreateTextureCaches(
+			_In_reads_((int32_t)TextureCacheSizeClass::Count) const uint32_t* capacities);
+
+		Options _options;
+		Size _gameSize = { 640, 480 };
+		Size _windowSize = { 640, 480 };
+		ScreenMode _screenMode = ScreenMode::Windowed;
+		Buffer<Vertex> _vertexBuffer;
+		uint32_t _vbWriteIndex = 0;
+		uint32_t _frameStartVertexLocation = 0;
+		uint32_t _frameVertexCount = 0;
+		Buffer<uint32_t> _quadAttributes;
+		std::unique_ptr<ITextureCache> _textureCaches[7];
+		Buffer<uint32_t> _palettes;
+		Buffer<uint32_t> _gammaTable;
+		int64_t _drawBatchesStartTime = 0;
+		bool _canRepeatPresent = false;
+		NullRenderStatistics _statistics = { 0 };
+		std::shared_ptr<TextureCacheTrace> _textureCacheTrace;
+		std::shared_ptr<BatchTrace> _batchTrace;
+		std::shared_ptr<ISimd> _simd;
+	};
+}
@@ -0,0 +1,307 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "TextureCacheSimulator.h"
+#include "Batch.h"
+#include "TextureCachePolicyFactory.h"
+
+#include <unordered_map>
+
+using namespace d2dx;
+
+_Use_decl_annotations_
+void TextureCacheTrace::AddAccess(
+	TextureCacheSizeClass sizeClass,
+	uint64_t contentKey)
+{
+	assert(contentKey != 0);
+	_accesses.push_back({ contentKey, (uint32_t)sizeClass, 0 });
+}
+
+_Use_decl_annotations_
+void TextureCacheTrace::SetLastAccessSize(
+	uint32_t size)
+{
+	assert(!_accesses.empty());
+	_accesses.back().size = size;
+}
+
+void TextureCacheTrace::AddNewFrame()
+{
+	_accesses.push_back({ 0, 0, 0 });
+}
+
+const std::vector<TextureCacheAccess>& TextureCacheTrace::GetAccesses() const
+{
+	return _accesses;
+}
+
+_Use_decl_annotations_
+RecordingTextureCache::RecordingTextureCache(
+	std::unique_ptr<ITextureCache> textureCache,
+	TextureCacheSizeClass sizeClass,
+	const std::shared_ptr<TextureCacheTrace>& trace) :
+	_textureCache{ std::move(textureCache) },
+	_sizeClass{ sizeClass },
+	_trace{ trace }
+{
+}
+
+void RecordingTextureCache::OnNewFrame()
+{
+	_textureCache->OnNewFrame();
+}
+
+_Use_decl_annotations_
+TextureCacheLocation RecordingTextureCache::FindTexture(
+	uint64_t contentKey,
+	const Batch& batch,
+	int32_t lastIndex)
+{
+	_trace->AddAccess(_sizeClass, contentKey);
+	return _textureCache->FindTexture(contentKey, batch, lastIndex);
+}
+
+_Use_decl_annotations_
+bool RecordingTextureCache::Contains(
+	uint64_t contentKey) const
+{
+	return _textureCache->Contains(contentKey);
+}
+
+_Use_decl_annotations_
+TextureCacheLocation RecordingTextureCache::InsertTexture(
+	uint64_t contentKey,
+	const Batch& batch)
+{
+	_trace->SetLastAccessSize((uint32_t)(batch.GetTextureWidth() * batch.GetTextureHeight()));
+	return _textureCache->InsertTexture(contentKey, batch);
+}
+
+_Use_decl_annotations_
+TextureCacheLocation RecordingTextureCache::PreloadTexture(
+	uint64_t contentKey,
+	const Batch& batch)
+{
+	/* Not an access by the game, so not recorded. */
+	return _textureCache->PreloadTexture(contentKey, batch);
+}
+
+_Use_decl_annotations_
+void RecordingTextureCache::UploadTexture(
+	TextureCacheLocation location,
+	int32_t width,
+	int32_t height,
+	const uint8_t* data)
+{
+	_textureCache->UploadTexture(location, width, height, data);
+}
+
+_Use_decl_annotations_
+ID3D11ShaderResourceView* RecordingTextureCache::GetSrv(
+	uint32_t atlasIndex) const
+{
+	return _textureCache->GetSrv(atlasIndex);
+}
+
+uint32_t RecordingTextureCache::GetMemoryFootprint() const
+{
+	return _textureCache->GetMemoryFootprint();
+}
+
+uint32_t RecordingTextureCache::GetUsedCount() const
+{
+	return _textureCache->GetUsedCount();
+}
+
+uint32_t RecordingTextureCache::GetCapacity() const
+{
+	return _textureCache->GetCapacity();
+}
+
+uint32_t RecordingTextureCache::GetWorkingSetSize() const
+{
+	return _textureCache->GetWorkingSetSize();
+}
+
+uint32_t RecordingTextureCache::GetEvictionCount() const
+{
+	return _textureCache->GetEvictionCount();
+}
+
+uint32_t RecordingTextureCache::GetPinnedCapacity() const
+{
+	return _textureCache->GetPinnedCapacity();
+}
+
+uint32_t RecordingTextureCache::GetPinnedUsedCount() const
+{
+	return _textureCache->GetPinnedUsedCount();
+}
+
+uint32_t RecordingTextureCache::GetPinnedEvictionCount() const
+{
+	return _textureCache->GetPinnedEvictionCount();
+}
+
+TextureCacheStatistics RecordingTextureCache::GetStatistics() const
+{
+	return _textureCache->GetStatistics();
+}
+
+struct SimulationResult final
+{
+	uint32_t hitCount;
+	uint32_t missCount;
+	uint32_t evictionCount;
+	uint64_t uploadBytes;
+};
+
+static SimulationResult SimulatePolicy(
+	_In_ const std::vector<TextureCacheAccess>& accesses,
+	_In_ TextureCacheSizeClass sizeClass,
+	_In_ TextureCachePolicyType policyType,
+	_In_ uint32_t capacity,
+	_In_ const std::shared_ptr<ISimd>& simd)
+{
+	auto policy = TextureCachePolicyFactory::Create(policyType, capacity, simd);
+	SimulationResult result = { 0 };
+
+	for (const auto& access : accesses)
+	{
+		if (!access.contentKey)
+		{
+			policy->OnNewFrame();
+			continue;
+		}
+
+		if (access.sizeClass != (uint32_t)sizeClass)
+		{
+			continue;
+		}
+
+		if (policy->Find(access.contentKey, -1) >= 0)
+		{
+			++result.hitCount;
+			continue;
+		}
+
+		bool evicted = false;
+		policy->Insert(access.contentKey, evicted);
+
+		++result.missCount;
+		result.evictionCount += evicted ? 1 : 0;
+		result.uploadBytes += access.size;
+	}
+
+	return result;
+}
+
+_Use_decl_annotations_
+void d2dx::RunTextureCacheSimulation(
+	const TextureCacheTrace& trace,
+	const std::shared_ptr<ISimd>& simd)
+{
+	/* Same as RenderContextResources::CreateTextureCaches. */
+	static const uint32_t capacities[(int)TextureCacheSizeClass::Count] = { 512, 1024, 2048, 2048, 1024, 512, 1024 };
+	static const char* sizeClassNames[(int)TextureCacheSizeClass::Count] = { "8x8", "16x16", "32x32", "64x64", "128x128", "256x256", "256x128" };
+	static const uint32_t capacityScales[][2] = { { 1, 2 }, { 1, 1 }, { 2, 1 } };
+
+	/* The real cache only records the upload size on a miss, which is always the first access to a
+	   content key. Fill it in for the later accesses too, since the simulated policies may miss on
+	   any of them. */
+	std::vector<TextureCacheAccess> accesses = trace.GetAccesses();
+	std::unordered_map<uint64_t, uint32_t> sizes[(int)TextureCacheSizeClass::Count];
+	uint32_t frameCount = 0;
+
+	for (auto& access : accesses)
+	{
+		if (!access.contentKey)
+		{
+			++frameCount;
+		}
+		else if (access.size)
+		{
+			sizes[access.sizeClass][access.contentKey] = access.size;
+		}
+		else
+		{
+			access.size = sizes[access.sizeClass][access.contentKey];
+		}
+	}
+
+	printf("Texture cache simulation (%u accesses in %u frames):\n", (uint32_t)(accesses.size() - frameCount), frameCount);
+	printf("%-10s %-8s %8s %10s %10s %10s %12s\n", "size", "policy", "capacity", "accesses", "hit rate", "evictions", "uploaded kB");
+
+	SimulationResult totals[ARRAYSIZE(capacityScales)][(int)TextureCachePolicyType::Count] = { 0 };
+
+	for (int32_t sizeClass = 0; sizeClass < (int32_t)TextureCacheSizeClass::Count; ++sizeClass)
+	{
+		for (int32_t scale = 0; scale < ARRAYSIZE(capacityScales); ++scale)
+		{
+			const uint32_t capacity = capacities[sizeClass] * capacityScales[scale][0] / capacityScales[scale][1];
+
+			for (int32_t policyType = 0; policyType < (int32_t)TextureCachePolicyType::Count; ++policyType)
+			{
+				const SimulationResult result = SimulatePolicy(accesses, (TextureCacheSizeClass)sizeClass, (TextureCachePolicyType)policyType, capacity, simd);
+				const uint32_t accessCount = result.hitCount + result.missCount;
+
+				if (!accessCount)
+				{
+					continue;
+				}
+
+				printf("%-10s %-8s %8u %10u %9.2f%% %10u %12llu\n",
+					sizeClassNames[sizeClass],
+					TextureCachePolicyFactory::GetName((TextureCachePolicyType)policyType),
+					capacity,
+					accessCount,
+					100.0 * result.hitCount / accessCount,
+					result.evictionCount,
+					result.uploadBytes / 1024);
+
+				auto& total = totals[scale][policyType];
+				total.hitCount += result.hitCount;
+				total.missCount += result.missCount;
+				total.evictionCount += result.evictionCount;
+				total.uploadBytes += result.uploadBytes;
+			}
+		}
+	}
+
+	static const char* capacityScaleNames[ARRAYSIZE(capacityScales)] = { "0.5x", "1x", "2x" };
+
+	for (int32_t scale = 0; scale < ARRAYSIZE(capacityScales); ++scale)
+	{
+		for (int32_t policyType = 0; policyType < (int32_t)TextureCachePolicyType::Count; ++policyType)
+		{
+			const auto& total = totals[scale][policyType];
+			const uint32_t accessCount = total.hitCount + total.missCount;
+
+			printf("%-10s %-8s %8s %10u %9.2f%% %10u %12llu\n",
+				"all",
+				TextureCachePolicyFactory::GetName((TextureCachePolicyType)policyType),
+				capacityScaleNames[scale],
+				accessCount,
+				accessCount ? 100.0 * total.hitCount / accessCount : 0.0,
+				total.evictionCount,
+				total.uploadBytes / 1024);
+		}
+	}
+}
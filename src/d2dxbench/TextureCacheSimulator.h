@@ -0,0 +1,126 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "ISimd.h"
+#include "ITextureCache.h"
+#include "Options.h"
+
+#include <vector>
+
+namespace d2dx
+{
+	struct TextureCacheAccess final
+	{
+		uint64_t contentKey;	/* Zero marks the start of a new frame. */
+		uint32_t sizeClass;
+		uint32_t size;			/* Bytes uploaded if the access misses, or zero if not known yet. */
+	};
+
+	/* The texture cache lookups made by D2DXContext::UpdateTexture during a replay, in order. */
+	class TextureCacheTrace final
+	{
+	public:
+		void AddAccess(
+			_In_ TextureCacheSizeClass sizeClass,
+			_In_ uint64_t contentKey);
+
+		/* Sets the upload size of the last access, when it missed and the texture was inserted. */
+		void SetLastAccessSize(
+			_In_ uint32_t size);
+
+		void AddNewFrame();
+
+		const std::vector<TextureCacheAccess>& GetAccesses() const;
+
+	private:
+		std::vector<TextureCacheAccess> _accesses;
+	};
+
+	/* Forwards to a texture cache, and records the lookups made through it. */
+	class RecordingTextureCache final : public ITextureCache
+	{
+	public:
+		RecordingTextureCache(
+			_In_ std::unique_ptr<ITextureCache> textureCache,
+			_In_ TextureCacheSizeClass sizeClass,
+			_In_ const std::shared_ptr<TextureCacheTrace>& trace);
+
+		virtual ~RecordingTextureCache() noexcept {}
+
+		virtual void OnNewFrame() override;
+
+		virtual TextureCacheLocation FindTexture(
+			_In_ uint64_t contentKey,
+			_In_ const Batch& batch,
+			_In_ int32_t lastIndex) override;
+
+		virtual bool Contains(
+			_In_ uint64_t contentKey) const override;
+
+		virtual TextureCacheLocation InsertTexture(
+			_In_ uint64_t contentKey,
+			_In_ const Batch& batch) override;
+
+		virtual TextureCacheLocation PreloadTexture(
+			_In_ uint64_t contentKey,
+			_In_ const Batch& batch) override;
+
+		virtual void UploadTexture(
+			_In_ TextureCacheLocation location,
+			_In_ int32_t width,
+			_In_ int32_t height,
+			_In_reads_(width * height) const uint8_t* data) override;
+
+		virtual ID3D11ShaderResourceView* GetSrv(
+			_In_ uint32_t atlasIndex) const override;
+
+		virtual uint32_t GetMemoryFootprint() const override;
+
+		virtual uint32_t GetUsedCount() const override;
+
+		virtual uint32_t GetCapacity() const override;
+
+		virtual uint32_t GetWorkingSetSize() const override;
+
+		virtual uint32_t GetEvictionCount() const override;
+
+		virtual uint32_t GetPinnedCapacity() const override;
+
+		virtual uint32_t GetPinnedUsedCount() const override;
+
+		virtual uint32_t GetPinnedEvictionCount() const override;
+
+		virtual TextureCacheStatistics GetStatistics() const override;
+
+	private:
+		std::unique_ptr<ITextureCache> _textureCache;
+		TextureCacheSizeClass _sizeClass;
+		std::shared_ptr<TextureCacheTrace> _trace;
+	};
+
+	/*
+		Replays the recorded accesses against every texture cache policy, at half, the same and
+		twice the capacity used by the game, and prints the hit rate, evictions and bytes uploaded
+		for each size class. Run with d2dxbench <trace file> -cachesim.
+	*/
+	void RunTextureCacheSimulation(
+		_In_ const TextureCacheTrace& trace,
+		_In_ const std::shared_ptr<ISimd>& simd);
+}
@@ -0,0 +1,616 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CompatibilityModeDisabler.h"
+#include "D2DXContext.h"
+#include "D2DXContextFactory.h"
+#include "GlideTrace.h"
+#include "Microbenchmarks.h"
+#include "NullGameHelper.h"
+#include "NullRenderContext.h"
+#include "TextureCacheSimulator.h"
+#include "Utils.h"
+
+using namespace d2dx;
+using namespace std;
+
+/*
+	Replays a Glide trace recorded with -dxdbg_record_glide through D2DXContext, with a
+	NullRenderContext standing in for D3D, and reports how much CPU time the hot entry points take.
+	Needs no GPU, so it can be used to catch regressions in the CPU side of d2dx.
+
+	Usage: d2dxbench <trace file> [-passes <count>] [-frames] [-sse2|-avx2|-avx512] [-renderthread] [-cachesim]
+	       d2dxbench -microbench [<trace file>] [-sse2|-avx2|-avx512]
+
+	-sse2, -avx2 and -avx512 force the given SIMD code paths, if the CPU supports them. By default
+	the fastest ones are used, like in the game.
+	-renderthread executes frames on the render thread, like the game does. OnBufferSwap then
+	measures the time the game thread spends handing off frames, and DrawBatches is not measured.
+	-microbench runs the synthetic benchmarks in Microbenchmarks.h instead of replaying a trace.
+	If a trace is given as well, it is replayed first, and the batches drawn in it are used for the
+	benchmarks that need real frames.
+	-cachesim records the texture cache lookups made in the first pass, and replays them against
+	each texture cache policy afterwards (see TextureCacheSimulator.h).
+*/
+
+enum class BenchCategory
+{
+	DrawVertexArray,
+	TexSource,
+	DrawBatches,
+	BufferSwap,
+	Total,
+	Count
+};
+
+static const char* benchCategoryNames[] =
+{
+	"OnDrawVertexArray",
+	"OnTexSource",
+	"DrawBatches",
+	"OnBufferSwap",
+	"Total",
+};
+
+static_assert(ARRAYSIZE(benchCategoryNames) == (size_t)BenchCategory::Count, "ARRAYSIZE(benchCategoryNames)");
+
+struct FrameTimes final
+{
+	int64_t times[(int32_t)BenchCategory::Count];
+};
+
+struct BenchTotals final
+{
+	uint32_t frameCount;
+	int64_t times[(int32_t)BenchCategory::Count];
+	int64_t maxTimes[(int32_t)BenchCategory::Count];
+};
+
+class TraceReplayer final
+{
+public:
+	TraceReplayer(
+		_In_ const std::shared_ptr<ISimd>& simd,
+		_In_ bool printFrames,
+		_In_ bool useRenderThread,
+		_In_ uint32_t pass,
+		_In_opt_ const std::shared_ptr<TextureCacheTrace>& textureCacheTrace,
+		_In_opt_ const std::shared_ptr<BatchTrace>& batchTrace) :
+		_renderContext{ std::make_shared<NullRenderContext>(simd) },
+		_d2dxContext{ std::make_unique<D2DXContext>(
+			std::make_shared<NullGameHelper>(),
+			simd,
+			std::make_shared<CompatibilityModeDisabler>(),
+			_renderContext) },
+		_pointers(D2DX_MAX_VERTICES_PER_FRAME),
+		_printFrames{ printFrames },
+		_useRenderThread{ useRenderThread },
+		_pass{ pass }
+	{
+		if (!_useRenderThread)
+		{
+			_d2dxContext->DisableRenderThread();
+		}
+
+		if (textureCacheTrace)
+		{
+			_renderContext->RecordTextureCacheAccesses(textureCacheTrace);
+		}
+
+		if (batchTrace)
+		{
+			_renderContext->RecordBatches(batchTrace);
+		}
+	}
+
+	/* Returns false if the chunk is malformed. */
+	bool ReplayChunk(
+		_In_reads_(chunkSize) uint8_t* chunk,
+		_In_ uint32_t chunkSize,
+		_Inout_ BenchTotals& totals)
+	{
+		uint32_t offset = 0;
+
+		while (offset < chunkSize)
+		{
+			if ((chunkSize - offset) < sizeof(GlideTrace::RecordHeader))
+			{
+				return false;
+			}
+
+			GlideTrace::RecordHeader recordHeader;
+			memcpy(&recordHeader, chunk + offset, sizeof(recordHeader));
+
+			const uint32_t recordSize = (sizeof(recordHeader) + recordHeader.argsSize + recordHeader.payloadSize + 3) & ~3U;
+
+			if (recordSize > (chunkSize - offset) || recordHeader.command >= GlideTrace::Command::Count)
+			{
+				return false;
+			}
+
+			uint8_t* args = chunk + offset + sizeof(recordHeader);
+			uint8_t* payload = args + recordHeader.argsSize;
+
+			ReplayRecord(recordHeader, args, payload, totals);
+
+			offset += recordSize;
+		}
+
+		return true;
+	}
+
+	/* Waits for the render thread to execute the last frame. */
+	void Finish()
+	{
+		_d2dxContext = nullptr;
+	}
+
+	const NullRenderStatistics& GetStatistics() const
+	{
+		return _renderContext->GetStatistics();
+	}
+
+private:
+	void ReplayRecord(
+		_In_ const GlideTrace::RecordHeader& recordHeader,
+		_In_ const uint8_t* args,
+		_In_ uint8_t* payload,
+		_Inout_ BenchTotals& totals)
+	{
+		BenchCategory category = BenchCategory::Count;
+		int64_t drawBatchesTime = 0;
+
+		if (recordHeader.command == GlideTrace::Command::DrawVertexArray)
+		{
+			/* The game passes an array of vertex pointers; rebuild one into the gathered vertices. */
+			auto a = (const GlideTrace::DrawVertexArrayArgs*)args;
+			const uint32_t count = min(a->count, _pointers.capacity);
+
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				_pointers.items[i] = payload + i * sizeof(D2::Vertex);
+			}
+		}
+
+		const int64_t startTime = TimeStamp();
+
+		switch (recordHeader.command)
+		{
+		case GlideTrace::Command::SstWinOpen:
+		{
+			auto a = (const GlideTrace::SstWinOpenArgs*)args;
+			_d2dxContext->OnSstWinOpen(0, a->width, a->height);
+			break;
+		}
+		case GlideTrace::Command::VertexLayout:
+		{
+			auto a = (const GlideTrace::VertexLayoutArgs*)args;
+			_d2dxContext->OnVertexLayout(a->param, a->offset);
+			break;
+		}
+		case GlideTrace::Command::TexDownload:
+		{
+			auto a = (const GlideTrace::TexDownloadArgs*)args;
+			_d2dxContext->OnTexDownload(a->tmu, payload, a->startAddress, a->width, a->height);
+			break;
+		}
+		case GlideTrace::Command::TexSource:
+		{
+			auto a = (const GlideTrace::TexSourceArgs*)args;
+			category = BenchCategory::TexSource;
+			_d2dxContext->OnTexSource(a->tmu, a->startAddress, a->width, a->height, a->largeLog2, a->ratioLog2);
+			break;
+		}
+		case GlideTrace::Command::ConstantColorValue:
+		{
+			auto a = (const GlideTrace::ConstantColorValueArgs*)args;
+			_d2dxContext->OnConstantColorValue(a->color);
+			break;
+		}
+		case GlideTrace::Command::AlphaBlendFunction:
+		{
+			auto a = (const GlideTrace::AlphaBlendFunctionArgs*)args;
+			_d2dxContext->OnAlphaBlendFunction(a->rgb_sf, a->rgb_df, a->alpha_sf, a->alpha_df);
+			break;
+		}
+		case GlideTrace::Command::ColorCombine:
+		{
+			auto a = (const GlideTrace::CombineArgs*)args;
+			_d2dxContext->OnColorCombine(a->function, a->factor, a->local, a->other, a->invert != 0);
+			break;
+		}
+		case GlideTrace::Command::AlphaCombine:
+		{
+			auto a = (const GlideTrace::CombineArgs*)args;
+			_d2dxContext->OnAlphaCombine(a->function, a->factor, a->local, a->other, a->invert != 0);
+			break;
+		}
+		case GlideTrace::Command::DrawPoint:
+		{
+			auto a = (const GlideTrace::DrawPrimitiveArgs*)args;
+			_d2dxContext->OnDrawPoint(payload, a->gameContext);
+			break;
+		}
+		case GlideTrace::Command::DrawLine:
+		{
+			auto a = (const GlideTrace::DrawPrimitiveArgs*)args;
+			_d2dxContext->OnDrawLine(payload, payload + sizeof(D2::Vertex), a->gameContext);
+			break;
+		}
+		case GlideTrace::Command::DrawVertexArray:
+		{
+			auto a = (const GlideTrace::DrawVertexArrayArgs*)args;
+			category = BenchCategory::DrawVertexArray;
+			_d2dxContext->OnDrawVertexArray(a->mode, min(a->count, _pointers.capacity), _pointers.items, a->gameContext);
+			break;
+		}
+		case GlideTrace::Command::DrawVertexArrayContiguous:
+		{
+			auto a = (const GlideTrace::DrawVertexArrayContiguousArgs*)args;
+			category = BenchCategory::DrawVertexArray;
+			_d2dxContext->OnDrawVertexArrayContiguous(a->mode, a->count, payload, a->stride, a->gameContext);
+			break;
+		}
+		case GlideTrace::Command::TexDownloadTable:
+		{
+			auto a = (const GlideTrace::TexDownloadTableArgs*)args;
+			_d2dxContext->OnTexDownloadTable((GrTexTable_t)a->type, payload);
+			break;
+		}
+		case GlideTrace::Command::LoadGammaTable:
+		{
+			auto a = (const GlideTrace::LoadGammaTableArgs*)args;
+			uint32_t* table = (uint32_t*)payload;
+			_d2dxContext->OnLoadGammaTable(a->nentries, table, table + a->nentries, table + 2 * a->nentries);
+			break;
+		}
+		case GlideTrace::Command::ChromakeyMode:
+		{
+			auto a = (const GlideTrace::ChromakeyModeArgs*)args;
+			_d2dxContext->OnChromakeyMode((GrChromakeyMode_t)a->mode);
+			break;
+		}
+		case GlideTrace::Command::LfbUnlock:
+		{
+			auto a = (const GlideTrace::LfbUnlockArgs*)args;
+			_d2dxContext->OnLfbUnlock((const uint32_t*)payload, a->strideInBytes);
+			break;
+		}
+		case GlideTrace::Command::GammaCorrectionRGB:
+		{
+			auto a = (const GlideTrace::GammaCorrectionRGBArgs*)args;
+			_d2dxContext->OnGammaCorrectionRGB(a->red, a->green, a->blue);
+			break;
+		}
+		case GlideTrace::Command::BufferSwap:
+		{
+			category = BenchCategory::BufferSwap;
+
+			if (_useRenderThread)
+			{
+				_d2dxContext->OnBufferSwap();
+				break;
+			}
+
+			drawBatchesTime = _renderContext->GetStatistics().drawBatchesTime;
+			_d2dxContext->OnBufferSwap();
+			drawBatchesTime = _renderContext->GetStatistics().drawBatchesTime - drawBatchesTime;
+			break;
+		}
+		case GlideTrace::Command::BufferClear:
+		{
+			_d2dxContext->OnBufferClear();
+			break;
+		}
+		case GlideTrace::Command::TexFilterMode:
+		{
+			auto a = (const GlideTrace::TexFilterModeArgs*)args;
+			_d2dxContext->OnTexFilterMode((GrChipID_t)a->tmu, (GrTextureFilterMode_t)a->filterMode);
+			break;
+		}
+		default:
+			break;
+		}
+
+		const int64_t time = TimeStamp() - startTime;
+
+		if (category != BenchCategory::Count)
+		{
+			AddTime(category, time);
+		}
+
+		AddTime(BenchCategory::Total, time);
+
+		if (recordHeader.command == GlideTrace::Command::BufferSwap)
+		{
+			AddTime(BenchCategory::DrawBatches, drawBatchesTime);
+			EndFrame(totals);
+		}
+	}
+
+	void AddTime(
+		_In_ BenchCategory category,
+		_In_ int64_t time)
+	{
+		_frameTimes.times[(int32_t)category] += time;
+	}
+
+	void EndFrame(
+		_Inout_ BenchTotals& totals)
+	{
+		if (_printFrames)
+		{
+			printf("%u,%u", _pass, _frame);
+
+			for (int32_t i = 0; i < (int32_t)BenchCategory::Count; ++i)
+			{
+				printf(",%.4f", TimeToMs(_frameTimes.times[i]));
+			}
+
+			printf("\n");
+		}
+
+		for (int32_t i = 0; i < (int32_t)BenchCategory::Count; ++i)
+		{
+			totals.times[i] += _frameTimes.times[i];
+			totals.maxTimes[i] = max(totals.maxTimes[i], _frameTimes.times[i]);
+		}
+
+		++totals.frameCount;
+		++_frame;
+		_frameTimes = { 0 };
+	}
+
+	std::shared_ptr<NullRenderContext> _renderContext;
+	std::unique_ptr<D2DXContext> _d2dxContext;
+	Buffer<uint8_t*> _pointers;
+	FrameTimes _frameTimes = { 0 };
+	uint32_t _frame = 0;
+	bool _printFrames;
+	bool _useRenderThread;
+	uint32_t _pass;
+};
+
+static bool ReplayTrace(
+	_In_ FILE* file,
+	_In_ const std::shared_ptr<ISimd>& simd,
+	_In_ bool printFrames,
+	_In_ bool useRenderThread,
+	_In_ uint32_t pass,
+	_In_opt_ const std::shared_ptr<TextureCacheTrace>& textureCacheTrace,
+	_In_opt_ const std::shared_ptr<BatchTrace>& batchTrace,
+	_Inout_ BenchTotals& totals,
+	_Out_ NullRenderStatistics& statistics)
+{
+	TraceReplayer replayer{ simd, printFrames, useRenderThread, pass, textureCacheTrace, batchTrace };
+	Buffer<uint8_t> chunk;
+
+	fseek(file, sizeof(GlideTrace::FileHeader), SEEK_SET);
+
+	/* Only the calls into D2DXContext are timed, not reading the trace. */
+	while (true)
+	{
+		GlideTrace::ChunkHeader chunkHeader;
+
+		if (fread(&chunkHeader, sizeof(chunkHeader), 1, file) != 1)
+		{
+			break;
+		}
+
+		if (chunkHeader.magic != GlideTrace::ChunkMagic)
+		{
+			fprintf(stderr, "Bad chunk magic at frame %u.\n", chunkHeader.frame);
+			return false;
+		}
+
+		if (chunk.capacity < chunkHeader.size)
+		{
+			chunk = Buffer<uint8_t>(chunkHeader.size);
+		}
+
+		if (fread(chunk.items, 1, chunkHeader.size, file) != chunkHeader.size)
+		{
+			fprintf(stderr, "Truncated chunk at frame %u.\n", chunkHeader.frame);
+			return false;
+		}
+
+		if (!replayer.ReplayChunk(chunk.items, chunkHeader.size, totals))
+		{
+			fprintf(stderr, "Malformed record in chunk at frame %u.\n", chunkHeader.frame);
+			return false;
+		}
+	}
+
+	replayer.Finish();
+	statistics = replayer.GetStatistics();
+	return true;
+}
+
+int main(
+	int argc,
+	const char* argv[])
+{
+	const char* traceFilename = nullptr;
+	uint32_t passCount = 1;
+	bool printFrames = false;
+	SimdBackend simdBackend = SimdBackend::Auto;
+	bool useRenderThread = false;
+	bool runMicrobenchmarks = false;
+	bool runCacheSimulation = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-passes") && (i + 1) < argc)
+		{
+			passCount = max(1U, (uint32_t)strtoul(argv[++i], nullptr, 10));
+		}
+		else if (!strcmp(argv[i], "-frames"))
+		{
+			printFrames = true;
+		}
+		else if (!strcmp(argv[i], "-sse2"))
+		{
+			simdBackend = SimdBackend::Sse2;
+		}
+		else if (!strcmp(argv[i], "-avx2"))
+		{
+			simdBackend = SimdBackend::Avx2;
+		}
+		else if (!strcmp(argv[i], "-avx512"))
+		{
+			simdBackend = SimdBackend::Avx512;
+		}
+		else if (!strcmp(argv[i], "-renderthread"))
+		{
+			useRenderThread = true;
+		}
+		else if (!strcmp(argv[i], "-microbench"))
+		{
+			runMicrobenchmarks = true;
+		}
+		else if (!strcmp(argv[i], "-cachesim"))
+		{
+			runCacheSimulation = true;
+		}
+		else
+		{
+			traceFilename = argv[i];
+		}
+	}
+
+	if (!traceFilename && !runMicrobenchmarks)
+	{
+		fprintf(stderr, "Usage: d2dxbench <trace file> [-passes <count>] [-frames] [-sse2|-avx2|-avx512] [-renderthread] [-cachesim]\n");
+		fprintf(stderr, "       d2dxbench -microbench [<trace file>] [-sse2|-avx2|-avx512]\n");
+		return 1;
+	}
+
+	static const char* simdBackendNames[] = { "auto", "SSE2", "AVX2", "AVX-512" };
+	static_assert(ARRAYSIZE(simdBackendNames) == (size_t)SimdBackend::Count, "ARRAYSIZE(simdBackendNames)");
+
+	simdBackend = D2DXContextFactory::ResolveSimdBackend(simdBackend);
+	std::shared_ptr<ISimd> simd = D2DXContextFactory::CreateSimd(simdBackend);
+	fprintf(stderr, "Using %s.\n", simdBackendNames[(int32_t)simdBackend]);
+
+	if (runMicrobenchmarks)
+	{
+		RunTextureCacheLookupBenchmark(simd);
+
+		if (!traceFilename)
+		{
+			return 0;
+		}
+
+		printf("\n");
+	}
+
+	FILE* file = nullptr;
+
+	if (fopen_s(&file, traceFilename, "rb") != 0 || !file)
+	{
+		fprintf(stderr, "Could not open %s.\n", traceFilename);
+		return 1;
+	}
+
+	GlideTrace::FileHeader fileHeader;
+
+	if (fread(&fileHeader, sizeof(fileHeader), 1, file) != 1 ||
+		fileHeader.magic != GlideTrace::FileMagic ||
+		fileHeader.version != GlideTrace::FileVersion ||
+		fileHeader.vertexSize != sizeof(D2::Vertex))
+	{
+		fprintf(stderr, "%s is not a compatible Glide trace.\n", traceFilename);
+		fclose(file);
+		return 1;
+	}
+
+	BenchTotals totals = { 0 };
+	NullRenderStatistics statistics = { 0 };
+
+	/* Lookups are made on the game thread, so recording them needs no synchronization. */
+	std::shared_ptr<TextureCacheTrace> textureCacheTrace = runCacheSimulation ? std::make_shared<TextureCacheTrace>() : nullptr;
+
+	/* Batches are recorded by whichever thread draws them, and only read after the replay has finished. */
+	std::shared_ptr<BatchTrace> batchTrace = runMicrobenchmarks ? std::make_shared<BatchTrace>() : nullptr;
+
+	if (printFrames)
+	{
+		printf("pass,frame");
+
+		for (int32_t i = 0; i < (int32_t)BenchCategory::Count; ++i)
+		{
+			printf(",%s", benchCategoryNames[i]);
+		}
+
+		printf("\n");
+	}
+
+	/* Each pass starts from a fresh context, so that all passes do the same work. */
+	for (uint32_t pass = 0; pass < passCount; ++pass)
+	{
+		if (!ReplayTrace(file, simd, printFrames, useRenderThread, pass, pass == 0 ? textureCacheTrace : nullptr, pass == 0 ? batchTrace : nullptr, totals, statistics))
+		{
+			fclose(file);
+			return 1;
+		}
+	}
+
+	fclose(file);
+
+	if (totals.frameCount == 0)
+	{
+		fprintf(stderr, "The trace contains no frames.\n");
+		return 1;
+	}
+
+	printf("\n%u frames in %u pass(es).\n\n", totals.frameCount, passCount);
+	printf("%-20s %12s %12s %12s\n", "", "total ms", "avg ms", "max ms");
+
+	for (int32_t i = 0; i < (int32_t)BenchCategory::Count; ++i)
+	{
+		printf("%-20s %12.3f %12.4f %12.4f\n",
+			benchCategoryNames[i],
+			TimeToMs(totals.times[i]),
+			TimeToMs(totals.times[i]) / totals.frameCount,
+			TimeToMs(totals.maxTimes[i]));
+	}
+
+	printf("\nPer pass:\n");
+	printf("  repeated frames:  %u\n", statistics.repeatedFrameCount);
+	printf("  draws:            %u\n", statistics.drawCount);
+	printf("  vertices:         %u\n", statistics.vertexCount);
+	printf("  texture uploads:  %u (%llu bytes)\n", statistics.textureUploadCount, statistics.textureUploadBytes);
+	printf("  palette uploads:  %u\n", statistics.paletteUploadCount);
+	printf("  gamma uploads:    %u\n", statistics.gammaTableUploadCount);
+	printf("  screen writes:    %u (%llu bytes)\n", statistics.screenWriteCount, statistics.screenWriteBytes);
+
+	if (textureCacheTrace)
+	{
+		printf("\n");
+		RunTextureCacheSimulation(*textureCacheTrace, simd);
+	}
+
+	if (batchTrace)
+	{
+		printf("\n");
+		RunSurfaceIdBenchmark(*batchTrace);
+	}
+
+	return 0;
+}
@@ -0,0 +1,226 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../d2dx/LiveMetrics.h"
+
+using namespace d2dx;
+
+/*
+	Samples the live metrics page of one or more game processes running with -dxdbg_live_metrics
+	(see LiveMetrics.h), and prints a line per process and sample.
+
+	Usage: d2dxmon [-interval <ms>] <process id> [<process id> ...]
+
+	Rates (fps, hashed bytes and evictions per second) are averaged over the sampling interval.
+	The other values are those of the last frame. The cache column shows how full each texture
+	cache is in percent, from 8x8 up to 256x256, then 256x128.
+*/
+
+struct MonitoredProcess final
+{
+	uint32_t processId;
+	HANDLE fileMapping;
+	const LiveMetricsPage* page;
+	bool hasPreviousSample;
+	LiveMetricsGameFrame previousGame;
+	LiveMetricsRenderFrame previousRender;
+};
+
+static const char* const majorGameStateNames[] =
+{
+	"unknown",
+	"intro",
+	"menus",
+	"ingame",
+	"title",
+};
+
+static bool OpenPage(
+	_Inout_ MonitoredProcess& process)
+{
+	char name[64];
+	LiveMetrics::GetPageName(process.processId, name, sizeof(name));
+
+	process.fileMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+
+	if (!process.fileMapping)
+	{
+		fprintf(stderr, "No live metrics for process %u (was it started with -dxdbg_live_metrics?).\n", process.processId);
+		return false;
+	}
+
+	process.page = (const LiveMetricsPage*)MapViewOfFile(process.fileMapping, FILE_MAP_READ, 0, 0, sizeof(LiveMetricsPage));
+
+	if (!process.page ||
+		process.page->magic != LiveMetricsMagic ||
+		process.page->version != LiveMetricsVersion ||
+		process.page->size != sizeof(LiveMetricsPage))
+	{
+		fprintf(stderr, "The live metrics of process %u have an unsupported layout.\n", process.processId);
+		return false;
+	}
+
+	return true;
+}
+
+template<typename T>
+static bool ReadSection(
+	_In_ const LiveMetricsSection<T>& section,
+	_Out_ T& result)
+{
+	/* Writers hold a section for a few stores at most, so this only fails if the process hangs
+	   in the middle of an update. */
+	for (int32_t attempt = 0; attempt < 1000; ++attempt)
+	{
+		if (section.TryRead(result))
+		{
+			return true;
+		}
+
+		YieldProcessor();
+	}
+
+	return false;
+}
+
+static void PrintHeader()
+{
+	printf("%8s %-7s %8s %7s %7s %7s %6s %7s %7s %5s %9s %8s  %s\n",
+		"pid", "state", "frame", "fps", "ms", "present", "draws", "batches", "verts", "pals", "hash kB/s", "evict/s", "cache %");
+}
+
+static void PrintSample(
+	_Inout_ MonitoredProcess& process,
+	_In_ double intervalSeconds)
+{
+	LiveMetricsGameFrame game;
+	LiveMetricsRenderFrame render;
+
+	if (!ReadSection(process.page->game, game) || !ReadSection(process.page->render, render))
+	{
+		printf("%8u (busy)\n", process.processId);
+		return;
+	}
+
+	double fps = 0.0;
+	double hashedKBPerSecond = 0.0;
+	double evictionsPerSecond = 0.0;
+
+	if (process.hasPreviousSample)
+	{
+		uint32_t evictionCount = 0;
+
+		for (uint32_t i = 0; i < LiveMetricsTextureCacheCount; ++i)
+		{
+			evictionCount += game.textureCacheEvictionCounts[i] - process.previousGame.textureCacheEvictionCounts[i];
+		}
+
+		fps = (render.presentCount - process.previousRender.presentCount) / intervalSeconds;
+		hashedKBPerSecond = (game.textureHashMissBytes - process.previousGame.textureHashMissBytes) / 1024.0 / intervalSeconds;
+		evictionsPerSecond = evictionCount / intervalSeconds;
+	}
+
+	char cacheUse[LiveMetricsTextureCacheCount * 4 + 1];
+	uint32_t cacheUseLength = 0;
+
+	for (uint32_t i = 0; i < LiveMetricsTextureCacheCount; ++i)
+	{
+		const uint32_t percent = game.textureCacheCapacities[i] > 0 ?
+			game.textureCacheUsedCounts[i] * 100 / game.textureCacheCapacities[i] : 0;
+
+		cacheUseLength += sprintf_s(cacheUse + cacheUseLength, sizeof(cacheUse) - cacheUseLength, "%4u", percent);
+	}
+
+	printf("%8u %-7s %8u %7.1f %7.2f %7.2f %6u %7u %7u %5u %9.1f %8.1f %s\n",
+		process.processId,
+		game.majorGameState < ARRAYSIZE(majorGameStateNames) ? majorGameStateNames[game.majorGameState] : "?",
+		game.frame,
+		fps,
+		render.frameTimeMs,
+		render.presentTimeMs,
+		render.drawCallCount,
+		game.batchCount,
+		game.vertexCount,
+		game.paletteCount,
+		hashedKBPerSecond,
+		evictionsPerSecond,
+		cacheUse);
+
+	process.previousGame = game;
+	process.previousRender = render;
+	process.hasPreviousSample = true;
+}
+
+int main(
+	int argc,
+	const char** argv)
+{
+	uint32_t intervalMs = 1000;
+	MonitoredProcess processes[64];
+	uint32_t processCount = 0;
+
+	for (int32_t i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "-interval") && i + 1 < argc)
+		{
+			intervalMs = max(1, atoi(argv[++i]));
+		}
+		else if (processCount < ARRAYSIZE(processes))
+		{
+			MonitoredProcess& process = processes[processCount];
+			memset(&process, 0, sizeof(process));
+			process.processId = (uint32_t)strtoul(argv[i], nullptr, 10);
+
+			if (OpenPage(process))
+			{
+				++processCount;
+			}
+		}
+	}
+
+	if (processCount == 0)
+	{
+		fprintf(stderr, "Usage: d2dxmon [-interval <ms>] <process id> [<process id> ...]\n");
+		return 1;
+	}
+
+	for (uint32_t sample = 0; ; ++sample)
+	{
+		if (!(sample % 20))
+		{
+			PrintHeader();
+		}
+
+		for (uint32_t i = 0; i < processCount; ++i)
+		{
+			PrintSample(processes[i], intervalMs / 1000.0);
+		}
+
+		fflush(stdout);
+		Sleep(intervalMs);
+	}
+
+	return 0;
+}
@@ -63,6 +63,9 @@ namespace d2dxtests
 			Assert::AreEqual(-D2DX_TMU_ADDRESS_ALIGNMENT, batch.GetTextureStartAddress());
 			Assert::AreEqual(0U, batch.GetVertexCount());
 			Assert::AreEqual(2, batch.GetTextureWidth());
+			Assert::AreEqual(0, batch.GetTextureOriginS());
+			Assert::AreEqual(0, batch.GetTextureOriginT());
+			Assert::AreEqual(0, batch.GetSurfaceId());
 		}
 
 		TEST_METHOD(SetAlphaBlend)
@@ -309,6 +312,35 @@ namespace d2dxtests
 			}
 		}
 
+		TEST_METHOD(SetTextureOrigin)
+		{
+			Batch batch;
+			for (int32_t t = 0; t < 256; t += 8)
+			{
+				for (int32_t s = 0; s < 256; s += 8)
+				{
+					batch.SetTextureOrigin(s, t);
+					Assert::IsFalse(batch.IsValid());
+					Assert::AreEqual(AlphaBlend::Opaque, batch.GetAlphaBlend());
+					Assert::AreEqual(AlphaCombine::One, batch.GetAlphaCombine());
+					Assert::AreEqual(0U, batch.GetTextureAtlas());
+					Assert::AreEqual(0U, batch.GetTextureIndex());
+					Assert::AreEqual(GameAddress::Unknown, batch.GetGameAddress());
+					Assert::AreEqual(0ULL, batch.GetHash());
+					Assert::AreEqual(2, batch.GetTextureHeight());
+					Assert::AreEqual(0, batch.GetPaletteIndex());
+					Assert::AreEqual(RgbCombine::ColorMultipliedByTexture, batch.GetRgbCombine());
+					Assert::AreEqual(0, batch.GetStartVertex());
+					Assert::AreEqual(TextureCategory::Unknown, batch.GetTextureCategory());
+					Assert::AreEqual(-D2DX_TMU_ADDRESS_ALIGNMENT, batch.GetTextureStartAddress());
+					Assert::AreEqual(0U, batch.GetVertexCount());
+					Assert::AreEqual(2, batch.GetTextureWidth());
+					Assert::AreEqual(s, batch.GetTextureOriginS());
+					Assert::AreEqual(t, batch.GetTextureOriginT());
+				}
+			}
+		}
+
 		TEST_METHOD(SetTextureStartAddress)
 		{
 			Batch batch;
@@ -356,5 +388,99 @@ namespace d2dxtests
 				Assert::AreEqual(2, batch.GetTextureWidth());
 			}
 		}
+
+		TEST_METHOD(SetSurfaceId)
+		{
+			Batch batch;
+			batch.SetVertexCount(4);
+			batch.SetStartVertex(0xFFFFC);
+			for (int32_t i = 0; i <= D2DX_SURFACE_ID_USER_INTERFACE; i += 7) /* prime */
+			{
+				batch.SetSurfaceId(i);
+				Assert::AreEqual(i, batch.GetSurfaceId());
+				Assert::AreEqual(4U, batch.GetVertexCount());
+				Assert::AreEqual(0xFFFFC, batch.GetStartVertex());
+			}
+			batch.SetSurfaceId(D2DX_SURFACE_ID_USER_INTERFACE);
+			Assert::AreEqual(D2DX_SURFACE_ID_USER_INTERFACE, batch.GetSurfaceId());
+		}
+
+		TEST_METHOD(GetQuadAttributes)
+		{
+			Batch batch;
+			batch.SetSurfaceId(D2DX_SURFACE_ID_USER_INTERFACE);
+			batch.SetTextureSize(256, 128);
+			Assert::AreEqual((uint32_t)D2DX_SURFACE_ID_USER_INTERFACE | (8U << 16) | (7U << 20), batch.GetQuadAttributes());
+
+			batch.SetSurfaceId(1234);
+			batch.SetTextureSize(8, 64);
+			Assert::AreEqual(1234U | (3U << 16) | (6U << 20), batch.GetQuadAttributes());
+		}
+
+		TEST_METHOD(GetVertexAtlasIndex)
+		{
+			Batch batch;
+			for (uint32_t atlas = 0; atlas < D2DX_MAX_TEXTURE_ATLASES; ++atlas)
+			{
+				for (uint32_t i = 0; i < D2DX_MAX_TEXTURES_PER_ATLAS; i += 7) /* prime */
+				{
+					batch.SetTextureAtlas(atlas);
+					batch.SetTextureIndex(i);
+					Assert::AreEqual((atlas << D2DX_TEXTURE_ATLAS_SLICE_BITS) | i, batch.GetVertexAtlasIndex());
+					Assert::IsTrue(batch.GetVertexAtlasIndex() < 4096U);
+				}
+			}
+		}
+
+		TEST_METHOD(StateKeyIgnoresTextureState)
+		{
+			Batch first;
+			first.SetTextureStartAddress(D2DX_TMU_ADDRESS_ALIGNMENT);
+			first.SetAlphaBlend(AlphaBlend::SrcAlphaInvSrcAlpha);
+			first.SetFilterMode(GR_TEXTUREFILTER_BILINEAR);
+			first.SetTextureSize(16, 16);
+			first.SetTextureAtlas(0);
+			first.SetTextureIndex(3);
+			first.SetTextureOrigin(32, 64);
+			first.SetPaletteIndex(2);
+
+			/* Batches from different caches and atlases are drawn together. */
+			Batch second = first;
+			second.SetTextureStartAddress(2 * D2DX_TMU_ADDRESS_ALIGNMENT);
+			second.SetTextureSize(256, 128);
+			second.SetTextureAtlas(5);
+			second.SetTextureIndex(511);
+			second.SetTextureOrigin(0, 0);
+			second.SetPaletteIndex(7);
+			second.SetIsChromaKeyEnabled(true);
+			second.SetTextureHash(0x1234);
+
+			Assert::AreEqual(first.GetStateKey(), second.GetStateKey());
+		}
+
+		TEST_METHOD(StateKeyDiffersOnBlendAndFilter)
+		{
+			std::array<uint32_t, 8> stateKeys;
+
+			for (int32_t alphaBlend = 0; alphaBlend < 4; ++alphaBlend)
+			{
+				for (int32_t filterMode = 0; filterMode < 2; ++filterMode)
+				{
+					Batch batch;
+					batch.SetTextureStartAddress(D2DX_TMU_ADDRESS_ALIGNMENT);
+					batch.SetAlphaBlend((AlphaBlend)alphaBlend);
+					batch.SetFilterMode(filterMode);
+					stateKeys[alphaBlend * 2 + filterMode] = batch.GetStateKey();
+				}
+			}
+
+			for (size_t i = 0; i < stateKeys.size(); ++i)
+			{
+				for (size_t j = i + 1; j < stateKeys.size(); ++j)
+				{
+					Assert::AreNotEqual(stateKeys[i], stateKeys[j]);
+				}
+			}
+		}
 	};
 }
@@ -0,0 +1,150 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <array>
+#include "CppUnitTest.h"
+#include "../d2dx/Batch.h"
+#include "../d2dx/BatchReorderer.h"
+#include "../d2dx/Vertex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestBatchReorderer)
+	{
+	public:
+		TEST_METHOD(GroupsNonOverlappingBatchesByState)
+		{
+			AddQuad(0, 0, 0, 10, 10);
+			AddQuad(1, 1, 100, 0, 10);
+			AddQuad(2, 0, 200, 0, 10);
+			AddQuad(3, 1, 300, 0, 10);
+
+			Reorder();
+
+			AssertOrder({ 0, 2, 1, 3 });
+		}
+
+		TEST_METHOD(KeepsOrderOfOverlappingBatches)
+		{
+			AddQuad(0, 0, 0, 0, 10);
+			AddQuad(1, 1, 5, 5, 10);
+			AddQuad(2, 0, 8, 8, 10);
+
+			Reorder();
+
+			AssertOrder({ 0, 1, 2 });
+		}
+
+		TEST_METHOD(MovesPastOnlyNonOverlappingBatches)
+		{
+			/* Batch 3 overlaps batch 2, but batch 2 has already moved in front of batch 1, so batch 3 can follow it. */
+			AddQuad(0, 0, 0, 0, 10);
+			AddQuad(1, 1, 100, 0, 10);
+			AddQuad(2, 0, 200, 0, 10);
+			AddQuad(3, 0, 205, 5, 10);
+
+			Reorder();
+
+			AssertOrder({ 0, 2, 3, 1 });
+		}
+
+		TEST_METHOD(TouchingBatchesCountAsOverlapping)
+		{
+			AddQuad(0, 0, 0, 0, 10);
+			AddQuad(1, 1, 10, 0, 10);
+			AddQuad(2, 0, 20, 0, 10);
+
+			Reorder();
+
+			AssertOrder({ 0, 1, 2 });
+		}
+
+		TEST_METHOD(DropsInvalidBatches)
+		{
+			AddQuad(0, 0, 0, 0, 10);
+			_batches.items[_batchCount++] = Batch();
+			AddQuad(1, 0, 100, 0, 10);
+
+			Reorder();
+
+			AssertOrder({ 0, 1 });
+		}
+
+	private:
+		void AddQuad(uint32_t id, uint64_t stateKey, int32_t x, int32_t y, int32_t size)
+		{
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureIndex(id);
+			batch.SetStartVertex(_vertexCount);
+			batch.SetVertexCount(4);
+
+			const float x0 = (float)x;
+			const float y0 = (float)y;
+			const float x1 = (float)(x + size);
+			const float y1 = (float)(y + size);
+
+			_vertices.items[_vertexCount++] = Vertex{ x0, y0, 0, 0, id, false, 0, 0 };
+			_vertices.items[_vertexCount++] = Vertex{ x1, y0, 0, 0, id, false, 0, 0 };
+			_vertices.items[_vertexCount++] = Vertex{ x1, y1, 0, 0, id, false, 0, 0 };
+			_vertices.items[_vertexCount++] = Vertex{ x0, y1, 0, 0, id, false, 0, 0 };
+
+			_stateKeys[_batchCount] = stateKey;
+			_batches.items[_batchCount++] = batch;
+		}
+
+		void Reorder()
+		{
+			_reorderer.Reorder(_batches, _batchCount, _vertices, _vertexCount, _stateKeys.data());
+		}
+
+		void AssertOrder(std::initializer_list<uint32_t> expectedIds)
+		{
+			Assert::AreEqual((uint32_t)expectedIds.size(), _batchCount);
+			Assert::AreEqual(4 * (uint32_t)expectedIds.size(), _vertexCount);
+
+			uint32_t i = 0;
+
+			for (uint32_t id : expectedIds)
+			{
+				const Batch& batch = _batches.items[i];
+				Assert::AreEqual(id, batch.GetTextureIndex());
+				Assert::AreEqual((int32_t)(4 * i), batch.GetStartVertex());
+
+				/* The vertices must have moved along with their batch. */
+				for (uint32_t j = 0; j < 4; ++j)
+				{
+					Assert::AreEqual(id, _vertices.items[batch.GetStartVertex() + j].GetColor());
+				}
+
+				++i;
+			}
+		}
+
+		BatchReorderer _reorderer{ 16, 64 };
+		Buffer<Batch> _batches{ 16 };
+		Buffer<Vertex> _vertices{ 64 };
+		std::array<uint64_t, 16> _stateKeys;
+		uint32_t _batchCount = 0;
+		uint32_t _vertexCount = 0;
+	};
+}
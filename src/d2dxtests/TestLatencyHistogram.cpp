@@ -0,0 +1,132 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "../d2dx/LatencyHistogram.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestLatencyHistogram)
+	{
+	public:
+		TEST_METHOD(SmallValuesHaveTheirOwnBuckets)
+		{
+			for (uint32_t value = 0; value < 2 * LatencyHistogram::SubBucketCount; ++value)
+			{
+				Assert::AreEqual(value, LatencyHistogram::GetBucketIndex(value));
+				Assert::AreEqual(value, LatencyHistogram::GetBucketHighestValue(value));
+			}
+		}
+
+		TEST_METHOD(BucketsAreContiguousAndBoundTheRelativeError)
+		{
+			uint32_t value = 0;
+
+			for (uint32_t bucketIndex = 0; bucketIndex < LatencyHistogram::BucketCount; ++bucketIndex)
+			{
+				const uint32_t highestValue = LatencyHistogram::GetBucketHighestValue(bucketIndex);
+
+				Assert::AreEqual(bucketIndex, LatencyHistogram::GetBucketIndex(value));
+				Assert::AreEqual(bucketIndex, LatencyHistogram::GetBucketIndex(highestValue));
+				Assert::IsTrue(highestValue - value <= value / LatencyHistogram::SubBucketCount);
+
+				value = highestValue + 1;
+			}
+
+			Assert::AreEqual(0U, value);
+		}
+
+		TEST_METHOD(EmptyHistogramReportsZero)
+		{
+			LatencyHistogram histogram;
+			Assert::AreEqual(0U, histogram.GetCount());
+			Assert::AreEqual(0U, histogram.GetMax());
+			Assert::AreEqual(0U, histogram.GetPercentile(50.0));
+		}
+
+		TEST_METHOD(PercentilesOfUniformValues)
+		{
+			LatencyHistogram histogram;
+
+			for (uint32_t value = 1; value <= 10000; ++value)
+			{
+				histogram.Record(value);
+			}
+
+			Assert::AreEqual(10000U, histogram.GetCount());
+			Assert::AreEqual(10000U, histogram.GetMax());
+
+			const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+
+			for (double percentile : percentiles)
+			{
+				const uint32_t expected = (uint32_t)(percentile * 100.0 + 0.5);
+				const uint32_t actual = histogram.GetPercentile(percentile);
+				Assert::IsTrue(actual >= expected);
+				Assert::IsTrue(actual - expected <= expected / LatencyHistogram::SubBucketCount);
+			}
+
+			Assert::AreEqual(10000U, histogram.GetPercentile(100.0));
+		}
+
+		TEST_METHOD(RareOutliersShowInTheTail)
+		{
+			LatencyHistogram histogram;
+
+			for (uint32_t i = 0; i < 990; ++i)
+			{
+				histogram.Record(16667);
+			}
+
+			for (uint32_t i = 0; i < 10; ++i)
+			{
+				histogram.Record(100000);
+			}
+
+			Assert::IsTrue(histogram.GetPercentile(50.0) < 17200);
+			Assert::IsTrue(histogram.GetPercentile(99.0) < 17200);
+			Assert::IsTrue(histogram.GetPercentile(99.9) >= 100000);
+			Assert::AreEqual(100000U, histogram.GetMax());
+		}
+
+		TEST_METHOD(AddAndReset)
+		{
+			LatencyHistogram a;
+			LatencyHistogram b;
+
+			a.Record(10);
+			b.Record(20);
+			b.Record(5000);
+			a.Add(b);
+
+			Assert::AreEqual(3U, a.GetCount());
+			Assert::AreEqual(5000U, a.GetMax());
+			Assert::AreEqual(20U, a.GetPercentile(50.0));
+
+			a.Reset();
+			Assert::AreEqual(0U, a.GetCount());
+			Assert::AreEqual(0U, a.GetMax());
+			Assert::AreEqual(0U, a.GetPercentile(99.0));
+		}
+	};
+}
@@ -0,0 +1,78 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "../d2dx/LiveMetrics.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestLiveMetrics)
+	{
+	public:
+		TEST_METHOD(ReadReturnsLastWrittenFrame)
+		{
+			LiveMetricsSection<LiveMetricsRenderFrame> section{};
+
+			LiveMetricsRenderFrame* frame = section.BeginWrite();
+			frame->presentCount = 1;
+			frame->drawCallCount = 100;
+			section.EndWrite();
+
+			frame = section.BeginWrite();
+			frame->presentCount = 2;
+			frame->drawCallCount = 200;
+			section.EndWrite();
+
+			LiveMetricsRenderFrame result;
+			Assert::IsTrue(section.TryRead(result));
+			Assert::AreEqual(2U, result.presentCount);
+			Assert::AreEqual(200U, result.drawCallCount);
+		}
+
+		TEST_METHOD(ReadFailsWhileWriting)
+		{
+			LiveMetricsSection<LiveMetricsRenderFrame> section{};
+			LiveMetricsRenderFrame result;
+
+			Assert::IsTrue(section.TryRead(result));
+
+			LiveMetricsRenderFrame* frame = section.BeginWrite();
+			frame->presentCount = 1;
+			Assert::IsFalse(section.TryRead(result));
+
+			section.EndWrite();
+			Assert::IsTrue(section.TryRead(result));
+			Assert::AreEqual(1U, result.presentCount);
+		}
+
+		TEST_METHOD(PageLayoutIsFixed)
+		{
+			/* The page is shared with monitoring tools built separately, see LiveMetricsVersion. */
+			Assert::AreEqual((size_t)0, offsetof(LiveMetricsPage, game) % 64);
+			Assert::AreEqual((size_t)0, offsetof(LiveMetricsPage, render) % 64);
+			Assert::AreEqual((size_t)24, offsetof(LiveMetricsGameFrame, textureHashMissBytes));
+			Assert::AreEqual((size_t)120, sizeof(LiveMetricsGameFrame));
+			Assert::AreEqual((size_t)20, sizeof(LiveMetricsRenderFrame));
+		}
+	};
+}
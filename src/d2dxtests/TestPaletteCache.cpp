@@ -0,0 +1,169 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../d2dx/PaletteCache.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestPaletteCache)
+	{
+	public:
+		TEST_METHOD(FillsSlotsInOrder)
+		{
+			PaletteCache paletteCache(4);
+			bool isNew = false;
+
+			for (uint64_t i = 0; i < 4; ++i)
+			{
+				Assert::AreEqual((int32_t)i, paletteCache.FindOrInsert(1000 + i, isNew));
+				Assert::IsTrue(isNew);
+			}
+
+			Assert::AreEqual(0U, paletteCache.GetHitCount());
+			Assert::AreEqual(4U, paletteCache.GetMissCount());
+			Assert::AreEqual(0U, paletteCache.GetEvictionCount());
+		}
+
+		TEST_METHOD(FindsCachedPalettes)
+		{
+			PaletteCache paletteCache(4);
+			bool isNew = false;
+
+			paletteCache.FindOrInsert(1, isNew);
+			paletteCache.FindOrInsert(2, isNew);
+
+			Assert::AreEqual(1, paletteCache.FindOrInsert(2, isNew));
+			Assert::IsFalse(isNew);
+			Assert::AreEqual(0, paletteCache.FindOrInsert(1, isNew));
+			Assert::IsFalse(isNew);
+
+			Assert::AreEqual(2U, paletteCache.GetHitCount());
+			Assert::AreEqual(2U, paletteCache.GetMissCount());
+		}
+
+		TEST_METHOD(EvictsLeastRecentlyUsed)
+		{
+			PaletteCache paletteCache(3);
+			bool isNew = false;
+
+			paletteCache.FindOrInsert(10, isNew);
+			paletteCache.FindOrInsert(20, isNew);
+			paletteCache.FindOrInsert(30, isNew);
+			paletteCache.FindOrInsert(10, isNew);
+
+			/* 20 is now the least recently used. */
+			Assert::AreEqual(1, paletteCache.FindOrInsert(40, isNew));
+			Assert::IsTrue(isNew);
+			Assert::AreEqual(1U, paletteCache.GetEvictionCount());
+
+			Assert::AreEqual(0, paletteCache.FindOrInsert(10, isNew));
+			Assert::IsFalse(isNew);
+			Assert::AreEqual(2, paletteCache.FindOrInsert(30, isNew));
+			Assert::IsFalse(isNew);
+
+			/* 40 is now the least recently used, and 20 comes back in its slot. */
+			Assert::AreEqual(1, paletteCache.FindOrInsert(20, isNew));
+			Assert::IsTrue(isNew);
+		}
+
+		TEST_METHOD(KeepsPaletteBoundFromPreviousFrame)
+		{
+			PaletteCache paletteCache(3);
+			bool isNew = false;
+
+			paletteCache.FindOrInsert(10, isNew);
+			paletteCache.FindOrInsert(20, isNew);
+			paletteCache.FindOrInsert(30, isNew);
+			paletteCache.FindOrInsert(10, isNew);
+
+			/* 10 stays bound, and is used by the new frame's batches without being downloaded again. */
+			paletteCache.OnNewFrame();
+
+			Assert::AreEqual(1, paletteCache.FindOrInsert(40, isNew));
+			Assert::IsTrue(isNew);
+			Assert::AreEqual(2, paletteCache.FindOrInsert(50, isNew));
+			Assert::IsTrue(isNew);
+
+			Assert::AreEqual(0, paletteCache.FindOrInsert(10, isNew));
+			Assert::IsFalse(isNew);
+		}
+
+		TEST_METHOD(NeverEvictsBoundPalette)
+		{
+			PaletteCache paletteCache(2);
+			bool isNew = false;
+
+			paletteCache.FindOrInsert(10, isNew);
+			paletteCache.FindOrInsert(20, isNew);
+
+			/* Both palettes are used by the frame, so one of them has to go, but not the bound one. */
+			for (uint64_t i = 3; i < 10; ++i)
+			{
+				const int32_t boundSlot = paletteCache.FindOrInsert(i * 10 - 10, isNew);
+				Assert::AreNotEqual(boundSlot, paletteCache.FindOrInsert(i * 10, isNew));
+				Assert::IsTrue(isNew);
+			}
+		}
+
+		TEST_METHOD(CountsEvictionsOfPalettesInUseByFrame)
+		{
+			PaletteCache paletteCache(2);
+			bool isNew = false;
+
+			paletteCache.FindOrInsert(10, isNew);
+			paletteCache.FindOrInsert(20, isNew);
+			paletteCache.OnNewFrame();
+
+			/* 10 has not been used by this frame. */
+			paletteCache.FindOrInsert(30, isNew);
+			Assert::AreEqual(1U, paletteCache.GetEvictionCount());
+			Assert::AreEqual(0U, paletteCache.GetInUseEvictionCount());
+
+			/* Both 20 and 30 have. */
+			paletteCache.FindOrInsert(40, isNew);
+			Assert::AreEqual(2U, paletteCache.GetEvictionCount());
+			Assert::AreEqual(1U, paletteCache.GetInUseEvictionCount());
+		}
+
+		TEST_METHOD(HandlesCollidingHashes)
+		{
+			/* All of these share the same home index in the hash table. */
+			PaletteCache paletteCache(4);
+			bool isNew = false;
+
+			for (uint64_t i = 1; i <= 64; ++i)
+			{
+				const int32_t slot = paletteCache.FindOrInsert(i << 40, isNew);
+				Assert::IsTrue(isNew);
+				Assert::IsTrue(slot >= 0 && slot < 4);
+
+				/* The three previous palettes must still be found after every eviction. */
+				for (uint64_t j = i > 3 ? i - 3 : 1; j <= i; ++j)
+				{
+					paletteCache.FindOrInsert(j << 40, isNew);
+					Assert::IsFalse(isNew);
+				}
+			}
+		}
+	};
+}
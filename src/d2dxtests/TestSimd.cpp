@@ -19,7 +19,12 @@
 #include "pch.h"
 #include <array>
 #include "CppUnitTest.h"
+#include "../d2dx/Types.h"
+#include "../d2dx/D2Types.h"
+#include "../d2dx/SimdAvx2.h"
+#include "../d2dx/SimdAvx512.h"
 #include "../d2dx/SimdSse2.h"
+#include "../d2dx/Vertex.h"
 
 using namespace Microsoft::WRL;
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
@@ -27,6 +32,189 @@ using namespace d2dx;
 
 namespace d2dxtests
 {
+	static uint32_t ExpandVertexArrayReference(
+		uint32_t mode,
+		uint32_t count,
+		const D2::Vertex* const* d2Vertices,
+		const Vertex& templateVertex,
+		uint32_t maskedConstantColor,
+		uint32_t iteratedColorMask,
+		int32_t stShift,
+		Vertex* vertices)
+	{
+		uint32_t vertexCount = 0;
+
+		/* Each quad covers triangles i and i + 1; a lone last triangle gets a degenerate second one. */
+		for (uint32_t i = 0; i < count - 2; i += 2)
+		{
+			const bool isFullQuad = (i + 3) < count;
+			uint32_t indices[4];
+
+			if (mode == GR_TRIANGLE_FAN)
+			{
+				indices[0] = 0;
+				indices[1] = i + 1;
+				indices[2] = i + 2;
+				indices[3] = isFullQuad ? i + 3 : i + 2;
+			}
+			else if (isFullQuad)
+			{
+				indices[0] = i + 1;
+				indices[1] = i;
+				indices[2] = i + 2;
+				indices[3] = i + 3;
+			}
+			else
+			{
+				indices[0] = i;
+				indices[1] = i + 1;
+				indices[2] = i + 2;
+				indices[3] = i + 2;
+			}
+
+			for (uint32_t j = 0; j < 4; ++j)
+			{
+				const D2::Vertex* d2Vertex = d2Vertices[indices[j]];
+				Vertex v = templateVertex;
+				v.SetPosition(d2Vertex->x, d2Vertex->y);
+				v.SetTexcoord((int32_t)d2Vertex->s >> stShift, (int32_t)d2Vertex->t >> stShift);
+				v.SetColor(maskedConstantColor | (d2Vertex->color & iteratedColorMask));
+				vertices[vertexCount++] = v;
+			}
+		}
+
+		return vertexCount;
+	}
+
+	static void AssertExpandVertexArrayMatchesReference(
+		ISimd* simd)
+	{
+		std::array<D2::Vertex, 64> d2Vertices;
+		std::array<const D2::Vertex*, 64> d2VertexPointers;
+
+		for (uint32_t i = 0; i < d2Vertices.size(); ++i)
+		{
+			d2Vertices[i].x = (float)(i * 37 % 800) - 0.5f;
+			d2Vertices[i].y = (float)(i * 53 % 600) + 0.25f;
+			d2Vertices[i].color = 0x12345678U * (i + 1);
+			d2Vertices[i].padding = 0xDEADBEEF;
+			d2Vertices[i].s = (float)(i * 61 % 512);
+			d2Vertices[i].t = (float)(i * 29 % 511) + 0.75f;
+			d2Vertices[i].padding2 = 0xDEADBEEF;
+
+			/* The game passes pointers in arbitrary order. */
+			d2VertexPointers[i] = &d2Vertices[(i * 7) % d2Vertices.size()];
+		}
+
+		const Vertex templateVertex{ 0, 0, 0, 0, 0, true, 123, 7 };
+
+		for (uint32_t mode : { (uint32_t)GR_TRIANGLE_STRIP, (uint32_t)GR_TRIANGLE_FAN })
+		{
+			for (uint32_t count = 3; count <= d2Vertices.size(); ++count)
+			{
+				for (int32_t stShift = 0; stShift <= 2; ++stShift)
+				{
+					std::array<Vertex, 2 * 64> expected;
+					std::array<Vertex, 2 * 64> actual;
+
+					const uint32_t expectedCount = ExpandVertexArrayReference(mode, count, d2VertexPointers.data(), templateVertex, 0xFF000000, 0x00FFFFFF, stShift, expected.data());
+					const uint32_t actualCount = simd->ExpandVertexArray(mode, count, d2VertexPointers.data(), templateVertex, 0xFF000000, 0x00FFFFFF, stShift, actual.data());
+
+					Assert::AreEqual(4 * ((count - 1) / 2), expectedCount);
+					Assert::AreEqual(expectedCount, actualCount);
+					Assert::AreEqual(0, memcmp(expected.data(), actual.data(), expectedCount * sizeof(Vertex)));
+				}
+			}
+		}
+	}
+
+	/* Runs the test on every backend that the CPU supports. */
+	template<typename TTest>
+	static void ForEachSupportedSimd(
+		TTest test)
+	{
+		test(std::make_shared<SimdSse2>().get());
+
+		if (IsAvx2Supported())
+		{
+			test(std::make_shared<SimdAvx2>().get());
+		}
+		else
+		{
+			Logger::WriteMessage("AVX2 is not supported on this CPU, skipping.");
+		}
+
+		if (IsAvx512Supported())
+		{
+			test(std::make_shared<SimdAvx512>().get());
+		}
+		else
+		{
+			Logger::WriteMessage("AVX-512 is not supported on this CPU, skipping.");
+		}
+	}
+
+	static void AssertIndexOfUInt32FindsEveryItem(
+		ISimd* simd)
+	{
+		alignas(64) std::array<uint32_t, 2048> items;
+
+		for (uint32_t i = 0; i < items.size(); ++i)
+		{
+			items[i] = i * 2654435761U + 1;
+		}
+
+		for (uint32_t itemsCount = 64; itemsCount <= items.size(); itemsCount *= 2)
+		{
+			for (uint32_t i = 0; i < itemsCount; ++i)
+			{
+				Assert::AreEqual((int32_t)i, simd->IndexOfUInt32(items.data(), itemsCount, items[i]));
+			}
+
+			/* Items past itemsCount must not be found, and neither must absent ones. */
+			if (itemsCount < items.size())
+			{
+				Assert::AreEqual(-1, simd->IndexOfUInt32(items.data(), itemsCount, items[itemsCount]));
+			}
+
+			Assert::AreEqual(-1, simd->IndexOfUInt32(items.data(), itemsCount, 0));
+		}
+	}
+
+	static void AssertIndexOfUInt64FindsEveryItem(
+		ISimd* simd)
+	{
+		alignas(64) std::array<uint64_t, 2048> items;
+
+		/* All items have the same low dword, so that both halves must be compared. */
+		for (uint64_t i = 0; i < items.size(); ++i)
+		{
+			items[i] = (((i + 1) * 2654435761ull) << 32) | 0x12345678;
+		}
+
+		for (uint32_t itemsCount = 32; itemsCount <= items.size(); itemsCount *= 2)
+		{
+			for (uint32_t i = 0; i < itemsCount; ++i)
+			{
+				Assert::AreEqual((int32_t)i, simd->IndexOfUInt64(items.data(), itemsCount, items[i]));
+			}
+
+			if (itemsCount < items.size())
+			{
+				Assert::AreEqual(-1, simd->IndexOfUInt64(items.data(), itemsCount, items[itemsCount]));
+			}
+
+			Assert::AreEqual(-1, simd->IndexOfUInt64(items.data(), itemsCount, 0x12345678));
+			Assert::AreEqual(-1, simd->IndexOfUInt64(items.data(), itemsCount, items[0] ^ 1));
+		}
+
+		/* Only 32-byte alignment is guaranteed for 64-bit items. */
+		for (uint32_t i = 0; i < 1024; ++i)
+		{
+			Assert::AreEqual((int32_t)i, simd->IndexOfUInt64(items.data() + 4, 1024, items[i + 4]));
+		}
+	}
+
 	TEST_CLASS(TestSimd)
 	{
 	public:
@@ -51,5 +239,20 @@ namespace d2dxtests
 			Assert::AreEqual(1009, simd->IndexOfUInt64(items.data(), items.size(), 14));
 			Assert::AreEqual(114, simd->IndexOfUInt64(items.data(), items.size(), 909));
 		}
+
+		TEST_METHOD(IndexOfUInt32AllBackends)
+		{
+			ForEachSupportedSimd(AssertIndexOfUInt32FindsEveryItem);
+		}
+
+		TEST_METHOD(IndexOfUInt64AllBackends)
+		{
+			ForEachSupportedSimd(AssertIndexOfUInt64FindsEveryItem);
+		}
+
+		TEST_METHOD(ExpandVertexArrayAllBackends)
+		{
+			ForEachSupportedSimd(AssertExpandVertexArrayMatchesReference);
+		}
 	};
 }
@@ -0,0 +1,93 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../d2dx/Batch.h"
+#include "../d2dx/SurfaceIdTracker.h"
+#include "../d2dx/Vertex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestSurfaceIdTracker)
+	{
+	public:
+		TEST_METHOD(VertexBoundsMatchTruncatedPositions)
+		{
+			Vertex vertices[9];
+
+			for (uint32_t vertexCount = 1; vertexCount <= ARRAYSIZE(vertices); ++vertexCount)
+			{
+				for (uint32_t seed = 0; seed < 1000; ++seed)
+				{
+					int32_t expectedMinX = INT_MAX;
+					int32_t expectedMinY = INT_MAX;
+					int32_t expectedMaxX = INT_MIN;
+					int32_t expectedMaxY = INT_MIN;
+
+					for (uint32_t i = 0; i < vertexCount; ++i)
+					{
+						/* Eighths, so that the compact vertex stores them exactly. */
+						const uint32_t r = (seed * 7919 + i * 104729) * 2654435761U;
+						const float x = (int32_t)(r % 12000) / 8.0f - 500.0f;
+						const float y = (int32_t)((r >> 16) % 8000) / 8.0f - 300.0f;
+						vertices[i] = Vertex{ x, y, 0, 0, 0, false, 0, 0 };
+
+						expectedMinX = min(expectedMinX, (int32_t)vertices[i].GetX());
+						expectedMinY = min(expectedMinY, (int32_t)vertices[i].GetY());
+						expectedMaxX = max(expectedMaxX, (int32_t)vertices[i].GetX());
+						expectedMaxY = max(expectedMaxY, (int32_t)vertices[i].GetY());
+					}
+
+					int32_t minx, miny, maxx, maxy;
+					SurfaceIdTracker::GetVertexBounds(vertices, vertexCount, minx, miny, maxx, maxy);
+
+					Assert::AreEqual(expectedMinX, minx);
+					Assert::AreEqual(expectedMinY, miny);
+					Assert::AreEqual(expectedMaxX, maxx);
+					Assert::AreEqual(expectedMaxY, maxy);
+				}
+			}
+		}
+
+		TEST_METHOD(OutsideOfGameIsUserInterface)
+		{
+			SurfaceIdTracker surfaceIdTracker{ nullptr };
+			surfaceIdTracker.OnNewFrame();
+
+			const Vertex vertices[4] =
+			{
+				Vertex{ 10, 10, 0, 0, 0, true, 0, 0 },
+				Vertex{ 42, 10, 0, 0, 0, true, 0, 0 },
+				Vertex{ 42, 42, 0, 0, 0, true, 0, 0 },
+				Vertex{ 10, 42, 0, 0, 0, true, 0, 0 },
+			};
+
+			Batch batch;
+			batch.SetIsChromaKeyEnabled(true);
+			batch.SetVertexCount(4);
+
+			surfaceIdTracker.UpdateBatchSurfaceId(batch, MajorGameState::Menus, { 640, 480 }, vertices, 4);
+
+			Assert::AreEqual(D2DX_SURFACE_ID_USER_INTERFACE, batch.GetSurfaceId());
+		}
+	};
+}
@@ -18,9 +18,11 @@
 */
 #include "pch.h"
 #include <array>
+#include <vector>
 #include "CppUnitTest.h"
 
 #include "../d2dx/Batch.h"
+#include "../d2dx/ShelfPackedAtlas.h"
 #include "../d2dx/SimdSse2.h"
 #include "../d2dx/Types.h"
 #include "../d2dx/TextureCache.h"
@@ -49,8 +51,13 @@ namespace d2dxtests
 		TEST_METHOD(FindNonExistentTexture)
 		{
 			auto simd = std::make_shared<SimdSse2>();
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(256, 128);
+
 			auto textureCache = std::make_unique<TextureCache>(256, 128, 2048, 512, (ID3D11Device*)nullptr, simd);
-			auto tcl = textureCache->FindTexture(0x12345678, -1);
+			auto tcl = textureCache->FindTexture(0x12345678, batch, -1);
 			Assert::AreEqual((int16_t)-1, tcl._textureAtlas);
 			Assert::AreEqual((int16_t)-1, tcl._textureIndex);
 		}
@@ -58,7 +65,6 @@ namespace d2dxtests
 		TEST_METHOD(InsertAndFindTextures)
 		{
 			auto simd = std::make_shared<SimdSse2>();
-			auto tmuData = std::make_unique<std::array<uint32_t, 2 * 256 * 128>>();
 
 			Batch batch;
 			batch.SetTextureStartAddress(0);
@@ -69,13 +75,13 @@ namespace d2dxtests
 			for (uint64_t i = 0; i < 64; ++i)
 			{
 				uint64_t hash = (0xFFull << 24) | (i << 16) | (i << 8) | i;
-				textureCache->InsertTexture(hash, batch, (const uint8_t*)tmuData->data(), (uint32_t)tmuData->size());
+				textureCache->InsertTexture(hash, batch);
 			}
 
 			for (uint64_t i = 0; i < 64; ++i)
 			{
 				uint64_t hash = (0xFFull << 24) | (i << 16) | (i << 8) | i;
-				auto tcl = textureCache->FindTexture(hash, -1);
+				auto tcl = textureCache->FindTexture(hash, batch, -1);
 				Assert::AreEqual((int16_t)0, tcl._textureAtlas);
 				Assert::AreEqual((int16_t)i, tcl._textureIndex);
 			}
@@ -84,7 +90,6 @@ namespace d2dxtests
 		TEST_METHOD(FirstInsertedTextureIsReplaced)
 		{
 			auto simd = std::make_shared<SimdSse2>();
-			auto tmuData = std::make_unique<std::array<uint32_t, 2 * 256 * 128>>();
 
 			Batch batch;
 			batch.SetTextureStartAddress(0);
@@ -95,7 +100,7 @@ namespace d2dxtests
 			for (uint64_t i = 0; i < 65; ++i)
 			{
 				uint64_t hash = (0xFFull << 24) | (i << 16) | (i << 8) | i;
-				auto tcl = textureCache->InsertTexture(hash, batch, (const uint8_t*)tmuData->data(), (uint32_t)tmuData->size());
+				auto tcl = textureCache->InsertTexture(hash, batch);
 
 				if (i == 64)
 				{
@@ -112,7 +117,7 @@ namespace d2dxtests
 			for (uint64_t i = 0; i < 64; ++i)
 			{
 				uint64_t hash = (0xFFull << 24) | (i << 16) | (i << 8) | i;
-				auto tcl = textureCache->FindTexture(hash, -1);
+				auto tcl = textureCache->FindTexture(hash, batch, -1);
 				
 				int16_t expectedTextureAtlas = 0;
 				int16_t expectedTextureIndex = i;
@@ -135,7 +140,6 @@ namespace d2dxtests
 		TEST_METHOD(SecondInsertedTextureIsReplacedIfFirstOneWasUsedInFrame)
 		{
 			auto simd = std::make_shared<SimdSse2>();
-			auto tmuData = std::make_unique<std::array<uint32_t, 2 * 256 * 128>>();
 
 			Batch batch;
 			batch.SetTextureStartAddress(0);
@@ -151,12 +155,12 @@ namespace d2dxtests
 				{
 					// Simulate new frame and use of texture in slot 0
 					textureCache->OnNewFrame();
-					auto tcl = textureCache->FindTexture(0xFF000000, -1);
+					auto tcl = textureCache->FindTexture(0xFF000000, batch, -1);
 					Assert::AreEqual((int16_t)0, tcl._textureAtlas);
 					Assert::AreEqual((int16_t)0, tcl._textureIndex);
 				}
 
-				auto tcl = textureCache->InsertTexture(hash, batch, (const uint8_t*)tmuData->data(), (uint32_t)tmuData->size());
+				auto tcl = textureCache->InsertTexture(hash, batch);
 
 				if (i == 64)
 				{
@@ -173,7 +177,7 @@ namespace d2dxtests
 			for (uint64_t i = 0; i < 64; ++i)
 			{
 				uint64_t hash = (0xFFull << 24) | (i << 16) | (i << 8) | i;
-				auto tcl = textureCache->FindTexture(hash, -1);
+				auto tcl = textureCache->FindTexture(hash, batch, -1);
 
 				int16_t expectedTextureAtlas = 0;
 				int16_t expectedTextureIndex = i;
@@ -192,5 +196,282 @@ namespace d2dxtests
 				Assert::AreEqual(expectedTextureIndex, tcl._textureIndex);
 			}
 		}
+
+		TEST_METHOD(FindTexturesAfterManyEvictions)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(256, 128);
+
+			auto textureCache = std::make_unique<TextureCache>(256, 128, 64, 512, (ID3D11Device*)nullptr, simd);
+
+			std::array<uint64_t, 64> slotHashes = { };
+
+			for (uint64_t i = 0; i < 4096; ++i)
+			{
+				if ((i % 16) == 0)
+				{
+					textureCache->OnNewFrame();
+				}
+
+				/* Hashes that collide in the low bits, so that probe sequences get long. */
+				uint64_t hash = ((i * 0x9E3779B97F4A7C15ull) & 0xFFFFFFFF00000000ull) | (i & 3) | 0x100;
+				auto tcl = textureCache->InsertTexture(hash, batch);
+				Assert::AreEqual((int16_t)0, tcl._textureAtlas);
+
+				const uint64_t evictedHash = slotHashes[tcl._textureIndex];
+				slotHashes[tcl._textureIndex] = hash;
+
+				if (evictedHash)
+				{
+					Assert::AreEqual((int16_t)-1, textureCache->FindTexture(evictedHash, batch, -1)._textureIndex);
+				}
+
+				Assert::AreEqual(tcl._textureIndex, textureCache->FindTexture(hash, batch, -1)._textureIndex);
+
+				if ((i % 256) == 255)
+				{
+					for (int16_t j = 0; j < 64; ++j)
+					{
+						Assert::AreEqual(j, textureCache->FindTexture(slotHashes[j], batch, -1)._textureIndex);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(LocationsAreOffsetByFirstAtlasIndex)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(128, 128);
+
+			auto textureCache = std::make_unique<TextureCache>(128, 128, 1024, 512, (ID3D11Device*)nullptr, simd,
+				TextureCachePolicyType::BitPmru, 3);
+			Assert::AreEqual(2U, textureCache->GetAtlasCount());
+
+			for (uint64_t i = 0; i < 1024; ++i)
+			{
+				auto tcl = textureCache->InsertTexture(i + 1, batch);
+				Assert::AreEqual((int16_t)(3 + (i >> 9)), tcl._textureAtlas);
+				Assert::AreEqual((int16_t)(i & 511), tcl._textureIndex);
+			}
+
+			const uint32_t capacities[ShelfPackedAtlas::TextureSizeCount] = { 512, 1024, 2048, 2048 };
+			auto sharedAtlas = std::make_shared<ShelfPackedAtlas>(capacities, (ID3D11Device*)nullptr);
+
+			batch.SetTextureSize(32, 32);
+
+			auto sharedTextureCache = std::make_unique<TextureCache>(32, 2048, sharedAtlas, simd,
+				TextureCachePolicyType::BitPmru, 5);
+			Assert::AreEqual(0U, sharedTextureCache->GetAtlasCount());
+			Assert::AreEqual((int16_t)5, sharedTextureCache->InsertTexture(1, batch)._textureAtlas);
+		}
+
+		TEST_METHOD(PinnedTexturesAreNotEvictedByOtherTextures)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(256, 128);
+
+			Batch uiBatch = batch;
+			uiBatch.SetTextureCategory(TextureCategory::UserInterface);
+
+			auto textureCache = std::make_unique<TextureCache>(256, 128, 256, 512, (ID3D11Device*)nullptr, simd,
+				TextureCachePolicyType::BitPmru, 0, 64);
+			Assert::AreEqual(64U, textureCache->GetPinnedCapacity());
+
+			for (uint64_t i = 0; i < 64; ++i)
+			{
+				auto tcl = textureCache->InsertTexture(0x1000 + i, uiBatch);
+				Assert::AreEqual((int16_t)(192 + i), tcl._textureIndex);
+			}
+
+			/* Churn through many more textures than the unpinned part of the cache can hold. */
+			for (uint64_t i = 0; i < 4096; ++i)
+			{
+				if ((i % 64) == 0)
+				{
+					textureCache->OnNewFrame();
+				}
+
+				auto tcl = textureCache->InsertTexture(0x100000 + i, batch);
+				Assert::IsTrue(tcl._textureIndex >= 0 && tcl._textureIndex < 192);
+			}
+
+			Assert::AreEqual(0U, textureCache->GetPinnedEvictionCount());
+			Assert::AreEqual(64U, textureCache->GetPinnedUsedCount());
+			Assert::AreEqual(256U, textureCache->GetUsedCount());
+
+			for (uint64_t i = 0; i < 64; ++i)
+			{
+				Assert::AreEqual((int16_t)(192 + i), textureCache->FindTexture(0x1000 + i, uiBatch, -1)._textureIndex);
+
+				/* Pinned textures are only found by UI batches. */
+				Assert::AreEqual((int16_t)-1, textureCache->FindTexture(0x1000 + i, batch, -1)._textureIndex);
+			}
+
+			/* UI textures evict each other once the pinned partition is full. */
+			textureCache->OnNewFrame();
+			auto tcl = textureCache->InsertTexture(0x2000, uiBatch);
+			Assert::IsTrue(tcl._textureIndex >= 192);
+			Assert::AreEqual(1U, textureCache->GetPinnedEvictionCount());
+			Assert::AreEqual(1U, textureCache->GetEvictionCount());
+		}
+
+		TEST_METHOD(StatisticsCountLookupsAndInserts)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(256, 128);
+
+			auto textureCache = std::make_unique<TextureCache>(256, 128, 64, 512, (ID3D11Device*)nullptr, simd);
+
+			for (uint64_t i = 0; i < 80; ++i)
+			{
+				if (textureCache->FindTexture(i + 1, batch, -1)._textureIndex < 0)
+				{
+					textureCache->InsertTexture(i + 1, batch);
+				}
+			}
+
+			textureCache->OnNewFrame();
+
+			const int16_t index = textureCache->FindTexture(80, batch, -1)._textureIndex;
+			Assert::AreEqual(index, textureCache->FindTexture(80, batch, index)._textureIndex);
+			Assert::AreEqual((int16_t)-1, textureCache->FindTexture(1, batch, -1)._textureIndex);
+
+			const TextureCacheStatistics statistics = textureCache->GetStatistics();
+			Assert::AreEqual(83ULL, statistics.lookupCount);
+			Assert::AreEqual(1ULL, statistics.lastIndexHitCount);
+			Assert::AreEqual(1ULL, statistics.scanHitCount);
+			Assert::AreEqual(81ULL, statistics.missCount);
+			Assert::AreEqual(80ULL, statistics.insertCount);
+			Assert::AreEqual(16ULL, statistics.evictionCount);
+			Assert::AreEqual(80ULL * 256 * 128, statistics.uploadedBytes);
+			Assert::AreEqual(1U, statistics.frameCount);
+			Assert::AreEqual(64U, statistics.workingSetSize);
+			Assert::AreEqual(64U, statistics.peakWorkingSetSize);
+			Assert::AreEqual(64U, statistics.usedCount);
+			Assert::AreEqual(64U, statistics.capacity);
+		}
+
+		TEST_METHOD(ContainsIsNotCountedAsUse)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(256, 128);
+
+			auto textureCache = std::make_unique<TextureCache>(256, 128, 64, 512, (ID3D11Device*)nullptr, simd);
+			textureCache->InsertTexture(1, batch);
+			textureCache->OnNewFrame();
+
+			Assert::IsTrue(textureCache->Contains(1));
+			Assert::IsFalse(textureCache->Contains(2));
+
+			const TextureCacheStatistics statistics = textureCache->GetStatistics();
+			Assert::AreEqual(0ULL, statistics.lookupCount);
+			Assert::AreEqual(0U, textureCache->GetWorkingSetSize());
+		}
+
+		TEST_METHOD(PreloadOnlyFillsFreeSlotsAndIsNotCountedAsUse)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			Batch batch;
+			batch.SetTextureStartAddress(0);
+			batch.SetTextureSize(256, 128);
+
+			auto textureCache = std::make_unique<TextureCache>(256, 128, 64, 512, (ID3D11Device*)nullptr, simd);
+			textureCache->InsertTexture(1, batch);
+			textureCache->OnNewFrame();
+
+			for (uint64_t i = 2; i <= 64; ++i)
+			{
+				Assert::IsTrue(textureCache->PreloadTexture(i, batch)._textureAtlas >= 0);
+			}
+
+			/* The cache is full, and preloading never evicts. */
+			Assert::AreEqual((int16_t)-1, textureCache->PreloadTexture(65, batch)._textureAtlas);
+			Assert::IsTrue(textureCache->Contains(1));
+			Assert::IsFalse(textureCache->Contains(65));
+
+			TextureCacheStatistics statistics = textureCache->GetStatistics();
+			Assert::AreEqual(1ULL, statistics.insertCount);
+			Assert::AreEqual(256ULL * 128, statistics.uploadedBytes);
+			Assert::AreEqual(0ULL, statistics.evictionCount);
+			Assert::AreEqual(64U, statistics.usedCount);
+			Assert::AreEqual(0U, textureCache->GetWorkingSetSize());
+
+			/* Preloaded textures are found like any other, which counts as a use. */
+			Assert::IsTrue(textureCache->FindTexture(64, batch, -1)._textureIndex >= 0);
+			Assert::AreEqual(1U, textureCache->GetWorkingSetSize());
+		}
+
+		TEST_METHOD(PinnedCapacityIsAlignedAndBounded)
+		{
+			Assert::AreEqual(0U, TextureCache::GetPinnedCapacity(1024, 0));
+			Assert::AreEqual(64U, TextureCache::GetPinnedCapacity(512, 10));
+			Assert::AreEqual(128U, TextureCache::GetPinnedCapacity(1024, 10));
+			Assert::AreEqual(256U, TextureCache::GetPinnedCapacity(2048, 10));
+			Assert::AreEqual(128U, TextureCache::GetPinnedCapacity(256, 50));
+			Assert::AreEqual(64U, TextureCache::GetPinnedCapacity(128, 100));
+		}
+
+		TEST_METHOD(SharedAtlasTexturesDoNotOverlap)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			const uint32_t capacities[ShelfPackedAtlas::TextureSizeCount] = { 512, 1024, 2048, 2048 };
+			auto sharedAtlas = std::make_shared<ShelfPackedAtlas>(capacities, (ID3D11Device*)nullptr);
+
+			/* 128 + 32 + 4 + 1/2 slices, packed without gaps. */
+			Assert::AreEqual(165U, sharedAtlas->GetSliceCount());
+
+			/* One flag per 8x8 block of each slice. */
+			std::vector<bool> isBlockUsed(sharedAtlas->GetSliceCount() * 32 * 32);
+
+			for (int32_t sizeIndex = 0; sizeIndex < ShelfPackedAtlas::TextureSizeCount; ++sizeIndex)
+			{
+				const int32_t size = 8 << sizeIndex;
+
+				Batch batch;
+				batch.SetTextureStartAddress(0);
+				batch.SetTextureSize(size, size);
+
+				auto textureCache = std::make_unique<TextureCache>(size, capacities[sizeIndex], sharedAtlas, simd);
+				Assert::AreEqual(0U, textureCache->GetAtlasCount());
+
+				for (uint64_t i = 0; i < capacities[sizeIndex]; ++i)
+				{
+					auto tcl = textureCache->InsertTexture(((uint64_t)size << 32) | (i + 1), batch);
+					Assert::AreEqual((int16_t)0, tcl._textureAtlas);
+					Assert::IsTrue(tcl._textureIndex >= 0 && tcl._textureIndex < (int32_t)sharedAtlas->GetSliceCount());
+					Assert::IsTrue(tcl._originS >= 0 && (tcl._originS + size) <= ShelfPackedAtlas::SliceSize);
+					Assert::IsTrue(tcl._originT >= 0 && (tcl._originT + size) <= ShelfPackedAtlas::SliceSize);
+					Assert::AreEqual(0, tcl._originS % size);
+					Assert::AreEqual(0, tcl._originT % size);
+
+					for (int32_t y = tcl._originT / 8; y < (tcl._originT + size) / 8; ++y)
+					{
+						for (int32_t x = tcl._originS / 8; x < (tcl._originS + size) / 8; ++x)
+						{
+							const uint32_t block = tcl._textureIndex * 32 * 32 + y * 32 + x;
+							Assert::IsFalse(isBlockUsed[block]);
+							isBlockUsed[block] = true;
+						}
+					}
+				}
+			}
+		}
 	};
 }
@@ -0,0 +1,164 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "../d2dx/TextureCacheBalancer.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureCacheBalancer)
+	{
+	public:
+		TEST_METHOD(StartsWithDefaultCapacities)
+		{
+			TextureCacheBalancer balancer{ 0 };
+			Assert::AreEqual(TextureCacheBalancer::GetMemoryFootprint(TextureCacheBalancer::DefaultCapacities), balancer.GetBudget());
+
+			for (int32_t i = 0; i < TextureCacheBalancer::SizeClassCount; ++i)
+			{
+				Assert::AreEqual(TextureCacheBalancer::DefaultCapacities[i], balancer.GetCapacities()[i]);
+			}
+		}
+
+		TEST_METHOD(NoChangeWithoutEvictions)
+		{
+			TextureCacheBalancer balancer{ 0 };
+			const uint32_t workingSetSizes[] = { 10, 10, 10, 10, 10, 10, 10 };
+			const uint32_t evictionCounts[] = { 0, 0, 0, 0, 0, 0, 0 };
+
+			for (uint32_t frame = 0; frame < 4 * TextureCacheBalancer::FramesPerRebalance; ++frame)
+			{
+				Assert::IsFalse(balancer.OnFrame(workingSetSizes, evictionCounts));
+			}
+
+			for (int32_t i = 0; i < TextureCacheBalancer::SizeClassCount; ++i)
+			{
+				Assert::AreEqual(TextureCacheBalancer::DefaultCapacities[i], balancer.GetCapacities()[i]);
+			}
+		}
+
+		TEST_METHOD(NoChangeBeforeEndOfPeriod)
+		{
+			TextureCacheBalancer balancer{ 0 };
+			const uint32_t workingSetSizes[] = { 10, 10, 10, 10, 1024, 10, 10 };
+			const uint32_t evictionCounts[] = { 0, 0, 0, 0, 100, 0, 0 };
+
+			for (uint32_t frame = 0; frame < TextureCacheBalancer::FramesPerRebalance - 1; ++frame)
+			{
+				Assert::IsFalse(balancer.OnFrame(workingSetSizes, evictionCounts));
+			}
+
+			Assert::IsTrue(balancer.OnFrame(workingSetSizes, evictionCounts));
+		}
+
+		TEST_METHOD(HotCacheGrowsAtExpenseOfColdCache)
+		{
+			TextureCacheBalancer balancer{ 0 };
+			const uint32_t workingSetSizes[] = { 10, 10, 10, 10, 1024, 10, 10 };
+			const uint32_t evictionCounts[] = { 0, 0, 0, 0, 100, 0, 0 };
+
+			for (uint32_t frame = 0; frame < TextureCacheBalancer::FramesPerRebalance; ++frame)
+			{
+				balancer.OnFrame(workingSetSizes, evictionCounts);
+			}
+
+			/* The 128x128 cache grows by half, paid for by the 256x128 cache, which is the smallest single donor. */
+			const uint32_t* capacities = balancer.GetCapacities();
+			Assert::AreEqual(1536U, capacities[(int32_t)TextureCacheSizeClass::Size128]);
+			Assert::AreEqual(768U, capacities[(int32_t)TextureCacheSizeClass::Size256x128]);
+			Assert::AreEqual(512U, capacities[(int32_t)TextureCacheSizeClass::Size256]);
+			Assert::AreEqual(balancer.GetBudget(), TextureCacheBalancer::GetMemoryFootprint(capacities));
+		}
+
+		TEST_METHOD(SpareBudgetIsUsedBeforeDonors)
+		{
+			TextureCacheBalancer balancer{ TextureCacheBalancer::GetMemoryFootprint(TextureCacheBalancer::DefaultCapacities) + 8 * 1024 * 1024 };
+			const uint32_t workingSetSizes[] = { 10, 10, 10, 10, 1024, 10, 10 };
+			const uint32_t evictionCounts[] = { 0, 0, 0, 0, 100, 0, 0 };
+
+			for (uint32_t frame = 0; frame < TextureCacheBalancer::FramesPerRebalance; ++frame)
+			{
+				balancer.OnFrame(workingSetSizes, evictionCounts);
+			}
+
+			const uint32_t* capacities = balancer.GetCapacities();
+			Assert::AreEqual(1536U, capacities[(int32_t)TextureCacheSizeClass::Size128]);
+			Assert::AreEqual(1024U, capacities[(int32_t)TextureCacheSizeClass::Size256x128]);
+			Assert::AreEqual(balancer.GetBudget(), TextureCacheBalancer::GetMemoryFootprint(capacities));
+		}
+
+		TEST_METHOD(DonorsKeepTheirWorkingSet)
+		{
+			TextureCacheBalancer balancer{ 0 };
+			const uint32_t workingSetSizes[] = { 512, 1024, 2048, 2048, 1024, 512, 1024 };
+			const uint32_t evictionCounts[] = { 0, 0, 0, 0, 100, 0, 0 };
+
+			for (uint32_t frame = 0; frame < TextureCacheBalancer::FramesPerRebalance; ++frame)
+			{
+				Assert::IsFalse(balancer.OnFrame(workingSetSizes, evictionCounts));
+			}
+
+			for (int32_t i = 0; i < TextureCacheBalancer::SizeClassCount; ++i)
+			{
+				Assert::AreEqual(TextureCacheBalancer::DefaultCapacities[i], balancer.GetCapacities()[i]);
+			}
+		}
+
+		TEST_METHOD(LimitsHoldUnderSustainedPressure)
+		{
+			TextureCacheBalancer balancer{ 1024 * 1024 * 1024 };
+			const uint32_t workingSetSizes[] = { 4096, 4096, 4096, 4096, 4096, 4096, 4096 };
+			const uint32_t evictionCounts[] = { 100, 100, 100, 100, 100, 100, 100 };
+
+			for (uint32_t frame = 0; frame < 64 * TextureCacheBalancer::FramesPerRebalance; ++frame)
+			{
+				balancer.OnFrame(workingSetSizes, evictionCounts);
+
+				const uint32_t* capacities = balancer.GetCapacities();
+				Assert::IsTrue(TextureCacheBalancer::GetMemoryFootprint(capacities) <= balancer.GetBudget());
+
+				uint32_t atlasCount = 1;
+				uint32_t sharedSize = 0;
+
+				for (int32_t i = 0; i < TextureCacheBalancer::SizeClassCount; ++i)
+				{
+					const Size textureSize = TextureCacheBalancer::GetTextureSize((TextureCacheSizeClass)i);
+					Assert::IsTrue(capacities[i] <= TextureCacheBalancer::MaxCapacity);
+					Assert::AreEqual(0U, capacities[i] % TextureCacheBalancer::CapacityGranularity);
+
+					if (textureSize.width <= 64)
+					{
+						sharedSize += capacities[i] * textureSize.width * textureSize.height;
+					}
+					else
+					{
+						atlasCount += (capacities[i] + D2DX_MAX_TEXTURES_PER_ATLAS - 1) / D2DX_MAX_TEXTURES_PER_ATLAS;
+					}
+				}
+
+				Assert::IsTrue(atlasCount <= D2DX_MAX_TEXTURE_ATLASES);
+				Assert::IsTrue(sharedSize <= D2DX_MAX_TEXTURES_PER_ATLAS * 256 * 256);
+			}
+		}
+	};
+}
@@ -0,0 +1,152 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include "CppUnitTest.h"
+
+#include "../d2dx/Buffer.h"
+#include "../d2dx/SimdSse2.h"
+#include "../d2dx/TextureCachePolicyFactory.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestTextureCachePolicy)
+	{
+	public:
+		TEST_METHOD(InsertAndFindTextures)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			for (int32_t policyType = 0; policyType < (int32_t)TextureCachePolicyType::Count; ++policyType)
+			{
+				auto policy = TextureCachePolicyFactory::Create((TextureCachePolicyType)policyType, 128, simd);
+				int32_t slots[128];
+
+				for (uint64_t i = 0; i < 128; ++i)
+				{
+					bool evicted = true;
+					slots[i] = policy->Insert(0x1000 + i, evicted);
+					Assert::IsFalse(evicted);
+					Assert::IsTrue(slots[i] >= 0 && slots[i] < 128);
+				}
+
+				Assert::AreEqual(128U, policy->GetUsedCount());
+
+				for (uint64_t i = 0; i < 128; ++i)
+				{
+					Assert::IsTrue(policy->Contains(0x1000 + i));
+					Assert::AreEqual(slots[i], policy->Find(0x1000 + i, -1));
+					Assert::AreEqual(slots[i], policy->Find(0x1000 + i, slots[i]));
+				}
+
+				Assert::IsFalse(policy->Contains(0x1000 + 128));
+				Assert::AreEqual(-1, policy->Find(0x1000 + 128, -1));
+			}
+		}
+
+		TEST_METHOD(ReplacedTexturesAreNotFound)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			for (int32_t policyType = 0; policyType < (int32_t)TextureCachePolicyType::Count; ++policyType)
+			{
+				auto policy = TextureCachePolicyFactory::Create((TextureCachePolicyType)policyType, 64, simd);
+				Buffer<uint64_t> slotKeys{ 64, true };
+				uint32_t state = 12345;
+
+				for (uint32_t i = 0; i < 20000; ++i)
+				{
+					if (!(i & 15))
+					{
+						policy->OnNewFrame();
+					}
+
+					/* Keys from a skewed distribution of 256, so that there are both hits and misses. */
+					state = state * 1664525 + 1013904223;
+					const uint64_t contentKey = 1 + ((state >> 8) & ((state >> 24) < 128 ? 31 : 255));
+
+					int32_t expectedSlot = -1;
+
+					for (int32_t slot = 0; slot < 64; ++slot)
+					{
+						if (slotKeys.items[slot] == contentKey)
+						{
+							expectedSlot = slot;
+						}
+					}
+
+					const int32_t foundSlot = policy->Find(contentKey, -1);
+					Assert::AreEqual(expectedSlot, foundSlot);
+
+					if (foundSlot < 0)
+					{
+						bool evicted = false;
+						const int32_t slot = policy->Insert(contentKey, evicted);
+						Assert::IsTrue(slot >= 0 && slot < 64);
+						Assert::AreEqual(slotKeys.items[slot] != 0, evicted);
+						slotKeys.items[slot] = contentKey;
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(TexturesUsedInFrameAreNotReplaced)
+		{
+			auto simd = std::make_shared<SimdSse2>();
+
+			for (int32_t policyType = 0; policyType < (int32_t)TextureCachePolicyType::Count; ++policyType)
+			{
+				auto policy = TextureCachePolicyFactory::Create((TextureCachePolicyType)policyType, 64, simd);
+
+				for (uint64_t i = 0; i < 64; ++i)
+				{
+					bool evicted = false;
+					policy->Insert(0x1000 + i, evicted);
+				}
+
+				policy->OnNewFrame();
+
+				for (uint64_t i = 0; i < 32; ++i)
+				{
+					Assert::IsTrue(policy->Find(0x1000 + i, -1) >= 0);
+				}
+
+				for (uint64_t i = 0; i < 32; ++i)
+				{
+					bool evicted = false;
+					policy->Insert(0x2000 + i, evicted);
+					Assert::IsTrue(evicted);
+				}
+
+				for (uint64_t i = 0; i < 32; ++i)
+				{
+					Assert::IsTrue(policy->Find(0x1000 + i, -1) >= 0);
+					Assert::IsTrue(policy->Find(0x2000 + i, -1) >= 0);
+				}
+
+				for (uint64_t i = 32; i < 64; ++i)
+				{
+					Assert::AreEqual(-1, policy->Find(0x1000 + i, -1));
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,88 @@
+/*
+	This file is part of D2DX.
+
+	Copyright (C) 2021  Bolrog
+
+	D2DX is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	D2DX is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with D2DX.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pch.h"
+#include <cmath>
+#include "CppUnitTest.h"
+#include "../d2dx/Types.h"
+#include "../d2dx/Vertex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace d2dx;
+
+namespace d2dxtests
+{
+	TEST_CLASS(TestVertex)
+	{
+	public:
+		TEST_METHOD(PackPositionRoundTripsIntegers)
+		{
+			for (int32_t i = -4095; i < 4096; ++i)
+			{
+				Assert::AreEqual((float)i, Vertex::UnpackPosition(Vertex::PackPosition((float)i)));
+			}
+		}
+
+		TEST_METHOD(PackPositionRoundTripsEighths)
+		{
+			for (int32_t i = -4096 * 8 + 1; i < 4096 * 8; ++i)
+			{
+				const float position = i / 8.0f;
+				Assert::AreEqual(position, Vertex::UnpackPosition(Vertex::PackPosition(position)));
+			}
+		}
+
+		TEST_METHOD(PackPositionRoundsToNearest)
+		{
+			for (int32_t i = 0; i < 10000; ++i)
+			{
+				const float position = (i * 7919 % 8190) - 4095.0f + (i % 97) / 97.0f * 0.999f;
+				const float error = fabsf(position - Vertex::UnpackPosition(Vertex::PackPosition(position)));
+				Assert::IsTrue(error <= 1.0f / 16);
+			}
+		}
+
+		TEST_METHOD(PackPositionClamps)
+		{
+			/* Symmetric, since the SNORM input format reads -32768 as -32767. */
+			Assert::AreEqual((int16_t)-INT16_MAX, Vertex::PackPosition(-5000.0f));
+			Assert::AreEqual((int16_t)INT16_MAX, Vertex::PackPosition(5000.0f));
+			Assert::AreEqual(-4095.875f, Vertex::UnpackPosition(Vertex::PackPosition(-4096.0f)));
+			Assert::AreEqual(4095.875f, Vertex::UnpackPosition(Vertex::PackPosition(4096.0f)));
+		}
+
+		TEST_METHOD(ConstructorRoundTrips)
+		{
+			const Vertex vertex{ 799.5f, -0.25f, 511, 17, 0xFF123456, true, 4095, 7 };
+			Assert::AreEqual(799.5f, vertex.GetX());
+			Assert::AreEqual(-0.25f, vertex.GetY());
+			Assert::AreEqual(511, vertex.GetS());
+			Assert::AreEqual(17, vertex.GetT());
+			Assert::AreEqual(0xFF123456U, vertex.GetColor());
+			Assert::IsTrue(vertex.IsChromaKeyEnabled());
+		}
+
+		TEST_METHOD(AddOffset)
+		{
+			Vertex vertex{ 10.125f, 20.5f, 0, 0, 0, false, 0, 0 };
+			vertex.AddOffset(-3, 4);
+			Assert::AreEqual(7.125f, vertex.GetX());
+			Assert::AreEqual(24.5f, vertex.GetY());
+		}
+	};
+}